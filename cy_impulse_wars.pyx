@@ -1,64 +1,106 @@
-from libc.stdint cimport int8_t, int32_t, uint8_t, uint16_t, uint64_t
+from libc.stdint cimport int8_t, int32_t, uint8_t, uint16_t, uint32_t, uint64_t
 from libc.stdlib cimport calloc, free
+from libc.string cimport memset
+
+import os
+
+import numpy as np
 
 import pufferlib
 
 from impulse_wars cimport (
     MAX_DRONES,
     CONTINUOUS_ACTION_SIZE,
-    discreteObsSize,
-    continuousObsSize,
-    obsBytes,
-    alignedSize,
-    MAP_OBS_SIZE,
+    obsProfile,
+    initObsProfile,
+    timingProfile,
+    initTimingProfile,
+    TRAINING_ACTIONS_PER_SECOND,
+    TRAINING_FRAME_RATE,
+    TRAINING_BOX2D_SUBSTEPS,
+    EVAL_FRAME_RATE,
+    EVAL_BOX2D_SUBSTEPS,
+    MAX_MAP_OBS_ROWS,
+    MAX_MAP_OBS_COLUMNS,
+    MAX_NEAR_WALL_OBS,
+    MAX_FLOATING_WALL_OBS,
+    MAX_PROJECTILE_OBS,
+    MAX_WEAPON_PICKUP_OBS,
+    obsFormat,
+    FLOAT32_OBS,
+    FLOAT16_OBS,
+    INT16_OBS,
+    obsBytesInFormat,
+    continuousObsBytes,
+    MAX_OBS_HISTORY,
+    MAX_POOLED_STATES,
+    OBS_HISTORY_HEADER_BYTES,
+    stackedObsBytes,
+    mapObsChannels,
+    decodedObsSize,
+    decodedMultihotObsOffset,
+    decodedWeaponTypesObsOffset,
+    decodedContinuousObsOffset,
     NUM_WALL_TYPES,
     NUM_WEAPONS,
-    MAP_OBS_ROWS,
-    MAP_OBS_COLUMNS,
-    NUM_NEAR_WALL_OBS,
-    NEAR_WALL_TYPES_OBS_OFFSET,
     NEAR_WALL_POS_OBS_SIZE,
-    NEAR_WALL_OBS_SIZE,
-    NEAR_WALL_POS_OBS_OFFSET,
-    NUM_FLOATING_WALL_OBS,
-    FLOATING_WALL_TYPES_OBS_OFFSET,
-    FLOATING_WALL_OBS_SIZE,
     FLOATING_WALL_INFO_OBS_SIZE,
-    FLOATING_WALL_INFO_OBS_OFFSET,
-    NUM_WEAPON_PICKUP_OBS,
-    WEAPON_PICKUP_WEAPONS_OBS_OFFSET,
     WEAPON_PICKUP_POS_OBS_SIZE,
-    WEAPON_PICKUP_OBS_SIZE,
-    WEAPON_PICKUP_POS_OBS_OFFSET,
-    NUM_PROJECTILE_OBS,
-    PROJECTILE_DRONE_OBS_OFFSET,
-    PROJECTILE_WEAPONS_OBS_OFFSET,
     PROJECTILE_INFO_OBS_SIZE,
-    PROJECTILE_OBS_SIZE,
-    PROJECTILE_INFO_OBS_OFFSET,
-    ENEMY_DRONE_WEAPONS_OBS_OFFSET,
-    ENEMY_DRONE_OBS_OFFSET,
+    LIDAR_RAY_OBS_SIZE,
     ENEMY_DRONE_OBS_SIZE,
     DRONE_OBS_SIZE,
     MISC_OBS_SIZE,
+    alignedSize,
     env,
-    NUM_MAPS,
+    arenaWorld,
+    createArenaWorld,
+    destroyArenaWorld,
+    stepArenaWorld,
+    NUM_TRAINING_MAPS,
+    initJobSystem,
+    destroyJobSystem,
     initEnv,
+    setTimingProfile,
+    setObsFormat,
+    enableObsHistory,
+    enableDecodedObs,
+    IMAGE_OBS_SIZE,
+    IMAGE_OBS_CHANNELS,
+    enableImageObs,
+    enableAutoReset,
     initMaps,
     setupEnv,
     rayClient,
     createRayClient,
     destroyRayClient,
     resetEnv,
-    stepEnv,
+    stepEnvs,
+    envSnapshotSize,
+    snapshotEnv,
+    restoreEnv,
+    resetPool,
+    createResetPool,
+    destroyResetPool,
+    traceWriter,
+    openTraceWriter,
+    closeTraceWriter,
+    setEnvTrace,
+    renderThread,
+    startRenderThread,
+    stopRenderThread,
+    renderThreadWindowClosed,
+    frozenPolicy,
+    loadFrozenPolicy,
+    destroyFrozenPolicy,
+    setOpponentPolicy,
     destroyMaps,
     destroyEnv,
-    LOG_BUFFER_SIZE,
-    logBuffer,
+    LOG_ENTRY_FIELDS,
     logEntry,
     createLogBuffer,
     destroyLogBuffer,
-    aggregateAndClearLogBuffer,
+    aggregateAndClearLogBuffers,
 )
 
 
@@ -73,47 +115,176 @@ def continuousActionsSize() -> int:
     return CONTINUOUS_ACTION_SIZE
 
 
-def obsConstants(numDrones: int) -> pufferlib.Namespace:
-    droneObsOffset = ENEMY_DRONE_OBS_OFFSET + ((numDrones - 1) * ENEMY_DRONE_OBS_SIZE)
+def maxFrameStack() -> int:
+    return MAX_OBS_HISTORY
+
+
+def maxResetPoolStates() -> int:
+    return MAX_POOLED_STATES
+
+
+# channels, rows and columns of each agent's image obs
+def imageObsShape() -> tuple[int, int, int]:
+    return (IMAGE_OBS_CHANNELS, IMAGE_OBS_SIZE, IMAGE_OBS_SIZE)
+
+
+def _flattenLogFields(value, prefix: str, names: list[str]):
+    if isinstance(value, dict):
+        for name, field in value.items():
+            _flattenLogFields(field, f"{prefix}{name}.", names)
+    elif isinstance(value, list):
+        for i, field in enumerate(value):
+            _flattenLogFields(field, f"{prefix}{i}.", names)
+    else:
+        names.append(prefix[:-1])
+
+
+# names of the fields of logged stats in the order the env aggregates
+# them, nested fields are joined with dots like 'stats.0.shotsFired.3'
+def logFieldNames() -> list[str]:
+    cdef logEntry log
+    memset(&log, 0, sizeof(log))
+    names = []
+    _flattenLogFields(log, "", names)
+    assert len(names) == LOG_ENTRY_FIELDS
+    return names
+
+
+# formats continuous observations can be stored in
+OBS_FORMATS = {
+    "float32": FLOAT32_OBS,
+    "float16": FLOAT16_OBS,
+    "int16": INT16_OBS,
+}
+
+
+def obsFormats() -> list[str]:
+    return list(OBS_FORMATS)
+
+
+# what envs observe; map window rows and columns, then how many near
+# walls, floating walls, projectiles and weapon pickups are observed and
+# how many lidar rays are cast
+OBS_PROFILES = {
+    "default": (
+        MAX_MAP_OBS_ROWS,
+        MAX_MAP_OBS_COLUMNS,
+        MAX_NEAR_WALL_OBS,
+        MAX_FLOATING_WALL_OBS,
+        MAX_PROJECTILE_OBS,
+        MAX_WEAPON_PICKUP_OBS,
+        0,
+    ),
+    # smaller observations that are cheaper to compute and infer on
+    "lean": (7, 7, 4, 2, 10, 2, 0),
+    # the default profile with distances to walls and drones around the
+    # drone at a finer angular resolution than the map obs
+    "lidar": (
+        MAX_MAP_OBS_ROWS,
+        MAX_MAP_OBS_COLUMNS,
+        MAX_NEAR_WALL_OBS,
+        MAX_FLOATING_WALL_OBS,
+        MAX_PROJECTILE_OBS,
+        MAX_WEAPON_PICKUP_OBS,
+        16,
+    ),
+}
+
+
+def obsProfiles() -> list[str]:
+    return list(OBS_PROFILES)
+
+
+cdef obsProfile makeObsProfile(uint8_t numDrones, str obsProfileName):
+    cdef obsProfile profile
+    rows, columns, nearWalls, floatingWalls, projectiles, pickups, lidarRays = OBS_PROFILES[obsProfileName]
+    initObsProfile(&profile, numDrones, rows, columns, nearWalls, floatingWalls, projectiles, pickups, lidarRays)
+    return profile
+
+
+# how physics is simulated; frame rate, box2d substeps and frames
+# stepped per action. Every profile acts as often as training does so
+# policies trained with one can be evaluated with another
+TIMING_PROFILES = {
+    # cheaper than training but less accurate, the benchmark's timing
+    # mode reports how much behavior drifts from eval with each profile
+    "fast": (20, 1, 20 // TRAINING_ACTIONS_PER_SECOND),
+    "training": (TRAINING_FRAME_RATE, TRAINING_BOX2D_SUBSTEPS, TRAINING_FRAME_RATE // TRAINING_ACTIONS_PER_SECOND),
+    "smooth": (60, 2, 60 // TRAINING_ACTIONS_PER_SECOND),
+    "eval": (EVAL_FRAME_RATE, EVAL_BOX2D_SUBSTEPS, EVAL_FRAME_RATE // TRAINING_ACTIONS_PER_SECOND),
+}
+
+
+def timingProfiles() -> list[str]:
+    return list(TIMING_PROFILES)
+
+
+cdef timingProfile makeTimingProfile(str timingProfileName):
+    cdef timingProfile timing
+    frameRate, box2dSubSteps, frameSkip = TIMING_PROFILES[timingProfileName]
+    initTimingProfile(&timing, frameRate, box2dSubSteps, frameSkip)
+    return timing
+
+
+def obsConstants(numDrones: int, obsFormatName: str = "float32", obsProfileName: str = "default", frameStack: int = 1) -> pufferlib.Namespace:
+    cdef obsFormat format = OBS_FORMATS[obsFormatName]
+    cdef obsProfile profile = makeObsProfile(numDrones, obsProfileName)
+    # stacked obs of an agent are a header followed by frameStack obs
+    stackedBytes = obsBytesInFormat(&profile, format)
+    if frameStack > 1:
+        stackedBytes = stackedObsBytes(&profile, format, frameStack)
     return pufferlib.Namespace(
-        obsBytes=obsBytes(numDrones),
-        mapObsSize=MAP_OBS_SIZE,
-        discreteObsSize=discreteObsSize(numDrones),
-        continuousObsSize=continuousObsSize(numDrones),
-        continuousObsBytes=continuousObsSize(numDrones) * sizeof(float),
+        obsBytes=obsBytesInFormat(&profile, format),
+        frameStack=frameStack,
+        stackedObsBytes=stackedBytes,
+        obsHistoryHeaderBytes=OBS_HISTORY_HEADER_BYTES,
+        mapObsSize=profile.mapObsSize,
+        discreteObsSize=profile.discreteObsSize,
+        continuousObsSize=profile.continuousObsSize,
+        continuousObsBytes=continuousObsBytes(&profile, format),
         wallTypes=NUM_WALL_TYPES,
         weaponTypes=NUM_WEAPONS + 1,
-        mapObsRows=MAP_OBS_ROWS,
-        mapObsColumns=MAP_OBS_COLUMNS,
-        continuousObsOffset=alignedSize(MAP_OBS_SIZE, sizeof(float)),
-        numNearWallObs=NUM_NEAR_WALL_OBS,
-        nearWallTypesObsOffset=NEAR_WALL_TYPES_OBS_OFFSET,
+        mapObsRows=profile.mapObsRows,
+        mapObsColumns=profile.mapObsColumns,
+        continuousObsOffset=alignedSize(profile.mapObsSize, sizeof(float)),
+        numNearWallObs=profile.numNearWallObs,
+        nearWallTypesObsOffset=profile.nearWallTypesObsOffset,
         nearWallPosObsSize=NEAR_WALL_POS_OBS_SIZE,
-        nearWallObsSize=NEAR_WALL_OBS_SIZE,
-        nearWallPosObsOffset=NEAR_WALL_POS_OBS_OFFSET,
-        numFloatingWallObs=NUM_FLOATING_WALL_OBS,
-        floatingWallTypesObsOffset=FLOATING_WALL_TYPES_OBS_OFFSET,
+        nearWallObsSize=profile.numNearWallObs * NEAR_WALL_POS_OBS_SIZE,
+        nearWallPosObsOffset=profile.nearWallPosObsOffset,
+        numFloatingWallObs=profile.numFloatingWallObs,
+        floatingWallTypesObsOffset=profile.floatingWallTypesObsOffset,
         floatingWallInfoObsSize=FLOATING_WALL_INFO_OBS_SIZE,
-        floatingWallObsSize=FLOATING_WALL_OBS_SIZE,
-        floatingWallInfoObsOffset=FLOATING_WALL_INFO_OBS_OFFSET,
-        numWeaponPickupObs=NUM_WEAPON_PICKUP_OBS,
-        weaponPickupTypesObsOffset=WEAPON_PICKUP_WEAPONS_OBS_OFFSET,
+        floatingWallObsSize=profile.numFloatingWallObs * FLOATING_WALL_INFO_OBS_SIZE,
+        floatingWallInfoObsOffset=profile.floatingWallInfoObsOffset,
+        numWeaponPickupObs=profile.numWeaponPickupObs,
+        weaponPickupTypesObsOffset=profile.weaponPickupWeaponsObsOffset,
         weaponPickupPosObsSize=WEAPON_PICKUP_POS_OBS_SIZE,
-        weaponPickupObsSize=WEAPON_PICKUP_OBS_SIZE,
-        weaponPickupPosObsOffset=WEAPON_PICKUP_POS_OBS_OFFSET,
-        numProjectileObs=NUM_PROJECTILE_OBS,
-        projectileDroneObsOffset=PROJECTILE_DRONE_OBS_OFFSET,
-        projectileTypesObsOffset=PROJECTILE_WEAPONS_OBS_OFFSET,
+        weaponPickupObsSize=profile.numWeaponPickupObs * WEAPON_PICKUP_POS_OBS_SIZE,
+        weaponPickupPosObsOffset=profile.weaponPickupPosObsOffset,
+        numProjectileObs=profile.numProjectileObs,
+        projectileDroneObsOffset=profile.projectileDroneObsOffset,
+        projectileTypesObsOffset=profile.projectileWeaponsObsOffset,
         projectileInfoObsSize=PROJECTILE_INFO_OBS_SIZE,
-        projectileObsSize=PROJECTILE_OBS_SIZE,
-        projectileInfoObsOffset=PROJECTILE_INFO_OBS_OFFSET,
-        enemyDroneWeaponsObsOffset=ENEMY_DRONE_WEAPONS_OBS_OFFSET,
-        enemyDroneObsOffset=ENEMY_DRONE_OBS_OFFSET,
+        projectileObsSize=profile.numProjectileObs * PROJECTILE_INFO_OBS_SIZE,
+        projectileInfoObsOffset=profile.projectileInfoObsOffset,
+        numLidarRays=profile.numLidarRays,
+        lidarRayObsSize=LIDAR_RAY_OBS_SIZE,
+        lidarObsSize=profile.numLidarRays * LIDAR_RAY_OBS_SIZE,
+        lidarObsOffset=profile.lidarObsOffset,
+        numEnemyDroneObs=profile.numEnemyDroneObs,
+        enemyDroneWeaponsObsOffset=profile.enemyDroneWeaponsObsOffset,
+        enemyDroneObsOffset=profile.enemyDroneObsOffset,
         enemyDroneObsSize=ENEMY_DRONE_OBS_SIZE,
-        droneObsOffset=droneObsOffset,
+        droneObsOffset=profile.droneObsOffset,
         droneObsSize=DRONE_OBS_SIZE,
         miscObsSize=MISC_OBS_SIZE,
-        miscObsOffset=droneObsOffset + DRONE_OBS_SIZE,
+        miscObsOffset=profile.miscObsOffset,
+        mapObsChannels=mapObsChannels(&profile),
+        decodedObsSize=decodedObsSize(&profile),
+        decodedMultihotObsOffset=decodedMultihotObsOffset(&profile),
+        decodedWeaponTypesObsOffset=decodedWeaponTypesObsOffset(&profile),
+        decodedContinuousObsOffset=decodedContinuousObsOffset(&profile),
     )
 
 
@@ -122,29 +293,69 @@ cdef class CyImpulseWars:
         uint16_t numEnvs
         uint8_t numDrones
         bint render
+        bint isTraining
+        bint useRenderThread
         env* envs
-        logBuffer *logs
+        uint16_t numWorlds
+        arenaWorld** worlds
+        frozenPolicy* opponentPolicy
+        resetPool* resetPool
+        traceWriter** traces
+        object logStats
         rayClient* rayClient
+        renderThread* renderThread
 
-    def __init__(self, uint16_t numEnvs, uint8_t numDrones, uint8_t numAgents, uint8_t[:, :] observations, bint discretizeActions, float[:, :] contActions, int32_t[:, :] discActions, float[:] rewards, uint8_t[:] masks, uint8_t[:] terminals, uint8_t[:] truncations, uint64_t seed, bint render, bint enableTeams, bint sittingDuck, bint isTraining, bint humanControl):
+    def __init__(self, uint16_t numEnvs, uint8_t numDrones, uint8_t numAgents, observations, bint discretizeActions, float[:, :] contActions, int32_t[:, :] discActions, float[:] rewards, uint8_t[:] masks, uint8_t[:] terminals, uint8_t[:] truncations, uint64_t seed, bint render, bint enableTeams, bint sittingDuck, bint isTraining, bint humanControl, uint8_t arenasPerWorld, uint8_t physicsThreads, str opponentPolicyPath, bint decodeObs, str obsFormatName, str obsProfileName, uint8_t frameStack, uint8_t resetPoolStates, terminalObservations, bint logSpread, str traceDir, uint64_t traceCapacity, bint useRenderThread, bint imageObs, str timingProfileName):
         self.numEnvs = numEnvs
         self.numDrones = numDrones
         self.render = render
+        self.isTraining = isTraining
+        self.useRenderThread = useRenderThread
         self.envs = <env*>calloc(numEnvs, sizeof(env))
-        self.logs = createLogBuffer(LOG_BUFFER_SIZE)
+        # rows of the means of logged stats followed by their standard
+        # deviations, mins and maxes if their spread is tracked
+        self.logStats = np.zeros((4 if logSpread else 1, LOG_ENTRY_FIELDS), dtype=np.float32)
+        # worlds pick up the job system's threads when they're created
+        initJobSystem(physicsThreads)
+
+        # observations are either bit packed bytes or decoded floats
+        cdef uint8_t[:, :] packedObs
+        cdef float[:, :] decodedObs
+        # final observations of episodes are copied here when envs
+        # are reset in the step their episode ends
+        cdef uint8_t[:, :] packedTerminalObs
+        cdef float[:, :] decodedTerminalObs
+        if decodeObs:
+            decodedObs = observations
+            if terminalObservations is not None:
+                decodedTerminalObs = terminalObservations
+        else:
+            packedObs = observations
+            if terminalObservations is not None:
+                packedTerminalObs = terminalObservations
 
         cdef int inc = numAgents
         cdef int i
         cdef int8_t mapIdx = -1
+        cdef obsFormat format = OBS_FORMATS[obsFormatName]
+        cdef obsProfile profile = makeObsProfile(numDrones, obsProfileName)
+        # envs pick the training or eval profile themselves if not set
+        cdef timingProfile timing
+        if timingProfileName:
+            timing = makeTimingProfile(timingProfileName)
+        cdef uint8_t *envObs = NULL
         for i in range(self.numEnvs):
             if isTraining:
-                mapIdx = i % NUM_MAPS
+                mapIdx = i % NUM_TRAINING_MAPS
+            if not decodeObs:
+                envObs = &packedObs[i * inc, 0]
 
             initEnv(
                 &self.envs[i],
                 numDrones,
                 numAgents,
-                &observations[i * inc, 0],
+                &profile,
+                envObs,
                 discretizeActions,
                 &contActions[i * inc, 0],
                 &discActions[i * inc, 0],
@@ -152,7 +363,7 @@ cdef class CyImpulseWars:
                 &masks[i * inc],
                 &terminals[i * inc],
                 &truncations[i * inc],
-                self.logs,
+                createLogBuffer(numDrones, logSpread),
                 mapIdx,
                 seed + i,
                 enableTeams,
@@ -160,11 +371,61 @@ cdef class CyImpulseWars:
                 isTraining,
             )
             self.envs[i].humanInput = humanControl
+            if timingProfileName:
+                setTimingProfile(&self.envs[i], &timing)
+            setObsFormat(&self.envs[i], format)
+            if frameStack > 1:
+                enableObsHistory(&self.envs[i], frameStack)
+            if decodeObs:
+                enableDecodedObs(&self.envs[i], &decodedObs[i * inc, 0])
+            if imageObs:
+                enableImageObs(&self.envs[i])
+            if terminalObservations is not None:
+                if decodeObs:
+                    enableAutoReset(&self.envs[i], &decodedTerminalObs[i * inc, 0])
+                else:
+                    enableAutoReset(&self.envs[i], &packedTerminalObs[i * inc, 0])
+
+        # every env's opponents share a single copy of the policy weights
+        cdef bytes policyPath
+        if opponentPolicyPath:
+            policyPath = opponentPolicyPath.encode()
+            self.opponentPolicy = loadFrozenPolicy(policyPath, &profile)
+            for i in range(self.numEnvs):
+                setOpponentPolicy(&self.envs[i], self.opponentPolicy)
+
+        # pack the arenas of consecutive envs into shared box2d worlds
+        self.numWorlds = 0
+        cdef uint16_t firstEnv
+        if arenasPerWorld > 1:
+            self.numWorlds = (numEnvs + arenasPerWorld - 1) // arenasPerWorld
+            self.worlds = <arenaWorld**>calloc(self.numWorlds, sizeof(arenaWorld*))
+            for i in range(self.numWorlds):
+                firstEnv = i * arenasPerWorld
+                self.worlds[i] = createArenaWorld(&self.envs[firstEnv], min(arenasPerWorld, numEnvs - firstEnv))
 
+        # derived map data is shared by every env in the process and only
+        # built once, this just takes a reference to it
         initMaps(&self.envs[i])
         for i in range(self.numEnvs):
             setupEnv(&self.envs[i])
 
+        # initial states of the next episodes are generated in the
+        # background so resets don't stall steps
+        if resetPoolStates != 0:
+            if self.numWorlds != 0:
+                raise ValueError("envs that share arena worlds can't use a reset pool")
+            self.resetPool = createResetPool(self.envs, numEnvs, resetPoolStates)
+
+        # every env writes the state of each frame to its own trace file
+        cdef bytes tracePath
+        if traceDir:
+            self.traces = <traceWriter**>calloc(numEnvs, sizeof(traceWriter*))
+            for i in range(self.numEnvs):
+                tracePath = os.path.join(traceDir, f"env_{os.getpid()}_{i}.trace").encode()
+                self.traces[i] = openTraceWriter(tracePath, traceCapacity, numDrones)
+                setEnvTrace(&self.envs[i], self.traces[i])
+
     cdef _initRaylib(self):
         self.rayClient = createRayClient()
         cdef int i
@@ -172,7 +433,11 @@ cdef class CyImpulseWars:
             self.envs[i].client = self.rayClient
 
     def reset(self):
-        if self.render and self.rayClient == NULL:
+        # the first env is rendered on its own thread, paced to its frame
+        # rate unless training
+        if self.render and self.useRenderThread and self.renderThread == NULL:
+            self.renderThread = startRenderThread(&self.envs[0], not self.isTraining)
+        elif self.render and not self.useRenderThread and self.rayClient == NULL:
             self._initRaylib()
 
         cdef int i
@@ -181,19 +446,68 @@ cdef class CyImpulseWars:
 
     def step(self):
         cdef int i
-        for i in range(self.numEnvs):
-            stepEnv(&self.envs[i])
+        # closing the render thread's window stops stepping, the envs
+        # can still be closed after
+        if self.renderThread != NULL and renderThreadWindowClosed(self.renderThread):
+            stopRenderThread(self.renderThread, &self.envs[0])
+            self.renderThread = NULL
+            raise SystemExit("render window closed")
+
+        if self.numWorlds != 0:
+            for i in range(self.numWorlds):
+                stepArenaWorld(self.worlds[i])
+            return
+
+        stepEnvs(self.envs, self.numEnvs)
 
+    def snapshot(self, uint16_t envIdx) -> bytes:
+        if envIdx >= self.numEnvs:
+            raise IndexError(f"env index {envIdx} is out of range")
+
+        cdef env *e = &self.envs[envIdx]
+        cdef uint32_t size = envSnapshotSize(e)
+        buf = bytearray(size)
+        cdef uint8_t[::1] bufView = buf
+        snapshotEnv(e, &bufView[0], size)
+        return bytes(buf)
+
+    def restore(self, uint16_t envIdx, const uint8_t[::1] snapshot):
+        if envIdx >= self.numEnvs:
+            raise IndexError(f"env index {envIdx} is out of range")
+        if self.numWorlds != 0:
+            raise ValueError("envs that share arena worlds can't be restored")
+
+        restoreEnv(&self.envs[envIdx], &snapshot[0], snapshot.shape[0])
+
+    # returns how many episodes were logged since the last call and the
+    # aggregated stats of them, the stats array is reused between calls
     def log(self):
-        cdef logEntry log = aggregateAndClearLogBuffer(self.numDrones, self.logs)
-        return log
+        cdef float[:, ::1] stats = self.logStats
+        cdef uint32_t count = aggregateAndClearLogBuffers(self.envs, self.numEnvs, &stats[0, 0])
+        return count, self.logStats
 
     def close(self):
         cdef int i
+        if self.renderThread != NULL:
+            stopRenderThread(self.renderThread, &self.envs[0])
+        if self.resetPool != NULL:
+            destroyResetPool(self.resetPool, self.envs)
         for i in range(self.numEnvs):
             destroyEnv(&self.envs[i])
+            destroyLogBuffer(self.envs[i].logs)
+        if self.traces != NULL:
+            for i in range(self.numEnvs):
+                closeTraceWriter(self.traces[i])
+            free(self.traces)
+        for i in range(self.numWorlds):
+            destroyArenaWorld(self.worlds[i])
+        if self.numWorlds != 0:
+            free(self.worlds)
+        if self.opponentPolicy != NULL:
+            destroyFrozenPolicy(self.opponentPolicy)
+
+        destroyJobSystem()
 
-        destroyLogBuffer(self.logs)
         destroyMaps()
         free(self.envs)
 
@@ -0,0 +1,174 @@
+from dataclasses import dataclass
+from typing import Iterator
+
+import numpy as np
+
+
+# reads trace files written by envs created with trace_dir set, the
+# layouts here must match the structs in src/trace.h
+
+TRACE_MAGIC = 0x52545749
+TRACE_VERSION = 1
+
+TRACE_DRONE_DEAD = 1 << 0
+TRACE_DRONE_SHIELDED = 1 << 1
+TRACE_DRONE_BRAKING = 1 << 2
+TRACE_DRONE_CHARGING_WEAPON = 1 << 3
+TRACE_DRONE_CHARGING_BURST = 1 << 4
+TRACE_DRONE_SHOT = 1 << 5
+
+FILE_HEADER_DTYPE = np.dtype(
+    [
+        ("magic", "<u4"),
+        ("version", "<u4"),
+        ("capacity", "<u8"),
+        ("head", "<u8"),
+        ("tail", "<u8"),
+        ("used", "<u8"),
+        ("framesWritten", "<u8"),
+        ("framesOverwritten", "<u8"),
+        ("framesDropped", "<u8"),
+        ("numDrones", "u1"),
+        ("numAgents", "u1"),
+        ("frameRate", "u1"),
+        ("teamsEnabled", "?"),
+        ("pad", "u1", 4),
+    ]
+)
+
+FRAME_DTYPE = np.dtype(
+    [
+        ("size", "<u4"),
+        ("episode", "<u4"),
+        ("frame", "<u2"),
+        ("stepsLeft", "<u2"),
+        ("numProjectiles", "<u2"),
+        ("numDrones", "u1"),
+        ("numFloatingWalls", "u1"),
+        ("numPickups", "u1"),
+        ("numExplosions", "u1"),
+        ("suddenDeathWallCounter", "u1"),
+        ("mapIdx", "i1"),
+        ("episodeEnded", "?"),
+        ("pad", "u1", 3),
+    ]
+)
+
+DRONE_DTYPE = np.dtype(
+    [
+        ("pos", "<f4", 2),
+        ("velocity", "<f4", 2),
+        ("aim", "<f4", 2),
+        ("energyLeft", "<f4"),
+        ("shieldHealth", "<f4"),
+        ("weapon", "u1"),
+        ("ammo", "i1"),
+        ("livesLeft", "u1"),
+        ("flags", "u1"),
+    ]
+)
+
+FLOATING_WALL_DTYPE = np.dtype(
+    [
+        ("pos", "<f4", 2),
+        ("rot", "<f4", 2),
+        ("type", "u1"),
+        ("pad", "u1", 3),
+    ]
+)
+
+PROJECTILE_DTYPE = np.dtype(
+    [
+        ("pos", "<f4", 2),
+        ("weapon", "u1"),
+        ("droneIdx", "u1"),
+        ("pad", "u1", 2),
+    ]
+)
+
+PICKUP_DTYPE = np.dtype(
+    [
+        ("pos", "<f4", 2),
+        ("weapon", "u1"),
+        ("enabled", "?"),
+        ("pad", "u1", 2),
+    ]
+)
+
+EXPLOSION_DTYPE = np.dtype(
+    [
+        ("pos", "<f4", 2),
+        ("radius", "<f4"),
+        ("droneIdx", "u1"),
+        ("isBurst", "?"),
+        ("pad", "u1", 2),
+    ]
+)
+
+
+@dataclass
+class TraceFrame:
+    episode: int
+    frame: int
+    stepsLeft: int
+    suddenDeathWallCounter: int
+    mapIdx: int
+    episodeEnded: bool
+    drones: np.ndarray
+    floatingWalls: np.ndarray
+    projectiles: np.ndarray
+    pickups: np.ndarray
+    explosions: np.ndarray
+
+
+# yields the frames of a trace from oldest to newest, the entity arrays
+# are views of the file's contents and are only valid while the
+# returned frames are referenced
+def readTrace(path: str) -> Iterator[TraceFrame]:
+    data = np.memmap(path, dtype=np.uint8, mode="r")
+    header = data[: FILE_HEADER_DTYPE.itemsize].view(FILE_HEADER_DTYPE)[0]
+    if header["magic"] != TRACE_MAGIC:
+        raise ValueError(f"{path} is not a trace file")
+    if header["version"] != TRACE_VERSION:
+        raise ValueError(f"trace file {path} is version {header['version']}, expected version {TRACE_VERSION}")
+
+    ring = data[FILE_HEADER_DTYPE.itemsize :]
+    capacity = int(header["capacity"])
+    offset = int(header["head"])
+    remaining = int(header["used"])
+    while remaining != 0:
+        size = int(ring[offset : offset + 4].view("<u4")[0])
+        # the rest of the ring is unused
+        if size == 0:
+            remaining -= capacity - offset
+            offset = 0
+            continue
+
+        frame = ring[offset : offset + FRAME_DTYPE.itemsize].view(FRAME_DTYPE)[0]
+        pos = offset + FRAME_DTYPE.itemsize
+        arrays = []
+        for dtype, count in (
+            (DRONE_DTYPE, frame["numDrones"]),
+            (FLOATING_WALL_DTYPE, frame["numFloatingWalls"]),
+            (PROJECTILE_DTYPE, frame["numProjectiles"]),
+            (PICKUP_DTYPE, frame["numPickups"]),
+            (EXPLOSION_DTYPE, frame["numExplosions"]),
+        ):
+            end = pos + int(count) * dtype.itemsize
+            arrays.append(ring[pos:end].view(dtype))
+            pos = end
+
+        yield TraceFrame(
+            int(frame["episode"]),
+            int(frame["frame"]),
+            int(frame["stepsLeft"]),
+            int(frame["suddenDeathWallCounter"]),
+            int(frame["mapIdx"]),
+            bool(frame["episodeEnded"]),
+            *arrays,
+        )
+
+        remaining -= size
+        offset += size
+        if offset == capacity:
+            offset = 0
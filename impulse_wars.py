@@ -1,3 +1,4 @@
+import os
 from typing import Dict
 
 import gymnasium
@@ -8,38 +9,66 @@ import pufferlib.emulation
 
 from cy_impulse_wars import (
     maxDrones,
+    maxFrameStack,
+    maxResetPoolStates,
+    imageObsShape,
+    obsFormats,
+    obsProfiles,
+    timingProfiles,
     obsConstants,
     continuousActionsSize,
+    logFieldNames,
     CyImpulseWars,
 )
 
 
-def transformRawLog(numDrones: int, rawLog: Dict[str, float]):
-    log = {
-        "length": rawLog["length"],
-        "ties": rawLog["ties"],
+# names of logged drone stats and the stats fields they're summed from
+DRONE_LOG_FIELDS = {
+    "reward": "reward",
+    "wins": "wins",
+    "distance_traveled": "distanceTraveled",
+    "abs_distance_traveled": "absDistanceTraveled",
+    "shots_fired": "shotsFired",
+    "shots_hit": "shotsHit",
+    "shots_taken": "shotsTaken",
+    "own_shots_taken": "ownShotsTaken",
+    "weapons_picked_up": "weaponsPickedUp",
+    "shots_distance": "shotDistances",
+    "brake_time": "brakeTime",
+    "bursts": "totalBursts",
+    "burst_hit": "burstsHit",
+    "energy_emptied": "energyEmptied",
+}
+
+
+# maps each logged value to the indices of the env's flat stats that are
+# summed to get it, per weapon stats are summed over weapons
+def logIndices(numDrones: int) -> Dict[str, np.ndarray]:
+    fields = {name: i for i, name in enumerate(logFieldNames())}
+    indices = {
+        "length": np.array([fields["length"]]),
+        "ties": np.array([fields["ties"]]),
     }
-
-    count = 0
-    for i, stats in enumerate(rawLog["stats"]):
-        log[f"drone_{i}_reward"] = stats["reward"]
-        log[f"drone_{i}_wins"] = stats["wins"]
-        log[f"drone_{i}_distance_traveled"] = stats["distanceTraveled"]
-        log[f"drone_{i}_abs_distance_traveled"] = stats["absDistanceTraveled"]
-        log[f"drone_{i}_shots_fired"] = sum(stats["shotsFired"])
-        log[f"drone_{i}_shots_hit"] = sum(stats["shotsHit"])
-        log[f"drone_{i}_shots_taken"] = sum(stats["shotsTaken"])
-        log[f"drone_{i}_own_shots_taken"] = sum(stats["ownShotsTaken"])
-        log[f"drone_{i}_weapons_picked_up"] = sum(stats["weaponsPickedUp"])
-        log[f"drone_{i}_shots_distance"] = sum(stats["shotDistances"])
-        log[f"drone_{i}_brake_time"] = stats["brakeTime"]
-        log[f"drone_{i}_bursts"] = stats["totalBursts"]
-        log[f"drone_{i}_burst_hit"] = stats["burstsHit"]
-        log[f"drone_{i}_energy_emptied"] = stats["energyEmptied"]
-
-        count += 1
-        if count >= numDrones:
-            break
+    for i in range(numDrones):
+        for logName, fieldName in DRONE_LOG_FIELDS.items():
+            prefix = f"stats.{i}.{fieldName}"
+            idxs = [idx for name, idx in fields.items() if name == prefix or name.startswith(prefix + ".")]
+            indices[f"drone_{i}_{logName}"] = np.array(idxs)
+
+    return indices
+
+
+def transformRawLog(indices: Dict[str, np.ndarray], stats: np.ndarray):
+    log = {name: float(stats[0, idxs].sum()) for name, idxs in indices.items()}
+    # the spread of values summed from multiple fields can't be derived
+    # from the spread of the fields, so only report it for single fields
+    if stats.shape[0] > 1:
+        for name, idxs in indices.items():
+            if len(idxs) != 1:
+                continue
+            log[f"{name}_std"] = float(stats[1, idxs[0]])
+            log[f"{name}_min"] = float(stats[2, idxs[0]])
+            log[f"{name}_max"] = float(stats[3, idxs[0]])
 
     return log
 
@@ -57,6 +86,21 @@ class ImpulseWars(pufferlib.PufferEnv):
         human_control: bool = False,
         seed: int = 0,
         render: bool = False,
+        arenas_per_world: int = 1,
+        physics_threads: int = 0,
+        opponent_policy: str = "",
+        decode_obs: bool = False,
+        obs_format: str = "float32",
+        obs_profile: str = "default",
+        frame_stack: int = 1,
+        reset_pool_states: int = 0,
+        auto_reset: bool = False,
+        log_spread: bool = False,
+        trace_dir: str = "",
+        trace_capacity: int = 64 * 1024 * 1024,
+        render_thread: bool = False,
+        image_obs: bool = False,
+        timing_profile: str = "",
         report_interval: int = 64,
         buf=None,
     ):
@@ -66,17 +110,61 @@ class ImpulseWars(pufferlib.PufferEnv):
             raise ValueError("num_agents must greater than 0 and less than or equal to num_drones")
         if enable_teams and (num_drones % 2 != 0 or num_drones <= 2):
             raise ValueError("enable_teams is only supported for even numbers of drones greater than 2")
+        if arenas_per_world <= 0 or arenas_per_world > 255:
+            raise ValueError("arenas_per_world must be greater than 0 and less than 256")
+        if render and arenas_per_world != 1:
+            raise ValueError("arenas_per_world must be 1 when rendering")
+        if physics_threads < 0 or physics_threads > 31:
+            raise ValueError("physics_threads must be between 0 and 31")
+        if obs_format not in obsFormats():
+            raise ValueError(f"obs_format must be one of {obsFormats()}")
+        if obs_profile not in obsProfiles():
+            raise ValueError(f"obs_profile must be one of {obsProfiles()}")
+        if timing_profile and timing_profile not in timingProfiles():
+            raise ValueError(f"timing_profile must be one of {timingProfiles()}")
+        if decode_obs and obs_format != "float32":
+            raise ValueError("obs_format must be float32 when decode_obs is set")
+        if frame_stack <= 0 or frame_stack > maxFrameStack():
+            raise ValueError(f"frame_stack must be greater than 0 and less than or equal to {maxFrameStack()}")
+        if decode_obs and frame_stack != 1:
+            raise ValueError("frame_stack must be 1 when decode_obs is set")
+        if reset_pool_states < 0 or reset_pool_states > maxResetPoolStates():
+            raise ValueError(f"reset_pool_states must be between 0 and {maxResetPoolStates()}")
+        if reset_pool_states != 0 and arenas_per_world != 1:
+            raise ValueError("arenas_per_world must be 1 when reset_pool_states is set")
+        if trace_dir and trace_capacity <= 0:
+            raise ValueError("trace_capacity must be greater than 0")
+        if image_obs and (decode_obs or frame_stack != 1):
+            raise ValueError("image_obs can't be used with decode_obs or frame_stack")
+        # human input is read from the window, which the render thread owns
+        if render_thread and human_control:
+            raise ValueError("human_control can't be used with render_thread")
 
         self.numDrones = num_drones
         self.num_agents = num_agents * num_envs
-        self.obsInfo = obsConstants(self.numDrones)
+        self.obsInfo = obsConstants(self.numDrones, obs_format, obs_profile, frame_stack)
         self.tick = 0
 
         # map observations are bit packed to save space, and scalar
-        # observations need to be floats
+        # observations need to be floats or quantized to 16 bits; when
+        # frames are stacked each agent's observations are a ring of the
+        # last frame_stack observations the env writes into in place
         self.single_observation_space = gymnasium.spaces.Box(
-            low=0, high=255, shape=(self.obsInfo.obsBytes,), dtype=np.uint8
+            low=0, high=255, shape=(self.obsInfo.stackedObsBytes,), dtype=np.uint8
         )
+        if decode_obs:
+            # observations are decoded by the env into the float layout
+            # the policy's encoder takes
+            self.single_observation_space = gymnasium.spaces.Box(
+                low=float("-inf"), high=float("inf"), shape=(self.obsInfo.decodedObsSize,), dtype=np.float32
+            )
+        elif image_obs:
+            # each agent observes a top down image centered on its drone
+            # rasterized by the env, flattened from channels, rows and
+            # columns
+            self.single_observation_space = gymnasium.spaces.Box(
+                low=0, high=255, shape=(int(np.prod(imageObsShape())),), dtype=np.uint8
+            )
 
         if discretize_actions:
             self.single_action_space = gymnasium.spaces.MultiDiscrete(
@@ -99,6 +187,7 @@ class ImpulseWars(pufferlib.PufferEnv):
             )
 
         self.report_interval = report_interval
+        self.logIndices = logIndices(num_drones)
         self.render_mode = "human" if render else None
 
         super().__init__(buf)
@@ -112,6 +201,18 @@ class ImpulseWars(pufferlib.PufferEnv):
         else:
             discreteActions = np.zeros((self.num_agents, *self.single_action_space.shape), dtype=np.int32)
 
+        # when auto resetting the env returns the first observations of
+        # the next episode in the step an episode ends, and the final
+        # observations of agents that are done are put here instead
+        self.terminal_observations = None
+        if auto_reset:
+            self.terminal_observations = np.zeros_like(self.observations)
+
+        # each env writes a trace of every frame to a ring file in
+        # trace_dir that can be read with game_trace.readTrace
+        if trace_dir:
+            os.makedirs(trace_dir, exist_ok=True)
+
         self.c_envs = CyImpulseWars(
             num_envs,
             num_drones,
@@ -130,6 +231,21 @@ class ImpulseWars(pufferlib.PufferEnv):
             sitting_duck,
             is_training,
             human_control,
+            arenas_per_world,
+            physics_threads,
+            opponent_policy,
+            decode_obs,
+            obs_format,
+            obs_profile,
+            frame_stack,
+            reset_pool_states,
+            self.terminal_observations,
+            log_spread,
+            trace_dir,
+            trace_capacity,
+            render_thread,
+            image_obs,
+            timing_profile,
         )
 
     def reset(self, seed=None):
@@ -144,12 +260,22 @@ class ImpulseWars(pufferlib.PufferEnv):
         infos = []
         self.tick += 1
         if self.tick % self.report_interval == 0:
-            rawLog = self.c_envs.log()
-            if rawLog["length"] > 0:
-                infos.append(transformRawLog(self.numDrones, rawLog))
+            numEpisodes, stats = self.c_envs.log()
+            if numEpisodes > 0:
+                infos.append(transformRawLog(self.logIndices, stats))
 
         return self.observations, self.rewards, self.terminals, self.truncations, infos
 
+    # returns the state of an env mid-episode so rollouts can be
+    # branched from it by passing it to restore
+    def snapshot(self, env_idx: int = 0) -> bytes:
+        return self.c_envs.snapshot(env_idx)
+
+    # restores an env to a snapshot of an env with the same config,
+    # observations are updated in place
+    def restore(self, snapshot: bytes, env_idx: int = 0):
+        self.c_envs.restore(env_idx, snapshot)
+
     def render(self):
         pass
 
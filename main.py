@@ -18,7 +18,7 @@ install(show_locals=False)
 
 import clean_pufferl
 
-from policy import Policy, Recurrent
+from policy import Policy, Recurrent, exportFrozenPolicy
 from impulse_wars import ImpulseWars
 
 
@@ -29,8 +29,13 @@ def make_policy(env, config, isTraining: bool):
         config.train.minibatch_size,
         config.env.num_drones,
         config.env.discretize_actions,
+        config.env.decode_obs,
+        config.env.obs_format,
+        config.env.obs_profile,
+        config.env.frame_stack,
         isTraining,
         config.train.device,
+        config.env.image_obs,
     )
     policy = Recurrent(env, policy)
     return pufferlib.cleanrl.RecurrentPolicy(policy)
@@ -62,6 +67,21 @@ def train(args) -> Deque[Dict[str, Any]] | None:
             is_training=True,
             seed=args.seed,
             render=args.render,
+            arenas_per_world=args.env.arenas_per_world,
+            physics_threads=args.env.physics_threads,
+            opponent_policy=args.env.opponent_policy,
+            decode_obs=args.env.decode_obs,
+            obs_format=args.env.obs_format,
+            obs_profile=args.env.obs_profile,
+            frame_stack=args.env.frame_stack,
+            reset_pool_states=args.env.reset_pool_states,
+            auto_reset=args.env.auto_reset,
+            log_spread=args.env.log_spread,
+            trace_dir=args.env.trace_dir,
+            trace_capacity=args.env.trace_capacity_mb * 1024 * 1024,
+            render_thread=args.env.render_thread,
+            image_obs=args.env.image_obs,
+            timing_profile=args.env.timing_profile,
         ),
         num_workers=args.vec.num_workers,
         batch_size=args.vec.env_batch_size,
@@ -160,12 +180,15 @@ if __name__ == "__main__":
         "--mode",
         type=str,
         default="train",
-        choices="train eval playtest autotune sweep".split(),
+        choices="train eval export playtest autotune sweep".split(),
     )
     parser.add_argument("--sweep-child", action="store_true")
     parser.add_argument(
         "--model-path", type=str, default=None, help="Path to model to evaluate or resume training"
     )
+    parser.add_argument(
+        "--export-path", type=str, default="opponent.bin", help="Path to write the exported model to"
+    )
     parser.add_argument("--seed", type=int, default=-1)
     parser.add_argument("--render", action="store_true", help="Enable rendering")
     parser.add_argument("--cell-id", type=int, default=0)
@@ -216,6 +239,91 @@ if __name__ == "__main__":
     parser.add_argument("--env.enable-teams", action="store_true", help="Split drones into 2 teams")
     parser.add_argument("--env.human-control", action="store_true", help="Enable human control by default")
     parser.add_argument("--env.sitting-duck", action="store_true", help="Scripted drones will do nothing")
+    parser.add_argument(
+        "--env.arenas-per-world", type=int, default=1, help="Number of envs that share a single physics world"
+    )
+    parser.add_argument(
+        "--env.physics-threads",
+        type=int,
+        default=0,
+        help="Extra threads shared by all physics worlds in a worker process, keep workers * (threads + 1) at or below the number of cores",
+    )
+    parser.add_argument(
+        "--env.decode-obs",
+        action="store_true",
+        help="Decode bit packed observations in the env instead of in the policy",
+    )
+    parser.add_argument(
+        "--env.obs-format",
+        type=str,
+        default="float32",
+        choices=["float32", "float16", "int16"],
+        help="Format continuous observations are stored in, 16 bit formats halve their size",
+    )
+    parser.add_argument(
+        "--env.obs-profile",
+        type=str,
+        default="default",
+        choices=["default", "lean", "lidar"],
+        help="How much of the arena is observed, lean has a smaller map window and fewer entity slots, lidar adds rays cast around the drone",
+    )
+    parser.add_argument(
+        "--env.timing-profile",
+        type=str,
+        default="training",
+        choices=["fast", "training", "smooth", "eval"],
+        help="Frame rate and physics substeps of training envs, agents act 10 times a second with all of them",
+    )
+    parser.add_argument(
+        "--env.frame-stack",
+        type=int,
+        default=1,
+        help="Number of past observations the env keeps for each agent, the policy encodes all of them",
+    )
+    parser.add_argument(
+        "--env.reset-pool-states",
+        type=int,
+        default=0,
+        help="Initial states generated ahead of time for each env by a background thread so resets don't stall steps",
+    )
+    parser.add_argument(
+        "--env.auto-reset",
+        action="store_true",
+        help="Reset envs in the step their episode ends instead of spending a step on the reset",
+    )
+    parser.add_argument(
+        "--env.log-spread",
+        action="store_true",
+        help="Log the standard deviation, min and max of episode stats along with their means",
+    )
+    parser.add_argument(
+        "--env.trace-dir",
+        type=str,
+        default="",
+        help="Directory each env writes a trace of the game state of every frame to",
+    )
+    parser.add_argument(
+        "--env.trace-capacity-mb",
+        type=int,
+        default=64,
+        help="Size of each env's trace file, the oldest frames are overwritten once it's full",
+    )
+    parser.add_argument(
+        "--env.image-obs",
+        action="store_true",
+        help="Observe a top down image centered on each agent's drone instead of vector observations",
+    )
+    parser.add_argument(
+        "--env.render-thread",
+        action="store_true",
+        help="Render on a separate thread so stepping the env never waits on drawing",
+    )
+    parser.add_argument(
+        "--env.opponent-policy",
+        type=str,
+        default="",
+        help="Policy exported with --mode export that drives non-agent drones instead of the scripted agent",
+    )
 
     parser.add_argument("--vec.backend", type=str, default="multiprocessing")
     parser.add_argument("--vec.num-envs", type=int, default=8)
@@ -271,6 +379,14 @@ if __name__ == "__main__":
                 discretize_actions=args.env.discretize_actions,
                 is_training=False,
                 human_control=args.env.human_control,
+                decode_obs=args.env.decode_obs,
+                obs_format=args.env.obs_format,
+                obs_profile=args.env.obs_profile,
+                frame_stack=args.env.frame_stack,
+                trace_dir=args.env.trace_dir,
+                trace_capacity=args.env.trace_capacity_mb * 1024 * 1024,
+                render_thread=args.env.render_thread,
+                image_obs=args.env.image_obs,
                 render=True,
                 seed=args.seed,
             ),
@@ -287,6 +403,12 @@ if __name__ == "__main__":
 
         for _ in range(10):
             eval_policy(vecenv, policy, args.train.device)
+    elif args.mode == "export":
+        if args.model_path is None:
+            raise ValueError("--model-path is required to export a model")
+        policy = th.load(args.model_path, map_location="cpu")
+        exportFrozenPolicy(policy, args.export_path)
+        print(f"Exported {args.model_path} to {args.export_path}")
     elif args.mode == "sweep":
         from sweep import sweep
 
@@ -1,3 +1,4 @@
+import struct
 from typing import Tuple
 
 from gymnasium import spaces
@@ -11,7 +12,7 @@ import pufferlib
 from pufferlib.models import LSTMWrapper
 from pufferlib.pytorch import layer_init, _nativize_dtype, nativize_tensor
 
-from cy_impulse_wars import obsConstants
+from cy_impulse_wars import imageObsShape, obsConstants
 
 
 cnnChannels = 64
@@ -32,16 +33,25 @@ class Policy(nn.Module):
         batchSize: int,
         numDrones: int,
         discretizeActions: bool = False,
+        decodedObs: bool = False,
+        obsFormat: str = "float32",
+        obsProfile: str = "default",
+        frameStack: int = 1,
         isTraining: bool = True,
         device: str = "cuda",
+        imageObs: bool = False,
     ):
         super().__init__()
 
         self.is_continuous = not discretizeActions
 
         self.numDrones = numDrones
+        self.decodedObs = decodedObs
+        self.imageObs = imageObs
+        self.obsFormat = obsFormat
+        self.frameStack = frameStack
         self.isTraining = isTraining
-        self.obsInfo = obsConstants(numDrones)
+        self.obsInfo = obsConstants(numDrones, obsFormat, obsProfile, frameStack)
 
         self.discreteFactors = np.array(
             [self.obsInfo.wallTypes] * self.obsInfo.numNearWallObs
@@ -54,15 +64,17 @@ class Policy(nn.Module):
         self.register_buffer("discreteOffsets", discreteOffsets, persistent=False)
         self.discreteMultihotDim = self.discreteFactors.sum()
 
-        multihotBuffer = th.zeros(batchSize, self.discreteMultihotDim, device=device)
+        # each stacked obs is encoded on its own
+        multihotBuffer = th.zeros(batchSize * frameStack, self.discreteMultihotDim, device=device)
         self.register_buffer("multihotOutput", multihotBuffer, persistent=False)
 
         # most of the observation is a 2D array of bytes, but the end
-        # contains around 200 floats; this allows us to treat the end
-        # of the observation as a float array
+        # contains around 200 floats or quantized floats; this allows us
+        # to treat the end of the observation as an array of them
+        continuousDtype = {"float32": np.float32, "float16": np.float16, "int16": np.int16}[obsFormat]
         _, *self.dtype = _nativize_dtype(
             np.dtype((np.uint8, (self.obsInfo.continuousObsBytes,))),
-            np.dtype((np.float32, (self.obsInfo.continuousObsSize,))),
+            np.dtype((continuousDtype, (self.obsInfo.continuousObsSize,))),
         )
         self.dtype = tuple(self.dtype)
 
@@ -80,7 +92,14 @@ class Policy(nn.Module):
         )
         self.register_buffer("unpackShift", th.tensor([5, 4, 3, 0], dtype=th.uint8), persistent=False)
 
-        self.mapObsInputChannels = (self.obsInfo.wallTypes + 1) + 1 + 1 + numDrones
+        # drone indexes in the map observation only cover the drones
+        # that are observed, plus 0 for no drone
+        self.mapDroneIndexes = self.obsInfo.numEnemyDroneObs + 1
+        self.mapObsInputChannels = (self.obsInfo.wallTypes + 1) + 1 + 1 + self.mapDroneIndexes
+        # the second conv layer's kernel covers the first one's entire
+        # output, which shrinks with the map obs window
+        conv1OutRows = ((self.obsInfo.mapObsRows - 5) // 3) + 1
+        conv1OutColumns = ((self.obsInfo.mapObsColumns - 5) // 3) + 1
         self.mapCNN = nn.Sequential(
             layer_init(
                 nn.Conv2d(
@@ -91,7 +110,9 @@ class Policy(nn.Module):
                 )
             ),
             nn.ReLU(),
-            layer_init(nn.Conv2d(cnnChannels, cnnChannels, kernel_size=3, stride=1)),
+            layer_init(
+                nn.Conv2d(cnnChannels, cnnChannels, kernel_size=(conv1OutRows, conv1OutColumns), stride=1)
+            ),
             nn.ReLU(),
             nn.Flatten(),
         )
@@ -112,16 +133,40 @@ class Policy(nn.Module):
                 self.obsInfo.numProjectileObs
                 * (weaponTypeEmbeddingDims + self.obsInfo.projectileInfoObsSize + self.numDrones + 1)
             )
-            + ((self.numDrones - 1) * (weaponTypeEmbeddingDims + self.obsInfo.enemyDroneObsSize))
+            + self.obsInfo.lidarObsSize
+            + (self.obsInfo.numEnemyDroneObs * (weaponTypeEmbeddingDims + self.obsInfo.enemyDroneObsSize))
             + (self.obsInfo.droneObsSize + weaponTypeEmbeddingDims)
             + self.obsInfo.miscObsSize
         )
 
+        if imageObs:
+            # image obs are encoded on their own by a CNN that downsamples
+            # them like the classic Atari encoder
+            self.imageShape = imageObsShape()
+            self.imageCNN = nn.Sequential(
+                layer_init(nn.Conv2d(self.imageShape[0], 32, kernel_size=8, stride=4)),
+                nn.ReLU(),
+                layer_init(nn.Conv2d(32, cnnChannels, kernel_size=4, stride=2)),
+                nn.ReLU(),
+                layer_init(nn.Conv2d(cnnChannels, cnnChannels, kernel_size=3, stride=1)),
+                nn.ReLU(),
+                nn.Flatten(),
+            )
+            with th.no_grad():
+                featuresSize = self.imageCNN(th.zeros(1, *self.imageShape)).shape[1]
+
         self.encoder = nn.Sequential(
             layer_init(nn.Linear(featuresSize, encoderOutputSize)),
             nn.ReLU(),
         )
 
+        if frameStack > 1:
+            self.register_buffer("frameAges", th.arange(frameStack, device=device), persistent=False)
+            self.frameEncoder = nn.Sequential(
+                layer_init(nn.Linear(frameStack * encoderOutputSize, encoderOutputSize)),
+                nn.ReLU(),
+            )
+
         if self.is_continuous:
             self.actorMean = layer_init(nn.Linear(lstmOutputSize, env.single_action_space.shape[0]), std=0.01)
             self.actorLogStd = nn.Parameter(th.zeros(1, env.single_action_space.shape[0]))
@@ -146,7 +191,69 @@ class Policy(nn.Module):
             (batchSize, 4, self.obsInfo.mapObsRows, self.obsInfo.mapObsColumns)
         )
 
+    def encode_decoded_observations(self, obs: th.Tensor) -> th.Tensor:
+        # the env already decoded observations into the encoder's input
+        # layout, so only the weapon type embeddings are left
+        batchSize = obs.shape[0]
+
+        mapObs = obs[:, : self.obsInfo.decodedMultihotObsOffset].view(
+            batchSize, self.mapObsInputChannels, self.obsInfo.mapObsRows, self.obsInfo.mapObsColumns
+        )
+        map = self.mapCNN(mapObs)
+
+        multihot = obs[:, self.obsInfo.decodedMultihotObsOffset : self.obsInfo.decodedWeaponTypesObsOffset]
+
+        weaponTypeObs = obs[
+            :, self.obsInfo.decodedWeaponTypesObsOffset : self.obsInfo.decodedContinuousObsOffset
+        ].int()
+        weaponTypes = self.weaponTypeEmbedding(weaponTypeObs).float()
+        weaponTypes = th.flatten(weaponTypes, start_dim=1, end_dim=-1)
+
+        continuousObs = obs[:, self.obsInfo.decodedContinuousObsOffset :]
+
+        features = th.cat((map, multihot, weaponTypes, continuousObs), dim=-1)
+
+        return self.encoder(features), None
+
+    def unstack_observations(self, obs: th.Tensor) -> Tuple[th.Tensor, th.Tensor, th.Tensor]:
+        """Returns a view of each agent's obs history ring, the slot of the
+        obs of each age (newest first) and how many slots hold obs. Slots
+        that don't hold obs are zeroed."""
+        batchSize = obs.shape[0]
+        frames = obs[:, self.obsInfo.obsHistoryHeaderBytes :].view(
+            batchSize, self.frameStack, self.obsInfo.obsBytes
+        )
+        newestSlot = obs[:, 0].long().unsqueeze(1)
+        slots = (newestSlot - self.frameAges) % self.frameStack
+        numFrames = obs[:, 1].long()
+        return frames, slots, numFrames
+
+    def encode_stacked_observations(self, obs: th.Tensor) -> th.Tensor:
+        # encode every stacked obs, then order the encodings by age so
+        # each input of the frame encoder always sees obs of the same age
+        batchSize = obs.shape[0]
+        frames, slots, numFrames = self.unstack_observations(obs)
+        hidden, _ = self.encode_frames(frames.reshape(batchSize * self.frameStack, self.obsInfo.obsBytes))
+        hidden = hidden.view(batchSize, self.frameStack, encoderOutputSize)
+        hidden = hidden.gather(1, slots.unsqueeze(-1).expand(-1, -1, encoderOutputSize))
+        hidden = hidden * (self.frameAges < numFrames.unsqueeze(1)).unsqueeze(-1)
+
+        return self.frameEncoder(th.flatten(hidden, start_dim=1)), None
+
+    def encode_image_observations(self, obs: th.Tensor) -> th.Tensor:
+        images = obs.view(obs.shape[0], *self.imageShape).float() / 255.0
+        return self.encoder(self.imageCNN(images)), None
+
     def encode_observations(self, obs: th.Tensor) -> th.Tensor:
+        if self.imageObs:
+            return self.encode_image_observations(obs)
+        if self.decodedObs:
+            return self.encode_decoded_observations(obs)
+        if self.frameStack > 1:
+            return self.encode_stacked_observations(obs)
+        return self.encode_frames(obs)
+
+    def encode_frames(self, obs: th.Tensor) -> th.Tensor:
         batchSize = obs.shape[0]
 
         mapObs = self.unpack(batchSize, obs)
@@ -163,7 +270,7 @@ class Policy(nn.Module):
 
         # one hot drone indexes
         droneIndexObs = mapObs[:, 3, :, :].long()
-        droneIndexes = one_hot(droneIndexObs, self.numDrones).permute(0, 3, 1, 2).float()
+        droneIndexes = one_hot(droneIndexObs, self.mapDroneIndexes).permute(0, 3, 1, 2).float()
 
         # combine all map observations and feed through CNN
         mapObs = th.cat((wallTypes, floatingWallObs, mapPickupObs, droneIndexes), dim=1)
@@ -183,6 +290,10 @@ class Policy(nn.Module):
 
         # process continuous observations
         continuousObs = nativize_tensor(obs[:, self.obsInfo.continuousObsOffset :], self.dtype)
+        if self.obsFormat == "int16":
+            continuousObs = continuousObs.float() / np.iinfo(np.int16).max
+        elif self.obsFormat == "float16":
+            continuousObs = continuousObs.float()
 
         # combine all observations and feed through final linear encoder
         features = th.cat((map, multihotOutput, weaponTypes, continuousObs), dim=-1)
@@ -220,3 +331,102 @@ class Policy(nn.Module):
         with th.no_grad():
             t = th.as_tensor(mapSpace.sample()[None])
             return self.mapCNN(t).shape[1]
+
+
+def exportFrozenPolicy(policy: nn.Module, path: str):
+    """Write the weights of a trained recurrent policy to a file the env
+    can load to drive opponent drones without calling into Python. The
+    layout matches loadFrozenPolicy in src/policy_agent.h; weights are
+    stored input major and the weapon type embeddings are folded into the
+    encoder weights."""
+
+    base = next(m for m in policy.modules() if isinstance(m, Policy))
+    lstm = next(m for m in policy.modules() if isinstance(m, nn.LSTM))
+    obsInfo = base.obsInfo
+    if base.frameStack > 1:
+        raise ValueError("policies that take stacked observations can't be exported")
+    if base.imageObs:
+        raise ValueError("policies that take image observations can't be exported")
+
+    cnnOutputSize = cnnChannels
+    multihotSize = int(base.discreteMultihotDim)
+    numWeaponSlots = obsInfo.discreteObsSize - obsInfo.projectileTypesObsOffset
+    continuousSize = obsInfo.continuousObsSize
+
+    with th.no_grad():
+        conv1 = base.mapCNN[0]
+        conv2 = base.mapCNN[2]
+        encoder = base.encoder[0].weight
+        if encoder.shape[1] != cnnOutputSize + multihotSize + (numWeaponSlots * weaponTypeEmbeddingDims) + continuousSize:
+            raise ValueError("policy was built for a different observation layout")
+
+        weaponStart = cnnOutputSize + multihotSize
+        continuousStart = weaponStart + (numWeaponSlots * weaponTypeEmbeddingDims)
+        encoderWeights = th.cat((encoder[:, :cnnOutputSize], encoder[:, continuousStart:]), dim=1).T
+        multihotWeights = encoder[:, cnnOutputSize:weaponStart].T
+        embeddings = base.weaponTypeEmbedding.weight
+        weaponWeights = th.stack(
+            [
+                embeddings
+                @ encoder[
+                    :,
+                    weaponStart
+                    + (i * weaponTypeEmbeddingDims) : weaponStart
+                    + ((i + 1) * weaponTypeEmbeddingDims),
+                ].T
+                for i in range(numWeaponSlots)
+            ]
+        )
+
+        lstmWeights = th.cat((lstm.weight_ih_l0, lstm.weight_hh_l0), dim=1).T
+        lstmBias = lstm.bias_ih_l0 + lstm.bias_hh_l0
+
+        # continuous actions are padded to 8 outputs
+        actor = base.actor if not base.is_continuous else base.actorMean
+        actorWeights = actor.weight
+        actorBias = actor.bias
+        if base.is_continuous:
+            padding = 8 - actorWeights.shape[0]
+            actorWeights = th.cat((actorWeights, actorWeights.new_zeros(padding, actorWeights.shape[1])))
+            actorBias = th.cat((actorBias, actorBias.new_zeros(padding)))
+
+        tensors = (
+            conv1.weight.permute(1, 2, 3, 0),
+            conv1.bias,
+            conv2.weight.permute(2, 3, 1, 0),
+            conv2.bias,
+            encoderWeights,
+            multihotWeights,
+            weaponWeights,
+            base.encoder[0].bias,
+            lstmWeights,
+            lstmBias,
+            actorWeights.T,
+            actorBias,
+        )
+
+        with open(path, "wb") as f:
+            f.write(
+                struct.pack(
+                    "<17I",
+                    0x4C505749,
+                    3,
+                    base.numDrones,
+                    int(not base.is_continuous),
+                    base.mapObsInputChannels,
+                    multihotSize,
+                    continuousSize,
+                    numWeaponSlots,
+                    obsInfo.weaponTypes,
+                    actorWeights.shape[0],
+                    obsInfo.mapObsRows,
+                    obsInfo.mapObsColumns,
+                    obsInfo.numNearWallObs,
+                    obsInfo.numFloatingWallObs,
+                    obsInfo.numProjectileObs,
+                    obsInfo.numWeaponPickupObs,
+                    obsInfo.numLidarRays,
+                )
+            )
+            for t in tensors:
+                f.write(t.detach().cpu().float().contiguous().numpy().astype("<f4").tobytes())
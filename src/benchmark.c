@@ -1,3 +1,6 @@
+#include <sched.h>
+#include <string.h>
+
 #include "env.h"
 
 void randActions(env *e) {
@@ -16,53 +19,862 @@ void randActions(env *e) {
     }
 }
 
-void perfTest(const uint32_t numSteps) {
-    const uint8_t NUM_DRONES = 2;
+// envs and the buffers they write obs, rewards and the like to, created
+// with createBenchEnv and destroyed with destroyBenchEnv
+typedef struct benchEnv {
+    env *envs;
+    uint8_t numEnvs;
+    uint8_t *obs;
+    float *rewards;
+    float *actions;
+    uint8_t *masks;
+    uint8_t *terminals;
+    uint8_t *truncations;
+    logBuffer **logs;
+} benchEnv;
+
+// initializes numEnvs envs but doesn't set them up so anything that has
+// to be done before an env is set up can be done first, setupBenchEnv
+// must be called before they're stepped
+benchEnv *createBenchEnv(const uint8_t numEnvs, const uint8_t numDrones, const uint8_t numAgents, const obsProfile *profile, const uint16_t agentObsBytes, const int8_t mapIdx, const uint64_t seed) {
+    benchEnv *b = fastCalloc(1, sizeof(benchEnv));
+    b->envs = fastCalloc(numEnvs, sizeof(env));
+    b->numEnvs = numEnvs;
+
+    const uint32_t envObsBytes = alignedSize(numAgents * agentObsBytes, sizeof(float));
+    posix_memalign((void **)&b->obs, sizeof(void *), numEnvs * envObsBytes);
+
+    b->rewards = fastCalloc(numEnvs * numDrones, sizeof(float));
+    b->actions = fastCalloc(numEnvs * numDrones * CONTINUOUS_ACTION_SIZE, sizeof(float));
+    b->masks = fastCalloc(numEnvs * numDrones, sizeof(uint8_t));
+    b->terminals = fastCalloc(numEnvs * numDrones, sizeof(uint8_t));
+    b->truncations = fastCalloc(numEnvs * numDrones, sizeof(uint8_t));
+    b->logs = fastCalloc(numEnvs, sizeof(logBuffer *));
+
+    for (uint8_t i = 0; i < numEnvs; i++) {
+        const uint16_t agentOffset = i * numDrones;
+        b->logs[i] = createLogBuffer(numDrones, false);
+        initEnv(&b->envs[i], numDrones, numAgents, profile, b->obs + (i * envObsBytes), false, b->actions + (agentOffset * CONTINUOUS_ACTION_SIZE), NULL, b->rewards + agentOffset, b->masks + agentOffset, b->terminals + agentOffset, b->truncations + agentOffset, b->logs[i], mapIdx, seed + i, false, false, true);
+    }
+    return b;
+}
+
+void setupBenchEnv(benchEnv *b) {
+    initMaps(&b->envs[0]);
+    for (uint8_t i = 0; i < b->numEnvs; i++) {
+        randActions(&b->envs[i]);
+        setupEnv(&b->envs[i]);
+    }
+}
+
+void destroyBenchEnv(benchEnv *b) {
+    for (uint8_t i = 0; i < b->numEnvs; i++) {
+        destroyEnv(&b->envs[i]);
+        destroyLogBuffer(b->logs[i]);
+    }
+    destroyMaps();
+
+    free(b->obs);
+    fastFree(b->actions);
+    fastFree(b->rewards);
+    fastFree(b->masks);
+    fastFree(b->terminals);
+    fastFree(b->truncations);
+    fastFree(b->logs);
+    fastFree(b->envs);
+    fastFree(b);
+}
 
-    env *e = fastCalloc(1, sizeof(env));
+// wall time is used instead of clock so time spent on other threads,
+// like box2d's tasks or a reset pool, isn't counted
+static inline double monotonicSeconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + (ts.tv_nsec / 1e9);
+}
 
-    uint8_t *obs = NULL;
-    posix_memalign((void **)&obs, sizeof(void *), alignedSize(NUM_DRONES * obsBytes(NUM_DRONES), sizeof(float)));
+// steps an env with random actions and returns how many seconds it took
+double timeSteps(env *e, const uint32_t numSteps) {
+    const double start = monotonicSeconds();
+    for (uint32_t steps = 0; steps < numSteps; steps++) {
+        randActions(e);
+        stepEnv(e);
+    }
+    return monotonicSeconds() - start;
+}
 
-    float *rewards = fastCalloc(NUM_DRONES, sizeof(float));
-    float *actions = fastCalloc(NUM_DRONES * CONTINUOUS_ACTION_SIZE, sizeof(float));
-    uint8_t *masks = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    uint8_t *terminals = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    uint8_t *truncations = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    logBuffer *logs = createLogBuffer(1);
+void perfTest(const uint32_t numSteps, const obsProfile *profile) {
+    benchEnv *b = createBenchEnv(1, profile->numDrones, profile->numDrones, profile, obsBytes(profile), -1, time(NULL));
+    env *e = &b->envs[0];
 
     // rayClient *client = createRayClient();
     // e->client = client;
 
-    time_t seed = time(NULL);
-    initEnv(e, NUM_DRONES, NUM_DRONES, obs, false, actions, NULL, rewards, masks, terminals, truncations, logs, -1, seed, false, false, true);
-    initMaps(e);
+    setupBenchEnv(b);
+    stepEnv(e);
+
+    const double elapsed = timeSteps(e, numSteps);
+    printf("%d drones, %u obs bytes: %u steps in %.2fs (%.0f steps/s)\n", profile->numDrones, obsBytes(profile), numSteps, elapsed, numSteps / elapsed);
+
+    destroyBenchEnv(b);
+}
+
+// keeps a large number of projectiles alive at all times to stress
+// projectile creation, removal and explosion handling
+void projectileStressTest(const uint32_t numSteps, const uint16_t numProjectiles) {
+    const uint8_t NUM_DRONES = 4;
+    const enum weaponType weapons[] = {SHOTGUN_WEAPON, FLAK_CANNON_WEAPON, MACHINEGUN_WEAPON, IMPLODER_WEAPON};
 
-    randActions(e);
-    setupEnv(e);
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
     stepEnv(e);
 
-    uint32_t steps = 0;
-    while (steps != numSteps) {
+    size_t maxLiveProjectiles = 0;
+    const double start = monotonicSeconds();
+    for (uint32_t steps = 0; steps < numSteps; steps++) {
+        for (uint8_t i = 0; i < cc_array_size(e->drones); i++) {
+            droneEntity *drone = safe_array_get_at(e->drones, i);
+            if (drone->dead) {
+                continue;
+            }
+            droneChangeWeapon(e, drone, weapons[i % (sizeof(weapons) / sizeof(weapons[0]))]);
+
+            const uint16_t spawnsPerDrone = numProjectiles / NUM_DRONES;
+            for (uint16_t j = 0; j < spawnsPerDrone && cc_array_size(e->projectiles) < numProjectiles; j++) {
+                const float angle = randFloat(&e->randState, -PI, PI);
+                createProjectile(e, drone, (b2Vec2){.x = cosf(angle), .y = sinf(angle)});
+            }
+        }
+        maxLiveProjectiles = max(maxLiveProjectiles, cc_array_size(e->projectiles));
+
         randActions(e);
         stepEnv(e);
-        steps++;
     }
+    const double elapsed = monotonicSeconds() - start;
+    printf("projectile stress test: %u steps in %.2fs (%.0f steps/s), max live projectiles: %zu\n", numSteps, elapsed, numSteps / elapsed, maxLiveProjectiles);
 
-    destroyEnv(e);
-    destroyMaps();
+    destroyBenchEnv(b);
+}
+
+// bursts diagonally off of each corner of every merged wall box that's
+// at least 3 cells thick on every map, and fails if a cell of the box
+// that's hidden behind other cells of the box was burst off of
+void burstCornerTest() {
+    const uint8_t NUM_DRONES = 2;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
+    droneEntity *drone = safe_array_get_at(e->drones, 0);
+
+    uint32_t bursts = 0;
+    for (uint8_t mapIdx = 0; mapIdx < NUM_MAPS; mapIdx++) {
+        setupMap(e, mapIdx);
+        const uint8_t columns = e->map->columns;
+        for (size_t i = 0; i < cc_array_size(e->wallBoxes); i++) {
+            const wallEntity *box = safe_array_get_at(e->wallBoxes, i);
+            if (box->boxColumns < 3 || box->boxRows < 3) {
+                continue;
+            }
+            const uint8_t firstCol = box->mapCellIdx % columns;
+            const uint8_t firstRow = box->mapCellIdx / columns;
+
+            for (uint8_t corner = 0; corner < 4; corner++) {
+                const bool right = corner & 1;
+                const bool top = corner & 2;
+                const b2Vec2 pos = {
+                    .x = box->pos.x + ((right ? 1.0f : -1.0f) * (box->extent.x + 1.5f)),
+                    .y = box->pos.y + ((top ? 1.0f : -1.0f) * (box->extent.y + 1.5f)),
+                };
+                const int16_t cellIdx = entityPosToCellIdx(e, pos);
+                if (cellIdx == -1 || ((const mapCell *)safe_array_get_at(e->cells, cellIdx))->ent != NULL) {
+                    continue;
+                }
+
+                // the biggest burst a drone can do
+                const b2ExplosionDef def = {
+                    .position = pos,
+                    .radius = DRONE_BURST_RADIUS_BASE + DRONE_BURST_RADIUS_MIN,
+                    .impulsePerLength = DRONE_BURST_IMPACT_BASE + DRONE_BURST_IMPACT_MIN,
+                    .maskBits = WALL_SHAPE,
+                };
+                explosionCtx ctx = {
+                    .e = e,
+                    .isBurst = true,
+                    .parentDrone = drone,
+                    .projectile = NULL,
+                    .def = &def,
+                    .wallImpulses = {0},
+                    .closestWallIdx = -1,
+                    .wallsHit = 0,
+                };
+                const b2Vec2 worldPos = arenaToWorldPos(e, pos);
+                const b2AABB aabb = {
+                    .lowerBound = {.x = worldPos.x - def.radius, .y = worldPos.y - def.radius},
+                    .upperBound = {.x = worldPos.x + def.radius, .y = worldPos.y + def.radius},
+                };
+                b2QueryFilter filter = b2DefaultQueryFilter();
+                filter.categoryBits = PROJECTILE_SHAPE;
+                filter.maskBits = def.maskBits;
+                b2World_OverlapAABB(e->worldID, aabb, filter, explodeCallback, &ctx);
+                bursts++;
+
+                if (ctx.wallsHit > MAX_WALL_HITS) {
+                    ERRORF("map %d: %u walls hit by burst, max is %d", mapIdx, ctx.wallsHit, MAX_WALL_HITS);
+                }
+                // only cells in the column and row of the box facing the
+                // burst aren't hidden
+                const uint8_t facingCol = right ? firstCol + box->boxColumns - 1 : firstCol;
+                const uint8_t facingRow = top ? firstRow + box->boxRows - 1 : firstRow;
+                for (uint8_t j = 0; j < ctx.wallsHit; j++) {
+                    const uint8_t col = ctx.wallImpulses[j].wallCellIdx % columns;
+                    const uint8_t row = ctx.wallImpulses[j].wallCellIdx / columns;
+                    const bool inBox = col >= firstCol && col < firstCol + box->boxColumns && row >= firstRow && row < firstRow + box->boxRows;
+                    if (inBox && col != facingCol && row != facingRow) {
+                        ERRORF("map %d: burst at %f, %f hit hidden cell %u, %u of box at cell %u, %u", mapIdx, pos.x, pos.y, col, row, firstCol, firstRow);
+                    }
+                }
+            }
+        }
+    }
+    if (bursts == 0) {
+        ERROR("no map has a wall box with an open corner to burst at");
+    }
+    printf("burst corner test: %u bursts hit no hidden cells\n", bursts);
+
+    destroyBenchEnv(b);
+}
+
+// steps numEnvs envs with arenasPerWorld envs sharing each box2d world
+void arenaWorldPerfTest(const uint32_t numSteps, const uint8_t numEnvs, const uint8_t arenasPerWorld) {
+    const uint8_t NUM_DRONES = 2;
+    const uint8_t numWorlds = numEnvs / arenasPerWorld;
+    ASSERT(numEnvs % arenasPerWorld == 0);
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(numEnvs, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+
+    // a single arena per world is the same as not sharing worlds
+    arenaWorld *worlds[numWorlds];
+    if (arenasPerWorld != 1) {
+        for (uint8_t i = 0; i < numWorlds; i++) {
+            worlds[i] = createArenaWorld(&b->envs[i * arenasPerWorld], arenasPerWorld);
+        }
+    }
+    setupBenchEnv(b);
+
+    const double start = monotonicSeconds();
+    for (uint32_t steps = 0; steps < numSteps; steps++) {
+        for (uint8_t i = 0; i < numEnvs; i++) {
+            randActions(&b->envs[i]);
+        }
+        if (arenasPerWorld == 1) {
+            for (uint8_t i = 0; i < numEnvs; i++) {
+                stepEnv(&b->envs[i]);
+            }
+        } else {
+            for (uint8_t i = 0; i < numWorlds; i++) {
+                stepArenaWorld(worlds[i]);
+            }
+        }
+    }
+    const double elapsed = monotonicSeconds() - start;
+    const uint32_t envSteps = numSteps * numEnvs;
+    printf("%d arenas per world: %u env steps in %.2fs (%.0f steps/s)\n", arenasPerWorld, envSteps, elapsed, envSteps / elapsed);
+
+    destroyBenchEnv(b);
+    if (arenasPerWorld != 1) {
+        for (uint8_t i = 0; i < numWorlds; i++) {
+            destroyArenaWorld(worlds[i]);
+        }
+    }
+}
+
+// steps a 16 drone env on the largest generated arena with box2d's
+// tasks run on numThreads threads of the shared job system
+void physicsThreadsPerfTest(const uint32_t numSteps, const uint8_t numThreads) {
+    const uint8_t NUM_DRONES = 16;
+    const int8_t HUGE_ARENA_MAP = NUM_MAPS - 1;
+
+    initJobSystem(numThreads);
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), HUGE_ARENA_MAP, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
+    stepEnv(e);
+
+    const double elapsed = timeSteps(e, numSteps);
+    printf("%d physics threads: %u steps in %.2fs (%.0f steps/s)\n", numThreads, numSteps, elapsed, numSteps / elapsed);
+
+    destroyBenchEnv(b);
+    destroyJobSystem();
+}
+
+// steps an env where a single agent plays against opponents driven by
+// an exported policy
+void opponentPolicyPerfTest(const uint32_t numSteps, const char *policyPath) {
+    const uint8_t NUM_DRONES = 4;
+    const uint8_t NUM_AGENTS = 1;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_AGENTS, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    frozenPolicy *policy = loadFrozenPolicy(policyPath, &profile);
+    setOpponentPolicy(e, policy);
+    setupBenchEnv(b);
+    stepEnv(e);
+
+    const double elapsed = timeSteps(e, numSteps);
+    printf("%d policy opponents: %u steps in %.2fs (%.0f steps/s)\n", NUM_DRONES - NUM_AGENTS, numSteps, elapsed, numSteps / elapsed);
+
+    destroyBenchEnv(b);
+    destroyFrozenPolicy(policy);
+}
+
+// times snapshotting and restoring an env mid-episode
+void snapshotPerfTest(const uint32_t numIters) {
+    const uint8_t NUM_DRONES = 4;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
+    // get far enough into the episode that there are projectiles and
+    // drone pieces to snapshot
+    for (uint16_t i = 0; i < 500 && !e->needsReset; i++) {
+        randActions(e);
+        stepEnv(e);
+    }
+
+    const uint32_t size = envSnapshotSize(e);
+    uint8_t *snapshot = fastCalloc(size, sizeof(uint8_t));
+
+    double start = monotonicSeconds();
+    for (uint32_t i = 0; i < numIters; i++) {
+        snapshotEnv(e, snapshot, size);
+    }
+    const double snapshotElapsed = monotonicSeconds() - start;
+
+    start = monotonicSeconds();
+    for (uint32_t i = 0; i < numIters; i++) {
+        restoreEnv(e, snapshot, size);
+    }
+    const double restoreElapsed = monotonicSeconds() - start;
+    printf(
+        "%u byte snapshots: snapshot %.2fus, restore %.2fus\n",
+        size,
+        (snapshotElapsed * 1e6) / numIters,
+        (restoreElapsed * 1e6) / numIters
+    );
+
+    destroyBenchEnv(b);
+    fastFree(snapshot);
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    const double x = *(const double *)a;
+    const double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// prints the mean, p99 and max of times in microseconds, sorting them
+static void printLatencies(const char *name, double *times, const uint32_t count) {
+    if (count == 0) {
+        printf("%s: none", name);
+        return;
+    }
+    double total = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        total += times[i];
+    }
+    qsort(times, count, sizeof(double), compareDoubles);
+    printf("%s: %.1fus mean, %.1fus p99, %.1fus max", name, (total * 1e6) / count, times[(count - 1) * 99 / 100] * 1e6, times[count - 1] * 1e6);
+}
+
+// compares the latency of steps that reset the env to other steps, with
+// initial states generated in the background if statesPerEnv isn't 0.
+// If lockAllocs is set allocations are locked without a pool to measure
+// what the lock costs
+void resetPoolPerfTest(const uint32_t numSteps, const uint8_t statesPerEnv, const bool lockAllocs) {
+    const uint8_t NUM_DRONES = 2;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
+    resetPool *pool = NULL;
+    if (statesPerEnv != 0) {
+        pool = createResetPool(e, 1, statesPerEnv);
+    } else if (lockAllocs) {
+        enableAllocLocking();
+    }
+
+    uint32_t resets = 0;
+    double *resetTimes = fastCalloc(numSteps, sizeof(double));
+    double *stepTimes = fastCalloc(numSteps, sizeof(double));
+    for (uint32_t steps = 0; steps < numSteps; steps++) {
+        randActions(e);
+        const bool resetting = e->needsReset;
+        const double start = monotonicSeconds();
+        stepEnv(e);
+        const double elapsed = monotonicSeconds() - start;
+        if (resetting) {
+            resetTimes[resets++] = elapsed;
+        } else {
+            stepTimes[steps - resets] = elapsed;
+        }
+    }
+
+    printf("%u pooled states%s: %u resets, ", statesPerEnv, lockAllocs ? ", locked allocs" : "", resets);
+    printLatencies("reset steps", resetTimes, resets);
+    printf("; ");
+    printLatencies("other steps", stepTimes, numSteps - resets);
+    printf("; %u pool misses\n", pool != NULL ? resetPoolMisses(pool) : 0);
+    fastFree(resetTimes);
+    fastFree(stepTimes);
+
+    if (pool != NULL) {
+        destroyResetPool(pool, e);
+    } else if (lockAllocs) {
+        disableAllocLocking();
+    }
+    destroyBenchEnv(b);
+}
+
+// resets envs every few steps so a reset pool is generating states on
+// its thread, and allocating while it does, the whole time the envs are
+// stepped; fails if the pool never kept up with a single reset
+void resetPoolStressTest(const uint32_t numSteps, const uint8_t numEnvs) {
+    const uint8_t NUM_DRONES = 2;
+    const uint8_t STEPS_PER_EPISODE = 8;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(numEnvs, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    setupBenchEnv(b);
+    resetPool *pool = createResetPool(b->envs, numEnvs, 2);
+
+    uint32_t resets = 0;
+    for (uint32_t steps = 0; steps < numSteps; steps++) {
+        for (uint8_t i = 0; i < numEnvs; i++) {
+            env *e = &b->envs[i];
+            if (steps % STEPS_PER_EPISODE == 0) {
+                e->needsReset = true;
+            }
+            resets += e->needsReset;
+            randActions(e);
+            stepEnv(e);
+        }
+    }
+    const uint32_t misses = resetPoolMisses(pool);
+    printf("reset pool stress test: %u resets of %u envs, %u pool misses\n", resets, numEnvs, misses);
+    if (misses == resets) {
+        ERROR("no reset was done from a pooled state");
+    }
+
+    destroyResetPool(pool, b->envs);
+    destroyBenchEnv(b);
+}
+
+// compares stepping with and without writing a trace of every frame
+void tracePerfTest(const uint32_t numSteps, const char *tracePath) {
+    const uint8_t NUM_DRONES = 2;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
+
+    traceWriter *trace = openTraceWriter(tracePath, 64 * 1024 * 1024, NUM_DRONES);
+    for (uint8_t i = 0; i < 2; i++) {
+        setEnvTrace(e, i == 0 ? NULL : trace);
+        const double elapsed = timeSteps(e, numSteps);
+        printf("trace %s: %u steps in %.2fs (%.0f steps/s)\n", i == 0 ? "disabled" : "enabled", numSteps, elapsed, numSteps / elapsed);
+    }
+    printf("%" PRIu64 " frames written to %s\n", traceFramesWritten(trace), tracePath);
+    setEnvTrace(e, NULL);
+    closeTraceWriter(trace);
+
+    destroyBenchEnv(b);
+}
+
+// frames taken by frameConsumerLoop, copied to a buffer that's allocated
+// before the consumer starts
+typedef struct consumedFrames {
+    uint8_t *data;
+    uint64_t capacity;
+    uint64_t size;
+    uint32_t count;
+} consumedFrames;
+
+static consumedFrames consumed;
+
+static void *frameConsumerLoop(void *arg) {
+    renderThread *rt = arg;
+    while (!atomic_load(&rt->stop)) {
+        const traceFrame *frame = takeRenderFrame(rt);
+        if (frame == NULL) {
+            sched_yield();
+            continue;
+        }
+        if (consumed.size + frame->size > consumed.capacity) {
+            continue;
+        }
+        memcpy(consumed.data + consumed.size, frame, frame->size);
+        consumed.size += frame->size;
+        consumed.count++;
+    }
+    return NULL;
+}
+
+// steps an env with its frames consumed on another thread the same way
+// the render thread takes them but without rendering, and fails if a
+// consumed frame doesn't match the frame written to a trace at the same
+// point. The env isn't rendered so any raylib calls made by the env's
+// thread would fail without a window.
+void frameConsumerTest(const uint32_t numSteps, const char *tracePath) {
+    const uint8_t NUM_DRONES = 2;
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, time(NULL));
+    env *e = &b->envs[0];
+    setupBenchEnv(b);
+
+    const uint64_t capacity = 256 * 1024 * 1024;
+    traceWriter *trace = openTraceWriter(tracePath, capacity, NUM_DRONES);
+    setEnvTrace(e, trace);
+    consumed = (consumedFrames){.data = fastCalloc(capacity, sizeof(uint8_t)), .capacity = capacity};
+    renderThread *rt = startFrameConsumer(e, false, frameConsumerLoop);
+
+    for (uint32_t steps = 0; steps < numSteps; steps++) {
+        randActions(e);
+        stepEnv(e);
+    }
+
+    stopRenderThread(rt, e);
+    const uint64_t framesWritten = traceFramesWritten(trace);
+    setEnvTrace(e, NULL);
+    closeTraceWriter(trace);
+
+    // frames are consumed in order but may be skipped
+    traceReader *reader = openTraceReader(tracePath);
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < consumed.count; i++) {
+        const traceFrame *frame = (const traceFrame *)(consumed.data + offset);
+        const traceFrame *traced = nextTraceFrame(reader);
+        while (traced != NULL && (traced->size != frame->size || memcmp(traced, frame, frame->size) != 0)) {
+            traced = nextTraceFrame(reader);
+        }
+        if (traced == NULL) {
+            ERRORF("consumed frame %u of episode %u doesn't match any traced frame", frame->frame, frame->episode);
+        }
+        offset += frame->size;
+    }
+    closeTraceReader(reader);
+    if (consumed.count == 0) {
+        ERROR("no frames were consumed");
+    }
+    printf("frame consumer test: %u of %" PRIu64 " frames consumed, all match the trace\n", consumed.count, framesWritten);
+
+    fastFree(consumed.data);
+    destroyBenchEnv(b);
+}
+
+// compares stepping with vector obs to stepping with image obs
+void imageObsPerfTest(const uint32_t numSteps) {
+    const uint8_t NUM_DRONES = 2;
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+
+    for (uint8_t i = 0; i < 2; i++) {
+        const bool imageObs = i == 1;
+        const uint16_t agentObsBytes = imageObs ? imageObsBytes() : obsBytes(&profile);
+        benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, agentObsBytes, -1, time(NULL));
+        env *e = &b->envs[0];
+        if (imageObs) {
+            enableImageObs(e);
+        }
+        setupBenchEnv(b);
 
-    free(obs);
-    fastFree(actions);
-    fastFree(rewards);
-    fastFree(masks);
-    fastFree(terminals);
-    fastFree(truncations);
-    destroyLogBuffer(logs);
-    fastFree(e);
+        const double elapsed = timeSteps(e, numSteps);
+        printf("%s obs, %u obs bytes: %u steps in %.2fs (%.0f steps/s)\n", imageObs ? "image" : "vector", agentObsBytes, numSteps, elapsed, numSteps / elapsed);
+
+        destroyBenchEnv(b);
+    }
+}
+
+// physics inaccuracies of a timing profile found by tracing each
+// projectile's movement over every frame
+typedef struct timingFidelity {
+    uint64_t projectileFrames;
+    // projectiles that moved through a wall
+    uint64_t wallTunnels;
+    // projectiles that moved through a drone without touching anything
+    uint64_t droneMisses;
+
+    uint32_t episodes;
+    float episodeSeconds;
+    float shotsFired;
+    float shotsHit;
+} timingFidelity;
+
+// returns the distance of the closest point on segment ab to the origin
+static float segmentOriginDistance(const b2Vec2 a, const b2Vec2 b) {
+    const b2Vec2 ab = b2Sub(b, a);
+    const float lengthSquared = b2LengthSquared(ab);
+    float t = 0.0f;
+    if (lengthSquared > 0.0f) {
+        t = b2ClampFloat(-b2Dot(a, ab) / lengthSquared, 0.0f, 1.0f);
+    }
+    return b2Length(b2MulAdd(a, t, ab));
+}
+
+static void checkFrameFidelity(const env *e, timingFidelity *f) {
+    const b2QueryFilter filter = {.categoryBits = PROJECTILE_SHAPE, .maskBits = WALL_SHAPE};
+    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        const projectileEntity *projectile = e->projectiles->buffer[i];
+        if (projectile->setMine || projectile->needsToBeDestroyed) {
+            continue;
+        }
+        f->projectileFrames++;
+
+        // projectiles that bounced off a wall end the frame on the side
+        // they started on
+        if (posBehindWall(e, projectile->lastPos, projectile->pos, NULL, filter, NULL)) {
+            f->wallTunnels++;
+        }
+
+        if (projectile->contacts != 0) {
+            continue;
+        }
+        for (uint8_t j = 0; j < e->numDrones; j++) {
+            const droneEntity *drone = safe_array_get_at(e->drones, j);
+            if (drone->dead || drone->idx == projectile->droneIdx) {
+                continue;
+            }
+            // movement of the projectile relative to the drone
+            const b2Vec2 start = b2Sub(projectile->lastPos, drone->lastPos);
+            const b2Vec2 end = b2Sub(projectile->pos, drone->pos);
+            if (segmentOriginDistance(start, end) < DRONE_RADIUS) {
+                f->droneMisses++;
+            }
+        }
+    }
 }
 
-int main(void) {
-    perfTest(2500000);
+static void addEpisodeFidelity(const env *e, timingFidelity *f) {
+    f->episodes++;
+    f->episodeSeconds += (float)(e->totalSteps - e->stepsLeft) / e->frameRate;
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        for (uint8_t w = 0; w < NUM_WEAPONS; w++) {
+            f->shotsFired += e->stats[i].shotsFired[w];
+            f->shotsHit += e->stats[i].shotsHit[w];
+        }
+    }
+}
+
+// returns how much a value differs from the reference in percent
+static float percentDrift(const float value, const float reference) {
+    if (reference == 0.0f) {
+        return 0.0f;
+    }
+    return ((value - reference) / reference) * 100.0f;
+}
+
+// steps an env with each timing profile to compare how fast they are
+// and how much their behavior drifts from the eval profile. Agents act
+// at the same rate with every profile so each step is the same amount
+// of game time.
+void timingPerfTest(const uint32_t numSteps) {
+    const uint8_t NUM_DRONES = 2;
+    const char *names[] = {"eval", "smooth", "training", "fast"};
+    timingProfile timings[4];
+    evalTimingProfile(&timings[0]);
+    initTimingProfile(&timings[1], 60, 2, 60 / TRAINING_ACTIONS_PER_SECOND);
+    trainingTimingProfile(&timings[2]);
+    initTimingProfile(&timings[3], 20, 1, 20 / TRAINING_ACTIONS_PER_SECOND);
+
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    const time_t seed = time(NULL);
+
+    float referenceHitRate = 0.0f;
+    float referenceEpisodeSeconds = 0.0f;
+    for (uint8_t i = 0; i < sizeof(timings) / sizeof(timings[0]); i++) {
+        const timingProfile *timing = &timings[i];
+        benchEnv *b = createBenchEnv(1, NUM_DRONES, NUM_DRONES, &profile, obsBytes(&profile), -1, seed);
+        env *e = &b->envs[0];
+        setTimingProfile(e, timing);
+        setupBenchEnv(b);
+
+        const double elapsed = timeSteps(e, numSteps);
+
+        // step frame by frame to check each one, stepped separately so
+        // the checks don't slow down the timed steps
+        timingFidelity fidelity = {0};
+        agentActions stepActions[NUM_DRONES];
+        for (uint32_t steps = 0; steps < numSteps; steps++) {
+            randActions(e);
+            beginStep(e, stepActions, false, false);
+            for (uint8_t frame = 0; frame < e->frameSkip; frame++) {
+                stepFrame(e, stepActions, false, false);
+                checkFrameFidelity(e, &fidelity);
+                if (e->needsReset) {
+                    addEpisodeFidelity(e, &fidelity);
+                    break;
+                }
+            }
+            endStep(e);
+        }
+
+        const float hitRate = fidelity.shotsFired == 0.0f ? 0.0f : fidelity.shotsHit / fidelity.shotsFired;
+        const float episodeSeconds = fidelity.episodes == 0 ? 0.0f : fidelity.episodeSeconds / fidelity.episodes;
+        if (i == 0) {
+            referenceHitRate = hitRate;
+            referenceEpisodeSeconds = episodeSeconds;
+        }
+        const double projectileFrames = max(fidelity.projectileFrames, (uint64_t)1) / 1000.0;
+        printf(
+            "%s (%u fps, %u substeps, %u frame skip): %.0f steps/s, %.0fx realtime\n",
+            names[i],
+            timing->frameRate,
+            timing->box2dSubSteps,
+            timing->frameSkip,
+            numSteps / elapsed,
+            (numSteps * ((double)timing->frameSkip / timing->frameRate)) / elapsed
+        );
+        printf(
+            "    per 1k projectile frames: %.2f wall tunnels, %.2f drone misses\n",
+            fidelity.wallTunnels / projectileFrames,
+            fidelity.droneMisses / projectileFrames
+        );
+        printf(
+            "    hit rate %.4f (%+.1f%%), episode length %.1fs (%+.1f%%) over %u episodes\n",
+            hitRate,
+            percentDrift(hitRate, referenceHitRate),
+            episodeSeconds,
+            percentDrift(episodeSeconds, referenceEpisodeSeconds),
+            fidelity.episodes
+        );
+
+        destroyBenchEnv(b);
+    }
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "projectiles") == 0) {
+        projectileStressTest(50000, 500);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "burst") == 0) {
+        burstCornerTest();
+        return 0;
+    }
+
+    obsProfile profile;
+    if (argc > 1 && strcmp(argv[1], "drones") == 0) {
+        const uint8_t droneCounts[] = {4, 8, 16};
+        for (uint8_t i = 0; i < sizeof(droneCounts) / sizeof(droneCounts[0]); i++) {
+            defaultObsProfile(&profile, droneCounts[i]);
+            perfTest(250000, &profile);
+        }
+        return 0;
+    }
+
+    // compare the default obs profile to a lean one with a 7x7 map
+    // window and fewer entity slots
+    if (argc > 1 && strcmp(argv[1], "obs") == 0) {
+        defaultObsProfile(&profile, 4);
+        perfTest(250000, &profile);
+        initObsProfile(&profile, 4, 7, 7, 4, 2, 10, 2, 0);
+        perfTest(250000, &profile);
+        return 0;
+    }
+
+    // compare the default obs profile with and without lidar rays
+    if (argc > 1 && strcmp(argv[1], "lidar") == 0) {
+        const uint8_t numRays[] = {0, 8, 16, 32};
+        for (uint8_t i = 0; i < sizeof(numRays) / sizeof(numRays[0]); i++) {
+            initObsProfile(&profile, 4, MAX_MAP_OBS_ROWS, MAX_MAP_OBS_COLUMNS, MAX_NEAR_WALL_OBS, MAX_FLOATING_WALL_OBS, MAX_PROJECTILE_OBS, MAX_WEAPON_PICKUP_OBS, numRays[i]);
+            printf("%u lidar rays\n", numRays[i]);
+            perfTest(250000, &profile);
+        }
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "arenas") == 0) {
+        const uint8_t arenasPerWorld[] = {1, 4, 16};
+        for (uint8_t i = 0; i < sizeof(arenasPerWorld) / sizeof(arenasPerWorld[0]); i++) {
+            arenaWorldPerfTest(50000, 16, arenasPerWorld[i]);
+        }
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "timing") == 0) {
+        timingPerfTest(50000);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "threads") == 0) {
+        const uint8_t numThreads[] = {0, 1, 3};
+        for (uint8_t i = 0; i < sizeof(numThreads) / sizeof(numThreads[0]); i++) {
+            physicsThreadsPerfTest(50000, numThreads[i]);
+        }
+        return 0;
+    }
+
+    if (argc > 2 && strcmp(argv[1], "opponents") == 0) {
+        opponentPolicyPerfTest(100000, argv[2]);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "snapshot") == 0) {
+        snapshotPerfTest(10000);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "resets") == 0) {
+        resetPoolPerfTest(250000, 0, false);
+        resetPoolPerfTest(250000, 0, true);
+        resetPoolPerfTest(250000, 2, false);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "resetstress") == 0) {
+        resetPoolStressTest(20000, 8);
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "trace") == 0) {
+        tracePerfTest(500000, argc > 2 ? argv[2] : "benchmark.trace");
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "consumer") == 0) {
+        frameConsumerTest(20000, argc > 2 ? argv[2] : "consumer.trace");
+        return 0;
+    }
+
+    if (argc > 1 && strcmp(argv[1], "image") == 0) {
+        imageObsPerfTest(250000);
+        return 0;
+    }
+
+    defaultObsProfile(&profile, 2);
+    perfTest(2500000, &profile);
     return 0;
 }
@@ -1,5 +1,6 @@
 #include "env.h"
 #include "render.h"
+#include "replay.h"
 
 #ifdef __EMSCRIPTEN__
 void emscriptenStep(void *e) {
@@ -8,13 +9,38 @@ void emscriptenStep(void *e) {
 }
 #endif
 
-int main(void) {
+#ifndef __EMSCRIPTEN__
+// plays back a trace written by an env instead of running a game
+void replayTrace(const char *path) {
+    rayClient *client = createRayClient();
+    traceReplay *replay = createTraceReplay(path, client);
+    while (!WindowShouldClose()) {
+        stepTraceReplay(replay);
+    }
+    destroyTraceReplay(replay);
+    destroyRayClient(client);
+}
+#endif
+
+int main(int argc, char **argv) {
+#ifndef __EMSCRIPTEN__
+    if (argc > 1) {
+        replayTrace(argv[1]);
+        return 0;
+    }
+#else
+    MAYBE_UNUSED(argc);
+    MAYBE_UNUSED(argv);
+#endif
+
     const int NUM_DRONES = 4;
 
     env *e = fastCalloc(1, sizeof(env));
 
     uint8_t *obs = NULL;
-    posix_memalign((void **)&obs, sizeof(void *), alignedSize(NUM_DRONES * obsBytes(NUM_DRONES), sizeof(float)));
+    obsProfile profile;
+    defaultObsProfile(&profile, NUM_DRONES);
+    posix_memalign((void **)&obs, sizeof(void *), alignedSize(NUM_DRONES * obsBytes(&profile), sizeof(float)));
 
     float *rewards = fastCalloc(NUM_DRONES, sizeof(float));
     float *contActions = fastCalloc(NUM_DRONES * CONTINUOUS_ACTION_SIZE, sizeof(float));
@@ -22,12 +48,12 @@ int main(void) {
     uint8_t *masks = fastCalloc(NUM_DRONES, sizeof(uint8_t));
     uint8_t *terminals = fastCalloc(NUM_DRONES, sizeof(uint8_t));
     uint8_t *truncations = fastCalloc(NUM_DRONES, sizeof(uint8_t));
-    logBuffer *logs = createLogBuffer(LOG_BUFFER_SIZE);
+    logBuffer *logs = createLogBuffer(NUM_DRONES, false);
 
     rayClient *client = createRayClient();
     e->client = client;
 
-    initEnv(e, NUM_DRONES, 0, obs, true, contActions, discActions, rewards, masks, terminals, truncations, logs, -1, time(NULL), true, false, false);
+    initEnv(e, NUM_DRONES, 0, &profile, obs, true, contActions, discActions, rewards, masks, terminals, truncations, logs, -1, time(NULL), true, false, false);
     initMaps(e);
     setupEnv(e);
     e->humanInput = true;
@@ -9,9 +9,16 @@ double accumulator = 0.0;
 #endif
 
 #include "game.h"
+#include "image_obs.h"
+#include "jobs.h"
+#include "lidar.h"
 #include "map.h"
+#include "policy_agent.h"
+#include "reset_pool.h"
 #include "scripted_agent.h"
 #include "settings.h"
+#include "snapshot.h"
+#include "trace.h"
 #include "types.h"
 
 // autopdx can't parse raylib's headers for some reason, but that's ok
@@ -20,9 +27,13 @@ double accumulator = 0.0;
 // just declare the necessary functions the Cython code needs
 #ifndef AUTOPXD
 #include "render.h"
+#include "render_thread.h"
 #else
 rayClient *createRayClient();
 void destroyRayClient(rayClient *client);
+renderThread *startRenderThread(env *e, const bool realtime);
+void stopRenderThread(renderThread *rt, env *e);
+bool renderThreadWindowClosed(renderThread *rt);
 typedef struct Vector2 {
     float x;
     float y;
@@ -32,84 +43,158 @@ typedef struct Vector2 {
 const uint8_t THREE_BIT_MASK = 0x7;
 const uint8_t FOUR_BIT_MASK = 0xf;
 
-logBuffer *createLogBuffer(uint16_t capacity) {
+// log entries are accumulated as arrays of floats, so logEntry and
+// droneStats must only be made up of floats
+const uint16_t LOG_ENTRY_FIELDS = sizeof(logEntry) / sizeof(float);
+const uint8_t DRONE_STATS_FIELDS = sizeof(droneStats) / sizeof(float);
+
+// creates a log buffer for an env with numDrones drones, each env should
+// have its own so envs can be stepped on different threads. If
+// trackSpread is set the variance, min and max of fields are tracked
+// along with their means
+logBuffer *createLogBuffer(uint8_t numDrones, bool trackSpread) {
     logBuffer *logs = fastCalloc(1, sizeof(logBuffer));
-    logs->logs = fastCalloc(capacity, sizeof(logEntry));
-    logs->size = 0;
-    logs->capacity = capacity;
+    logs->numFields = 2 + (numDrones * DRONE_STATS_FIELDS);
+    logs->mean = fastCalloc(LOG_ENTRY_FIELDS, sizeof(double));
+    if (trackSpread) {
+        logs->m2 = fastCalloc(LOG_ENTRY_FIELDS, sizeof(double));
+        logs->min = fastCalloc(LOG_ENTRY_FIELDS, sizeof(float));
+        logs->max = fastCalloc(LOG_ENTRY_FIELDS, sizeof(float));
+    }
     return logs;
 }
 
-void destroyLogBuffer(logBuffer *buffer) {
-    fastFree(buffer->logs);
-    fastFree(buffer);
+void destroyLogBuffer(logBuffer *logs) {
+    fastFree(logs->mean);
+    fastFree(logs->m2);
+    fastFree(logs->min);
+    fastFree(logs->max);
+    fastFree(logs);
 }
 
-void addLogEntry(logBuffer *logs, logEntry *log) {
-    if (logs->size == logs->capacity) {
+void clearLogBuffer(logBuffer *logs) {
+    logs->count = 0;
+    memset(logs->mean, 0x0, logs->numFields * sizeof(double));
+    if (logs->m2 != NULL) {
+        memset(logs->m2, 0x0, logs->numFields * sizeof(double));
+    }
+}
+
+// adds an episode to the running statistics with Welford's algorithm
+void addLogEntry(logBuffer *logs, const logEntry *log) {
+    const float *fields = (const float *)log;
+    logs->count++;
+    const double invCount = 1.0 / logs->count;
+    if (logs->m2 == NULL) {
+        for (uint16_t i = 0; i < logs->numFields; i++) {
+            logs->mean[i] += (fields[i] - logs->mean[i]) * invCount;
+        }
         return;
     }
-    logs->logs[logs->size] = *log;
-    logs->size += 1;
+
+    for (uint16_t i = 0; i < logs->numFields; i++) {
+        const double delta = fields[i] - logs->mean[i];
+        logs->mean[i] += delta * invCount;
+        logs->m2[i] += delta * (fields[i] - logs->mean[i]);
+        if (logs->count == 1) {
+            logs->min[i] = fields[i];
+            logs->max[i] = fields[i];
+        } else {
+            logs->min[i] = fminf(logs->min[i], fields[i]);
+            logs->max[i] = fmaxf(logs->max[i], fields[i]);
+        }
+    }
 }
 
-logEntry aggregateAndClearLogBuffer(uint8_t numDrones, logBuffer *logs) {
-    logEntry log = {0};
-    if (logs->size == 0) {
-        return log;
-    }
-
-    DEBUG_LOGF("aggregating logs, size: %d", logs->size);
-
-    const float logSize = logs->size;
-    for (uint16_t i = 0; i < logs->size; i++) {
-        log.length += logs->logs[i].length / logSize;
-        log.ties += logs->logs[i].ties / logSize;
-
-        for (uint8_t j = 0; j < numDrones; j++) {
-            log.stats[j].reward += logs->logs[i].stats[j].reward / logSize;
-            log.stats[j].wins += logs->logs[i].stats[j].wins / logSize;
-
-            log.stats[j].distanceTraveled += logs->logs[i].stats[j].distanceTraveled / logSize;
-            log.stats[j].absDistanceTraveled += logs->logs[i].stats[j].absDistanceTraveled / logSize;
-            log.stats[j].brakeTime += logs->logs[i].stats[j].brakeTime / logSize;
-            log.stats[j].totalBursts += logs->logs[i].stats[j].totalBursts / logSize;
-            log.stats[j].burstsHit += logs->logs[i].stats[j].burstsHit / logSize;
-            log.stats[j].energyEmptied += logs->logs[i].stats[j].energyEmptied / logSize;
-
-            for (uint8_t k = 0; k < NUM_WEAPONS; k++) {
-                log.stats[j].shotsFired[k] += logs->logs[i].stats[j].shotsFired[k] / logSize;
-                log.stats[j].shotsHit[k] += logs->logs[i].stats[j].shotsHit[k] / logSize;
-                log.stats[j].shotsTaken[k] += logs->logs[i].stats[j].shotsTaken[k] / logSize;
-                log.stats[j].ownShotsTaken[k] += logs->logs[i].stats[j].ownShotsTaken[k] / logSize;
-                log.stats[j].weaponsPickedUp[k] += logs->logs[i].stats[j].weaponsPickedUp[k] / logSize;
-                log.stats[j].shotDistances[k] += logs->logs[i].stats[j].shotDistances[k] / logSize;
-            }
+// combines the statistics of src into dst, both must have been created
+// for the same number of drones and both or neither must track spread
+void mergeLogBuffer(logBuffer *dst, const logBuffer *src) {
+    ASSERT(dst->numFields == src->numFields);
+    ASSERT((dst->m2 == NULL) == (src->m2 == NULL));
+    if (src->count == 0) {
+        return;
+    }
+    if (dst->count == 0) {
+        dst->count = src->count;
+        memcpy(dst->mean, src->mean, src->numFields * sizeof(double));
+        if (src->m2 != NULL) {
+            memcpy(dst->m2, src->m2, src->numFields * sizeof(double));
+            memcpy(dst->min, src->min, src->numFields * sizeof(float));
+            memcpy(dst->max, src->max, src->numFields * sizeof(float));
+        }
+        return;
+    }
+
+    const double count = (double)dst->count + src->count;
+    const double srcWeight = src->count / count;
+    const double crossWeight = ((double)dst->count * src->count) / count;
+    for (uint16_t i = 0; i < dst->numFields; i++) {
+        const double delta = src->mean[i] - dst->mean[i];
+        dst->mean[i] += delta * srcWeight;
+        if (dst->m2 != NULL) {
+            dst->m2[i] += src->m2[i] + (delta * delta * crossWeight);
+            dst->min[i] = fminf(dst->min[i], src->min[i]);
+            dst->max[i] = fmaxf(dst->max[i], src->max[i]);
+        }
+    }
+    dst->count += src->count;
+}
+
+// merges the log buffers of envs and clears them, returns the number of
+// episodes logged. out holds LOG_ENTRY_FIELDS means followed by the
+// standard deviations, mins and maxes of fields if spread is tracked;
+// fields of drones that don't exist are left as they are
+uint32_t aggregateAndClearLogBuffers(env *envs, const uint16_t numEnvs, float *out) {
+    logBuffer *logs = envs[0].logs;
+    for (uint16_t i = 1; i < numEnvs; i++) {
+        mergeLogBuffer(logs, envs[i].logs);
+        clearLogBuffer(envs[i].logs);
+    }
+
+    const uint32_t count = logs->count;
+    if (count == 0) {
+        return 0;
+    }
+    DEBUG_LOGF("aggregating logs of %u episodes", count);
+
+    for (uint16_t i = 0; i < logs->numFields; i++) {
+        out[i] = logs->mean[i];
+    }
+    if (logs->m2 != NULL) {
+        float *std = out + LOG_ENTRY_FIELDS;
+        float *min = std + LOG_ENTRY_FIELDS;
+        float *max = min + LOG_ENTRY_FIELDS;
+        for (uint16_t i = 0; i < logs->numFields; i++) {
+            std[i] = sqrt(logs->m2[i] / count);
+            min[i] = logs->min[i];
+            max[i] = logs->max[i];
         }
     }
 
-    logs->size = 0;
-    return log;
+    clearLogBuffer(logs);
+    return count;
 }
 
 // returns a cell index that is closest to pos that isn't cellIdx
 uint16_t findNearestCell(const env *e, const b2Vec2 pos, const uint16_t cellIdx) {
     uint16_t closestCell = cellIdx;
     float minDistance = FLT_MAX;
-    const uint8_t cellCol = cellIdx / e->map->columns;
-    const uint8_t cellRow = cellIdx % e->map->columns;
+    const uint8_t cellCol = cellIdx % e->map->columns;
+    const uint8_t cellRow = cellIdx / e->map->columns;
     for (uint8_t i = 0; i < 8; i++) {
-        const int8_t newCellCol = cellCol + cellOffsets[i][0];
+        const int16_t newCellCol = cellCol + cellOffsets[i][0];
         if (newCellCol < 0 || newCellCol >= e->map->columns) {
             continue;
         }
-        const int8_t newCellRow = cellRow + cellOffsets[i][1];
+        const int16_t newCellRow = cellRow + cellOffsets[i][1];
         if (newCellRow < 0 || newCellRow >= e->map->rows) {
             continue;
         }
         const int16_t newCellIdx = cellIndex(e, newCellCol, newCellRow);
         const mapCell *cell = safe_array_get_at(e->cells, newCellIdx);
-        if (minDistance != min(minDistance, b2DistanceSquared(pos, cell->pos))) {
+        const float distance = b2DistanceSquared(pos, cell->pos);
+        if (distance < minDistance) {
+            minDistance = distance;
             closestCell = newCellIdx;
         }
     }
@@ -127,31 +212,99 @@ static inline float scaleAmmo(const env *e, const droneEntity *drone) {
     return scaledAmmo;
 }
 
+// positions and distances in large arenas can be outside of the
+// observed range, clamp them to the edge of it
+static inline float scalePos(const float v, const float max) {
+    return scaleValue(min(max(v, -max), max), max, false);
+}
+
+static inline float scaleDistance(const float v, const float max) {
+    return scaleValue(min(v, max), max, true);
+}
+
+// finds the drones the agent observes, in order of drone index; when
+// there are more other drones than can be observed only the nearest
+// living drones are chosen so observation cost doesn't grow with the
+// number of drones
+static FORCE_INLINE uint8_t findNearDrones(const env *e, const droneEntity *agentDrone, const uint8_t numDrones, uint8_t nearDrones[_MAX_ENEMY_DRONE_OBS]) {
+    uint8_t numNearDrones = 0;
+    if (numDrones - 1 <= MAX_ENEMY_DRONE_OBS) {
+        for (uint8_t i = 0; i < numDrones; i++) {
+            if (i != agentDrone->idx) {
+                nearDrones[numNearDrones++] = i;
+            }
+        }
+        // returned as numDrones - 1 so it's a constant when numDrones is
+        return numDrones - 1;
+    }
+
+    // keep the nearest drones sorted by distance
+    nearEntity nearest[_MAX_ENEMY_DRONE_OBS];
+    for (uint8_t i = 0; i < numDrones; i++) {
+        if (i == agentDrone->idx) {
+            continue;
+        }
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        float distanceSquared = FLT_MAX;
+        if (drone->livesLeft != 0) {
+            distanceSquared = b2DistanceSquared(drone->pos, agentDrone->pos);
+        }
+        if (numNearDrones == MAX_ENEMY_DRONE_OBS && distanceSquared >= nearest[numNearDrones - 1].distanceSquared) {
+            continue;
+        }
+
+        uint8_t j = numNearDrones;
+        if (numNearDrones < MAX_ENEMY_DRONE_OBS) {
+            numNearDrones++;
+        } else {
+            j--;
+        }
+        while (j > 0 && nearest[j - 1].distanceSquared > distanceSquared) {
+            nearest[j] = nearest[j - 1];
+            j--;
+        }
+        nearest[j] = (nearEntity){.idx = i, .distanceSquared = distanceSquared};
+    }
+
+    // sort the chosen drones by index
+    for (uint8_t i = 0; i < numNearDrones; i++) {
+        const uint8_t droneIdx = nearest[i].idx;
+        uint8_t j = i;
+        while (j > 0 && nearDrones[j - 1] > droneIdx) {
+            nearDrones[j] = nearDrones[j - 1];
+            j--;
+        }
+        nearDrones[j] = droneIdx;
+    }
+
+    return numNearDrones;
+}
+
 // fills a small 2D grid centered around the agent with discretized
 // walls, floating walls, weapon pickups, and drone positions
-void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset) {
+static FORCE_INLINE void computeMapObs(env *e, const obsProfile *profile, const uint8_t agentIdx, uint8_t *obs, const uint8_t *nearDrones, const uint8_t numNearDrones) {
     droneEntity *drone = safe_array_get_at(e->drones, agentIdx);
     const uint8_t droneCellCol = drone->mapCellIdx % e->map->columns;
     const uint8_t droneCellRow = drone->mapCellIdx / e->map->columns;
 
-    const int8_t obsStartCol = droneCellCol - (MAP_OBS_COLUMNS / 2);
-    const int8_t startCol = max(obsStartCol, 0);
-    const int8_t obsStartRow = droneCellRow - (MAP_OBS_ROWS / 2);
-    const int8_t startRow = max(obsStartRow, 0);
+    const int16_t obsStartCol = droneCellCol - (profile->mapObsColumns / 2);
+    const int16_t startCol = max(obsStartCol, 0);
+    const int16_t obsStartRow = droneCellRow - (profile->mapObsRows / 2);
+    const int16_t startRow = max(obsStartRow, 0);
 
-    const int8_t obsEndCol = droneCellCol + (MAP_OBS_COLUMNS / 2);
-    const int8_t endCol = min(obsEndCol, e->map->columns - 1);
-    const int8_t endRow = min(droneCellRow + (MAP_OBS_ROWS / 2), e->map->rows - 1);
+    const int16_t obsEndCol = droneCellCol + (profile->mapObsColumns / 2);
+    const int16_t endCol = min(obsEndCol, e->map->columns - 1);
+    const int16_t endRow = min(droneCellRow + (profile->mapObsRows / 2), e->map->rows - 1);
 
     const int8_t obsColOffset = startCol - obsStartCol;
     const int8_t obsRowOffset = startRow - obsStartRow;
-    uint16_t startOffset = obsStartOffset;
+    uint16_t startOffset = 0;
     if (obsColOffset == 0 && obsRowOffset != 0) {
-        startOffset += obsRowOffset * MAP_OBS_COLUMNS;
+        startOffset += obsRowOffset * profile->mapObsColumns;
     } else if (obsColOffset != 0 && obsRowOffset == 0) {
         startOffset += obsColOffset;
     } else if (obsColOffset != 0 && obsRowOffset != 0) {
-        startOffset += obsColOffset + (obsRowOffset * MAP_OBS_COLUMNS);
+        startOffset += obsColOffset + (obsRowOffset * profile->mapObsColumns);
     }
     uint16_t offset = startOffset;
 
@@ -159,10 +312,10 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
     if (!e->suddenDeathWallsPlaced) {
         // copy precomputed map layout if sudden death walls haven't been placed
         const int8_t numCols = endCol - startCol + 1;
-        for (int8_t row = startRow; row <= endRow; row++) {
+        for (int16_t row = startRow; row <= endRow; row++) {
             const int16_t cellIdx = cellIndex(e, startCol, row);
-            memcpy(e->obs + offset, e->map->packedLayout + cellIdx, numCols * sizeof(uint8_t));
-            offset += MAP_OBS_COLUMNS;
+            memcpy(obs + offset, e->mapData->packedLayout + cellIdx, numCols * sizeof(uint8_t));
+            offset += profile->mapObsColumns;
         }
 
         // compute discretized location of weapon pickups on grid
@@ -177,15 +330,15 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
                 continue;
             }
 
-            offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * MAP_OBS_COLUMNS));
-            ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset: %d", offset);
-            e->obs[offset] |= 1 << 3;
+            offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * profile->mapObsColumns));
+            ASSERTF(offset <= startOffset + profile->mapObsSize, "offset: %d", offset);
+            obs[offset] |= 1 << 3;
         }
     } else {
         // sudden death walls have been placed so compute may layout manually
         const int8_t colPadding = obsColOffset + (obsEndCol - endCol);
-        for (int8_t row = startRow; row <= endRow; row++) {
-            for (int8_t col = startCol; col <= endCol; col++) {
+        for (int16_t row = startRow; row <= endRow; row++) {
+            for (int16_t col = startCol; col <= endCol; col++) {
                 const int16_t cellIdx = cellIndex(e, col, row);
                 const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
                 if (cell->ent == NULL) {
@@ -194,16 +347,16 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
                 }
 
                 if (entityTypeIsWall(cell->ent->type)) {
-                    e->obs[offset] = ((cell->ent->type + 1) & TWO_BIT_MASK) << 5;
+                    obs[offset] = ((cell->ent->type + 1) & TWO_BIT_MASK) << 5;
                 } else if (cell->ent->type == WEAPON_PICKUP_ENTITY) {
-                    e->obs[offset] |= 1 << 3;
+                    obs[offset] |= 1 << 3;
                 }
 
                 offset++;
             }
             offset += colPadding;
         }
-        ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset %u startOffset %u", offset, startOffset);
+        ASSERTF(offset <= startOffset + profile->mapObsSize, "offset %u startOffset %u", offset, startOffset);
     }
 
     // compute discretized locations of floating walls on grid
@@ -218,29 +371,22 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
             continue;
         }
 
-        offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * MAP_OBS_COLUMNS));
-        ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset: %d", offset);
-        e->obs[offset] = ((wall->type + 1) & TWO_BIT_MASK) << 5;
-        e->obs[offset] |= 1 << 4;
+        offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * profile->mapObsColumns));
+        ASSERTF(offset <= startOffset + profile->mapObsSize, "offset: %d", offset);
+        obs[offset] = ((wall->type + 1) & TWO_BIT_MASK) << 5;
+        obs[offset] |= 1 << 4;
     }
 
     // compute discretized location and index of drones on grid
     uint8_t newDroneIdx = 1;
-    uint16_t droneCells[e->numDrones];
-    memset(droneCells, 0x0, sizeof(droneCells));
-    for (uint8_t i = 0; i < cc_array_size(e->drones); i++) {
-        if (i == agentIdx) {
-            continue;
-        }
-
+    uint16_t droneCells[_MAX_ENEMY_DRONE_OBS] = {0};
+    for (uint8_t i = 0; i < numNearDrones; i++) {
         // ensure drones do not share cells in the observation
-        droneEntity *otherDrone = safe_array_get_at(e->drones, i);
-        if (i != 0) {
-            for (uint8_t j = 0; j < i; j++) {
-                if (droneCells[j] == otherDrone->mapCellIdx) {
-                    otherDrone->mapCellIdx = findNearestCell(e, otherDrone->pos, otherDrone->mapCellIdx);
-                    break;
-                }
+        droneEntity *otherDrone = safe_array_get_at(e->drones, nearDrones[i]);
+        for (uint8_t j = 0; j < i; j++) {
+            if (droneCells[j] == otherDrone->mapCellIdx) {
+                otherDrone->mapCellIdx = findNearestCell(e, otherDrone->pos, otherDrone->mapCellIdx);
+                break;
             }
         }
         const uint8_t cellCol = otherDrone->mapCellIdx % e->map->columns;
@@ -253,36 +399,36 @@ void computeMapObs(env *e, const uint8_t agentIdx, const uint16_t obsStartOffset
         }
         droneCells[i] = otherDrone->mapCellIdx;
 
-        offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * MAP_OBS_COLUMNS));
-        ASSERTF(offset <= startOffset + MAP_OBS_SIZE, "offset: %d", offset);
-        e->obs[offset] |= (newDroneIdx++ & THREE_BIT_MASK);
+        offset = startOffset + ((cellCol - startCol) + ((cellRow - startRow) * profile->mapObsColumns));
+        ASSERTF(offset <= startOffset + profile->mapObsSize, "offset: %d", offset);
+        obs[offset] |= (newDroneIdx++ & THREE_BIT_MASK);
     }
 }
 
 #ifndef AUTOPXD
 // computes observations for N nearest walls, floating walls, and weapon pickups
-void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObsStart, float *continuousObs) {
-    nearEntity nearWalls[NUM_NEAR_WALL_OBS];
-    findNearWalls(e, drone, nearWalls, NUM_NEAR_WALL_OBS);
+static FORCE_INLINE void computeNearObs(env *e, const obsProfile *profile, const droneEntity *drone, uint8_t *discreteObs, float *continuousObs) {
+    nearEntity nearWalls[_MAX_NEAR_WALL_OBS];
+    findNearWalls(e, drone, nearWalls, profile->numNearWallObs);
 
     uint16_t offset;
 
     // compute type and position of N nearest walls
-    for (uint8_t i = 0; i < NUM_NEAR_WALL_OBS; i++) {
+    for (uint8_t i = 0; i < profile->numNearWallObs; i++) {
         const wallEntity *wall = nearWalls[i].entity;
 
-        offset = discreteObsStart + NEAR_WALL_TYPES_OBS_OFFSET + i;
-        ASSERTF(offset <= discreteObsStart + FLOATING_WALL_TYPES_OBS_OFFSET, "offset: %d", offset);
-        e->obs[offset] = wall->type;
+        offset = profile->nearWallTypesObsOffset + i;
+        ASSERTF(offset <= profile->floatingWallTypesObsOffset, "offset: %d", offset);
+        discreteObs[offset] = wall->type;
 
         // DEBUG_LOGF("wall %d cell %d", i, wall->mapCellIdx);
 
-        offset = NEAR_WALL_POS_OBS_OFFSET + (i * NEAR_WALL_POS_OBS_SIZE);
-        ASSERTF(offset <= FLOATING_WALL_INFO_OBS_OFFSET, "offset: %d", offset);
+        offset = profile->nearWallPosObsOffset + (i * NEAR_WALL_POS_OBS_SIZE);
+        ASSERTF(offset <= profile->floatingWallInfoObsOffset, "offset: %d", offset);
         const b2Vec2 wallRelPos = b2Sub(wall->pos, drone->pos);
 
-        continuousObs[offset++] = scaleValue(wallRelPos.x, MAX_X_POS, false);
-        continuousObs[offset] = scaleValue(wallRelPos.y, MAX_Y_POS, false);
+        continuousObs[offset++] = scalePos(wallRelPos.x, MAX_X_POS);
+        continuousObs[offset] = scalePos(wallRelPos.y, MAX_Y_POS);
     }
 
     if (cc_array_size(e->floatingWalls) != 0) {
@@ -300,25 +446,25 @@ void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObs
 
         // compute type, position, angle and velocity of N nearest floating walls
         for (uint8_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
-            if (i == NUM_FLOATING_WALL_OBS) {
+            if (i == profile->numFloatingWallObs) {
                 break;
             }
             const wallEntity *wall = nearFloatingWalls[i].entity;
 
             const b2Transform wallTransform = b2Body_GetTransform(wall->bodyID);
-            const b2Vec2 wallRelPos = b2Sub(wallTransform.p, drone->pos);
+            const b2Vec2 wallRelPos = b2Sub(worldToArenaPos(e, wallTransform.p), drone->pos);
             const float angle = b2Rot_GetAngle(wallTransform.q);
 
-            offset = discreteObsStart + FLOATING_WALL_TYPES_OBS_OFFSET + i;
-            ASSERTF(offset <= discreteObsStart + PROJECTILE_DRONE_OBS_OFFSET, "offset: %d", offset);
-            e->obs[offset] = wall->type + 1;
+            offset = profile->floatingWallTypesObsOffset + i;
+            ASSERTF(offset <= profile->projectileDroneObsOffset, "offset: %d", offset);
+            discreteObs[offset] = wall->type + 1;
 
             // DEBUG_LOGF("floating wall %d cell %d", i, wall->mapCellIdx);
 
-            offset = FLOATING_WALL_INFO_OBS_OFFSET + (i * FLOATING_WALL_INFO_OBS_SIZE);
-            ASSERTF(offset <= WEAPON_PICKUP_POS_OBS_OFFSET, "offset: %d", offset);
-            continuousObs[offset++] = scaleValue(wallRelPos.x, MAX_X_POS, false);
-            continuousObs[offset++] = scaleValue(wallRelPos.y, MAX_Y_POS, false);
+            offset = profile->floatingWallInfoObsOffset + (i * FLOATING_WALL_INFO_OBS_SIZE);
+            ASSERTF(offset <= profile->weaponPickupPosObsOffset, "offset: %d", offset);
+            continuousObs[offset++] = scalePos(wallRelPos.x, MAX_X_POS);
+            continuousObs[offset++] = scalePos(wallRelPos.y, MAX_Y_POS);
             continuousObs[offset++] = scaleValue(angle, MAX_ANGLE, false);
             continuousObs[offset++] = scaleValue(wall->velocity.x, MAX_SPEED, false);
             continuousObs[offset] = scaleValue(wall->velocity.y, MAX_SPEED, false);
@@ -340,28 +486,230 @@ void computeNearObs(env *e, const droneEntity *drone, const uint16_t discreteObs
 
         // compute type and location of N nearest weapon pickups
         for (uint8_t i = 0; i < cc_array_size(e->pickups); i++) {
-            if (i == NUM_WEAPON_PICKUP_OBS) {
+            if (i == profile->numWeaponPickupObs) {
                 break;
             }
             const weaponPickupEntity *pickup = nearPickups[i].entity;
 
-            offset = discreteObsStart + WEAPON_PICKUP_WEAPONS_OBS_OFFSET + i;
-            ASSERTF(offset <= discreteObsStart + ENEMY_DRONE_WEAPONS_OBS_OFFSET, "offset: %d", offset);
-            e->obs[offset] = pickup->weapon + 1;
+            offset = profile->weaponPickupWeaponsObsOffset + i;
+            ASSERTF(offset <= profile->enemyDroneWeaponsObsOffset, "offset: %d", offset);
+            discreteObs[offset] = pickup->weapon + 1;
 
             // DEBUG_LOGF("pickup %d cell %d", i, pickup->mapCellIdx);
 
-            offset = WEAPON_PICKUP_POS_OBS_OFFSET + (i * WEAPON_PICKUP_POS_OBS_SIZE);
-            ASSERTF(offset <= PROJECTILE_INFO_OBS_OFFSET, "offset: %d", offset);
+            offset = profile->weaponPickupPosObsOffset + (i * WEAPON_PICKUP_POS_OBS_SIZE);
+            ASSERTF(offset <= profile->projectileInfoObsOffset, "offset: %d", offset);
             const b2Vec2 pickupRelPos = b2Sub(pickup->pos, drone->pos);
-            continuousObs[offset++] = scaleValue(pickupRelPos.x, MAX_X_POS, false);
-            continuousObs[offset] = scaleValue(pickupRelPos.y, MAX_Y_POS, false);
+            continuousObs[offset++] = scalePos(pickupRelPos.x, MAX_X_POS);
+            continuousObs[offset] = scalePos(pickupRelPos.y, MAX_Y_POS);
         }
     }
 }
 #endif
 
-void computeObs(env *e) {
+// computes the observations of a drone into obs; numDrones and the
+// profile are compile time constants in specialized variants so offsets
+// fold and loops over drones can be unrolled
+static FORCE_INLINE void computeDroneObs(env *e, const obsProfile *profile, droneEntity *agentDrone, const uint8_t numDrones, const enum obsFormat format, uint8_t *obs) {
+    const uint8_t numEnemyObs = numEnemyDroneObs(numDrones);
+    const uint16_t agentDiscreteObsBytes = profile->discreteObsBytes;
+    const uint16_t numContinuousObs = profile->continuousObsSize;
+
+    // compute discrete map observations
+    memset(obs, 0x0, obsBytesInFormat(profile, format));
+    uint8_t nearDrones[_MAX_ENEMY_DRONE_OBS];
+    const uint8_t numNearDrones = findNearDrones(e, agentDrone, numDrones, nearDrones);
+    computeMapObs(e, profile, agentDrone->idx, obs, nearDrones, numNearDrones);
+
+    // compute continuous observations
+    uint16_t discreteObsOffset;
+    uint16_t continuousObsOffset;
+    float *continuousObs = (float *)(obs + agentDiscreteObsBytes);
+    // quantized continuous obs are computed as floats and converted
+    // after they're all written
+    float quantizeScratch[numContinuousObs];
+    if (format != FLOAT32_OBS) {
+        memset(quantizeScratch, 0x0, numContinuousObs * sizeof(float));
+        continuousObs = quantizeScratch;
+    }
+
+    computeNearObs(e, profile, agentDrone, obs, continuousObs);
+
+    // find the nearest projectiles sorted by distance to the current
+    // agent, only as many as the profile observes are kept
+    const b2Vec2 agentPos = agentDrone->pos;
+    const uint8_t maxProjectiles = profile->numProjectileObs;
+    projectileEntity *nearProjectiles[_MAX_PROJECTILE_OBS];
+    float nearDistances[_MAX_PROJECTILE_OBS];
+    uint8_t numNearProjectiles = 0;
+    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        projectileEntity *projectile = e->projectiles->buffer[i];
+        const float distance = b2DistanceSquared(agentPos, projectile->pos);
+        if (numNearProjectiles == maxProjectiles && (maxProjectiles == 0 || distance >= nearDistances[maxProjectiles - 1])) {
+            continue;
+        }
+
+        uint8_t j = numNearProjectiles;
+        if (numNearProjectiles < maxProjectiles) {
+            numNearProjectiles++;
+        } else {
+            j--;
+        }
+        while (j > 0 && nearDistances[j - 1] > distance) {
+            nearProjectiles[j] = nearProjectiles[j - 1];
+            nearDistances[j] = nearDistances[j - 1];
+            j--;
+        }
+        nearProjectiles[j] = projectile;
+        nearDistances[j] = distance;
+    }
+
+    // compute type and location of N projectiles
+    for (uint8_t i = 0; i < numNearProjectiles; i++) {
+        const projectileEntity *projectile = nearProjectiles[i];
+
+        discreteObsOffset = profile->projectileDroneObsOffset + i;
+        ASSERTF(discreteObsOffset <= profile->projectileWeaponsObsOffset, "offset: %d", discreteObsOffset);
+        obs[discreteObsOffset] = projectile->droneIdx + 1;
+
+        discreteObsOffset = profile->projectileWeaponsObsOffset + i;
+        ASSERTF(discreteObsOffset <= profile->weaponPickupWeaponsObsOffset, "offset: %d", discreteObsOffset);
+        obs[discreteObsOffset] = projectile->weaponInfo->type + 1;
+
+        continuousObsOffset = profile->projectileInfoObsOffset + (i * PROJECTILE_INFO_OBS_SIZE);
+        ASSERTF(continuousObsOffset <= profile->lidarObsOffset, "offset: %d", continuousObsOffset);
+        const b2Vec2 projectileRelPos = b2Sub(projectile->pos, agentDrone->pos);
+        continuousObs[continuousObsOffset++] = scalePos(projectileRelPos.x, MAX_X_POS);
+        continuousObs[continuousObsOffset++] = scalePos(projectileRelPos.y, MAX_Y_POS);
+        continuousObs[continuousObsOffset++] = scaleValue(projectile->velocity.x, MAX_SPEED, false);
+        continuousObs[continuousObsOffset] = scaleValue(projectile->velocity.y, MAX_SPEED, false);
+    }
+
+    if (profile->numLidarRays != 0) {
+        computeLidarObs(e, agentDrone, profile->numLidarRays, continuousObs + profile->lidarObsOffset);
+    }
+
+    // compute enemy drone observations
+    bool hitShot = false;
+    bool tookShot = false;
+    droneMask hitDrones = agentDrone->stepInfo.hitDrones & ~droneBit(agentDrone->idx);
+    while (hitDrones != 0) {
+        const uint8_t i = popDroneIdx(&hitDrones);
+        if (agentDrone->stepInfo.shotHit[i]) {
+            hitShot = true;
+        }
+        if (agentDrone->stepInfo.shotTaken[i]) {
+            tookShot = true;
+        }
+    }
+
+    uint8_t processedDrones = 0;
+    for (uint8_t i = 0; i < numNearDrones; i++) {
+        droneEntity *enemyDrone = safe_array_get_at(e->drones, nearDrones[i]);
+        if (enemyDrone->livesLeft == 0) {
+            processedDrones++;
+            continue;
+        }
+
+        const b2Vec2 enemyDroneRelPos = b2Sub(enemyDrone->pos, agentDrone->pos);
+        const float enemyDroneDistance = b2Distance(enemyDrone->pos, agentDrone->pos);
+        const b2Vec2 enemyDroneAccel = b2Sub(enemyDrone->velocity, enemyDrone->lastVelocity);
+        const b2Vec2 enemyDroneRelNormPos = b2Normalize(b2Sub(enemyDrone->pos, agentDrone->pos));
+        const float enemyDroneAimAngle = atan2f(enemyDrone->lastAim.y, enemyDrone->lastAim.x);
+        float enemyDroneBraking = 0.0f;
+        if (enemyDrone->braking) {
+            enemyDroneBraking = 1.0f;
+        }
+
+        discreteObsOffset = profile->enemyDroneWeaponsObsOffset + processedDrones;
+        obs[discreteObsOffset] = enemyDrone->weaponInfo->type + 1;
+
+        continuousObsOffset = profile->enemyDroneObsOffset + (numEnemyObs - 1) + (processedDrones * ENEMY_DRONE_OBS_SIZE);
+        continuousObs[continuousObsOffset++] = enemyDrone->team == agentDrone->team;
+        continuousObs[continuousObsOffset++] = scalePos(enemyDroneRelPos.x, MAX_X_POS);
+        continuousObs[continuousObsOffset++] = scalePos(enemyDroneRelPos.y, MAX_Y_POS);
+        continuousObs[continuousObsOffset++] = scaleDistance(enemyDroneDistance, MAX_DISTANCE);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->velocity.x, MAX_SPEED, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->velocity.y, MAX_SPEED, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDroneAccel.x, MAX_ACCEL, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDroneAccel.y, MAX_ACCEL, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDroneRelNormPos.x, 1.0f, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDroneRelNormPos.y, 1.0f, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->lastAim.x, 1.0f, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->lastAim.y, 1.0f, false);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDroneAimAngle, PI, false);
+        continuousObs[continuousObsOffset++] = scaleAmmo(e, enemyDrone);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->weaponCooldown, enemyDrone->weaponInfo->coolDown, true);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->weaponCharge, enemyDrone->weaponInfo->charge, true);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->energyLeft, DRONE_ENERGY_MAX, true);
+        continuousObs[continuousObsOffset++] = (float)enemyDrone->energyFullyDepleted;
+        continuousObs[continuousObsOffset++] = enemyDroneBraking;
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->burstCooldown, DRONE_BURST_COOLDOWN, true);
+        continuousObs[continuousObsOffset++] = (float)enemyDrone->chargingBurst;
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->burstCharge, DRONE_ENERGY_MAX, true);
+        continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->livesLeft, DRONE_LIVES, true);
+        continuousObs[continuousObsOffset++] = !enemyDrone->dead;
+
+        processedDrones++;
+        ASSERTF(continuousObsOffset == profile->enemyDroneObsOffset + (numEnemyObs - 1) + (processedDrones * ENEMY_DRONE_OBS_SIZE), "offset: %d", continuousObsOffset);
+    }
+
+    // compute active drone observations
+    continuousObsOffset = profile->enemyDroneObsOffset + (numEnemyObs * ENEMY_DRONE_OBS_SIZE);
+    const b2Vec2 agentDroneAccel = b2Sub(agentDrone->velocity, agentDrone->lastVelocity);
+    float agentDroneBraking = 0.0f;
+    if (agentDrone->braking) {
+        agentDroneBraking = 1.0f;
+    }
+
+    discreteObsOffset = profile->enemyDroneWeaponsObsOffset + numEnemyObs;
+    obs[discreteObsOffset] = agentDrone->weaponInfo->type + 1;
+
+    continuousObs[continuousObsOffset++] = scalePos(agentDrone->pos.x, MAX_X_POS);
+    continuousObs[continuousObsOffset++] = scalePos(agentDrone->pos.y, MAX_Y_POS);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->velocity.x, MAX_SPEED, false);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->velocity.y, MAX_SPEED, false);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDroneAccel.x, MAX_ACCEL, false);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDroneAccel.y, MAX_ACCEL, false);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->lastAim.x, 1.0f, false);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->lastAim.y, 1.0f, false);
+    continuousObs[continuousObsOffset++] = scaleAmmo(e, agentDrone);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->weaponCooldown, agentDrone->weaponInfo->coolDown, true);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->weaponCharge, agentDrone->weaponInfo->charge, true);
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->energyLeft, DRONE_ENERGY_MAX, true);
+    continuousObs[continuousObsOffset++] = (float)agentDrone->energyFullyDepleted;
+    continuousObs[continuousObsOffset++] = agentDroneBraking;
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->burstCooldown, DRONE_BURST_COOLDOWN, true);
+    continuousObs[continuousObsOffset++] = (float)agentDrone->chargingBurst;
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->burstCharge, DRONE_ENERGY_MAX, true);
+    continuousObs[continuousObsOffset++] = hitShot;
+    continuousObs[continuousObsOffset++] = tookShot;
+    continuousObs[continuousObsOffset++] = agentDrone->stepInfo.ownShotTaken;
+    continuousObs[continuousObsOffset++] = scaleValue(agentDrone->livesLeft, DRONE_LIVES, true);
+    continuousObs[continuousObsOffset++] = !agentDrone->dead;
+
+    ASSERTF(continuousObsOffset == profile->miscObsOffset, "offset: %d", continuousObsOffset);
+    continuousObs[continuousObsOffset] = scaleValue(e->stepsLeft, e->totalSteps, true);
+
+    if (format == FLOAT16_OBS) {
+        floatsToHalves(continuousObs, (uint16_t *)(obs + agentDiscreteObsBytes), numContinuousObs);
+    } else if (format == INT16_OBS) {
+        floatsToFixed(continuousObs, (int16_t *)(obs + agentDiscreteObsBytes), numContinuousObs);
+    }
+}
+
+static inline void clearAgentObsHistory(const env *e, uint8_t *agentObs) {
+    memset(agentObs, 0x0, OBS_HISTORY_HEADER_BYTES + (e->obsHistoryLen * e->obsBytes));
+}
+
+static FORCE_INLINE void _computeObs(env *e, const obsProfile *profile, const uint8_t numDrones) {
+    // obs are written to the next slot of each agent's history ring
+    uint32_t slotOffset = 0;
+    if (e->obsHistoryLen != 0) {
+        e->obsHistorySlot = (e->obsHistorySlot + 1) % e->obsHistoryLen;
+        slotOffset = OBS_HISTORY_HEADER_BYTES + (e->obsHistorySlot * e->obsBytes);
+    }
+
     for (uint8_t agentIdx = 0; agentIdx < e->numAgents; agentIdx++) {
         droneEntity *agentDrone = safe_array_get_at(e->drones, agentIdx);
         // if the drone is dead, only compute observations if it died
@@ -370,164 +718,174 @@ void computeObs(env *e) {
             continue;
         }
 
-        // compute discrete map observations
-        const uint16_t discreteObsStart = e->obsBytes * agentIdx;
-        memset(e->obs + discreteObsStart, 0x0, e->obsBytes);
-        computeMapObs(e, agentIdx, discreteObsStart);
+        uint8_t *agentObs = e->obs + (agentIdx * e->obsStride);
+        if (e->obsHistoryLen != 0) {
+            // stacked obs never span a death
+            if (agentDrone->diedThisStep) {
+                clearAgentObsHistory(e, agentObs);
+            }
+            agentObs[0] = e->obsHistorySlot;
+            agentObs[1] = min(agentObs[1] + 1, e->obsHistoryLen);
+        }
+        computeDroneObs(e, profile, agentDrone, numDrones, e->obsFormat, agentObs + slotOffset);
+    }
+}
 
-        // compute continuous observations
-        uint16_t discreteObsOffset;
-        uint16_t continuousObsOffset;
-        const uint16_t continuousObsStart = discreteObsStart + e->discreteObsBytes;
-        float *continuousObs = (float *)(e->obs + continuousObsStart);
+// generate observation functions specialized for common drone counts
+// with the default obs profile, laid out here so its offsets are
+// constants
+#define DEFINE_COMPUTE_OBS(numDrones)                                                                                                                                               \
+    void computeObs##numDrones(env *e) {                                                                                                                                            \
+        obsProfile profile;                                                                                                                                                         \
+        layoutObsProfile(&profile, numDrones, _MAX_MAP_OBS_ROWS, _MAX_MAP_OBS_COLUMNS, _MAX_NEAR_WALL_OBS, _MAX_FLOATING_WALL_OBS, _MAX_PROJECTILE_OBS, _MAX_WEAPON_PICKUP_OBS, 0); \
+        _computeObs(e, &profile, numDrones);                                                                                                                                        \
+    }
 
-        computeNearObs(e, agentDrone, discreteObsStart, continuousObs);
+DEFINE_COMPUTE_OBS(2)
+DEFINE_COMPUTE_OBS(3)
+DEFINE_COMPUTE_OBS(4)
 
-        // sort projectiles by distance to the current agent
-        const b2Vec2 agentPos = agentDrone->pos;
-        const size_t numProjectiles = cc_array_size(e->projectiles);
-        projectileEntity *sortedProjectiles[numProjectiles];
-        memcpy(sortedProjectiles, e->projectiles->buffer, numProjectiles * sizeof(projectileEntity *));
+void computeObsAnyDrones(env *e) {
+    _computeObs(e, &e->obsProfile, e->numDrones);
+}
 
-        for (int16_t i = 1; i < (int64_t)numProjectiles; i++) {
-            projectileEntity *key = sortedProjectiles[i];
-            const float keyDistance = b2DistanceSquared(agentPos, key->pos);
-            int16_t j = i - 1;
+void selectComputeObs(env *e) {
+    obsProfile profile;
+    defaultObsProfile(&profile, e->numDrones);
+    if (memcmp(&profile, &e->obsProfile, sizeof(obsProfile)) != 0) {
+        e->computeObs = computeObsAnyDrones;
+        return;
+    }
 
-            while (j >= 0 && b2DistanceSquared(agentPos, sortedProjectiles[j]->pos) > keyDistance) {
-                sortedProjectiles[j + 1] = sortedProjectiles[j];
-                j = j - 1;
-            }
+    switch (e->numDrones) {
+    case 2:
+        e->computeObs = computeObs2;
+        break;
+    case 3:
+        e->computeObs = computeObs3;
+        break;
+    case 4:
+        e->computeObs = computeObs4;
+        break;
+    default:
+        e->computeObs = computeObsAnyDrones;
+    }
+}
 
-            sortedProjectiles[j + 1] = key;
+// one hot encodes each field of the bit packed map obs into its own
+// plane of floats
+static inline void decodeMapObs(const uint8_t *mapObs, float *out, const uint16_t mapObsSize, const uint8_t numDroneChannels) {
+    const uint8_t wallChannels = NUM_WALL_TYPES + 1;
+    float *floatingWallPlane = out + (wallChannels * mapObsSize);
+    float *pickupPlane = floatingWallPlane + mapObsSize;
+    float *dronePlanes = pickupPlane + mapObsSize;
+
+    uint16_t i = 0;
+#ifdef USE_AVX2
+    // decode 8 cells at a time, comparisons produce all set lanes which
+    // are masked into 1.0f
+    const __m256 ones = _mm256_set1_ps(1.0f);
+    for (; i + 8 <= mapObsSize; i += 8) {
+        uint64_t packed;
+        memcpy(&packed, mapObs + i, sizeof(packed));
+        const __m256i cells = _mm256_cvtepu8_epi32(_mm_cvtsi64_si128(packed));
+        const __m256i wallTypes = _mm256_and_si256(_mm256_srli_epi32(cells, 5), _mm256_set1_epi32(TWO_BIT_MASK));
+        const __m256i floatingWalls = _mm256_and_si256(_mm256_srli_epi32(cells, 4), _mm256_set1_epi32(1));
+        const __m256i pickups = _mm256_and_si256(_mm256_srli_epi32(cells, 3), _mm256_set1_epi32(1));
+        const __m256i drones = _mm256_and_si256(cells, _mm256_set1_epi32(THREE_BIT_MASK));
+
+        for (uint8_t c = 0; c < wallChannels; c++) {
+            const __m256 set = _mm256_castsi256_ps(_mm256_cmpeq_epi32(wallTypes, _mm256_set1_epi32(c)));
+            _mm256_storeu_ps(out + (c * mapObsSize) + i, _mm256_and_ps(set, ones));
         }
+        _mm256_storeu_ps(floatingWallPlane + i, _mm256_cvtepi32_ps(floatingWalls));
+        _mm256_storeu_ps(pickupPlane + i, _mm256_cvtepi32_ps(pickups));
+        for (uint8_t c = 0; c < numDroneChannels; c++) {
+            const __m256 set = _mm256_castsi256_ps(_mm256_cmpeq_epi32(drones, _mm256_set1_epi32(c)));
+            _mm256_storeu_ps(dronePlanes + (c * mapObsSize) + i, _mm256_and_ps(set, ones));
+        }
+    }
+#endif
+    for (; i < mapObsSize; i++) {
+        const uint8_t cell = mapObs[i];
+        const uint8_t wallType = (cell >> 5) & TWO_BIT_MASK;
+        for (uint8_t c = 0; c < wallChannels; c++) {
+            out[(c * mapObsSize) + i] = wallType == c;
+        }
+        floatingWallPlane[i] = (cell >> 4) & 1;
+        pickupPlane[i] = (cell >> 3) & 1;
+        const uint8_t droneIdx = cell & THREE_BIT_MASK;
+        for (uint8_t c = 0; c < numDroneChannels; c++) {
+            dronePlanes[(c * mapObsSize) + i] = droneIdx == c;
+        }
+    }
+}
 
-        // compute type and location of N projectiles
-        for (size_t i = 0; i < numProjectiles; i++) {
-            if (i == NUM_PROJECTILE_OBS) {
-                break;
-            }
-            const projectileEntity *projectile = sortedProjectiles[i];
-
-            discreteObsOffset = discreteObsStart + PROJECTILE_DRONE_OBS_OFFSET + i;
-            ASSERTF(discreteObsOffset <= discreteObsStart + PROJECTILE_WEAPONS_OBS_OFFSET, "offset: %d", discreteObsOffset);
-            e->obs[discreteObsOffset] = projectile->droneIdx + 1;
-
-            discreteObsOffset = discreteObsStart + PROJECTILE_WEAPONS_OBS_OFFSET + i;
-            ASSERTF(discreteObsOffset <= discreteObsStart + WEAPON_PICKUP_WEAPONS_OBS_OFFSET, "offset: %d", discreteObsOffset);
-            e->obs[discreteObsOffset] = projectile->weaponInfo->type + 1;
+// decodes the bit packed obs of every agent into the layout the
+// policy's encoder takes so the learner doesn't have to
+void decodeObs(env *e) {
+    const obsProfile *profile = &e->obsProfile;
+    const uint8_t numDroneChannels = profile->numEnemyDroneObs + 1;
+    const uint16_t multihotOffset = decodedMultihotObsOffset(profile);
+    const uint16_t weaponTypesOffset = decodedWeaponTypesObsOffset(profile);
+    const uint16_t continuousOffset = decodedContinuousObsOffset(profile);
+    const uint16_t numWeaponTypeObs = weaponTypeObsSize(profile);
 
-            continuousObsOffset = PROJECTILE_INFO_OBS_OFFSET + (i * PROJECTILE_INFO_OBS_SIZE);
-            ASSERTF(continuousObsOffset <= ENEMY_DRONE_OBS_OFFSET, "offset: %d", continuousObsOffset);
-            const b2Vec2 projectileRelPos = b2Sub(projectile->pos, agentDrone->pos);
-            continuousObs[continuousObsOffset++] = scaleValue(projectileRelPos.x, MAX_X_POS, false);
-            continuousObs[continuousObsOffset++] = scaleValue(projectileRelPos.y, MAX_Y_POS, false);
-            continuousObs[continuousObsOffset++] = scaleValue(projectile->velocity.x, MAX_SPEED, false);
-            continuousObs[continuousObsOffset] = scaleValue(projectile->velocity.y, MAX_SPEED, false);
+    for (uint8_t agentIdx = 0; agentIdx < e->numAgents; agentIdx++) {
+        const uint8_t *obs = e->obs + (agentIdx * e->obsBytes);
+        float *decoded = e->decodedObs + (agentIdx * e->decodedObsSize);
+
+        decodeMapObs(obs, decoded, profile->mapObsSize, numDroneChannels);
+
+        // near wall types, floating wall types and projectile drone
+        // indexes are one hot encoded one after another
+        float *multihot = decoded + multihotOffset;
+        memset(multihot, 0x0, (weaponTypesOffset - multihotOffset) * sizeof(float));
+        uint16_t offset = 0;
+        for (uint8_t i = 0; i < profile->numNearWallObs; i++) {
+            offset += oneHotEncode(multihot, offset, obs[profile->nearWallTypesObsOffset + i], NUM_WALL_TYPES);
         }
+        for (uint8_t i = 0; i < profile->numFloatingWallObs; i++) {
+            offset += oneHotEncode(multihot, offset, obs[profile->floatingWallTypesObsOffset + i], NUM_WALL_TYPES + 1);
+        }
+        for (uint8_t i = 0; i < profile->numProjectileObs; i++) {
+            offset += oneHotEncode(multihot, offset, obs[profile->projectileDroneObsOffset + i], e->numDrones + 1);
+        }
+        ASSERTF(offset == weaponTypesOffset - multihotOffset, "offset: %d", offset);
 
-        // compute enemy drone observations
-        bool hitShot = false;
-        bool tookShot = false;
-        uint8_t processedDrones = 0;
-        for (uint8_t i = 0; i < e->numDrones; i++) {
-            if (i == agentIdx) {
-                continue;
-            }
-
-            if (agentDrone->stepInfo.shotHit[i]) {
-                hitShot = true;
-            }
-            if (agentDrone->stepInfo.shotTaken[i]) {
-                tookShot = true;
-            }
+        float *weaponTypes = decoded + weaponTypesOffset;
+        for (uint16_t i = 0; i < numWeaponTypeObs; i++) {
+            weaponTypes[i] = obs[profile->projectileWeaponsObsOffset + i];
+        }
 
-            droneEntity *enemyDrone = safe_array_get_at(e->drones, i);
-            if (enemyDrone->livesLeft == 0) {
-                processedDrones++;
-                continue;
-            }
+        memcpy(decoded + continuousOffset, obs + e->discreteObsBytes, profile->continuousObsSize * sizeof(float));
+    }
+}
 
-            const b2Vec2 enemyDroneRelPos = b2Sub(enemyDrone->pos, agentDrone->pos);
-            const float enemyDroneDistance = b2Distance(enemyDrone->pos, agentDrone->pos);
-            const b2Vec2 enemyDroneAccel = b2Sub(enemyDrone->velocity, enemyDrone->lastVelocity);
-            const b2Vec2 enemyDroneRelNormPos = b2Normalize(b2Sub(enemyDrone->pos, agentDrone->pos));
-            const float enemyDroneAimAngle = atan2f(enemyDrone->lastAim.y, enemyDrone->lastAim.x);
-            float enemyDroneBraking = 0.0f;
-            if (enemyDrone->braking) {
-                enemyDroneBraking = 1.0f;
-            }
+void computeObs(env *e) {
+    e->computeObs(e);
+    if (e->decodedObs != NULL) {
+        decodeObs(e);
+    }
+}
 
-            discreteObsOffset = discreteObsStart + ENEMY_DRONE_WEAPONS_OBS_OFFSET + processedDrones;
-            e->obs[discreteObsOffset] = enemyDrone->weaponInfo->type + 1;
-
-            continuousObsOffset = ENEMY_DRONE_OBS_OFFSET + (e->numDrones - 1) + (processedDrones * ENEMY_DRONE_OBS_SIZE);
-            continuousObs[continuousObsOffset++] = enemyDrone->team == agentDrone->team;
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneRelPos.x, MAX_X_POS, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneRelPos.y, MAX_Y_POS, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneDistance, MAX_DISTANCE, true);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->velocity.x, MAX_SPEED, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->velocity.y, MAX_SPEED, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneAccel.x, MAX_ACCEL, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneAccel.y, MAX_ACCEL, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneRelNormPos.x, 1.0f, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneRelNormPos.y, 1.0f, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->lastAim.x, 1.0f, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->lastAim.y, 1.0f, false);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDroneAimAngle, PI, false);
-            continuousObs[continuousObsOffset++] = scaleAmmo(e, enemyDrone);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->weaponCooldown, enemyDrone->weaponInfo->coolDown, true);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->weaponCharge, enemyDrone->weaponInfo->charge, true);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->energyLeft, DRONE_ENERGY_MAX, true);
-            continuousObs[continuousObsOffset++] = (float)enemyDrone->energyFullyDepleted;
-            continuousObs[continuousObsOffset++] = enemyDroneBraking;
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->burstCooldown, DRONE_BURST_COOLDOWN, true);
-            continuousObs[continuousObsOffset++] = (float)enemyDrone->chargingBurst;
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->burstCharge, DRONE_ENERGY_MAX, true);
-            continuousObs[continuousObsOffset++] = scaleValue(enemyDrone->livesLeft, DRONE_LIVES, true);
-            continuousObs[continuousObsOffset++] = !enemyDrone->dead;
+// computes the observations of a non-agent drone as if it was an agent,
+// opponent policies always take float observations
+void computeOpponentObs(env *e, droneEntity *drone, uint8_t *obs) {
+    computeDroneObs(e, &e->obsProfile, drone, e->numDrones, FLOAT32_OBS, obs);
+}
 
-            processedDrones++;
-            ASSERTF(continuousObsOffset == ENEMY_DRONE_OBS_OFFSET + (e->numDrones - 1) + (processedDrones * ENEMY_DRONE_OBS_SIZE), "offset: %d", continuousObsOffset);
-        }
-
-        // compute active drone observations
-        continuousObsOffset = ENEMY_DRONE_OBS_OFFSET + ((e->numDrones - 1) * ENEMY_DRONE_OBS_SIZE);
-        const b2Vec2 agentDroneAccel = b2Sub(agentDrone->velocity, agentDrone->lastVelocity);
-        float agentDroneBraking = 0.0f;
-        if (agentDrone->braking) {
-            agentDroneBraking = 1.0f;
-        }
-
-        discreteObsOffset = discreteObsStart + ENEMY_DRONE_WEAPONS_OBS_OFFSET + e->numDrones - 1;
-        e->obs[discreteObsOffset] = agentDrone->weaponInfo->type + 1;
-
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->pos.x, MAX_X_POS, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->pos.y, MAX_Y_POS, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->velocity.x, MAX_SPEED, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->velocity.y, MAX_SPEED, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDroneAccel.x, MAX_ACCEL, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDroneAccel.y, MAX_ACCEL, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->lastAim.x, 1.0f, false);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->lastAim.y, 1.0f, false);
-        continuousObs[continuousObsOffset++] = scaleAmmo(e, agentDrone);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->weaponCooldown, agentDrone->weaponInfo->coolDown, true);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->weaponCharge, agentDrone->weaponInfo->charge, true);
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->energyLeft, DRONE_ENERGY_MAX, true);
-        continuousObs[continuousObsOffset++] = (float)agentDrone->energyFullyDepleted;
-        continuousObs[continuousObsOffset++] = agentDroneBraking;
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->burstCooldown, DRONE_BURST_COOLDOWN, true);
-        continuousObs[continuousObsOffset++] = (float)agentDrone->chargingBurst;
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->burstCharge, DRONE_ENERGY_MAX, true);
-        continuousObs[continuousObsOffset++] = hitShot;
-        continuousObs[continuousObsOffset++] = tookShot;
-        continuousObs[continuousObsOffset++] = agentDrone->stepInfo.ownShotTaken;
-        continuousObs[continuousObsOffset++] = scaleValue(agentDrone->livesLeft, DRONE_LIVES, true);
-        continuousObs[continuousObsOffset++] = !agentDrone->dead;
-
-        ASSERTF(continuousObsOffset == ENEMY_DRONE_OBS_OFFSET + ((e->numDrones - 1) * ENEMY_DRONE_OBS_SIZE) + DRONE_OBS_SIZE, "offset: %d", continuousObsOffset);
-        continuousObs[continuousObsOffset] = scaleValue(e->stepsLeft, e->totalSteps, true);
+// clears every agent's obs history so the next obs computed are the
+// first ones in it
+void resetObsHistory(env *e) {
+    if (e->obsHistoryLen == 0) {
+        return;
+    }
+    for (uint8_t i = 0; i < e->numAgents; i++) {
+        clearAgentObsHistory(e, e->obs + (i * e->obsStride));
     }
+    // the first obs are written to slot 0
+    e->obsHistorySlot = e->obsHistoryLen - 1;
 }
 
 void setupEnv(env *e) {
@@ -539,6 +897,11 @@ void setupEnv(env *e) {
 
     e->lastSpawnQuad = -1;
 
+    if (e->opponentStates != NULL) {
+        memset(e->opponentStates, 0x0, e->numDrones * POLICY_STATE_SIZE * sizeof(float));
+    }
+    e->opponentActionsReady = false;
+
     int8_t mapIdx = e->pinnedMapIdx;
     if (e->pinnedMapIdx == -1) {
         uint8_t firstMap = 0;
@@ -546,7 +909,7 @@ void setupEnv(env *e) {
         if (!e->isTraining) {
             firstMap = 1;
         }
-        mapIdx = randInt(&e->randState, firstMap, NUM_MAPS - 1);
+        mapIdx = randInt(&e->randState, firstMap, NUM_TRAINING_MAPS - 1);
     }
     DEBUG_LOGF("setting up map %d", mapIdx);
     setupMap(e, mapIdx);
@@ -571,21 +934,51 @@ void setupEnv(env *e) {
         renderEnv(e, true, false, -1, -1);
     }
 
+    resetObsHistory(e);
     computeObs(e);
 }
 
-// sets the timing related variables for the environment depending on
-// the frame rate
-void setEnvFrameRate(env *e, uint8_t frameRate) {
-    e->frameRate = frameRate;
-    e->deltaTime = 1.0f / (float)frameRate;
-    e->frameSkip = frameRate / TRAINING_ACTIONS_PER_SECOND;
+// sets the timing related variables for the environment, must be called
+// before the env is set up or added to an arena world
+void setTimingProfile(env *e, const timingProfile *timing) {
+    if (e->arenaWorld != NULL) {
+        ERROR("timing profile can't be changed after the env is added to an arena world");
+    }
+    e->frameRate = timing->frameRate;
+    e->deltaTime = 1.0f / (float)timing->frameRate;
+    e->frameSkip = timing->frameSkip;
+    e->box2dSubSteps = timing->box2dSubSteps;
+
+    e->totalSteps = ROUND_STEPS * timing->frameRate;
+    e->totalSuddenDeathSteps = SUDDEN_DEATH_STEPS * timing->frameRate;
+}
+
+timingProfile envTimingProfile(const env *e) {
+    return (timingProfile){
+        .frameRate = e->frameRate,
+        .box2dSubSteps = e->box2dSubSteps,
+        .frameSkip = e->frameSkip,
+    };
+}
+
+// defined below with the specialized step functions
+void selectStepEnv(env *e);
+
+// creates a world that runs its tasks on the shared job system if it has
+// been started; worldJobs must be freed after the world is destroyed
+b2WorldId createWorld(worldJobs **worldJobs) {
+    b2WorldDef worldDef = b2DefaultWorldDef();
+    worldDef.gravity = (b2Vec2){.x = 0.0f, .y = 0.0f};
+    *worldJobs = useJobSystem(&worldDef);
+    return b2CreateWorld(&worldDef);
+}
 
-    e->totalSteps = ROUND_STEPS * frameRate;
-    e->totalSuddenDeathSteps = SUDDEN_DEATH_STEPS * frameRate;
+void destroyWorld(b2WorldId worldID, worldJobs *worldJobs) {
+    b2DestroyWorld(worldID);
+    fastFree(worldJobs);
 }
 
-env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool discretizeActions, float *contActions, int32_t *discActions, float *rewards, uint8_t *masks, uint8_t *terminals, uint8_t *truncations, logBuffer *logs, int8_t mapIdx, uint64_t seed, bool enableTeams, bool sittingDuck, bool isTraining) {
+env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, const obsProfile *profile, uint8_t *obs, bool discretizeActions, float *contActions, int32_t *discActions, float *rewards, uint8_t *masks, uint8_t *terminals, uint8_t *truncations, logBuffer *logs, int8_t mapIdx, uint64_t seed, bool enableTeams, bool sittingDuck, bool isTraining) {
     e->numDrones = numDrones;
     e->numAgents = numAgents;
     e->teamsEnabled = enableTeams;
@@ -596,10 +989,23 @@ env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool di
     e->sittingDuck = sittingDuck;
     e->isTraining = isTraining;
 
-    e->obsBytes = obsBytes(e->numDrones);
-    e->discreteObsBytes = alignedSize(discreteObsSize(e->numDrones) * sizeof(uint8_t), sizeof(float));
+    if (profile->numDrones != numDrones) {
+        ERRORF("obs profile is for %u drones, env has %u", profile->numDrones, numDrones);
+    }
+    e->obsProfile = *profile;
+    e->obsFormat = FLOAT32_OBS;
+    e->obsBytes = obsBytes(&e->obsProfile);
+    e->discreteObsBytes = e->obsProfile.discreteObsBytes;
+    e->obsHistoryLen = 0;
+    e->obsHistorySlot = 0;
+    e->obsStride = e->obsBytes;
+    selectComputeObs(e);
 
     e->obs = obs;
+    e->decodedObs = NULL;
+    e->imageObs = false;
+    e->terminalObs = NULL;
+    e->decodedObsSize = decodedObsSize(&e->obsProfile);
     e->discretizeActions = discretizeActions;
     e->contActions = contActions;
     e->discActions = discActions;
@@ -609,23 +1015,28 @@ env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool di
     e->terminals = terminals;
     e->truncations = truncations;
 
-    float frameRate = TRAINING_FRAME_RATE;
-    e->box2dSubSteps = TRAINING_BOX2D_SUBSTEPS;
-    // set a higher frame rate and physics substeps when evaluating
-    // to make it more enjoyable to play
-    if (!isTraining) {
-        frameRate = EVAL_FRAME_RATE;
-        e->box2dSubSteps = EVAL_BOX2D_SUBSTEPS;
-    }
-    setEnvFrameRate(e, frameRate);
     e->randState = seed;
     e->needsReset = false;
 
     e->logs = logs;
 
-    b2WorldDef worldDef = b2DefaultWorldDef();
-    worldDef.gravity = (b2Vec2){.x = 0.0f, .y = 0.0f};
-    e->worldID = b2CreateWorld(&worldDef);
+    e->worldID = createWorld(&e->worldJobs);
+    e->arenaWorld = NULL;
+    e->arenaOffset = b2Vec2_zero;
+
+    // set a higher frame rate and physics substeps when evaluating
+    // to make it more enjoyable to play, setTimingProfile can override
+    // this before the env is set up
+    timingProfile timing;
+    if (isTraining) {
+        trainingTimingProfile(&timing);
+    } else {
+        evalTimingProfile(&timing);
+    }
+    setTimingProfile(e, &timing);
+
+    const b2BodyDef wallsBodyDef = b2DefaultBodyDef();
+    e->wallsBodyID = b2CreateBody(e->worldID, &wallsBodyDef);
     e->pinnedMapIdx = mapIdx;
     e->mapIdx = -1;
 
@@ -634,6 +1045,7 @@ env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool di
 
     create_array(&e->cells, 512);
     create_array(&e->walls, 128);
+    create_array(&e->wallBoxes, 32);
     create_array(&e->floatingWalls, MAX_FLOATING_WALLS);
     create_array(&e->drones, e->numDrones);
     create_array(&e->pickups, MAX_WEAPON_PICKUPS);
@@ -643,22 +1055,181 @@ env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, uint8_t *obs, bool di
     create_array(&e->explodingProjectiles, 8);
     create_array(&e->dronePieces, 16);
 
+    // path tables are allocated when they're first used
     e->mapPathing = fastCalloc(NUM_MAPS, sizeof(pathingInfo));
-    for (uint8_t i = 0; i < NUM_MAPS; i++) {
-        const mapEntry *map = maps[i];
-        pathingInfo *info = &e->mapPathing[i];
-        info->paths = fastMalloc(map->rows * map->columns * map->rows * map->columns * sizeof(uint8_t));
-        memset(info->paths, UINT8_MAX, map->rows * map->columns * map->rows * map->columns * sizeof(uint8_t));
-        info->pathBuffer = fastCalloc(3 * 8 * map->rows * map->columns, sizeof(int8_t));
-    }
+
+    e->opponentPolicy = NULL;
+    e->opponentStates = NULL;
+    e->opponentActionsReady = false;
+    e->resetPool = NULL;
+    e->trace = NULL;
+    e->renderThread = NULL;
+    e->frameEvents = NULL;
+    e->resetPoolIdx = 0;
 
     e->humanInput = false;
     e->humanDroneInput = 0;
     e->connectedControllers = 0;
 
+    selectStepEnv(e);
+
     return e;
 }
 
+// makes the env write decoded observations to decodedObs instead of bit
+// packed observations to the obs buffer passed to initEnv, the packed
+// observations are written to a buffer the env owns instead. Must be
+// called before setupEnv
+void enableDecodedObs(env *e, float *decodedObs) {
+    if (e->obsFormat != FLOAT32_OBS) {
+        ERROR("decoded observations can't be quantized");
+    }
+    if (e->obsHistoryLen != 0) {
+        ERROR("decoded observations can't be stacked");
+    }
+    if (e->imageObs) {
+        ERROR("image observations can't be decoded");
+    }
+    e->decodedObs = decodedObs;
+    e->obs = fastCalloc(e->numAgents, e->obsBytes);
+}
+
+// makes the env write a rasterized image obs of each agent's
+// surroundings to the obs buffer passed to initEnv instead of vector
+// obs, the buffer must be sized with imageObsBytes. Must be called
+// before setupEnv
+void enableImageObs(env *e) {
+    if (e->decodedObs != NULL) {
+        ERROR("image observations can't be decoded");
+    }
+    if (e->obsHistoryLen != 0) {
+        ERROR("image observations can't be stacked");
+    }
+    e->imageObs = true;
+    e->obsBytes = imageObsBytes();
+    e->obsStride = e->obsBytes;
+    e->computeObs = computeImageObs;
+}
+
+// makes the env store continuous observations in format, the obs buffer
+// passed to initEnv must be sized with obsBytesInFormat. Must be called
+// before setupEnv
+void setObsFormat(env *e, enum obsFormat format) {
+    if (e->decodedObs != NULL && format != FLOAT32_OBS) {
+        ERROR("decoded observations can't be quantized");
+    }
+    if (e->imageObs) {
+        ERROR("the obs format must be set before enabling image observations");
+    }
+    e->obsFormat = format;
+    e->obsBytes = obsBytesInFormat(&e->obsProfile, format);
+    e->obsStride = e->obsBytes;
+    if (e->obsHistoryLen != 0) {
+        e->obsStride = stackedObsBytes(&e->obsProfile, format, e->obsHistoryLen);
+    }
+}
+
+// keeps the last historyLen obs of each agent in the obs buffer passed
+// to initEnv so the learner can read stacked obs without copying them,
+// each agent's obs take stackedObsBytes. An agent's obs start with a
+// header of the slot its newest obs are in and how many slots hold obs,
+// followed by the slots; obs are written to the next slot every step.
+// Histories are cleared when the env is reset and when the agent's drone
+// dies. Must be called before setupEnv
+void enableObsHistory(env *e, const uint8_t historyLen) {
+    if (e->decodedObs != NULL) {
+        ERROR("decoded observations can't be stacked");
+    }
+    if (e->imageObs) {
+        ERROR("image observations can't be stacked");
+    }
+    if (historyLen < 2 || historyLen > MAX_OBS_HISTORY) {
+        ERRORF("obs history length must be between 2 and %u, got %u", MAX_OBS_HISTORY, historyLen);
+    }
+    e->obsHistoryLen = historyLen;
+    e->obsStride = stackedObsBytes(&e->obsProfile, e->obsFormat, historyLen);
+}
+
+// makes the env reset in the same step its episode ends instead of at the
+// start of the next step. The obs buffer gets the first obs of the new
+// episode and the final obs are copied to terminalObs, which must be the
+// same size as the env's obs; rewards, terminals and truncations are of
+// the step that ended the episode
+void enableAutoReset(env *e, void *terminalObs) {
+    if (terminalObs == NULL) {
+        ERROR("auto reset needs a buffer for terminal observations");
+    }
+    if (e->terminalObs != NULL) {
+        ERROR("auto reset is already enabled");
+    }
+    e->terminalObs = terminalObs;
+}
+
+// makes a trained policy drive the env's non-agent drones instead of the
+// scripted agent. Must be called before setupEnv, the policy can be
+// shared by every env in the process and must outlive them
+void setOpponentPolicy(env *e, frozenPolicy *policy) {
+    if (policy->numDrones != e->numDrones) {
+        ERRORF("opponent policy was exported for %u drones, env has %u", policy->numDrones, e->numDrones);
+    }
+    if (memcmp(&policy->obsProfile, &e->obsProfile, sizeof(obsProfile)) != 0) {
+        ERROR("opponent policy was loaded with a different obs profile than the env's");
+    }
+    e->opponentPolicy = policy;
+    e->opponentStates = fastCalloc(e->numDrones * POLICY_STATE_SIZE, sizeof(float));
+}
+
+// moves the arenas of envs into a single box2d world so box2d's per world
+// overhead is paid once per step instead of once per env. Must be called
+// after initEnv and before initMaps and setupEnv, and the envs must be
+// stepped together with stepArenaWorld afterwards
+arenaWorld *createArenaWorld(env *envs, const uint8_t numArenas) {
+    ASSERT(numArenas != 0);
+    arenaWorld *w = fastCalloc(1, sizeof(arenaWorld));
+    w->numArenas = numArenas;
+    w->arenas = fastCalloc(numArenas, sizeof(env *));
+
+    w->worldID = createWorld(&w->worldJobs);
+
+    // arrange arenas in a square grid to keep coordinates small
+    uint8_t gridColumns = 1;
+    while (gridColumns * gridColumns < numArenas) {
+        gridColumns++;
+    }
+
+    for (uint8_t i = 0; i < numArenas; i++) {
+        env *e = &envs[i];
+        ASSERT(e->arenaWorld == NULL && e->mapIdx == -1);
+        if (e->frameRate != envs[0].frameRate || e->box2dSubSteps != envs[0].box2dSubSteps || e->frameSkip != envs[0].frameSkip) {
+            ERRORF("arena %d has a different timing profile than the other arenas in its world", i);
+        }
+        // the env's own world is empty besides the static walls body
+        destroyWorld(e->worldID, e->worldJobs);
+        e->worldJobs = NULL;
+
+        e->arenaWorld = w;
+        e->worldID = w->worldID;
+        e->arenaOffset = (b2Vec2){
+            .x = (i % gridColumns) * ARENA_SPACING,
+            .y = (i / gridColumns) * ARENA_SPACING,
+        };
+        b2BodyDef wallsBodyDef = b2DefaultBodyDef();
+        wallsBodyDef.position = e->arenaOffset;
+        e->wallsBodyID = b2CreateBody(e->worldID, &wallsBodyDef);
+
+        w->arenas[i] = e;
+    }
+
+    return w;
+}
+
+// must be called after destroyEnv has been called on every env in the world
+void destroyArenaWorld(arenaWorld *w) {
+    destroyWorld(w->worldID, w->worldJobs);
+    fastFree(w->arenas);
+    fastFree(w);
+}
+
 void clearEnv(env *e) {
     // rewards get cleared in stepEnv every step
     memset(e->masks, 1, e->numAgents * sizeof(uint8_t));
@@ -719,15 +1290,26 @@ void destroyEnv(env *e) {
     for (uint8_t i = 0; i < NUM_MAPS; i++) {
         pathingInfo *info = &e->mapPathing[i];
         fastFree(info->paths);
+        fastFree(info->localPaths);
         fastFree(info->pathBuffer);
     }
     fastFree(e->mapPathing);
+    fastFree(e->opponentStates);
+    fastFree(e->frameEvents);
+    if (e->decodedObs != NULL) {
+        fastFree(e->obs);
+    }
 
     for (size_t i = 0; i < cc_array_size(e->walls); i++) {
         wallEntity *wall = safe_array_get_at(e->walls, i);
         destroyWall(e, wall, false);
     }
 
+    for (size_t i = 0; i < cc_array_size(e->wallBoxes); i++) {
+        wallEntity *box = safe_array_get_at(e->wallBoxes, i);
+        destroyWall(e, box, false);
+    }
+
     for (size_t i = 0; i < cc_array_size(e->cells); i++) {
         mapCell *cell = safe_array_get_at(e->cells, i);
         fastFree(cell);
@@ -735,7 +1317,6 @@ void destroyEnv(env *e) {
 
     for (size_t i = 0; i < cc_array_size(e->entities); i++) {
         entity *ent = safe_array_get_at(e->entities, i);
-        fastFree(ent->id);
         fastFree(ent);
     }
     b2DestroyIdPool(&e->idPool);
@@ -743,6 +1324,7 @@ void destroyEnv(env *e) {
     cc_array_destroy(e->entities);
     cc_array_destroy(e->cells);
     cc_array_destroy(e->walls);
+    cc_array_destroy(e->wallBoxes);
     cc_array_destroy(e->drones);
     cc_array_destroy(e->floatingWalls);
     cc_array_destroy(e->pickups);
@@ -752,7 +1334,12 @@ void destroyEnv(env *e) {
     cc_array_destroy(e->explodingProjectiles);
     cc_array_destroy(e->dronePieces);
 
-    b2DestroyWorld(e->worldID);
+    // shared worlds are destroyed by destroyArenaWorld
+    if (e->arenaWorld == NULL) {
+        destroyWorld(e->worldID, e->worldJobs);
+    } else {
+        b2DestroyBody(e->wallsBodyID);
+    }
 }
 
 void resetEnv(env *e) {
@@ -770,7 +1357,7 @@ float computeExplosionReward(const droneEntity *drone) {
     return computeHitStrength(drone) * EXPLOSION_HIT_REWARD_COEF;
 }
 
-float computeReward(env *e, droneEntity *drone) {
+float computeReward(env *e, droneEntity *drone, const uint8_t *diedDrones, const uint8_t numDiedDrones) {
     float reward = 0.0f;
 
     if (drone->energyFullyDepleted && drone->energyRefillWait == DRONE_ENERGY_REFILL_EMPTY_WAIT) {
@@ -785,39 +1372,60 @@ float computeReward(env *e, droneEntity *drone) {
         reward += WEAPON_PICKUP_REWARD;
     }
 
-    for (uint8_t i = 0; i < e->numDrones; i++) {
-        if (i == drone->idx) {
+    // only drones that this drone hit or was hit by this step need
+    // to be checked for shot and explosion rewards
+    droneMask hitDrones = drone->stepInfo.hitDrones & ~droneBit(drone->idx);
+    while (hitDrones != 0) {
+        const uint8_t i = popDroneIdx(&hitDrones);
+        droneEntity *enemyDrone = safe_array_get_at(e->drones, i);
+        if (drone->team == enemyDrone->team) {
             continue;
         }
-        droneEntity *enemyDrone = safe_array_get_at(e->drones, i);
-        const bool onTeam = drone->team == enemyDrone->team;
 
-        if (drone->stepInfo.shotHit[i] != 0 && !onTeam) {
+        if (drone->stepInfo.shotHit[i] != 0) {
             // subtract 1 from the weapon type because 1 is added so we
             // can use 0 as no shot was hit
             const weaponInformation *weaponInfo = weaponInfos[drone->stepInfo.shotHit[i] - 1];
             reward += computeShotReward(enemyDrone, weaponInfo);
         }
-        if (drone->stepInfo.explosionHit[i] && !onTeam) {
+        if (drone->stepInfo.explosionHit[i]) {
             reward += computeExplosionReward(enemyDrone);
         }
 
         if (e->numAgents == e->numDrones) {
-            if (drone->stepInfo.shotTaken[i] != 0 && !onTeam) {
+            if (drone->stepInfo.shotTaken[i] != 0) {
                 const weaponInformation *weaponInfo = weaponInfos[drone->stepInfo.shotTaken[i] - 1];
                 reward -= computeShotReward(drone, weaponInfo) * 0.5f;
             }
-            if (drone->stepInfo.explosionTaken[i] && !onTeam) {
+            if (drone->stepInfo.explosionTaken[i]) {
                 reward -= computeExplosionReward(drone) * 0.5f;
             }
         }
+    }
+
+    for (uint8_t i = 0; i < numDiedDrones; i++) {
+        if (diedDrones[i] == drone->idx) {
+            continue;
+        }
+        const droneEntity *enemyDrone = safe_array_get_at(e->drones, diedDrones[i]);
+        if (drone->team != enemyDrone->team) {
+            reward += ENEMY_DEATH_REWARD;
+        } else {
+            reward += TEAMMATE_DEATH_PUNISHMENT;
+        }
+    }
 
+    // approaching enemies requires checking every other drone, so skip
+    // it entirely when it isn't rewarded
+    if (APPROACH_REWARD == 0.0f) {
+        return reward;
+    }
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        if (i == drone->idx) {
+            continue;
+        }
+        droneEntity *enemyDrone = safe_array_get_at(e->drones, i);
         if (enemyDrone->dead && enemyDrone->diedThisStep) {
-            if (!onTeam) {
-                reward += ENEMY_DEATH_REWARD;
-            } else {
-                reward += TEAMMATE_DEATH_PUNISHMENT;
-            }
             continue;
         }
 
@@ -843,11 +1451,21 @@ void computeRewards(env *e, const bool roundOver, const int8_t winner, const int
         e->rewards[winner] += WIN_REWARD;
     }
 
+    // find drones that died this step once instead of per drone
+    uint8_t diedDrones[_MAX_DRONES];
+    uint8_t numDiedDrones = 0;
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        if (drone->dead && drone->diedThisStep) {
+            diedDrones[numDiedDrones++] = i;
+        }
+    }
+
     for (uint8_t i = 0; i < e->numDrones; i++) {
         float reward = 0.0f;
         droneEntity *drone = safe_array_get_at(e->drones, i);
         if (!drone->dead) {
-            reward = computeReward(e, drone);
+            reward = computeReward(e, drone, diedDrones, numDiedDrones);
             if (roundOver && winningTeam == drone->team) {
                 reward += WIN_REWARD;
             }
@@ -865,10 +1483,10 @@ static inline bool isActionNoop(const b2Vec2 action) {
     return b2Length(action) < ACTION_NOOP_MAGNITUDE;
 }
 
-agentActions _computeActions(env *e, droneEntity *drone, const agentActions *manualActions) {
+static FORCE_INLINE agentActions _computeActions(env *e, droneEntity *drone, const agentActions *manualActions, const bool discretizeActions) {
     agentActions actions = {0};
 
-    if (e->discretizeActions && manualActions == NULL) {
+    if (discretizeActions && manualActions == NULL) {
         const uint8_t offset = drone->idx * DISCRETE_ACTION_SIZE;
         uint8_t move = e->discActions[offset + 0];
         // 0 is no-op for both move and aim
@@ -940,8 +1558,8 @@ agentActions _computeActions(env *e, droneEntity *drone, const agentActions *man
     return actions;
 }
 
-agentActions computeActions(env *e, droneEntity *drone, const agentActions *manualActions) {
-    const agentActions actions = _computeActions(e, drone, manualActions);
+static FORCE_INLINE agentActions computeDroneActions(env *e, droneEntity *drone, const agentActions *manualActions, const bool discretizeActions) {
+    const agentActions actions = _computeActions(e, drone, manualActions, discretizeActions);
     drone->lastMove = actions.move;
     if (!b2VecEqual(actions.aim, b2Vec2_zero)) {
         drone->lastAim = actions.aim;
@@ -949,6 +1567,10 @@ agentActions computeActions(env *e, droneEntity *drone, const agentActions *manu
     return actions;
 }
 
+agentActions computeActions(env *e, droneEntity *drone, const agentActions *manualActions) {
+    return computeDroneActions(e, drone, manualActions, e->discretizeActions);
+}
+
 void updateConnectedControllers(env *e) {
     for (uint8_t i = 0; i < e->numDrones; i++) {
         if (IsGamepadAvailable(i)) {
@@ -1071,227 +1693,369 @@ bool droneControlledByHuman(const env *e, uint8_t i) {
     return (e->connectedControllers > 1 && i >= e->humanDroneInput) || (e->connectedControllers <= 1 && i == e->humanDroneInput);
 }
 
-void stepEnv(env *e) {
-    if (e->needsReset) {
-        DEBUG_LOG("Resetting environment");
-        resetEnv(e);
+// applies actions for a single frame before the world is stepped;
+// rendered and teamsEnabled are compile time constants in specialized
+// step functions so unused branches can be eliminated
+static FORCE_INLINE void preStepFrame(env *e, const agentActions *stepActions, const bool rendered) {
+    e->episodeLength++;
 
-#ifdef __EMSCRIPTEN__
-        lastFrameTime = emscripten_get_now();
-        accumulator = 0.0;
-#endif
+    // handle actions
+    if (rendered) {
+        updateHumanInputToggle(e);
     }
 
-    agentActions stepActions[e->numDrones];
-    memset(stepActions, 0x0, e->numDrones * sizeof(agentActions));
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneEntity *drone = safe_array_get_at(e->drones, i);
+        memset(&drone->stepInfo, 0x0, sizeof(droneStepInfo));
+        if (drone->dead) {
+            drone->diedThisStep = false;
+        }
+    }
 
-    // preprocess agent actions for the next frameSkip steps
     for (uint8_t i = 0; i < e->numDrones; i++) {
         droneEntity *drone = safe_array_get_at(e->drones, i);
-        if (drone->dead || droneControlledByHuman(e, i)) {
+        if (drone->dead) {
             continue;
         }
 
-        if (i < e->numAgents) {
-            stepActions[i] = computeActions(e, drone, NULL);
+        agentActions actions;
+        // take inputs from humans every frame
+        if (rendered && droneControlledByHuman(e, i)) {
+            actions = getPlayerInputs(e, drone, i - e->humanDroneInput);
         } else {
-            const agentActions scriptedActions = scriptedAgentActions(e, drone);
-            stepActions[i] = computeActions(e, drone, &scriptedActions);
+            actions = stepActions[i];
+        }
+
+        if (actions.discardWeapon) {
+            droneDiscardWeapon(e, drone);
+        }
+        if (actions.shoot) {
+            droneShoot(e, drone, actions.aim, actions.chargingWeapon);
+        }
+        if (actions.chargingBurst) {
+            droneChargeBurst(e, drone);
+        } else if (drone->chargingBurst) {
+            droneBurst(e, drone);
+        }
+        if (!b2VecEqual(actions.move, b2Vec2_zero)) {
+            droneMove(drone, actions.move);
+        }
+        droneBrake(e, drone, actions.brake);
+
+        // update shield velocity if its active
+        if (drone->shield != NULL) {
+            b2Body_SetLinearVelocity(drone->shield->bodyID, b2Body_GetLinearVelocity(drone->bodyID));
         }
     }
+}
 
-    // reset reward buffer
-    memset(e->rewards, 0x0, e->numAgents * sizeof(float));
+// handles game logic for a single frame after the world was stepped and
+// the env's box2d events were handled
+static FORCE_INLINE void postStepFrame(env *e, const bool rendered, const bool teamsEnabled) {
+    // handle sudden death
+    e->stepsLeft = max(e->stepsLeft - 1, 0);
+    if ((!e->isTraining || e->numDrones == e->numAgents) && e->stepsLeft == 0) {
+        e->suddenDeathSteps = max(e->suddenDeathSteps - 1, 0);
+        if (e->suddenDeathSteps == 0) {
+            DEBUG_LOG("placing sudden death walls");
+            handleSuddenDeath(e);
+            e->suddenDeathSteps = e->totalSuddenDeathSteps;
+        }
+    }
 
-    for (int i = 0; i < e->frameSkip; i++) {
-#ifdef __EMSCRIPTEN__
-        // running at a fixed frame rate doesn't seem to work well in
-        // the browser, so we need to adjust to handle a variable frame
-        // rate; see https://www.gafferongames.com/post/fix_your_timestep/
-        const double curTime = emscripten_get_now();
-        const double deltaTime = (curTime - lastFrameTime) / 1000.0;
-        lastFrameTime = curTime;
-
-        accumulator += deltaTime;
-        while (accumulator >= e->deltaTime) {
-            if (e->needsReset) {
-                break;
-            }
-#endif
-            e->episodeLength++;
+    projectilesStep(e);
 
-            // handle actions
-            if (e->client != NULL) {
-                updateHumanInputToggle(e);
+    int8_t lastAlive = -1;
+    int8_t lastAliveTeam = -1;
+    bool allAliveOnSameTeam = false;
+    bool roundOver = false;
+    uint8_t deadDrones = 0;
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneEntity *drone = safe_array_get_at(e->drones, i);
+        if (drone->livesLeft != 0) {
+            if (!droneStep(e, drone)) {
+                // couldn't find a respawn position, end the round
+                deadDrones++;
+                roundOver = true;
             }
-
-            for (uint8_t i = 0; i < e->numDrones; i++) {
-                droneEntity *drone = safe_array_get_at(e->drones, i);
-                memset(&drone->stepInfo, 0x0, sizeof(droneStepInfo));
-                if (drone->dead) {
-                    drone->diedThisStep = false;
+            lastAlive = i;
+
+            if (teamsEnabled) {
+                if (lastAliveTeam == -1) {
+                    lastAliveTeam = drone->team;
+                    allAliveOnSameTeam = true;
+                } else if (drone->team != lastAliveTeam) {
+                    allAliveOnSameTeam = false;
                 }
             }
-
-            for (uint8_t i = 0; i < e->numDrones; i++) {
-                droneEntity *drone = safe_array_get_at(e->drones, i);
-                if (drone->dead) {
-                    continue;
-                }
-
-                agentActions actions;
-                // take inputs from humans every frame
-                if (droneControlledByHuman(e, i)) {
-                    actions = getPlayerInputs(e, drone, i - e->humanDroneInput);
+        } else {
+            deadDrones++;
+            if (i < e->numAgents) {
+                if (drone->diedThisStep) {
+                    e->terminals[i] = 1;
                 } else {
-                    actions = stepActions[i];
+                    e->masks[i] = 0;
                 }
+            }
+        }
+    }
 
-                if (actions.discardWeapon) {
-                    droneDiscardWeapon(e, drone);
-                }
-                if (actions.shoot) {
-                    droneShoot(e, drone, actions.aim, actions.chargingWeapon);
-                }
-                if (actions.chargingBurst) {
-                    droneChargeBurst(e, drone);
-                } else if (drone->chargingBurst) {
-                    droneBurst(e, drone);
-                }
-                if (!b2VecEqual(actions.move, b2Vec2_zero)) {
-                    droneMove(drone, actions.move);
-                }
-                droneBrake(e, drone, actions.brake);
+    weaponPickupsStep(e);
 
-                // update shield velocity if its active
-                if (drone->shield != NULL) {
-                    b2Body_SetLinearVelocity(drone->shield->bodyID, b2Body_GetLinearVelocity(drone->bodyID));
-                }
-            }
+    if (!roundOver) {
+        roundOver = deadDrones >= e->numDrones - 1;
+    }
+    if (teamsEnabled && allAliveOnSameTeam) {
+        roundOver = true;
+        lastAlive = -1;
+    }
+    // if the enemy drone(s) are scripted don't enable sudden death
+    // so that the agent has to work for victories
+    if (e->isTraining && e->numDrones != e->numAgents && e->stepsLeft == 0) {
+        roundOver = true;
+        lastAliveTeam = -1;
+    }
+    if (roundOver && deadDrones < e->numDrones - 1) {
+        lastAlive = -1;
+    }
+    computeRewards(e, roundOver, lastAlive, lastAliveTeam);
 
-            b2World_Step(e->worldID, e->deltaTime, e->box2dSubSteps);
+    if (rendered) {
+        renderEnv(e, false, roundOver, lastAlive, lastAliveTeam);
+    }
 
-            // update dynamic body positions and velocities
-            handleBodyMoveEvents(e);
+    if (!roundOver) {
+        return;
+    }
 
-            // handle collisions
-            handleContactEvents(e);
-            handleSensorEvents(e);
+    if (e->numDrones != e->numAgents && e->stepsLeft == 0) {
+        DEBUG_LOG("truncating episode");
+        memset(e->truncations, 1, e->numAgents * sizeof(uint8_t));
+    } else {
+        DEBUG_LOG("terminating episode");
+        memset(e->terminals, 1, e->numAgents * sizeof(uint8_t));
+    }
 
-            // handle sudden death
-            e->stepsLeft = max(e->stepsLeft - 1, 0);
-            if ((!e->isTraining || e->numDrones == e->numAgents) && e->stepsLeft == 0) {
-                e->suddenDeathSteps = max(e->suddenDeathSteps - 1, 0);
-                if (e->suddenDeathSteps == 0) {
-                    DEBUG_LOG("placing sudden death walls");
-                    handleSuddenDeath(e);
-                    e->suddenDeathSteps = e->totalSuddenDeathSteps;
-                }
-            }
+    logEntry log = {0};
+    log.length = e->episodeLength;
+    if (lastAlive != -1) {
+        e->stats[lastAlive].wins = 1.0f;
+    } else if (!teamsEnabled || (teamsEnabled && lastAliveTeam == -1)) {
+        log.ties = 1.0f;
+    }
 
-            projectilesStep(e);
-
-            int8_t lastAlive = -1;
-            int8_t lastAliveTeam = -1;
-            bool allAliveOnSameTeam = false;
-            bool roundOver = false;
-            uint8_t deadDrones = 0;
-            for (uint8_t i = 0; i < e->numDrones; i++) {
-                droneEntity *drone = safe_array_get_at(e->drones, i);
-                if (drone->livesLeft != 0) {
-                    if (!droneStep(e, drone)) {
-                        // couldn't find a respawn position, end the round
-                        deadDrones++;
-                        roundOver = true;
-                    }
-                    lastAlive = i;
-
-                    if (e->teamsEnabled) {
-                        if (lastAliveTeam == -1) {
-                            lastAliveTeam = drone->team;
-                            allAliveOnSameTeam = true;
-                        } else if (drone->team != lastAliveTeam) {
-                            allAliveOnSameTeam = false;
-                        }
-                    }
-                } else {
-                    deadDrones++;
-                    if (i < e->numAgents) {
-                        if (drone->diedThisStep) {
-                            e->terminals[i] = 1;
-                        } else {
-                            e->masks[i] = 0;
-                        }
-                    }
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        if (!drone->dead && teamsEnabled && drone->team == lastAliveTeam) {
+            e->stats[i].wins = 1.0f;
+        }
+        // set absolute distance traveled of agent drones
+        e->stats[i].absDistanceTraveled = b2Distance(drone->initalPos, drone->pos);
+    }
+
+    memcpy(log.stats, e->stats, sizeof(e->stats));
+    addLogEntry(e->logs, &log);
+
+    e->needsReset = true;
+}
+
+// hands the state of the env after a frame was stepped to whatever is
+// tracing or rendering it
+static inline void recordFrame(env *e) {
+    if (e->frameEvents == NULL) {
+        return;
+    }
+    if (e->trace != NULL) {
+        writeTraceFrame(e->trace, e);
+    }
+    if (e->renderThread != NULL) {
+        publishRenderFrame(e->renderThread, e);
+    }
+    e->frameEvents->numExplosions = 0;
+}
+
+static FORCE_INLINE void stepFrame(env *e, const agentActions *stepActions, const bool rendered, const bool teamsEnabled) {
+    preStepFrame(e, stepActions, rendered);
+
+    b2World_Step(e->worldID, e->deltaTime, e->box2dSubSteps);
+
+    // update dynamic body positions and velocities
+    handleBodyMoveEvents(e);
+
+    // handle collisions
+    handleContactEvents(e);
+    handleSensorEvents(e);
+
+    postStepFrame(e, rendered, teamsEnabled);
+    recordFrame(e);
+}
+
+static inline void resetEnvIfNeeded(env *e) {
+    if (!e->needsReset) {
+        return;
+    }
+    DEBUG_LOG("Resetting environment");
+    // rendered envs are reset normally so the first frame is drawn
+    if (e->resetPool == NULL || e->client != NULL || !restorePooledState(e)) {
+        resetEnv(e);
+    }
+
+#ifdef __EMSCRIPTEN__
+    lastFrameTime = emscripten_get_now();
+    accumulator = 0.0;
+#endif
+}
+
+// saves the final obs of the episode and resets the env, keeping the
+// rewards, terminals and truncations of the step that ended it
+static void autoResetEnv(env *e) {
+    if (e->decodedObs != NULL) {
+        memcpy(e->terminalObs, e->decodedObs, e->numAgents * e->decodedObsSize * sizeof(float));
+    } else {
+        memcpy(e->terminalObs, e->obs, e->numAgents * e->obsStride);
+    }
+
+    float rewards[e->numAgents];
+    uint8_t terminals[e->numAgents];
+    uint8_t truncations[e->numAgents];
+    memcpy(rewards, e->rewards, sizeof(rewards));
+    memcpy(terminals, e->terminals, sizeof(terminals));
+    memcpy(truncations, e->truncations, sizeof(truncations));
+
+    resetEnvIfNeeded(e);
+
+    memcpy(e->rewards, rewards, sizeof(rewards));
+    memcpy(e->terminals, terminals, sizeof(terminals));
+    memcpy(e->truncations, truncations, sizeof(truncations));
+}
+
+static agentActions policyOutputActions(const frozenPolicy *p, const droneEntity *drone, const float *out) {
+    agentActions actions = {0};
+    if (p->discreteActions) {
+        // take the most likely action of each action head
+        uint8_t heads[sizeof(POLICY_DISCRETE_ACTION_HEADS)];
+        for (uint8_t i = 0; i < sizeof(POLICY_DISCRETE_ACTION_HEADS); i++) {
+            heads[i] = 0;
+            for (uint8_t j = 1; j < POLICY_DISCRETE_ACTION_HEADS[i]; j++) {
+                if (out[j] > out[heads[i]]) {
+                    heads[i] = j;
                 }
             }
+            out += POLICY_DISCRETE_ACTION_HEADS[i];
+        }
 
-            weaponPickupsStep(e);
+        // 0 is no-op for both move and aim
+        if (heads[0] != 0) {
+            actions.move.x = discMoveToContMoveMap[0][heads[0] - 1];
+            actions.move.y = discMoveToContMoveMap[1][heads[0] - 1];
+        }
+        if (heads[1] != 0) {
+            actions.aim.x = discAimToContAimMap[0][heads[1] - 1];
+            actions.aim.y = discAimToContAimMap[1][heads[1] - 1];
+        }
+        actions.chargingWeapon = heads[2] == 1;
+        actions.brake = heads[3] == 1;
+        actions.chargingBurst = heads[4] == 1;
+    } else {
+        actions.move = (b2Vec2){.x = tanhf(out[0]), .y = tanhf(out[1])};
+        actions.aim = (b2Vec2){.x = tanhf(out[2]), .y = tanhf(out[3])};
+        actions.chargingWeapon = out[4] > 0.0f;
+        actions.brake = out[5] > 0.0f;
+        actions.chargingBurst = out[6] > 0.0f;
+    }
 
-            if (!roundOver) {
-                roundOver = deadDrones >= e->numDrones - 1;
-            }
-            if (e->teamsEnabled && allAliveOnSameTeam) {
-                roundOver = true;
-                lastAlive = -1;
-            }
-            // if the enemy drone(s) are scripted don't enable sudden death
-            // so that the agent has to work for victories
-            if (e->isTraining && e->numDrones != e->numAgents && e->stepsLeft == 0) {
-                roundOver = true;
-                lastAliveTeam = -1;
-            }
-            if (roundOver && deadDrones < e->numDrones - 1) {
-                lastAlive = -1;
-            }
-            computeRewards(e, roundOver, lastAlive, lastAliveTeam);
+    actions.shoot = actions.chargingWeapon;
+    if (!actions.chargingWeapon && drone->chargingWeapon) {
+        actions.shoot = true;
+    }
+    return actions;
+}
 
-            if (e->client != NULL) {
-                renderEnv(e, false, roundOver, lastAlive, lastAliveTeam);
+static void runOpponentBatch(frozenPolicy *p, const uint8_t batchSize, float **states, env **envs, droneEntity **drones) {
+    policyForward(p, batchSize, states);
+    for (uint8_t b = 0; b < batchSize; b++) {
+        const float *out = p->actorOut + (b * p->numActionOutputs);
+        envs[b]->opponentActions[drones[b]->idx] = policyOutputActions(p, drones[b], out);
+    }
+}
+
+// infers the actions of the non-agent drones of multiple envs with their
+// opponent policy in as few batches as possible; envs that don't have an
+// opponent policy are skipped, the rest must share the same policy
+void inferOpponentActions(env *const *envs, const uint16_t numEnvs) {
+    frozenPolicy *p = NULL;
+    float *states[POLICY_MAX_BATCH];
+    env *batchEnvs[POLICY_MAX_BATCH];
+    droneEntity *batchDrones[POLICY_MAX_BATCH];
+    uint8_t batchSize = 0;
+
+    for (uint16_t i = 0; i < numEnvs; i++) {
+        env *e = envs[i];
+        if (e->opponentPolicy == NULL) {
+            continue;
+        }
+        ASSERT(p == NULL || p == e->opponentPolicy);
+        p = e->opponentPolicy;
+
+        // observations must be of the state the next step starts from
+        resetEnvIfNeeded(e);
+        for (uint8_t j = e->numAgents; j < e->numDrones; j++) {
+            droneEntity *drone = safe_array_get_at(e->drones, j);
+            if (drone->dead) {
+                continue;
             }
 
-            if (roundOver) {
-                if (e->numDrones != e->numAgents && e->stepsLeft == 0) {
-                    DEBUG_LOG("truncating episode");
-                    memset(e->truncations, 1, e->numAgents * sizeof(uint8_t));
-                } else {
-                    DEBUG_LOG("terminating episode");
-                    memset(e->terminals, 1, e->numAgents * sizeof(uint8_t));
-                }
+            computeOpponentObs(e, drone, p->obs + (batchSize * p->obsBytes));
+            states[batchSize] = e->opponentStates + (j * POLICY_STATE_SIZE);
+            batchEnvs[batchSize] = e;
+            batchDrones[batchSize] = drone;
+            batchSize++;
+            if (batchSize == POLICY_MAX_BATCH) {
+                runOpponentBatch(p, batchSize, states, batchEnvs, batchDrones);
+                batchSize = 0;
+            }
+        }
+        e->opponentActionsReady = true;
+    }
 
-                logEntry log = {0};
-                log.length = e->episodeLength;
-                if (lastAlive != -1) {
-                    e->stats[lastAlive].wins = 1.0f;
-                } else if (!e->teamsEnabled || (e->teamsEnabled && lastAliveTeam == -1)) {
-                    log.ties = 1.0f;
-                }
+    if (batchSize != 0) {
+        runOpponentBatch(p, batchSize, states, batchEnvs, batchDrones);
+    }
+}
 
-                for (uint8_t i = 0; i < e->numDrones; i++) {
-                    const droneEntity *drone = safe_array_get_at(e->drones, i);
-                    if (!drone->dead && e->teamsEnabled && drone->team == lastAliveTeam) {
-                        e->stats[i].wins = 1.0f;
-                    }
-                    // set absolute distance traveled of agent drones
-                    e->stats[i].absDistanceTraveled = b2Distance(drone->initalPos, drone->pos);
-                }
+// resets the env if needed and computes the actions for the next
+// frameSkip frames
+static FORCE_INLINE void beginStep(env *e, agentActions *stepActions, const bool rendered, const bool discretizeActions) {
+    resetEnvIfNeeded(e);
+    if (e->opponentPolicy != NULL && !e->opponentActionsReady) {
+        inferOpponentActions(&e, 1);
+    }
 
-                memcpy(log.stats, e->stats, sizeof(e->stats));
-                addLogEntry(e->logs, &log);
+    memset(stepActions, 0x0, e->numDrones * sizeof(agentActions));
 
-                e->needsReset = true;
-                break;
-            }
-#ifdef __EMSCRIPTEN__
-            accumulator -= e->deltaTime;
+    // preprocess agent actions for the next frameSkip steps
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneEntity *drone = safe_array_get_at(e->drones, i);
+        if (drone->dead || (rendered && droneControlledByHuman(e, i))) {
+            continue;
         }
 
-        if (e->needsReset) {
-            break;
+        if (i < e->numAgents) {
+            stepActions[i] = computeDroneActions(e, drone, NULL, discretizeActions);
+        } else if (e->opponentPolicy != NULL) {
+            stepActions[i] = computeDroneActions(e, drone, &e->opponentActions[i], discretizeActions);
+        } else {
+            const agentActions scriptedActions = scriptedAgentActions(e, drone);
+            stepActions[i] = computeDroneActions(e, drone, &scriptedActions, discretizeActions);
         }
-#endif
     }
+    e->opponentActionsReady = false;
 
+    // reset reward buffer
+    memset(e->rewards, 0x0, e->numAgents * sizeof(float));
+}
+
+static FORCE_INLINE void endStep(env *e) {
 #ifndef NDEBUG
     bool gotReward = false;
     for (uint8_t i = 0; i < e->numDrones; i++) {
@@ -1314,6 +2078,193 @@ void stepEnv(env *e) {
 #endif
 
     computeObs(e);
+    if (e->terminalObs != NULL && e->needsReset) {
+        autoResetEnv(e);
+    }
+}
+
+static FORCE_INLINE void _stepEnv(env *e, const bool rendered, const bool discretizeActions, const bool teamsEnabled) {
+    agentActions stepActions[e->numDrones];
+    beginStep(e, stepActions, rendered, discretizeActions);
+
+    for (int i = 0; i < e->frameSkip; i++) {
+#ifdef __EMSCRIPTEN__
+        if (rendered) {
+            // running at a fixed frame rate doesn't seem to work well in
+            // the browser, so we need to adjust to handle a variable frame
+            // rate; see https://www.gafferongames.com/post/fix_your_timestep/
+            const double curTime = emscripten_get_now();
+            const double deltaTime = (curTime - lastFrameTime) / 1000.0;
+            lastFrameTime = curTime;
+
+            accumulator += deltaTime;
+            while (accumulator >= e->deltaTime && !e->needsReset) {
+                stepFrame(e, stepActions, rendered, teamsEnabled);
+                accumulator -= e->deltaTime;
+            }
+            if (e->needsReset) {
+                break;
+            }
+            continue;
+        }
+#endif
+        stepFrame(e, stepActions, rendered, teamsEnabled);
+        if (e->needsReset) {
+            break;
+        }
+    }
+
+    endStep(e);
+}
+
+// generate step functions specialized for when the env isn't being
+// rendered so the hot loop used in training doesn't contain rendering,
+// human input or unneeded action and team handling
+#define DEFINE_HEADLESS_STEP_ENV(name, discretizeActions, teamsEnabled) \
+    void name(env *e) {                                                 \
+        _stepEnv(e, false, discretizeActions, teamsEnabled);            \
+    }
+
+DEFINE_HEADLESS_STEP_ENV(stepEnvHeadlessCont, false, false)
+DEFINE_HEADLESS_STEP_ENV(stepEnvHeadlessDisc, true, false)
+DEFINE_HEADLESS_STEP_ENV(stepEnvHeadlessContTeams, false, true)
+DEFINE_HEADLESS_STEP_ENV(stepEnvHeadlessDiscTeams, true, true)
+
+void stepEnvRendered(env *e) {
+    _stepEnv(e, true, e->discretizeActions, e->teamsEnabled);
+}
+
+void selectStepEnv(env *e) {
+    if (e->discretizeActions) {
+        e->stepHeadless = e->teamsEnabled ? stepEnvHeadlessDiscTeams : stepEnvHeadlessDisc;
+    } else {
+        e->stepHeadless = e->teamsEnabled ? stepEnvHeadlessContTeams : stepEnvHeadlessCont;
+    }
+}
+
+void stepEnv(env *e) {
+    // envs sharing a world must be stepped with stepArenaWorld
+    ASSERT(e->arenaWorld == NULL);
+    // a client can be attached to an env after it was initialized
+    if (e->client != NULL) {
+        stepEnvRendered(e);
+        return;
+    }
+    e->stepHeadless(e);
+}
+
+// steps multiple envs, opponent policy inference is batched across them
+void stepEnvs(env *envs, const uint16_t numEnvs) {
+    if (envs[0].opponentPolicy != NULL) {
+        env *envPtrs[numEnvs];
+        for (uint16_t i = 0; i < numEnvs; i++) {
+            envPtrs[i] = &envs[i];
+        }
+        inferOpponentActions(envPtrs, numEnvs);
+    }
+    for (uint16_t i = 0; i < numEnvs; i++) {
+        stepEnv(&envs[i]);
+    }
+}
+
+// returns the env that owns a shape if its round hasn't ended this step
+static inline env *activeShapeOwner(const b2ShapeId shapeID) {
+    if (!b2Shape_IsValid(shapeID)) {
+        return NULL;
+    }
+    const entity *ent = b2Shape_GetUserData(shapeID);
+    if (ent->env->needsReset) {
+        return NULL;
+    }
+    return ent->env;
+}
+
+// routes the events of a shared world to the envs that own the entities
+// involved, skipping envs whose round ended earlier this step
+void handleArenaWorldEvents(const arenaWorld *w) {
+    b2BodyEvents bodyEvents = b2World_GetBodyEvents(w->worldID);
+    for (int i = 0; i < bodyEvents.moveCount; i++) {
+        const b2BodyMoveEvent *event = bodyEvents.moveEvents + i;
+        const entity *ent = event->userData;
+        if (!b2Body_IsValid(event->bodyId) || ent == NULL || ent->env->needsReset) {
+            continue;
+        }
+        handleBodyMoveEvent(ent->env, event);
+    }
+
+    b2ContactEvents contactEvents = b2World_GetContactEvents(w->worldID);
+    for (int i = 0; i < contactEvents.beginCount; ++i) {
+        const b2ContactBeginTouchEvent *event = contactEvents.beginEvents + i;
+        env *owner = activeShapeOwner(event->shapeIdA);
+        if (owner == NULL) {
+            owner = activeShapeOwner(event->shapeIdB);
+        }
+        if (owner != NULL) {
+            handleContactBeginEvent(owner, event);
+        }
+    }
+    for (int i = 0; i < contactEvents.endCount; ++i) {
+        handleContactEndEvent(contactEvents.endEvents + i);
+    }
+
+    b2SensorEvents sensorEvents = b2World_GetSensorEvents(w->worldID);
+    for (int i = 0; i < sensorEvents.beginCount; ++i) {
+        const b2SensorBeginTouchEvent *event = sensorEvents.beginEvents + i;
+        env *owner = activeShapeOwner(event->sensorShapeId);
+        if (owner != NULL) {
+            handleSensorBeginEvent(owner, event);
+        }
+    }
+    for (int i = 0; i < sensorEvents.endCount; ++i) {
+        handleSensorEndEvent(sensorEvents.endEvents + i);
+    }
+}
+
+// steps every env in a shared world; the world is stepped once per frame
+// for all envs instead of once per env
+void stepArenaWorld(arenaWorld *w) {
+    const env *first = w->arenas[0];
+    agentActions stepActions[w->numArenas][_MAX_DRONES];
+    if (first->opponentPolicy != NULL) {
+        inferOpponentActions(w->arenas, w->numArenas);
+    }
+    for (uint8_t i = 0; i < w->numArenas; i++) {
+        env *e = w->arenas[i];
+        ASSERT(e->client == NULL);
+        beginStep(e, stepActions[i], false, e->discretizeActions);
+    }
+
+    for (int frame = 0; frame < first->frameSkip; frame++) {
+        bool stepWorld = false;
+        for (uint8_t i = 0; i < w->numArenas; i++) {
+            env *e = w->arenas[i];
+            if (e->needsReset) {
+                continue;
+            }
+            preStepFrame(e, stepActions[i], false);
+            stepWorld = true;
+        }
+        // every round ended this step
+        if (!stepWorld) {
+            break;
+        }
+
+        b2World_Step(w->worldID, first->deltaTime, first->box2dSubSteps);
+        handleArenaWorldEvents(w);
+
+        for (uint8_t i = 0; i < w->numArenas; i++) {
+            env *e = w->arenas[i];
+            if (e->needsReset) {
+                continue;
+            }
+            postStepFrame(e, false, e->teamsEnabled);
+            recordFrame(e);
+        }
+    }
+
+    for (uint8_t i = 0; i < w->numArenas; i++) {
+        endStep(w->arenas[i]);
+    }
 }
 
 #endif
@@ -0,0 +1,339 @@
+#ifndef IMPULSE_WARS_FRAME_VIEW_H
+#define IMPULSE_WARS_FRAME_VIEW_H
+
+#include "map.h"
+#include "render.h"
+#include "trace.h"
+#include "types.h"
+
+// renders encoded frames with the same rendering as a live env without
+// a box2d world. The view's env only has the entities the renderer
+// needs, and they're overwritten from each frame that's applied. All
+// entities are allocated when the view is created so applying frames
+// never allocates, views may be used on a render thread while an env
+// is stepped on another.
+
+// explosions are skipped once this many are being rendered so fast
+// forwarding through fights doesn't slow rendering to a crawl
+#define FRAME_VIEW_MAX_EXPLOSIONS 64
+// projectiles past this many in a frame aren't rendered
+#define FRAME_VIEW_MAX_PROJECTILES 1024
+
+typedef struct frameView {
+    env *e;
+    mapDataEntry mapData;
+    uint16_t numStaticWalls;
+    uint8_t suddenDeathWallCounter;
+    uint32_t episode;
+    droneEntity *drones;
+    shieldEntity *shields;
+    wallEntity floatingWalls[MAX_FLOATING_WALLS];
+    weaponPickupEntity pickups[MAX_WEAPON_PICKUPS];
+    explosionInfo explosions[FRAME_VIEW_MAX_EXPLOSIONS];
+    projectileEntity *projectiles;
+    // enough for every cell of the largest map to be a wall
+    wallEntity *walls;
+    uint16_t wallsCapacity;
+} frameView;
+
+static void clearFrameViewWalls(frameView *v, const uint16_t keep) {
+    env *e = v->e;
+    while (cc_array_size(e->walls) > keep) {
+        cc_array_remove_last(e->walls, NULL);
+    }
+}
+
+static void addFrameViewWall(frameView *v, const uint8_t col, const uint8_t row, const enum entityType type) {
+    const mapEntry *map = v->e->map;
+    ASSERT(cc_array_size(v->e->walls) < v->wallsCapacity);
+    wallEntity *wall = &v->walls[cc_array_size(v->e->walls)];
+    *wall = (wallEntity){0};
+    // same cell positions as setupMap
+    wall->pos = (b2Vec2){
+        .x = (col - ((map->columns - 1) * 0.5f)) * WALL_THICKNESS,
+        .y = (row - ((map->rows - 1) * 0.5f)) * WALL_THICKNESS,
+    };
+    wall->rot = b2Rot_identity;
+    wall->extent = (b2Vec2){.x = WALL_THICKNESS / 2.0f, .y = WALL_THICKNESS / 2.0f};
+    wall->mapCellIdx = col + (row * map->columns);
+    wall->type = type;
+    cc_array_add(v->e->walls, wall);
+}
+
+static bool isStaticWallLayoutCell(const char cell) {
+    return cell == 'W' || cell == 'B' || cell == 'D';
+}
+
+// static walls aren't merged into boxes like they are in a live env,
+// the renderer draws them the same either way
+static void setFrameViewMap(frameView *v, const int8_t mapIdx) {
+    env *e = v->e;
+    clearFrameViewWalls(v, 0);
+    v->suddenDeathWallCounter = 0;
+
+    const mapEntry *map = maps[mapIdx];
+    e->mapIdx = mapIdx;
+    e->map = map;
+    for (uint8_t row = 0; row < map->rows; row++) {
+        for (uint8_t col = 0; col < map->columns; col++) {
+            enum entityType type;
+            switch (map->layout[col + (row * map->columns)]) {
+            case 'W':
+                type = STANDARD_WALL_ENTITY;
+                break;
+            case 'B':
+                type = BOUNCY_WALL_ENTITY;
+                break;
+            case 'D':
+                type = DEATH_WALL_ENTITY;
+                break;
+            default:
+                continue;
+            }
+            addFrameViewWall(v, col, row, type);
+        }
+    }
+    v->numStaticWalls = cc_array_size(e->walls);
+
+    computeMapBoundsAndQuadrants(e, &v->mapData);
+    e->mapData = &v->mapData;
+    setupEnvCamera(e);
+}
+
+// sudden death walls fill the empty cells of one more ring of the map
+// inside the border every time the counter increases
+static void setFrameViewSuddenDeathWalls(frameView *v, const uint8_t counter) {
+    if (counter == v->suddenDeathWallCounter) {
+        return;
+    }
+    clearFrameViewWalls(v, v->numStaticWalls);
+    v->suddenDeathWallCounter = counter;
+
+    const mapEntry *map = v->e->map;
+    for (uint8_t ring = 1; ring <= counter; ring++) {
+        if (ring * 2 >= map->columns || ring * 2 >= map->rows) {
+            break;
+        }
+        const uint8_t lastCol = map->columns - 1 - ring;
+        const uint8_t lastRow = map->rows - 1 - ring;
+        for (uint8_t row = ring; row <= lastRow; row++) {
+            for (uint8_t col = ring; col <= lastCol; col++) {
+                if (row != ring && row != lastRow && col != ring && col != lastCol) {
+                    continue;
+                }
+                if (isStaticWallLayoutCell(map->layout[col + (row * map->columns)])) {
+                    continue;
+                }
+                addFrameViewWall(v, col, row, DEATH_WALL_ENTITY);
+            }
+        }
+    }
+}
+
+// explosions that finished rendering are removed here before the
+// renderer would free them so their slots can be reused; a slot is free
+// when its explosion has no render steps left
+static void removeFinishedFrameViewExplosions(frameView *v) {
+    CC_Array *explosions = v->e->explosions;
+    for (size_t i = cc_array_size(explosions); i > 0; i--) {
+        const explosionInfo *explInfo = explosions->buffer[i - 1];
+        if (explInfo->renderSteps == 0) {
+            cc_array_remove_at(explosions, i - 1, NULL);
+        }
+    }
+}
+
+static void addFrameViewExplosions(frameView *v, const traceFrame *frame) {
+    env *e = v->e;
+    removeFinishedFrameViewExplosions(v);
+    const traceExplosion *explosions = traceFrameExplosions(frame);
+    uint8_t slot = 0;
+    for (uint8_t i = 0; i < frame->numExplosions; i++) {
+        while (slot < FRAME_VIEW_MAX_EXPLOSIONS && v->explosions[slot].renderSteps != 0) {
+            slot++;
+        }
+        if (slot == FRAME_VIEW_MAX_EXPLOSIONS) {
+            return;
+        }
+        explosionInfo *explInfo = &v->explosions[slot];
+        *explInfo = (explosionInfo){0};
+        explInfo->def.position = explosions[i].pos;
+        explInfo->def.radius = explosions[i].radius;
+        explInfo->isBurst = explosions[i].isBurst;
+        explInfo->droneIdx = explosions[i].droneIdx;
+        explInfo->renderSteps = UINT16_MAX;
+        cc_array_add(e->explosions, explInfo);
+    }
+}
+
+static void resetFrameViewTrails(frameView *v) {
+    for (uint8_t i = 0; i < v->e->numDrones; i++) {
+        v->drones[i].trailPoints.length = 0;
+    }
+}
+
+// sets the view's entities to the state of the frame
+static void applyFrame(frameView *v, const traceFrame *frame) {
+    env *e = v->e;
+    if (frame->mapIdx != e->mapIdx) {
+        setFrameViewMap(v, frame->mapIdx);
+    }
+    setFrameViewSuddenDeathWalls(v, frame->suddenDeathWallCounter);
+    e->stepsLeft = frame->stepsLeft;
+    e->episodeLength = frame->frame;
+    v->episode = frame->episode;
+
+    const traceDrone *drones = traceFrameDrones(frame);
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const traceDrone *td = &drones[i];
+        droneEntity *drone = &v->drones[i];
+        drone->pos = td->pos;
+        drone->velocity = td->velocity;
+        drone->lastAim = td->aim;
+        drone->energyLeft = td->energyLeft;
+        drone->weaponInfo = weaponInfos[td->weapon];
+        drone->ammo = td->ammo;
+        drone->livesLeft = td->livesLeft;
+        drone->dead = td->flags & TRACE_DRONE_DEAD;
+        drone->braking = td->flags & TRACE_DRONE_BRAKING;
+        drone->chargingWeapon = td->flags & TRACE_DRONE_CHARGING_WEAPON;
+        drone->chargingBurst = td->flags & TRACE_DRONE_CHARGING_BURST;
+        drone->shotThisStep = td->flags & TRACE_DRONE_SHOT;
+
+        drone->shield = NULL;
+        if (td->flags & TRACE_DRONE_SHIELDED) {
+            drone->shield = &v->shields[i];
+            drone->shield->pos = td->pos;
+            drone->shield->health = td->shieldHealth;
+        }
+    }
+
+    cc_array_remove_all(e->floatingWalls);
+    const traceFloatingWall *walls = traceFrameFloatingWalls(frame);
+    for (uint8_t i = 0; i < min(frame->numFloatingWalls, MAX_FLOATING_WALLS); i++) {
+        wallEntity *wall = &v->floatingWalls[i];
+        wall->pos = walls[i].pos;
+        wall->rot = walls[i].rot;
+        wall->extent = (b2Vec2){.x = FLOATING_WALL_THICKNESS / 2.0f, .y = FLOATING_WALL_THICKNESS / 2.0f};
+        wall->type = walls[i].type;
+        wall->isFloating = true;
+        cc_array_add(e->floatingWalls, wall);
+    }
+
+    cc_array_remove_all(e->projectiles);
+    const traceProjectile *projectiles = traceFrameProjectiles(frame);
+    for (uint16_t i = 0; i < min(frame->numProjectiles, FRAME_VIEW_MAX_PROJECTILES); i++) {
+        projectileEntity *projectile = &v->projectiles[i];
+        projectile->pos = projectiles[i].pos;
+        projectile->weaponInfo = weaponInfos[projectiles[i].weapon];
+        projectile->droneIdx = projectiles[i].droneIdx;
+        cc_array_add(e->projectiles, projectile);
+    }
+
+    cc_array_remove_all(e->pickups);
+    const tracePickup *pickups = traceFramePickups(frame);
+    for (uint8_t i = 0; i < min(frame->numPickups, MAX_WEAPON_PICKUPS); i++) {
+        weaponPickupEntity *pickup = &v->pickups[i];
+        pickup->pos = pickups[i].pos;
+        pickup->weapon = pickups[i].weapon;
+        pickup->respawnWait = pickups[i].enabled ? 0.0f : 1.0f;
+        cc_array_add(e->pickups, pickup);
+    }
+}
+
+// creates a view of frames of envs with the given config, must be
+// paired with a call to destroyFrameView; the client can be set later
+// but must be before a frame is applied
+frameView *createFrameView(const uint8_t numDrones, const uint8_t numAgents, const uint8_t frameRate, const bool teamsEnabled, rayClient *client) {
+    frameView *v = fastCalloc(1, sizeof(frameView));
+    env *e = fastCalloc(1, sizeof(env));
+    v->e = e;
+    e->numDrones = numDrones;
+    e->numAgents = numAgents;
+    e->teamsEnabled = teamsEnabled;
+    e->frameRate = frameRate;
+    e->deltaTime = 1.0f / (float)frameRate;
+    e->mapIdx = -1;
+    e->client = client;
+
+    for (uint8_t i = 0; i < NUM_MAPS; i++) {
+        v->wallsCapacity = max(v->wallsCapacity, maps[i]->columns * maps[i]->rows);
+    }
+    v->walls = fastCalloc(v->wallsCapacity, sizeof(wallEntity));
+    v->projectiles = fastCalloc(FRAME_VIEW_MAX_PROJECTILES, sizeof(projectileEntity));
+
+    // the arrays are created with enough capacity that they never grow
+    create_array(&e->walls, v->wallsCapacity);
+    create_array(&e->floatingWalls, MAX_FLOATING_WALLS);
+    create_array(&e->drones, e->numDrones);
+    create_array(&e->pickups, MAX_WEAPON_PICKUPS);
+    create_array(&e->projectiles, FRAME_VIEW_MAX_PROJECTILES);
+    create_array(&e->explosions, FRAME_VIEW_MAX_EXPLOSIONS);
+    create_array(&e->dronePieces, 1);
+
+    v->drones = fastCalloc(e->numDrones, sizeof(droneEntity));
+    v->shields = fastCalloc(e->numDrones, sizeof(shieldEntity));
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneEntity *drone = &v->drones[i];
+        drone->idx = i;
+        drone->team = i;
+        if (e->teamsEnabled) {
+            drone->team = i / (e->numDrones / 2);
+        }
+        v->shields[i].drone = drone;
+        cc_array_add(e->drones, drone);
+    }
+
+    // generated map layouts are normally built by initMaps which needs
+    // a box2d world
+    generateMapLayouts();
+
+    return v;
+}
+
+void destroyFrameView(frameView *v) {
+    env *e = v->e;
+    cc_array_destroy(e->walls);
+    cc_array_destroy(e->floatingWalls);
+    cc_array_destroy(e->drones);
+    cc_array_destroy(e->pickups);
+    cc_array_destroy(e->projectiles);
+    cc_array_destroy(e->explosions);
+    cc_array_destroy(e->dronePieces);
+    fastFree(e);
+
+    fastFree(v->drones);
+    fastFree(v->shields);
+    fastFree(v->projectiles);
+    fastFree(v->walls);
+    fastFree(v);
+}
+
+// moves the view to a frame that may not follow the last one applied
+void setFrameView(frameView *v, const traceFrame *frame) {
+    resetFrameViewTrails(v);
+    applyFrame(v, frame);
+}
+
+// moves the view to the frame that follows the last one applied,
+// starting its explosions and extending drone trails
+void advanceFrameView(frameView *v, const traceFrame *frame) {
+    if (frame->episode != v->episode) {
+        resetFrameViewTrails(v);
+    }
+    applyFrame(v, frame);
+    addFrameViewExplosions(v, frame);
+    for (uint8_t i = 0; i < v->e->numDrones; i++) {
+        droneEntity *drone = &v->drones[i];
+        if (!drone->dead) {
+            updateTrailPoints(&drone->trailPoints, MAX_DRONE_TRAIL_POINTS, drone->pos);
+        }
+    }
+}
+
+void renderFrameView(frameView *v) {
+    removeFinishedFrameViewExplosions(v);
+    renderEnv(v->e, false, false, -1, -1);
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "helpers.h"
 #include "settings.h"
+#include "trace.h"
 #include "types.h"
 
 // these functions call each other so need to be forward declared
@@ -11,52 +12,77 @@ void createExplosion(env *e, droneEntity *drone, const projectileEntity *project
 
 void updateTrailPoints(trailPoints *tp, const uint8_t maxLen, const b2Vec2 pos);
 
+// envs that share a box2d world have their arenas placed at different
+// offsets in it; positions stored in entities are always relative to
+// the env's arena and are only converted when passed to or from box2d
+static inline b2Vec2 arenaToWorldPos(const env *e, const b2Vec2 pos) {
+    return b2Add(pos, e->arenaOffset);
+}
+
+static inline b2Vec2 worldToArenaPos(const env *e, const b2Vec2 pos) {
+    return b2Sub(pos, e->arenaOffset);
+}
+
 entity *createEntity(env *e, enum entityType type, void *entityData) {
-    int32_t id = b2AllocId(&e->idPool);
+    int32_t idx = b2AllocId(&e->idPool);
+    ASSERTF((uint32_t)idx < ENTITY_INDEX_MASK, "too many entities: %d", idx);
     entity *ent = NULL;
-    if (id == (int64_t)cc_array_size(e->entities)) {
+    if (idx == (int64_t)cc_array_size(e->entities)) {
         ent = fastCalloc(1, sizeof(entity));
-        ent->id = fastCalloc(1, sizeof(entityID));
         cc_array_add(e->entities, ent);
     } else {
-        ent = safe_array_get_at(e->entities, id);
+        ent = safe_array_get_at(e->entities, idx);
     }
 
-    ent->generation += 1;
+    ent->generation = (ent->generation + 1) & ENTITY_GENERATION_MASK;
+    ent->env = e;
     ent->type = type;
     ent->entity = entityData;
-    ent->id->id = id + 1,
-    ent->id->generation = ent->generation;
+    ent->id = ((entityID)ent->generation << ENTITY_INDEX_BITS) | (entityID)(idx + 1);
 
     return ent;
 }
 
 void destroyEntity(env *e, entity *ent) {
-    b2FreeId(&e->idPool, ent->id->id - 1);
-    ent->id->id = 0;
+    b2FreeId(&e->idPool, (ent->id & ENTITY_INDEX_MASK) - 1);
+    ent->id = 0;
 }
 
 // will return a pointer to an entity or NULL if the given entity ID is
 // invalid or orphaned
-entity *getEntityByID(const env *e, const entityID *id) {
-    if (id->id < 1 || (int64_t)cc_array_size(e->entities) < id->id) {
+entity *getEntityByID(const env *e, const entityID id) {
+    const uint32_t idx = (id & ENTITY_INDEX_MASK) - 1;
+    if (idx >= cc_array_size(e->entities)) {
         // invalid index
         return NULL;
     }
-    entity *ent = safe_array_get_at(e->entities, id->id - 1);
-    if (ent->id->id == 0 || ent->generation != id->generation) {
-        // orphaned entity
+    // destroyed entities have an ID of 0 and reused entities have a
+    // different generation, so this check catches orphaned entities
+    entity *ent = e->entities->buffer[idx];
+    if (ent->id != id) {
         return NULL;
     }
     return ent;
 }
 
+static inline droneMask droneBit(const uint8_t droneIdx) {
+    return (droneMask)1 << droneIdx;
+}
+
+// returns the lowest drone index in the mask and removes it
+static inline uint8_t popDroneIdx(droneMask *mask) {
+    ASSERT(*mask != 0);
+    const uint8_t idx = __builtin_ctz(*mask);
+    *mask &= *mask - 1;
+    return idx;
+}
+
 static inline bool entityTypeIsWall(const enum entityType type) {
     // walls are the first 3 entity types
     return type <= DEATH_WALL_ENTITY;
 }
 
-static inline int16_t cellIndex(const env *e, const int8_t col, const int8_t row) {
+static inline int16_t cellIndex(const env *e, const int16_t col, const int16_t row) {
     return col + (row * e->map->columns);
 }
 
@@ -65,8 +91,8 @@ static inline int16_t cellIndex(const env *e, const int8_t col, const int8_t row
 static inline int16_t entityPosToCellIdx(const env *e, const b2Vec2 pos) {
     const float cellX = pos.x + (((float)e->map->columns * WALL_THICKNESS) / 2.0f);
     const float cellY = pos.y + (((float)e->map->rows * WALL_THICKNESS) / 2.0f);
-    const int8_t cellCol = cellX / WALL_THICKNESS;
-    const int8_t cellRow = cellY / WALL_THICKNESS;
+    const int16_t cellCol = cellX / WALL_THICKNESS;
+    const int16_t cellRow = cellY / WALL_THICKNESS;
     const int16_t cellIdx = cellIndex(e, cellCol, cellRow);
     // set the cell to -1 if it's out of bounds
     if (cellIdx < 0 || (uint16_t)cellIdx >= cc_array_size(e->cells)) {
@@ -92,7 +118,8 @@ bool overlapAABBCallback(b2ShapeId shapeID, void *context) {
 
 // returns true if the given position overlaps with shapes in a bounding
 // box with a height and width of distance
-bool isOverlappingAABB(const env *e, const b2Vec2 pos, const float distance, const b2QueryFilter filter) {
+bool isOverlappingAABB(const env *e, const b2Vec2 arenaPos, const float distance, const b2QueryFilter filter) {
+    const b2Vec2 pos = arenaToWorldPos(e, arenaPos);
     b2AABB bounds = {
         .lowerBound = {.x = pos.x - distance, .y = pos.y - distance},
         .upperBound = {.x = pos.x + distance, .y = pos.y + distance},
@@ -148,6 +175,19 @@ b2ShapeProxy makeDistanceProxy(const entity *ent, bool *isCircle) {
         proxy.radius = proj->weaponInfo->radius;
         return proxy;
     }
+    if (entityTypeIsWall(ent->type)) {
+        // merged static wall boxes can span many cells
+        const wallEntity *wall = ent->entity;
+        if (wall->boxColumns != 0) {
+            b2ShapeProxy proxy = {0};
+            proxy.count = 4;
+            proxy.points[0] = (b2Vec2){.x = -wall->extent.x, .y = -wall->extent.y};
+            proxy.points[1] = (b2Vec2){.x = -wall->extent.x, .y = +wall->extent.y};
+            proxy.points[2] = (b2Vec2){.x = +wall->extent.x, .y = -wall->extent.y};
+            proxy.points[3] = (b2Vec2){.x = +wall->extent.x, .y = +wall->extent.y};
+            return proxy;
+        }
+    }
 
     return makeDistanceProxyFromType(ent->type, isCircle);
 }
@@ -240,7 +280,7 @@ bool posBehindWall(const env *e, const b2Vec2 srcPos, const b2Vec2 dstPos, const
         .targetType = targetType,
         .hit = false,
     };
-    b2World_CastRay(e->worldID, srcPos, translation, filter, posBehindWallCallback, &ctx);
+    b2World_CastRay(e->worldID, arenaToWorldPos(e, srcPos), translation, filter, posBehindWallCallback, &ctx);
     return ctx.hit;
 }
 
@@ -276,7 +316,8 @@ bool isOverlappingCircleCallback(b2ShapeId shapeID, void *context) {
 }
 
 bool isOverlappingCircleInLineOfSight(const env *e, const entity *ent, const b2Vec2 startPos, const float radius, const b2QueryFilter filter, const enum entityType *targetType) {
-    const b2ShapeProxy cirProxy = b2MakeProxy(&startPos, 1, radius);
+    const b2Vec2 worldPos = arenaToWorldPos(e, startPos);
+    const b2ShapeProxy cirProxy = b2MakeProxy(&worldPos, 1, radius);
     overlapCircleCtx ctx = {
         .e = e,
         .ent = ent,
@@ -291,7 +332,7 @@ bool isOverlappingCircleInLineOfSight(const env *e, const entity *ent, const b2V
     return ctx.overlaps;
 }
 
-uint8_t cellOffsets[8][2] = {
+int8_t cellOffsets[8][2] = {
     {-1, 0},  // left
     {1, 0},   // right
     {0, -1},  // up
@@ -332,10 +373,10 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
         if (quad == -1) {
             cellIdx = randInt(&e->randState, 0, nCells);
         } else {
-            const float minX = e->map->spawnQuads[quad].min.x;
-            const float minY = e->map->spawnQuads[quad].min.y;
-            const float maxX = e->map->spawnQuads[quad].max.x;
-            const float maxY = e->map->spawnQuads[quad].max.y;
+            const float minX = e->mapData->spawnQuads[quad].min.x;
+            const float minY = e->mapData->spawnQuads[quad].min.y;
+            const float maxX = e->mapData->spawnQuads[quad].max.x;
+            const float maxY = e->mapData->spawnQuads[quad].max.y;
 
             b2Vec2 randPos = {.x = randFloat(&e->randState, minX, maxX), .y = randFloat(&e->randState, minY, maxY)};
             cellIdx = entityPosToCellIdx(e, randPos);
@@ -377,8 +418,8 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
                 const uint8_t cellRow = cellIdx % e->map->columns;
                 bool deathWallNeighboring = false;
                 for (uint8_t i = 0; i < 8; i++) {
-                    const int8_t col = cellCol + cellOffsets[i][0];
-                    const int8_t row = cellRow + cellOffsets[i][1];
+                    const int16_t col = cellCol + cellOffsets[i][0];
+                    const int16_t row = cellRow + cellOffsets[i][1];
                     if (row < 0 || row >= e->map->rows || col < 0 || col >= e->map->columns) {
                         continue;
                     }
@@ -393,7 +434,7 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
                     continue;
                 }
             } else {
-                if (!e->map->droneSpawns[cellIdx]) {
+                if (!e->mapData->droneSpawns[cellIdx]) {
                     continue;
                 }
 
@@ -427,21 +468,7 @@ bool findOpenPos(env *e, const enum shapeCategory shapeType, b2Vec2 *emptyPos, i
     }
 }
 
-entity *createWall(env *e, const b2Vec2 pos, const float width, const float height, int16_t cellIdx, const enum entityType type, const bool floating) {
-    ASSERT(cellIdx != -1);
-    ASSERT(entityTypeIsWall(type));
-
-    b2BodyDef wallBodyDef = b2DefaultBodyDef();
-    wallBodyDef.position = pos;
-    if (floating) {
-        wallBodyDef.type = b2_dynamicBody;
-        wallBodyDef.linearDamping = FLOATING_WALL_DAMPING;
-        wallBodyDef.angularDamping = FLOATING_WALL_DAMPING;
-        wallBodyDef.isAwake = false;
-    }
-    b2BodyId wallBodyID = b2CreateBody(e->worldID, &wallBodyDef);
-
-    b2Vec2 extent = {.x = width / 2.0f, .y = height / 2.0f};
+b2ShapeDef createWallShapeDef(const enum entityType type, const bool floating) {
     b2ShapeDef wallShapeDef = b2DefaultShapeDef();
     wallShapeDef.invokeContactCreation = false;
     wallShapeDef.density = WALL_DENSITY;
@@ -462,8 +489,13 @@ entity *createWall(env *e, const b2Vec2 pos, const float width, const float heig
         wallShapeDef.enableContactEvents = true;
     }
 
+    return wallShapeDef;
+}
+
+wallEntity *createWallEntity(env *e, const b2Vec2 pos, const b2Vec2 extent, const int16_t cellIdx, const enum entityType type, const bool floating) {
     wallEntity *wall = fastCalloc(1, sizeof(wallEntity));
-    wall->bodyID = wallBodyID;
+    wall->bodyID = b2_nullBodyId;
+    wall->shapeID = b2_nullShapeId;
     wall->pos = pos;
     wall->rot = b2Rot_identity;
     wall->velocity = b2Vec2_zero;
@@ -476,18 +508,76 @@ entity *createWall(env *e, const b2Vec2 pos, const float width, const float heig
     entity *ent = createEntity(e, type, wall);
     wall->ent = ent;
 
-    wallShapeDef.userData = ent;
-    const b2Polygon wallPolygon = b2MakeBox(extent.x, extent.y);
-    wall->shapeID = b2CreatePolygonShape(wallBodyID, &wallShapeDef, &wallPolygon);
-    b2Body_SetUserData(wall->bodyID, ent);
+    return wall;
+}
 
-    if (floating) {
-        cc_array_add(e->floatingWalls, wall);
-    } else {
+// static walls don't get a physics body or shape of their own, they are
+// only used for observations and lookups by map cell; createWallBox
+// must be called to create the shapes that cover them
+entity *createWall(env *e, const b2Vec2 pos, const float width, const float height, int16_t cellIdx, const enum entityType type, const bool floating) {
+    ASSERT(cellIdx != -1);
+    ASSERT(entityTypeIsWall(type));
+
+    const b2Vec2 extent = {.x = width / 2.0f, .y = height / 2.0f};
+    wallEntity *wall = createWallEntity(e, pos, extent, cellIdx, type, floating);
+    if (!floating) {
+        wall->bodyID = e->wallsBodyID;
         cc_array_add(e->walls, wall);
+        return wall->ent;
     }
 
-    return ent;
+    b2BodyDef wallBodyDef = b2DefaultBodyDef();
+    wallBodyDef.position = arenaToWorldPos(e, pos);
+    wallBodyDef.type = b2_dynamicBody;
+    wallBodyDef.linearDamping = FLOATING_WALL_DAMPING;
+    wallBodyDef.angularDamping = FLOATING_WALL_DAMPING;
+    wallBodyDef.isAwake = false;
+    wall->bodyID = b2CreateBody(e->worldID, &wallBodyDef);
+
+    b2ShapeDef wallShapeDef = createWallShapeDef(type, floating);
+    wallShapeDef.userData = wall->ent;
+    const b2Polygon wallPolygon = b2MakeBox(extent.x, extent.y);
+    wall->shapeID = b2CreatePolygonShape(wall->bodyID, &wallShapeDef, &wallPolygon);
+    b2Body_SetUserData(wall->bodyID, wall->ent);
+
+    cc_array_add(e->floatingWalls, wall);
+
+    return wall->ent;
+}
+
+// creates a single box shape on the static walls body that covers
+// columns x rows static walls of the same type starting at cellIdx
+void createWallBox(env *e, const int16_t cellIdx, const uint8_t columns, const uint8_t rows, const enum entityType type) {
+    ASSERT(cellIdx != -1);
+    ASSERT(columns != 0 && rows != 0);
+    ASSERT(entityTypeIsWall(type));
+
+    const mapCell *startCell = safe_array_get_at(e->cells, cellIdx);
+    const b2Vec2 pos = {
+        .x = startCell->pos.x + ((columns - 1) * WALL_THICKNESS / 2.0f),
+        .y = startCell->pos.y + ((rows - 1) * WALL_THICKNESS / 2.0f),
+    };
+    const b2Vec2 extent = {.x = columns * WALL_THICKNESS / 2.0f, .y = rows * WALL_THICKNESS / 2.0f};
+    wallEntity *box = createWallEntity(e, pos, extent, cellIdx, type, false);
+    box->boxColumns = columns;
+    box->boxRows = rows;
+    box->bodyID = e->wallsBodyID;
+
+    b2ShapeDef wallShapeDef = createWallShapeDef(type, false);
+    wallShapeDef.userData = box->ent;
+    const b2Polygon boxPolygon = b2MakeOffsetBox(extent.x, extent.y, pos, b2Rot_identity);
+    box->shapeID = b2CreatePolygonShape(e->wallsBodyID, &wallShapeDef, &boxPolygon);
+
+    for (uint8_t row = 0; row < rows; row++) {
+        for (uint8_t col = 0; col < columns; col++) {
+            const mapCell *cell = safe_array_get_at(e->cells, cellIdx + (row * e->map->columns) + col);
+            ASSERT(cell->ent != NULL && cell->ent->type == type);
+            wallEntity *wall = cell->ent->entity;
+            wall->shapeID = box->shapeID;
+        }
+    }
+
+    cc_array_add(e->wallBoxes, box);
 }
 
 void destroyWall(env *e, wallEntity *wall, const bool full) {
@@ -498,7 +588,13 @@ void destroyWall(env *e, wallEntity *wall, const bool full) {
         cell->ent = NULL;
     }
 
-    b2DestroyBody(wall->bodyID);
+    // static walls share the static walls body, only box walls own
+    // their shape
+    if (wall->isFloating) {
+        b2DestroyBody(wall->bodyID);
+    } else if (wall->boxColumns != 0) {
+        b2DestroyShape(wall->shapeID, false);
+    }
     fastFree(wall);
 }
 
@@ -538,7 +634,7 @@ void createWeaponPickupBodyShape(const env *e, weaponPickupEntity *pickup) {
     pickup->bodyDestroyed = false;
 
     b2BodyDef pickupBodyDef = b2DefaultBodyDef();
-    pickupBodyDef.position = pickup->pos;
+    pickupBodyDef.position = arenaToWorldPos(e, pickup->pos);
     pickupBodyDef.userData = pickup->ent;
     pickup->bodyID = b2CreateBody(e->worldID, &pickupBodyDef);
 
@@ -628,7 +724,7 @@ void createDroneShield(env *e, droneEntity *drone, const int8_t groupIdx) {
     b2BodyDef shieldBodyDef = b2DefaultBodyDef();
     shieldBodyDef.type = b2_kinematicBody;
     shieldBodyDef.fixedRotation = true;
-    shieldBodyDef.position = drone->pos;
+    shieldBodyDef.position = arenaToWorldPos(e, drone->pos);
     b2BodyId shieldBodyID = b2CreateBody(e->worldID, &shieldBodyDef);
 
     b2ShapeDef shieldShapeDef = b2DefaultShapeDef();
@@ -670,30 +766,12 @@ void createDroneShield(env *e, droneEntity *drone, const int8_t groupIdx) {
     drone->shield = shield;
 }
 
-void createDrone(env *e, const uint8_t idx) {
+// creates a drone at pos without a shield
+droneEntity *createDroneAtPos(env *e, const uint8_t idx, const b2Vec2 pos) {
     const int8_t groupIdx = -(idx + 1);
     b2BodyDef droneBodyDef = b2DefaultBodyDef();
     droneBodyDef.type = b2_dynamicBody;
-
-    int8_t spawnQuad = -1;
-    if (!e->isTraining) {
-        // spawn drones in diagonal quadrants from each other so that
-        // they're more likely to be further apart if we're not training;
-        // doing this while training will result in much slower learning
-        // due to drones starting much farther apart
-        if (e->lastSpawnQuad == -1) {
-            spawnQuad = randInt(&e->randState, 0, 3);
-        } else if (e->numDrones == 2) {
-            spawnQuad = 3 - e->lastSpawnQuad;
-        } else {
-            spawnQuad = (e->lastSpawnQuad + 1) % 4;
-        }
-        e->lastSpawnQuad = spawnQuad;
-    }
-    if (!findOpenPos(e, DRONE_SHAPE, &droneBodyDef.position, spawnQuad)) {
-        ERROR("no open position for drone");
-    }
-
+    droneBodyDef.position = arenaToWorldPos(e, pos);
     droneBodyDef.fixedRotation = true;
     droneBodyDef.linearDamping = DRONE_LINEAR_DAMPING;
     b2BodyId droneBodyID = b2CreateBody(e->worldID, &droneBodyDef);
@@ -718,9 +796,9 @@ void createDrone(env *e, const uint8_t idx) {
     if (e->teamsEnabled) {
         drone->team = idx / (e->numDrones / 2);
     }
-    drone->initalPos = droneBodyDef.position;
-    drone->pos = droneBodyDef.position;
-    drone->mapCellIdx = entityPosToCellIdx(e, droneBodyDef.position);
+    drone->initalPos = pos;
+    drone->pos = pos;
+    drone->mapCellIdx = entityPosToCellIdx(e, pos);
     drone->lastAim = (b2Vec2){.x = 0.0f, .y = -1.0f};
     drone->livesLeft = DRONE_LIVES;
     drone->respawnGuideLifetime = UINT16_MAX;
@@ -735,7 +813,32 @@ void createDrone(env *e, const uint8_t idx) {
 
     cc_array_add(e->drones, drone);
 
-    createDroneShield(e, drone, groupIdx);
+    return drone;
+}
+
+void createDrone(env *e, const uint8_t idx) {
+    int8_t spawnQuad = -1;
+    if (!e->isTraining) {
+        // spawn drones in diagonal quadrants from each other so that
+        // they're more likely to be further apart if we're not training;
+        // doing this while training will result in much slower learning
+        // due to drones starting much farther apart
+        if (e->lastSpawnQuad == -1) {
+            spawnQuad = randInt(&e->randState, 0, 3);
+        } else if (e->numDrones == 2) {
+            spawnQuad = 3 - e->lastSpawnQuad;
+        } else {
+            spawnQuad = (e->lastSpawnQuad + 1) % 4;
+        }
+        e->lastSpawnQuad = spawnQuad;
+    }
+    b2Vec2 pos;
+    if (!findOpenPos(e, DRONE_SHAPE, &pos, spawnQuad)) {
+        ERROR("no open position for drone");
+    }
+
+    droneEntity *drone = createDroneAtPos(e, idx, pos);
+    createDroneShield(e, drone, -(idx + 1));
 }
 
 void droneAddEnergy(droneEntity *drone, float energy) {
@@ -747,14 +850,9 @@ void droneAddEnergy(droneEntity *drone, float energy) {
     }
 }
 
-void createDronePiece(env *e, droneEntity *drone, const bool fromShield) {
-    const float distance = randFloat(&e->randState, DRONE_PIECE_MIN_DISTANCE, DRONE_PIECE_MAX_DISTANCE);
-    const b2Vec2 direction = {.x = randFloat(&e->randState, -1.0f, 1.0f), .y = randFloat(&e->randState, -1.0f, 1.0f)};
-    const b2Vec2 pos = b2MulAdd(drone->pos, distance, direction);
-    const b2Rot rot = b2MakeRot(randFloat(&e->randState, -PI, PI));
-
+dronePieceEntity *createDronePieceAtPos(env *e, const uint8_t droneIdx, const b2Vec2 pos, const b2Rot rot, const b2Vec2 velocity, const float angularVelocity, const bool fromShield) {
     dronePieceEntity *piece = fastCalloc(1, sizeof(dronePieceEntity));
-    piece->droneIdx = drone->idx;
+    piece->droneIdx = droneIdx;
     piece->pos = pos;
     piece->rot = rot;
     piece->isShieldPiece = fromShield;
@@ -766,14 +864,12 @@ void createDronePiece(env *e, droneEntity *drone, const bool fromShield) {
     b2BodyDef pieceBodyDef = b2DefaultBodyDef();
     pieceBodyDef.type = b2_dynamicBody;
 
-    pieceBodyDef.position = pos;
+    pieceBodyDef.position = arenaToWorldPos(e, pos);
     pieceBodyDef.rotation = rot;
     pieceBodyDef.linearDamping = DRONE_PIECE_LINEAR_DAMPING;
     pieceBodyDef.angularDamping = DRONE_PIECE_ANGULAR_DAMPING;
-    const float bonus = 1.0f + min(b2Length(drone->velocity) / 15.0f, 5.0f);
-    const float speed = randFloat(&e->randState, DRONE_PIECE_MIN_SPEED, DRONE_PIECE_MAX_SPEED) * bonus;
-    pieceBodyDef.linearVelocity = b2MulSV(speed, direction);
-    pieceBodyDef.angularVelocity = randFloat(&e->randState, -PI, PI);
+    pieceBodyDef.linearVelocity = velocity;
+    pieceBodyDef.angularVelocity = angularVelocity;
     pieceBodyDef.userData = ent;
     piece->bodyID = b2CreateBody(e->worldID, &pieceBodyDef);
 
@@ -800,6 +896,20 @@ void createDronePiece(env *e, droneEntity *drone, const bool fromShield) {
     piece->shapeID = b2CreatePolygonShape(piece->bodyID, &pieceShapeDef, &piecePolygon);
 
     cc_array_add(e->dronePieces, piece);
+
+    return piece;
+}
+
+void createDronePiece(env *e, droneEntity *drone, const bool fromShield) {
+    const float distance = randFloat(&e->randState, DRONE_PIECE_MIN_DISTANCE, DRONE_PIECE_MAX_DISTANCE);
+    const b2Vec2 direction = {.x = randFloat(&e->randState, -1.0f, 1.0f), .y = randFloat(&e->randState, -1.0f, 1.0f)};
+    const b2Vec2 pos = b2MulAdd(drone->pos, distance, direction);
+    const b2Rot rot = b2MakeRot(randFloat(&e->randState, -PI, PI));
+
+    const float bonus = 1.0f + min(b2Length(drone->velocity) / 15.0f, 5.0f);
+    const float speed = randFloat(&e->randState, DRONE_PIECE_MIN_SPEED, DRONE_PIECE_MAX_SPEED) * bonus;
+    const float angularVelocity = randFloat(&e->randState, -PI, PI);
+    createDronePieceAtPos(e, drone->idx, pos, rot, b2MulSV(speed, direction), angularVelocity, fromShield);
 }
 
 void destroyDronePiece(env *e, dronePieceEntity *piece) {
@@ -884,7 +994,7 @@ bool respawnDrone(env *e, droneEntity *drone) {
     if (!findOpenPos(e, DRONE_SHAPE, &pos, -1)) {
         return false;
     }
-    b2Body_SetTransform(drone->bodyID, pos, b2Rot_identity);
+    b2Body_SetTransform(drone->bodyID, arenaToWorldPos(e, pos), b2Rot_identity);
     b2Body_Enable(drone->bodyID);
     b2Body_SetLinearDamping(drone->bodyID, DRONE_LINEAR_DAMPING);
 
@@ -903,6 +1013,38 @@ bool respawnDrone(env *e, droneEntity *drone) {
     return true;
 }
 
+// creates the body and shapes of a projectile at pos, the projectile's
+// weapon and entity must already be set
+void createProjectileBodyShapes(const env *e, projectileEntity *projectile, const b2Vec2 pos) {
+    const weaponInformation *weaponInfo = projectile->weaponInfo;
+
+    b2BodyDef projectileBodyDef = b2DefaultBodyDef();
+    projectileBodyDef.type = b2_dynamicBody;
+    projectileBodyDef.isBullet = weaponInfo->isPhysicsBullet;
+    projectileBodyDef.linearDamping = weaponInfo->damping;
+    projectileBodyDef.enableSleep = weaponInfo->canSleep;
+    projectileBodyDef.position = arenaToWorldPos(e, pos);
+    projectileBodyDef.userData = projectile->ent;
+    projectile->bodyID = b2CreateBody(e->worldID, &projectileBodyDef);
+
+    b2ShapeDef projectileShapeDef = b2DefaultShapeDef();
+    projectileShapeDef.enableContactEvents = true;
+    projectileShapeDef.density = weaponInfo->density;
+    projectileShapeDef.material.restitution = 1.0f;
+    projectileShapeDef.material.friction = 0.0f;
+    projectileShapeDef.filter.categoryBits = PROJECTILE_SHAPE;
+    projectileShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | PROJECTILE_SHAPE | DRONE_SHAPE | SHIELD_SHAPE;
+    projectileShapeDef.userData = projectile->ent;
+    const b2Circle projectileCircle = {.center = b2Vec2_zero, .radius = weaponInfo->radius};
+    projectile->shapeID = b2CreateCircleShape(projectile->bodyID, &projectileShapeDef, &projectileCircle);
+
+    // create a sensor shape if needed
+    if (weaponInfo->hasSensor) {
+        projectile->sensorID = weaponSensor(projectile->bodyID, weaponInfo->type);
+        b2Shape_SetUserData(projectile->sensorID, projectile->ent);
+    }
+}
+
 void createProjectile(env *e, droneEntity *drone, const b2Vec2 normAim) {
     ASSERT_VEC_NORMALIZED(normAim);
 
@@ -930,65 +1072,36 @@ void createProjectile(env *e, droneEntity *drone, const b2Vec2 normAim) {
         const b2Vec2 rayEnd = b2MulAdd(drone->pos, droneRadius + (radius * 2.5f), normAim);
         const b2Vec2 translation = b2Sub(rayEnd, drone->pos);
         const b2QueryFilter filter = {.categoryBits = PROJECTILE_SHAPE, .maskBits = WALL_SHAPE};
-        const b2RayResult rayRes = b2World_CastRayClosest(e->worldID, drone->pos, translation, filter);
+        const b2RayResult rayRes = b2World_CastRayClosest(e->worldID, arenaToWorldPos(e, drone->pos), translation, filter);
         if (rayRes.hit) {
             const b2Vec2 invNormAim = b2MulSV(-1.0f, normAim);
-            pos = b2MulAdd(rayRes.point, radius * 1.5f, invNormAim);
+            pos = b2MulAdd(worldToArenaPos(e, rayRes.point), radius * 1.5f, invNormAim);
         }
     }
 
-    b2BodyDef projectileBodyDef = b2DefaultBodyDef();
-    projectileBodyDef.type = b2_dynamicBody;
-    projectileBodyDef.isBullet = drone->weaponInfo->isPhysicsBullet;
-    projectileBodyDef.linearDamping = drone->weaponInfo->damping;
-    projectileBodyDef.enableSleep = drone->weaponInfo->canSleep;
-    projectileBodyDef.position = pos;
-    b2BodyId projectileBodyID = b2CreateBody(e->worldID, &projectileBodyDef);
-    b2ShapeDef projectileShapeDef = b2DefaultShapeDef();
-    projectileShapeDef.enableContactEvents = true;
-    projectileShapeDef.density = drone->weaponInfo->density;
-    projectileShapeDef.material.restitution = 1.0f;
-    projectileShapeDef.material.friction = 0.0f;
-    projectileShapeDef.filter.categoryBits = PROJECTILE_SHAPE;
-    projectileShapeDef.filter.maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | PROJECTILE_SHAPE | DRONE_SHAPE | SHIELD_SHAPE;
-    const b2Circle projectileCircle = {.center = b2Vec2_zero, .radius = radius};
-
-    b2ShapeId projectileShapeID = b2CreateCircleShape(projectileBodyID, &projectileShapeDef, &projectileCircle);
+    projectileEntity *projectile = fastCalloc(1, sizeof(projectileEntity));
+    projectile->droneIdx = drone->idx;
+    projectile->weaponInfo = drone->weaponInfo;
+    entity *ent = createEntity(e, PROJECTILE_ENTITY, projectile);
+    projectile->ent = ent;
+    createProjectileBodyShapes(e, projectile, pos);
 
     // add a bit of lateral drone velocity to projectile
     b2Vec2 forwardVel = b2MulSV(b2Dot(drone->velocity, normAim), normAim);
     b2Vec2 lateralVel = b2Sub(drone->velocity, forwardVel);
-    lateralVel = b2MulSV(projectileShapeDef.density * DRONE_MOVE_AIM_COEF, lateralVel);
+    lateralVel = b2MulSV(drone->weaponInfo->density * DRONE_MOVE_AIM_COEF, lateralVel);
     b2Vec2 aim = weaponAdjustAim(&e->randState, drone->weaponInfo->type, drone->heat, normAim);
     b2Vec2 fire = b2MulAdd(lateralVel, weaponFire(&e->randState, drone->weaponInfo->type), aim);
-    b2Body_ApplyLinearImpulseToCenter(projectileBodyID, fire, true);
+    b2Body_ApplyLinearImpulseToCenter(projectile->bodyID, fire, true);
 
-    projectileEntity *projectile = fastCalloc(1, sizeof(projectileEntity));
-    projectile->droneIdx = drone->idx;
-    projectile->bodyID = projectileBodyID;
-    projectile->shapeID = projectileShapeID;
-    projectile->weaponInfo = drone->weaponInfo;
-    projectile->pos = projectileBodyDef.position;
-    projectile->lastPos = projectileBodyDef.position;
-    projectile->velocity = b2Body_GetLinearVelocity(projectileBodyID);
+    projectile->pos = pos;
+    projectile->lastPos = pos;
+    projectile->velocity = b2Body_GetLinearVelocity(projectile->bodyID);
     projectile->lastVelocity = projectile->velocity;
     projectile->speed = b2Length(projectile->velocity);
     projectile->lastSpeed = projectile->speed;
-    if (projectile->weaponInfo->type == BLACK_HOLE_WEAPON) {
-        create_array(&projectile->entsInBlackHole, 4);
-    }
+    projectile->idx = cc_array_size(e->projectiles);
     cc_array_add(e->projectiles, projectile);
-
-    entity *ent = createEntity(e, PROJECTILE_ENTITY, projectile);
-    projectile->ent = ent;
-    b2Body_SetUserData(projectile->bodyID, ent);
-    b2Shape_SetUserData(projectile->shapeID, ent);
-
-    // create a sensor shape if needed
-    if (projectile->weaponInfo->hasSensor) {
-        projectile->sensorID = weaponSensor(projectile->bodyID, projectile->weaponInfo->type);
-        b2Shape_SetUserData(projectile->sensorID, ent);
-    }
 }
 
 // compute value generally from 0-1 based off of how much a projectile(s)
@@ -1000,15 +1113,9 @@ float computeHitStrength(const droneEntity *hitDrone) {
 }
 
 // simplified and copied from box2d/src/shape.c
-float getShapeProjectedPerimeter(const b2ShapeId shapeID, const b2Vec2 line) {
-    if (b2Shape_GetType(shapeID) == b2_circleShape) {
-        const b2Circle circle = b2Shape_GetCircle(shapeID);
-        return circle.radius * 2.0f;
-    }
-
-    const b2Polygon polygon = b2Shape_GetPolygon(shapeID);
-    const b2Vec2 *points = polygon.vertices;
-    int count = polygon.count;
+float getPolygonProjectedPerimeter(const b2Polygon *polygon, const b2Vec2 line) {
+    const b2Vec2 *points = polygon->vertices;
+    int count = polygon->count;
     B2_ASSERT(count > 0);
     float value = b2Dot(points[0], line);
     float lower = value;
@@ -1022,6 +1129,16 @@ float getShapeProjectedPerimeter(const b2ShapeId shapeID, const b2Vec2 line) {
     return upper - lower;
 }
 
+float getShapeProjectedPerimeter(const b2ShapeId shapeID, const b2Vec2 line) {
+    if (b2Shape_GetType(shapeID) == b2_circleShape) {
+        const b2Circle circle = b2Shape_GetCircle(shapeID);
+        return circle.radius * 2.0f;
+    }
+
+    const b2Polygon polygon = b2Shape_GetPolygon(shapeID);
+    return getPolygonProjectedPerimeter(&polygon, line);
+}
+
 // explodes projectile and ensures any other projectiles that are caught
 // in the explosion are also destroyed if necessary
 void createProjectileExplosion(env *e, projectileEntity *projectile, const bool initalProjectile) {
@@ -1038,6 +1155,9 @@ void createProjectileExplosion(env *e, projectileEntity *projectile, const bool
     droneEntity *parentDrone = safe_array_get_at(e->drones, projectile->droneIdx);
     createExplosion(e, parentDrone, projectile, &explosion);
 
+    if (e->frameEvents != NULL) {
+        recordFrameExplosion(e, &explosion, projectile->droneIdx, false);
+    }
     if (e->client != NULL) {
         explosionInfo *explInfo = fastCalloc(1, sizeof(explosionInfo));
         explInfo->def = explosion;
@@ -1093,16 +1213,43 @@ typedef struct explosionCtx {
 
 const float COS_85_DEGREES = 0.087155743f;
 
-// b2World_Explode doesn't support filtering on shapes of the same category,
-// so we have to do it manually
-// mostly copied from box2d/src/world.c
-bool explodeCallback(b2ShapeId shapeID, void *context) {
-    if (!b2Shape_IsValid(shapeID)) {
-        return true;
+// returns true if a ray from pos to a point on a wall cell of a merged
+// box enters the box before reaching the point, meaning nearer cells of
+// the same box hide the cell; posBehindWall can't tell as it ignores
+// the whole box
+static bool cellBehindWallBox(const wallEntity *box, const b2Vec2 pos, const b2Vec2 cellPoint) {
+    const b2Vec2 lower = b2Sub(box->pos, box->extent);
+    const b2Vec2 upper = b2Add(box->pos, box->extent);
+    const b2Vec2 d = b2Sub(cellPoint, pos);
+
+    // find where the ray enters the box with the slab method
+    float tEnter = -FLT_MAX;
+    const float origin[2] = {pos.x, pos.y};
+    const float dir[2] = {d.x, d.y};
+    const float lowerBound[2] = {lower.x, lower.y};
+    const float upperBound[2] = {upper.x, upper.y};
+    for (uint8_t i = 0; i < 2; i++) {
+        if (fabsf(dir[i]) < FLT_EPSILON) {
+            continue;
+        }
+        const float t1 = (lowerBound[i] - origin[i]) / dir[i];
+        const float t2 = (upperBound[i] - origin[i]) / dir[i];
+        tEnter = fmaxf(tEnter, fminf(t1, t2));
+    }
+    // the ray starts inside the box, which a burst can't
+    if (tEnter < 0.0f) {
+        return false;
     }
 
-    explosionCtx *ctx = context;
-    const entity *entity = b2Shape_GetUserData(shapeID);
+    // the ray enters the box at the point if the cell is on the side of
+    // the box facing pos; allow a bit of error so rays that graze the
+    // corner of a neighboring cell don't hide the cell
+    return (1.0f - tEnter) * b2Length(d) > 0.01f;
+}
+
+// applies the explosion to a single entity; shapeEnt is the entity
+// the hit shape belongs to, which is a wall box for static walls
+bool explodeEntity(explosionCtx *ctx, const b2ShapeId shapeID, const entity *shapeEnt, const entity *entity) {
     projectileEntity *projectile = NULL;
     droneEntity *drone = NULL;
     wallEntity *wall = NULL;
@@ -1132,6 +1279,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
             DEBUG_LOGF("drone %d hit itself with explosion from weapon %d", drone->idx, ctx->projectile->weaponInfo->type);
         }
         ctx->parentDrone->stepInfo.explosionHit[drone->idx] = true;
+        ctx->parentDrone->stepInfo.hitDrones |= droneBit(drone->idx);
         if (ctx->isBurst) {
             DEBUG_LOGF("drone %d hit drone %d with burst", ctx->parentDrone->idx, drone->idx);
             ctx->e->stats[ctx->parentDrone->idx].burstsHit++;
@@ -1142,6 +1290,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
             DEBUG_LOGF("drone %d hit by explosion from weapon %d from drone %d", drone->idx, ctx->projectile->weaponInfo->type, ctx->parentDrone->idx);
         }
         drone->stepInfo.explosionTaken[ctx->parentDrone->idx] = true;
+        drone->stepInfo.hitDrones |= droneBit(ctx->parentDrone->idx);
         transform.p = drone->pos;
         transform.q = b2Rot_identity;
         break;
@@ -1186,7 +1335,10 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
     if (!isImplosion) {
         filter.maskBits |= FLOATING_WALL_SHAPE;
     }
-    if (posBehindWall(ctx->e, ctx->def->position, output.pointA, entity, filter, NULL)) {
+    if (posBehindWall(ctx->e, ctx->def->position, output.pointA, shapeEnt, filter, NULL)) {
+        return true;
+    }
+    if (isStaticWall && cellBehindWallBox(shapeEnt->entity, ctx->def->position, output.pointA)) {
         return true;
     }
 
@@ -1210,7 +1362,15 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         // the localLine isn't used in perimeter calculations for circles
         localLine = b2InvRotateVector(transform.q, b2LeftPerp(direction));
     }
-    float perimeter = getShapeProjectedPerimeter(shapeID, localLine);
+    float perimeter;
+    if (isStaticWall) {
+        // static walls share merged box shapes, use the geometry of
+        // the wall cell itself
+        const b2Polygon wallPolygon = b2MakeBox(wall->extent.x, wall->extent.y);
+        perimeter = getPolygonProjectedPerimeter(&wallPolygon, localLine);
+    } else {
+        perimeter = getShapeProjectedPerimeter(shapeID, localLine);
+    }
     const float relDistance = output.distance / ctx->def->radius;
     const float scale = 1.0f - (SQUARED(relDistance) * relDistance);
 
@@ -1261,12 +1421,11 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         // ensure this wall faces at least 85 degrees away from the
         // closest hit wall to prevent multiple walls facing roughly
         // the same direction greatly increasing the impulse magnitude
-        if (ctx->closestWallIdx == -1) {
-            ctx->closestWallIdx = 0;
-        } else {
+        bool isClosest = ctx->closestWallIdx == -1;
+        if (!isClosest) {
             const float closestWallDistance = ctx->wallImpulses[ctx->closestWallIdx].distance;
             if (output.distance < closestWallDistance) {
-                ctx->closestWallIdx = ctx->wallsHit;
+                isClosest = true;
 
                 for (int8_t i = 0; i < ctx->wallsHit; i++) {
                     const wallBurstImpulse impulse = ctx->wallImpulses[i];
@@ -1281,12 +1440,31 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
         // reduce the magnitude when pushing a drone away from a wall
         magnitude = log2f(magnitude) * (5.0f + (25.0f * ctx->parentDrone->burstCharge));
 
-        ctx->wallImpulses[ctx->wallsHit++] = (wallBurstImpulse){
+        // if too many walls were hit keep the closest ones
+        ASSERT(ctx->wallsHit <= MAX_WALL_HITS);
+        uint8_t hitIdx = ctx->wallsHit;
+        if (hitIdx == MAX_WALL_HITS) {
+            hitIdx = 0;
+            for (uint8_t i = 1; i < ctx->wallsHit; i++) {
+                if (ctx->wallImpulses[i].distance > ctx->wallImpulses[hitIdx].distance) {
+                    hitIdx = i;
+                }
+            }
+            if (output.distance >= ctx->wallImpulses[hitIdx].distance) {
+                return true;
+            }
+        } else {
+            ctx->wallsHit++;
+        }
+        ctx->wallImpulses[hitIdx] = (wallBurstImpulse){
             .distance = output.distance,
             .direction = direction,
             .magnitude = magnitude,
             .wallCellIdx = wall->mapCellIdx,
         };
+        if (isClosest) {
+            ctx->closestWallIdx = hitIdx;
+        }
         return true;
     }
     const b2Vec2 impulse = b2MulSV(magnitude, direction);
@@ -1296,7 +1474,7 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
     case STANDARD_WALL_ENTITY:
     case BOUNCY_WALL_ENTITY:
     case DEATH_WALL_ENTITY:
-        b2Body_ApplyLinearImpulse(bodyID, impulse, output.pointA, true);
+        b2Body_ApplyLinearImpulse(bodyID, impulse, arenaToWorldPos(ctx->e, output.pointA), true);
         wall->velocity = b2Body_GetLinearVelocity(wall->bodyID);
         break;
     case PROJECTILE_ENTITY:
@@ -1340,6 +1518,41 @@ bool explodeCallback(b2ShapeId shapeID, void *context) {
     return true;
 }
 
+// b2World_Explode doesn't support filtering on shapes of the same category,
+// so we have to do it manually
+// mostly copied from box2d/src/world.c
+bool explodeCallback(b2ShapeId shapeID, void *context) {
+    if (!b2Shape_IsValid(shapeID)) {
+        return true;
+    }
+
+    explosionCtx *ctx = context;
+    const entity *ent = b2Shape_GetUserData(shapeID);
+    if (!entityTypeIsWall(ent->type)) {
+        return explodeEntity(ctx, shapeID, ent, ent);
+    }
+    const wallEntity *wall = ent->entity;
+    if (wall->isFloating) {
+        return explodeEntity(ctx, shapeID, ent, ent);
+    }
+    // normal explosions don't affect static walls
+    if (!ctx->isBurst) {
+        return true;
+    }
+
+    // static walls are merged into boxes, burst off of each wall cell
+    // the box covers so bursts behave the same no matter how the
+    // walls were merged
+    for (uint8_t row = 0; row < wall->boxRows; row++) {
+        for (uint8_t col = 0; col < wall->boxColumns; col++) {
+            const mapCell *cell = safe_array_get_at(ctx->e->cells, wall->mapCellIdx + (row * ctx->e->map->columns) + col);
+            ASSERT(cell->ent != NULL && entityTypeIsWall(cell->ent->type));
+            explodeEntity(ctx, shapeID, ent, cell->ent);
+        }
+    }
+    return true;
+}
+
 void applyDroneBurstImpulse(env *e, explosionCtx *ctx, const droneEntity *drone) {
     wallBurstImpulse *hitWalls = ctx->wallImpulses;
     uint8_t wallsHit = ctx->wallsHit;
@@ -1370,14 +1583,14 @@ void applyDroneBurstImpulse(env *e, explosionCtx *ctx, const droneEntity *drone)
             if (impulseB.distance == FLT_MAX) {
                 continue;
             }
-            const uint8_t cellIdxDiff = abs(impulseB.wallCellIdx - impulseA.wallCellIdx);
+            const uint16_t cellIdxDiff = abs(impulseB.wallCellIdx - impulseA.wallCellIdx);
             if (cellIdxDiff == e->map->columns) {
                 hitWalls[j].distance = FLT_MAX;
                 continue;
             }
             if (cellIdxDiff == 1) {
-                int8_t colA = impulseA.wallCellIdx / e->map->columns;
-                int8_t colB = impulseB.wallCellIdx / e->map->columns;
+                int16_t colA = impulseA.wallCellIdx / e->map->columns;
+                int16_t colB = impulseB.wallCellIdx / e->map->columns;
                 if (colA == colB) {
                     hitWalls[j].distance = FLT_MAX;
                 }
@@ -1410,11 +1623,12 @@ void applyDroneBurstImpulse(env *e, explosionCtx *ctx, const droneEntity *drone)
 }
 
 void createExplosion(env *e, droneEntity *drone, const projectileEntity *projectile, const b2ExplosionDef *def) {
+    const b2Vec2 pos = arenaToWorldPos(e, def->position);
     b2AABB aabb = {
-        .lowerBound.x = def->position.x - def->radius,
-        .lowerBound.y = def->position.y - def->radius,
-        .upperBound.x = def->position.x + def->radius,
-        .upperBound.y = def->position.y + def->radius,
+        .lowerBound.x = pos.x - def->radius,
+        .lowerBound.y = pos.y - def->radius,
+        .upperBound.x = pos.x + def->radius,
+        .upperBound.y = pos.y + def->radius,
     };
 
     b2QueryFilter filter = b2DefaultQueryFilter();
@@ -1440,6 +1654,37 @@ void createExplosion(env *e, droneEntity *drone, const projectileEntity *project
     }
 }
 
+// removes a projectile from e->projectiles in constant time by moving
+// the last projectile into the removed projectile's slot
+static inline void removeProjectile(env *e, const projectileEntity *projectile) {
+    ASSERT(safe_array_get_at(e->projectiles, projectile->idx) == projectile);
+    const enum cc_stat res = cc_array_remove_fast_at(e->projectiles, projectile->idx, NULL);
+    MAYBE_UNUSED(res);
+    ASSERT(res == CC_OK);
+
+    if (projectile->idx < cc_array_size(e->projectiles)) {
+        projectileEntity *movedProjectile = safe_array_get_at(e->projectiles, projectile->idx);
+        movedProjectile->idx = projectile->idx;
+    }
+}
+
+// removes the projectile last returned by an iterator over e->projectiles
+// without invalidating the iterator
+static inline void removeProjectileIter(CC_ArrayIter *iter) {
+    const enum cc_stat res = cc_array_iter_remove_fast(iter, NULL);
+    MAYBE_UNUSED(res);
+    ASSERT(res == CC_OK);
+
+    // the last projectile was moved to the removed projectile's slot,
+    // which the iterator will return next
+    CC_Array *projectiles = iter->ar;
+    const size_t idx = iter->index;
+    if (idx < cc_array_size(projectiles)) {
+        projectileEntity *movedProjectile = safe_array_get_at(projectiles, idx);
+        movedProjectile->idx = idx;
+    }
+}
+
 void destroyProjectile(env *e, projectileEntity *projectile, const bool processExplosions, const bool full) {
     // explode projectile if necessary
     if (processExplosions && projectile->weaponInfo->explosive) {
@@ -1451,21 +1696,11 @@ void destroyProjectile(env *e, projectileEntity *projectile, const bool processE
     b2DestroyBody(projectile->bodyID);
 
     if (full) {
-        enum cc_stat res = cc_array_remove_fast(e->projectiles, projectile, NULL);
-        MAYBE_UNUSED(res);
-        ASSERT(res == CC_OK);
+        removeProjectile(e, projectile);
     }
 
     e->stats[projectile->droneIdx].shotDistances[projectile->droneIdx] += projectile->distance;
 
-    if (projectile->entsInBlackHole != NULL) {
-        for (uint8_t i = 0; i < cc_array_size(projectile->entsInBlackHole); i++) {
-            entityID *id = safe_array_get_at(projectile->entsInBlackHole, i);
-            fastFree(id);
-        }
-        cc_array_destroy(projectile->entsInBlackHole);
-    }
-
     fastFree(projectile);
 }
 
@@ -1481,10 +1716,7 @@ static inline void destroyExplodedProjectiles(env *e) {
     cc_array_iter_init(&iter, e->explodingProjectiles);
     projectileEntity *projectile;
     while (cc_array_iter_next(&iter, (void **)&projectile) != CC_ITER_END) {
-        destroyProjectile(e, projectile, false, false);
-        const enum cc_stat res = cc_array_remove_fast(e->projectiles, projectile, NULL);
-        MAYBE_UNUSED(res);
-        ASSERT(res == CC_OK);
+        destroyProjectile(e, projectile, false, true);
     }
     cc_array_remove_all(e->explodingProjectiles);
 }
@@ -1492,7 +1724,8 @@ static inline void destroyExplodedProjectiles(env *e) {
 void createSuddenDeathWalls(env *e, const b2Vec2 startPos, const b2Vec2 size) {
     int16_t endIdx;
     uint8_t indexIncrement;
-    if (size.y == WALL_THICKNESS) {
+    const bool horizontal = size.y == WALL_THICKNESS;
+    if (horizontal) {
         // horizontal walls
         const b2Vec2 endPos = (b2Vec2){.x = startPos.x + size.x, .y = startPos.y};
         endIdx = entityPosToCellIdx(e, endPos);
@@ -1513,6 +1746,9 @@ void createSuddenDeathWalls(env *e, const b2Vec2 startPos, const b2Vec2 size) {
     if (startIdx == -1) {
         ERRORF("invalid position for sudden death wall: (%f, %f)", startPos.x, startPos.y);
     }
+    // create a box for each contiguous run of newly placed walls
+    int16_t runStartIdx = -1;
+    uint8_t runLength = 0;
     for (uint16_t i = startIdx; i <= endIdx; i += indexIncrement) {
         mapCell *cell = safe_array_get_at(e->cells, i);
         if (cell->ent != NULL) {
@@ -1520,22 +1756,28 @@ void createSuddenDeathWalls(env *e, const b2Vec2 startPos, const b2Vec2 size) {
                 weaponPickupEntity *pickup = cell->ent->entity;
                 disableWeaponPickup(e, pickup);
             } else {
+                if (runLength != 0) {
+                    createWallBox(e, runStartIdx, horizontal ? runLength : 1, horizontal ? 1 : runLength, DEATH_WALL_ENTITY);
+                    runLength = 0;
+                }
                 continue;
             }
         }
         entity *ent = createWall(e, cell->pos, WALL_THICKNESS, WALL_THICKNESS, i, DEATH_WALL_ENTITY, false);
         cell->ent = ent;
+
+        if (runLength == 0) {
+            runStartIdx = i;
+        }
+        runLength++;
+    }
+    if (runLength != 0) {
+        createWallBox(e, runStartIdx, horizontal ? runLength : 1, horizontal ? 1 : runLength, DEATH_WALL_ENTITY);
     }
 }
 
-// TODO: handle when all walls are placed
-void handleSuddenDeath(env *e) {
-    ASSERT(e->suddenDeathSteps == 0);
-
-    // create new walls that will close in on the arena
-    e->suddenDeathWallCounter++;
-    e->suddenDeathWallsPlaced = true;
-
+// creates the ring of sudden death walls for the current wall counter
+void placeSuddenDeathWalls(env *e) {
     const float leftX = (e->suddenDeathWallCounter - 1) * WALL_THICKNESS;
     const float yOffset = (WALL_THICKNESS * (e->suddenDeathWallCounter - 1)) + (WALL_THICKNESS / 2);
     const float xWidth = WALL_THICKNESS * (e->map->columns - (e->suddenDeathWallCounter * 2) - 1);
@@ -1544,8 +1786,8 @@ void handleSuddenDeath(env *e) {
     createSuddenDeathWalls(
         e,
         (b2Vec2){
-            .x = e->map->bounds.min.x + leftX,
-            .y = e->map->bounds.min.y + yOffset,
+            .x = e->mapData->bounds.min.x + leftX,
+            .y = e->mapData->bounds.min.y + yOffset,
         },
         (b2Vec2){
             .x = xWidth,
@@ -1556,8 +1798,8 @@ void handleSuddenDeath(env *e) {
     createSuddenDeathWalls(
         e,
         (b2Vec2){
-            .x = e->map->bounds.min.x + leftX,
-            .y = e->map->bounds.max.y - yOffset,
+            .x = e->mapData->bounds.min.x + leftX,
+            .y = e->mapData->bounds.max.y - yOffset,
         },
         (b2Vec2){
             .x = xWidth,
@@ -1568,8 +1810,8 @@ void handleSuddenDeath(env *e) {
     createSuddenDeathWalls(
         e,
         (b2Vec2){
-            .x = e->map->bounds.min.x + leftX,
-            .y = e->map->bounds.min.y + (e->suddenDeathWallCounter * WALL_THICKNESS),
+            .x = e->mapData->bounds.min.x + leftX,
+            .y = e->mapData->bounds.min.y + (e->suddenDeathWallCounter * WALL_THICKNESS),
         },
         (b2Vec2){
             .x = WALL_THICKNESS,
@@ -1580,14 +1822,24 @@ void handleSuddenDeath(env *e) {
     createSuddenDeathWalls(
         e,
         (b2Vec2){
-            .x = e->map->bounds.min.x + ((e->map->columns - e->suddenDeathWallCounter - 2) * WALL_THICKNESS),
-            .y = e->map->bounds.min.y + (e->suddenDeathWallCounter * WALL_THICKNESS),
+            .x = e->mapData->bounds.min.x + ((e->map->columns - e->suddenDeathWallCounter - 2) * WALL_THICKNESS),
+            .y = e->mapData->bounds.min.y + (e->suddenDeathWallCounter * WALL_THICKNESS),
         },
         (b2Vec2){
             .x = WALL_THICKNESS,
             .y = WALL_THICKNESS * (e->map->rows - (e->suddenDeathWallCounter * 2) - 2),
         }
     );
+}
+
+// TODO: handle when all walls are placed
+void handleSuddenDeath(env *e) {
+    ASSERT(e->suddenDeathSteps == 0);
+
+    // create new walls that will close in on the arena
+    e->suddenDeathWallCounter++;
+    e->suddenDeathWallsPlaced = true;
+    placeSuddenDeathWalls(e);
 
     // mark drones as dead if they touch a newly placed wall
     for (uint8_t i = 0; i < e->numDrones; i++) {
@@ -1629,7 +1881,7 @@ void handleSuddenDeath(env *e) {
     while (cc_array_iter_next(&projectileIter, (void **)&projectile) != CC_ITER_END) {
         const mapCell *cell = safe_array_get_at(e->cells, projectile->mapCellIdx);
         if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
-            cc_array_iter_remove_fast(&projectileIter, NULL);
+            removeProjectileIter(&projectileIter);
             destroyProjectile(e, projectile, false, false);
         }
     }
@@ -1794,6 +2046,9 @@ void droneBurst(env *e, droneEntity *drone) {
     }
     e->stats[drone->idx].totalBursts++;
 
+    if (e->frameEvents != NULL) {
+        recordFrameExplosion(e, &explosion, drone->idx, true);
+    }
     if (e->client != NULL) {
         explosionInfo *explInfo = fastCalloc(1, sizeof(explosionInfo));
         explInfo->def = explosion;
@@ -1884,19 +2139,16 @@ bool droneStep(env *e, droneEntity *drone) {
 void handleBlackHolePull(env *e, projectileEntity *projectile) {
     ASSERT(projectile->weaponInfo->type == BLACK_HOLE_WEAPON);
 
-    CC_ArrayIter entIter;
-    cc_array_iter_init(&entIter, projectile->entsInBlackHole);
-    entityID *id;
-    while (cc_array_iter_next(&entIter, (void **)&id) != CC_ITER_END) {
+    uint8_t i = 0;
+    while (i < projectile->numEntsInBlackHole) {
         // check if the entity is still valid
-        const entity *ent = getEntityByID(e, id);
+        const entity *ent = getEntityByID(e, projectile->entsInBlackHole[i]);
         if (ent == NULL) {
-            fastFree(id);
-            enum cc_stat res = cc_array_iter_remove_fast(&entIter, NULL);
-            MAYBE_UNUSED(res);
-            ASSERT(res == CC_OK);
+            projectile->entsInBlackHole[i] = projectile->entsInBlackHole[--projectile->numEntsInBlackHole];
             continue;
         }
+        i++;
+
         const b2DistanceOutput output = closestPoint(projectile->ent, ent);
         const b2QueryFilter filter = {.categoryBits = PROJECTILE_SHAPE, .maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE};
         if (posBehindWall(e, projectile->pos, output.pointB, ent, filter, NULL)) {
@@ -1969,7 +2221,7 @@ void handleBlackHolePull(env *e, projectileEntity *projectile) {
         const b2Vec2 force = b2MulSV(magnitude, direction);
 
         if (entityTypeIsWall(ent->type)) {
-            b2Body_ApplyForce(bodyID, force, output.pointB, true);
+            b2Body_ApplyForce(bodyID, force, arenaToWorldPos(e, output.pointB), true);
         } else {
             b2Body_ApplyForceToCenter(bodyID, force, true);
         }
@@ -2007,9 +2259,7 @@ void projectilesStep(env *e) {
                 // we have to destroy the projectile using the iterator so
                 // we can continue to iterate correctly
                 destroyProjectile(e, projectile, true, false);
-                enum cc_stat res = cc_array_iter_remove_fast(&projIter, NULL);
-                MAYBE_UNUSED(res);
-                ASSERT(res == CC_OK);
+                removeProjectileIter(&projIter);
                 destroyed = true;
                 break;
             }
@@ -2018,7 +2268,7 @@ void projectilesStep(env *e) {
             }
         }
 
-        if (projectile->entsInBlackHole != NULL) {
+        if (projectile->weaponInfo->type == BLACK_HOLE_WEAPON) {
             handleBlackHolePull(e, projectile);
         }
 
@@ -2029,9 +2279,7 @@ void projectilesStep(env *e) {
             // we have to destroy the projectile using the iterator so
             // we can continue to iterate correctly
             destroyProjectile(e, projectile, true, false);
-            enum cc_stat res = cc_array_iter_remove_fast(&projIter, NULL);
-            MAYBE_UNUSED(res);
-            ASSERT(res == CC_OK);
+            removeProjectileIter(&projIter);
             continue;
         }
     }
@@ -2080,104 +2328,107 @@ void weaponPickupsStep(env *e) {
     }
 }
 
-// only update positions and velocities of dynamic bodies if they moved
-// this step
-void handleBodyMoveEvents(env *e) {
-    b2BodyEvents events = b2World_GetBodyEvents(e->worldID);
-    for (int i = 0; i < events.moveCount; i++) {
-        const b2BodyMoveEvent *event = events.moveEvents + i;
-        if (!b2Body_IsValid(event->bodyId)) {
-            continue;
+void handleBodyMoveEvent(env *e, const b2BodyMoveEvent *event) {
+    if (!b2Body_IsValid(event->bodyId)) {
+        return;
+    }
+    ASSERT(b2IsValidVec2(event->transform.p));
+    const b2Vec2 newPos = worldToArenaPos(e, event->transform.p);
+    entity *ent = event->userData;
+    if (ent == NULL) {
+        return;
+    }
+
+    wallEntity *wall;
+    projectileEntity *proj;
+    droneEntity *drone;
+    shieldEntity *shield;
+    dronePieceEntity *piece;
+    int16_t mapIdx;
+
+    // if the new position is out of bounds, destroy the entity unless
+    // a drone is out of bounds, then just kill it
+    switch (ent->type) {
+    case STANDARD_WALL_ENTITY:
+    case BOUNCY_WALL_ENTITY:
+    case DEATH_WALL_ENTITY:
+        wall = ent->entity;
+        mapIdx = entityPosToCellIdx(e, newPos);
+        if (mapIdx == -1) {
+            DEBUG_LOGF("invalid position for floating wall: (%f, %f) destroying", newPos.x, newPos.y);
+            cc_array_remove_fast(e->floatingWalls, wall, NULL);
+            destroyWall(e, wall, false);
+            return;
         }
-        ASSERT(b2IsValidVec2(event->transform.p));
-        const b2Vec2 newPos = event->transform.p;
-        entity *ent = event->userData;
-        if (ent == NULL) {
-            continue;
+        wall->mapCellIdx = mapIdx;
+        wall->pos = newPos;
+        wall->rot = event->transform.q;
+        wall->velocity = b2Body_GetLinearVelocity(wall->bodyID);
+        break;
+    case PROJECTILE_ENTITY:
+        proj = ent->entity;
+        mapIdx = entityPosToCellIdx(e, newPos);
+        if (mapIdx == -1) {
+            DEBUG_LOGF("invalid position for projectile: (%f, %f) destroying", newPos.x, newPos.y);
+            destroyProjectile(e, proj, false, true);
+            return;
+        }
+        proj->mapCellIdx = mapIdx;
+        proj->lastPos = proj->pos;
+        proj->pos = newPos;
+        proj->lastVelocity = proj->velocity;
+        proj->velocity = b2Body_GetLinearVelocity(proj->bodyID);
+        // if the projectile doesn't have damping its speed will
+        // only change when colliding with a dynamic body or getting
+        // hit by an explosion, and if it's currently colliding with
+        // something we don't care about the current speed
+        if (proj->weaponInfo->damping != 0.0f && proj->contacts == 0) {
+            proj->lastSpeed = proj->speed;
+            proj->speed = b2Length(proj->velocity);
         }
 
-        wallEntity *wall;
-        projectileEntity *proj;
-        droneEntity *drone;
-        shieldEntity *shield;
-        dronePieceEntity *piece;
-        int16_t mapIdx;
-
-        // if the new position is out of bounds, destroy the entity unless
-        // a drone is out of bounds, then just kill it
-        switch (ent->type) {
-        case STANDARD_WALL_ENTITY:
-        case BOUNCY_WALL_ENTITY:
-        case DEATH_WALL_ENTITY:
-            wall = ent->entity;
-            mapIdx = entityPosToCellIdx(e, newPos);
-            if (mapIdx == -1) {
-                DEBUG_LOGF("invalid position for floating wall: (%f, %f) destroying", newPos.x, newPos.y);
-                cc_array_remove_fast(e->floatingWalls, wall, NULL);
-                destroyWall(e, wall, false);
-                continue;
-            }
-            wall->mapCellIdx = mapIdx;
-            wall->pos = newPos;
-            wall->rot = event->transform.q;
-            wall->velocity = b2Body_GetLinearVelocity(wall->bodyID);
-            break;
-        case PROJECTILE_ENTITY:
-            proj = ent->entity;
-            mapIdx = entityPosToCellIdx(e, newPos);
-            if (mapIdx == -1) {
-                DEBUG_LOGF("invalid position for projectile: (%f, %f) destroying", newPos.x, newPos.y);
-                destroyProjectile(e, proj, false, true);
-                continue;
-            }
-            proj->mapCellIdx = mapIdx;
-            proj->lastPos = proj->pos;
-            proj->pos = newPos;
-            proj->lastVelocity = proj->velocity;
-            proj->velocity = b2Body_GetLinearVelocity(proj->bodyID);
-            // if the projectile doesn't have damping its speed will
-            // only change when colliding with a dynamic body or getting
-            // hit by an explosion, and if it's currently colliding with
-            // something we don't care about the current speed
-            if (proj->weaponInfo->damping != 0.0f && proj->contacts == 0) {
-                proj->lastSpeed = proj->speed;
-                proj->speed = b2Length(proj->velocity);
-            }
+        if (e->client != NULL) {
+            updateTrailPoints(&proj->trailPoints, MAX_PROJECTLE_TRAIL_POINTS, newPos);
+        }
+        break;
+    case DRONE_ENTITY:
+        drone = ent->entity;
+        mapIdx = entityPosToCellIdx(e, newPos);
+        if (mapIdx == -1) {
+            DEBUG_LOGF("invalid position for drone: (%f, %f) killing it", newPos.x, newPos.y);
+            killDrone(e, drone);
+            return;
+        }
+        drone->mapCellIdx = mapIdx;
+        drone->lastPos = drone->pos;
+        drone->pos = newPos;
+        drone->lastVelocity = drone->velocity;
+        drone->velocity = b2Body_GetLinearVelocity(drone->bodyID);
 
-            if (e->client != NULL) {
-                updateTrailPoints(&proj->trailPoints, MAX_PROJECTLE_TRAIL_POINTS, newPos);
-            }
-            break;
-        case DRONE_ENTITY:
-            drone = ent->entity;
-            mapIdx = entityPosToCellIdx(e, newPos);
-            if (mapIdx == -1) {
-                DEBUG_LOGF("invalid position for drone: (%f, %f) killing it", newPos.x, newPos.y);
-                killDrone(e, drone);
-                continue;
-            }
-            drone->mapCellIdx = mapIdx;
-            drone->lastPos = drone->pos;
-            drone->pos = newPos;
-            drone->lastVelocity = drone->velocity;
-            drone->velocity = b2Body_GetLinearVelocity(drone->bodyID);
-
-            if (e->client != NULL) {
-                updateTrailPoints(&drone->trailPoints, MAX_DRONE_TRAIL_POINTS, newPos);
-            }
-            break;
-        case SHIELD_ENTITY:
-            shield = ent->entity;
-            shield->pos = newPos;
-            break;
-        case DRONE_PIECE_ENTITY:
-            piece = ent->entity;
-            piece->pos = newPos;
-            piece->rot = event->transform.q;
-            break;
-        default:
-            ERRORF("unknown entity type for move event %d", ent->type);
+        if (e->client != NULL) {
+            updateTrailPoints(&drone->trailPoints, MAX_DRONE_TRAIL_POINTS, newPos);
         }
+        break;
+    case SHIELD_ENTITY:
+        shield = ent->entity;
+        shield->pos = newPos;
+        break;
+    case DRONE_PIECE_ENTITY:
+        piece = ent->entity;
+        piece->pos = newPos;
+        piece->rot = event->transform.q;
+        break;
+    default:
+        ERRORF("unknown entity type for move event %d", ent->type);
+    }
+}
+
+// only update positions and velocities of dynamic bodies if they moved
+// this step
+void handleBodyMoveEvents(env *e) {
+    b2BodyEvents events = b2World_GetBodyEvents(e->worldID);
+    for (int i = 0; i < events.moveCount; i++) {
+        handleBodyMoveEvent(e, events.moveEvents + i);
     }
 }
 
@@ -2242,9 +2493,11 @@ uint8_t handleProjectileBeginContact(env *e, const entity *proj, const entity *e
             }
             // add 1 so we can differentiate between no weapon and weapon 0
             shooterDrone->stepInfo.shotHit[hitDrone->idx] = projectile->weaponInfo->type + 1;
+            shooterDrone->stepInfo.hitDrones |= droneBit(hitDrone->idx);
             e->stats[shooterDrone->idx].shotsHit[projectile->weaponInfo->type]++;
             DEBUG_LOGF("drone %d hit drone %d with weapon %d", shooterDrone->idx, hitDrone->idx, projectile->weaponInfo->type);
             hitDrone->stepInfo.shotTaken[shooterDrone->idx] = projectile->weaponInfo->type + 1;
+            hitDrone->stepInfo.hitDrones |= droneBit(shooterDrone->idx);
             e->stats[hitDrone->idx].shotsTaken[projectile->weaponInfo->type]++;
             DEBUG_LOGF("drone %d hit by drone %d with weapon %d", hitDrone->idx, shooterDrone->idx, projectile->weaponInfo->type);
         } else {
@@ -2292,6 +2545,7 @@ uint8_t handleProjectileBeginContact(env *e, const entity *proj, const entity *e
             jointDef.referenceAngle = b2RelativeAngle(projRot, wall->rot);
         }
         b2CreateWeldJoint(e->worldID, &jointDef);
+        projectile->mineWallID = ent->id;
         projectile->velocity = b2Vec2_zero;
         projectile->lastVelocity = b2Vec2_zero;
         projectile->speed = 0.0f;
@@ -2361,78 +2615,83 @@ void handleProjectileEndContact(const entity *proj, const entity *ent) {
     projectile->lastSpeed = newSpeed;
 }
 
-// TODO: drone on drone collisions should reduce shield health
-void handleContactEvents(env *e) {
-    b2ContactEvents events = b2World_GetContactEvents(e->worldID);
-    for (int i = 0; i < events.beginCount; ++i) {
-        const b2ContactBeginTouchEvent *event = events.beginEvents + i;
-        entity *e1 = NULL;
-        entity *e2 = NULL;
+void handleContactBeginEvent(env *e, const b2ContactBeginTouchEvent *event) {
+    entity *e1 = NULL;
+    entity *e2 = NULL;
 
-        if (b2Shape_IsValid(event->shapeIdA)) {
-            e1 = b2Shape_GetUserData(event->shapeIdA);
-            ASSERT(e1 != NULL);
-        }
-        if (b2Shape_IsValid(event->shapeIdB)) {
-            e2 = b2Shape_GetUserData(event->shapeIdB);
-            ASSERT(e2 != NULL);
-        }
+    if (b2Shape_IsValid(event->shapeIdA)) {
+        e1 = b2Shape_GetUserData(event->shapeIdA);
+        ASSERT(e1 != NULL);
+    }
+    if (b2Shape_IsValid(event->shapeIdB)) {
+        e2 = b2Shape_GetUserData(event->shapeIdB);
+        ASSERT(e2 != NULL);
+    }
 
-        if (e1 != NULL) {
-            if (e1->type == PROJECTILE_ENTITY) {
-                uint8_t numDestroyed = handleProjectileBeginContact(e, e1, e2, &event->manifold, true);
-                if (numDestroyed == 2) {
-                    continue;
-                } else if (numDestroyed == 1) {
-                    e1 = NULL;
-                }
+    if (e1 != NULL) {
+        if (e1->type == PROJECTILE_ENTITY) {
+            uint8_t numDestroyed = handleProjectileBeginContact(e, e1, e2, &event->manifold, true);
+            if (numDestroyed == 2) {
+                return;
+            } else if (numDestroyed == 1) {
+                e1 = NULL;
+            }
 
-            } else if (e1->type == DEATH_WALL_ENTITY && e2 != NULL) {
-                if (e2->type == DRONE_ENTITY) {
-                    droneEntity *drone = e2->entity;
-                    killDrone(e, drone);
-                } else if (e2->type == SHIELD_ENTITY) {
-                    shieldEntity *shield = e2->entity;
-                    shield->health = 0.0f;
-                    destroyDroneShield(e, shield, true);
-                    e2 = NULL;
-                }
+        } else if (e1->type == DEATH_WALL_ENTITY && e2 != NULL) {
+            if (e2->type == DRONE_ENTITY) {
+                droneEntity *drone = e2->entity;
+                killDrone(e, drone);
+            } else if (e2->type == SHIELD_ENTITY) {
+                shieldEntity *shield = e2->entity;
+                shield->health = 0.0f;
+                destroyDroneShield(e, shield, true);
+                e2 = NULL;
             }
         }
-        if (e2 != NULL) {
-            if (e2->type == PROJECTILE_ENTITY) {
-                handleProjectileBeginContact(e, e2, e1, &event->manifold, false);
-            } else if (e2->type == DEATH_WALL_ENTITY && e1 != NULL) {
-                if (e1->type == DRONE_ENTITY) {
-                    droneEntity *drone = e1->entity;
-                    killDrone(e, drone);
-                } else if (e1->type == SHIELD_ENTITY) {
-                    shieldEntity *shield = e1->entity;
-                    shield->health = 0.0f;
-                    destroyDroneShield(e, shield, true);
-                }
+    }
+    if (e2 != NULL) {
+        if (e2->type == PROJECTILE_ENTITY) {
+            handleProjectileBeginContact(e, e2, e1, &event->manifold, false);
+        } else if (e2->type == DEATH_WALL_ENTITY && e1 != NULL) {
+            if (e1->type == DRONE_ENTITY) {
+                droneEntity *drone = e1->entity;
+                killDrone(e, drone);
+            } else if (e1->type == SHIELD_ENTITY) {
+                shieldEntity *shield = e1->entity;
+                shield->health = 0.0f;
+                destroyDroneShield(e, shield, true);
             }
         }
     }
+}
+
+void handleContactEndEvent(const b2ContactEndTouchEvent *event) {
+    entity *e1 = NULL;
+    entity *e2 = NULL;
+    if (b2Shape_IsValid(event->shapeIdA)) {
+        e1 = b2Shape_GetUserData(event->shapeIdA);
+        ASSERT(e1 != NULL);
+    }
+    if (b2Shape_IsValid(event->shapeIdB)) {
+        e2 = b2Shape_GetUserData(event->shapeIdB);
+        ASSERT(e2 != NULL);
+    }
+    if (e1 != NULL && e1->type == PROJECTILE_ENTITY) {
+        handleProjectileEndContact(e1, e2);
+    }
+    if (e2 != NULL && e2->type == PROJECTILE_ENTITY) {
+        handleProjectileEndContact(e2, e1);
+    }
+}
 
+// TODO: drone on drone collisions should reduce shield health
+void handleContactEvents(env *e) {
+    b2ContactEvents events = b2World_GetContactEvents(e->worldID);
+    for (int i = 0; i < events.beginCount; ++i) {
+        handleContactBeginEvent(e, events.beginEvents + i);
+    }
     for (int i = 0; i < events.endCount; ++i) {
-        const b2ContactEndTouchEvent *event = events.endEvents + i;
-        entity *e1 = NULL;
-        entity *e2 = NULL;
-        if (b2Shape_IsValid(event->shapeIdA)) {
-            e1 = b2Shape_GetUserData(event->shapeIdA);
-            ASSERT(e1 != NULL);
-        }
-        if (b2Shape_IsValid(event->shapeIdB)) {
-            e2 = b2Shape_GetUserData(event->shapeIdB);
-            ASSERT(e2 != NULL);
-        }
-        if (e1 != NULL && e1->type == PROJECTILE_ENTITY) {
-            handleProjectileEndContact(e1, e2);
-        }
-        if (e2 != NULL && e2->type == PROJECTILE_ENTITY) {
-            handleProjectileEndContact(e2, e1);
-        }
+        handleContactEndEvent(events.endEvents + i);
     }
 }
 
@@ -2513,13 +2772,11 @@ void handleProjectileBeginTouch(env *e, const entity *sensor, entity *visitor) {
             }
         }
 
-        // copy the entity ID so it won't be changed if the entity is
-        // destroyed and reused later
-        const entityID *visitorID = visitor->id;
-        entityID *id = fastCalloc(1, sizeof(entityID));
-        id->id = visitorID->id;
-        id->generation = visitorID->generation;
-        cc_array_add(projectile->entsInBlackHole, id);
+        if (projectile->numEntsInBlackHole == MAX_ENTS_IN_BLACK_HOLE) {
+            DEBUG_LOG("black hole is full, not pulling entity");
+            return;
+        }
+        projectile->entsInBlackHole[projectile->numEntsInBlackHole++] = visitor->id;
         break;
     default:
         ERRORF("invalid projectile type %d for begin touch event", sensor->type);
@@ -2570,12 +2827,9 @@ void handleProjectileEndTouch(const entity *sensor, entity *visitor) {
             return;
         }
 
-        const entityID *visitorID = visitor->id;
-        for (uint8_t i = 0; i < cc_array_size(projectile->entsInBlackHole); ++i) {
-            entityID *id = safe_array_get_at(projectile->entsInBlackHole, i);
-            if (id->id == visitorID->id) {
-                fastFree(id);
-                cc_array_remove_fast_at(projectile->entsInBlackHole, i, NULL);
+        for (uint8_t i = 0; i < projectile->numEntsInBlackHole; ++i) {
+            if (projectile->entsInBlackHole[i] == visitor->id) {
+                projectile->entsInBlackHole[i] = projectile->entsInBlackHole[--projectile->numEntsInBlackHole];
                 return;
             }
         }
@@ -2585,58 +2839,63 @@ void handleProjectileEndTouch(const entity *sensor, entity *visitor) {
     }
 }
 
-void handleSensorEvents(env *e) {
-    b2SensorEvents events = b2World_GetSensorEvents(e->worldID);
-    for (int i = 0; i < events.beginCount; ++i) {
-        const b2SensorBeginTouchEvent *event = events.beginEvents + i;
-        if (!b2Shape_IsValid(event->sensorShapeId)) {
-            DEBUG_LOG("could not find sensor shape for begin touch event");
-            continue;
-        }
-        entity *s = b2Shape_GetUserData(event->sensorShapeId);
-        ASSERT(s != NULL);
+void handleSensorBeginEvent(env *e, const b2SensorBeginTouchEvent *event) {
+    if (!b2Shape_IsValid(event->sensorShapeId)) {
+        DEBUG_LOG("could not find sensor shape for begin touch event");
+        return;
+    }
+    entity *s = b2Shape_GetUserData(event->sensorShapeId);
+    ASSERT(s != NULL);
 
-        if (!b2Shape_IsValid(event->visitorShapeId)) {
-            DEBUG_LOG("could not find visitor shape for begin touch event");
-            continue;
-        }
-        entity *v = b2Shape_GetUserData(event->visitorShapeId);
-        ASSERT(v != NULL);
+    if (!b2Shape_IsValid(event->visitorShapeId)) {
+        DEBUG_LOG("could not find visitor shape for begin touch event");
+        return;
+    }
+    entity *v = b2Shape_GetUserData(event->visitorShapeId);
+    ASSERT(v != NULL);
 
-        switch (s->type) {
-        case WEAPON_PICKUP_ENTITY:
-            handleWeaponPickupBeginTouch(e, s, v);
-            break;
-        case PROJECTILE_ENTITY:
-            handleProjectileBeginTouch(e, s, v);
-            break;
-        default:
-            ERRORF("unknown entity type %d for sensor begin touch event", s->type);
-        }
+    switch (s->type) {
+    case WEAPON_PICKUP_ENTITY:
+        handleWeaponPickupBeginTouch(e, s, v);
+        break;
+    case PROJECTILE_ENTITY:
+        handleProjectileBeginTouch(e, s, v);
+        break;
+    default:
+        ERRORF("unknown entity type %d for sensor begin touch event", s->type);
     }
+}
 
-    for (int i = 0; i < events.endCount; ++i) {
-        const b2SensorEndTouchEvent *event = events.endEvents + i;
-        if (!b2Shape_IsValid(event->sensorShapeId)) {
-            DEBUG_LOG("could not find sensor shape for end touch event");
-            continue;
-        }
-        entity *s = b2Shape_GetUserData(event->sensorShapeId);
-        ASSERT(s != NULL);
-        entity *v = NULL;
-        if (b2Shape_IsValid(event->visitorShapeId)) {
-            v = b2Shape_GetUserData(event->visitorShapeId);
-            ASSERT(v != NULL);
-        }
+void handleSensorEndEvent(const b2SensorEndTouchEvent *event) {
+    if (!b2Shape_IsValid(event->sensorShapeId)) {
+        DEBUG_LOG("could not find sensor shape for end touch event");
+        return;
+    }
+    entity *s = b2Shape_GetUserData(event->sensorShapeId);
+    ASSERT(s != NULL);
+    entity *v = NULL;
+    if (b2Shape_IsValid(event->visitorShapeId)) {
+        v = b2Shape_GetUserData(event->visitorShapeId);
+        ASSERT(v != NULL);
+    }
 
-        if (s->type == PROJECTILE_ENTITY) {
-            handleProjectileEndTouch(s, v);
-            continue;
-        }
+    if (s->type == PROJECTILE_ENTITY) {
+        handleProjectileEndTouch(s, v);
+        return;
+    }
 
-        if (v != NULL) {
-            handleWeaponPickupEndTouch(s, v);
-        }
+    if (v != NULL) {
+        handleWeaponPickupEndTouch(s, v);
+    }
+}
+
+void handleSensorEvents(env *e) {
+    b2SensorEvents events = b2World_GetSensorEvents(e->worldID);
+    for (int i = 0; i < events.beginCount; ++i) {
+        handleSensorBeginEvent(e, events.beginEvents + i);
+    }
+    for (int i = 0; i < events.endCount; ++i) {
+        handleSensorEndEvent(events.endEvents + i);
     }
 }
 
@@ -2645,7 +2904,7 @@ void findNearWalls(const env *e, const droneEntity *drone, nearEntity nearestWal
 
     for (uint8_t i = 0; i < MAX_NEAREST_WALLS; ++i) {
         const uint32_t idx = (MAX_NEAREST_WALLS * drone->mapCellIdx) + i;
-        const uint16_t wallIdx = e->map->nearestWalls[idx].idx;
+        const uint16_t wallIdx = e->mapData->nearestWalls[idx].idx;
         wallEntity *wall = safe_array_get_at(e->walls, wallIdx);
         nearWalls[i].entity = wall;
         nearWalls[i].distanceSquared = b2DistanceSquared(drone->pos, wall->pos);
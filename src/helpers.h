@@ -10,6 +10,13 @@
 
 #include "include/cc_array.h"
 
+// use AVX2 and FMA intrinsics in hot loops when the target supports them,
+// every use must have a scalar fallback
+#if defined(__AVX2__) && defined(__FMA__) && !defined(AUTOPXD)
+#include <immintrin.h>
+#define USE_AVX2
+#endif
+
 #ifndef NDEBUG
 #define ON_ERROR __builtin_trap()
 #define _DEBUG_GET_TIMEINFO() \
@@ -78,6 +85,10 @@
 // only used in debug builds
 #define MAYBE_UNUSED(x) (void)x
 
+// force a function to be inlined so branches on constant arguments can
+// be eliminated when generating specialized variants of it
+#define FORCE_INLINE inline __attribute__((always_inline))
+
 #define SQUARED(x) ((x) * (x))
 
 #ifndef PI
@@ -119,6 +130,8 @@
 #define fastCallocFn calloc
 #define fastFree(ptr) free(ptr)
 #define fastFreeFn free
+#define enableAllocLocking()
+#define disableAllocLocking()
 #else
 #include "include/dlmalloc.h"
 #define fastMalloc(size) dlmalloc(size)
@@ -127,6 +140,10 @@
 #define fastCallocFn dlcalloc
 #define fastFree(ptr) dlfree(ptr)
 #define fastFreeFn dlfree
+// must be enabled while any thread other than the one stepping envs
+// allocates, see dlmalloc_enable_locking
+#define enableAllocLocking() dlmalloc_enable_locking()
+#define disableAllocLocking() dlmalloc_disable_locking()
 #endif
 
 static inline void create_array(CC_Array **array, size_t initialCap) {
@@ -228,6 +245,65 @@ static inline uint16_t alignedSize(const uint16_t size, const uint8_t align) {
     return (size + align - 1) & ~(align - 1);
 }
 
+// converts a float to a half precision float, rounding to nearest even;
+// from https://gist.github.com/rygorous/2156668
+static inline uint16_t floatToHalf(const float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(x));
+    const uint16_t sign = (x >> 16) & 0x8000;
+    x &= 0x7FFFFFFF;
+
+    // infinity, NaN or too large to represent
+    if (x >= 0x47800000) {
+        return sign | (x > 0x7F800000 ? 0x7E00 : 0x7C00);
+    }
+    // subnormal or zero, adding 0.5 shifts the mantissa into place
+    if (x < 0x38800000) {
+        float shifted;
+        memcpy(&shifted, &x, sizeof(shifted));
+        shifted += 0.5f;
+        memcpy(&x, &shifted, sizeof(x));
+        return sign | (uint16_t)(x - 0x3F000000);
+    }
+    const uint32_t mantissaOdd = (x >> 13) & 1;
+    x += 0xC8000FFF + mantissaOdd;
+    return sign | (uint16_t)(x >> 13);
+}
+
+static inline void floatsToHalves(const float *in, uint16_t *out, const uint16_t n) {
+    uint16_t i = 0;
+#if defined(USE_AVX2) && defined(__F16C__)
+    for (; i + 8 <= n; i += 8) {
+        const __m128i halves = _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128((__m128i *)(out + i), halves);
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = floatToHalf(in[i]);
+    }
+}
+
+// converts floats between -1 and 1 to fixed point with 15 fractional bits
+static inline void floatsToFixed(const float *in, int16_t *out, const uint16_t n) {
+    uint16_t i = 0;
+#ifdef USE_AVX2
+    const __m256 lower = _mm256_set1_ps(-1.0f);
+    const __m256 upper = _mm256_set1_ps(1.0f);
+    const __m256 scale = _mm256_set1_ps(INT16_MAX);
+    for (; i + 8 <= n; i += 8) {
+        __m256 v = _mm256_min_ps(_mm256_max_ps(_mm256_loadu_ps(in + i), lower), upper);
+        const __m256i ints = _mm256_cvtps_epi32(_mm256_mul_ps(v, scale));
+        // packing works within 128 bit lanes, gather the low half of
+        // each lane into the low 128 bits
+        const __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(ints, ints), 0x08);
+        _mm_storeu_si128((__m128i *)(out + i), _mm256_castsi256_si128(packed));
+    }
+#endif
+    for (; i < n; i++) {
+        out[i] = (int16_t)lrintf(min(max(in[i], -1.0f), 1.0f) * INT16_MAX);
+    }
+}
+
 #define BITNSLOTS(nb) ((nb + sizeof(uint8_t) - 1) / sizeof(uint8_t))
 
 static inline uint16_t bitMask(const uint16_t n) {
@@ -0,0 +1,282 @@
+#ifndef IMPULSE_WARS_IMAGE_OBS_H
+#define IMPULSE_WARS_IMAGE_OBS_H
+
+#include "game.h"
+#include "helpers.h"
+#include "settings.h"
+#include "types.h"
+
+// image observations are a top down view centered on the agent's drone
+// rasterized on the CPU, one plane of IMAGE_OBS_SIZE x IMAGE_OBS_SIZE
+// bytes per channel. Entities are drawn as their shapes with the value
+// of each pixel identifying what's there, overlapping entities in the
+// same channel keep the highest value.
+
+// the row width is fixed so a row is exactly two AVX2 vectors
+#define _IMAGE_OBS_SIZE 64
+const uint8_t IMAGE_OBS_SIZE = _IMAGE_OBS_SIZE;
+// the view is as wide as the largest map obs window
+const uint8_t IMAGE_OBS_VIEW_CELLS = _MAX_MAP_OBS_COLUMNS;
+
+enum imageObsChannel {
+    // static and sudden death walls, by wall type
+    IMAGE_WALL_CHANNEL,
+    // floating walls, by wall type
+    IMAGE_FLOATING_WALL_CHANNEL,
+    // weapon pickups that can be picked up, by weapon
+    IMAGE_PICKUP_CHANNEL,
+    // the agent's drone and shield
+    IMAGE_AGENT_CHANNEL,
+    // other drones and shields, teammates are dimmer than enemies
+    IMAGE_DRONE_CHANNEL,
+    // projectiles, the agent's are dimmer than others'
+    IMAGE_PROJECTILE_CHANNEL,
+    NUM_IMAGE_OBS_CHANNELS,
+};
+const uint8_t IMAGE_OBS_CHANNELS = NUM_IMAGE_OBS_CHANNELS;
+
+uint16_t imageObsBytes() {
+    return IMAGE_OBS_CHANNELS * IMAGE_OBS_SIZE * IMAGE_OBS_SIZE;
+}
+
+#ifndef AUTOPXD
+
+// entities smaller than this many pixels are drawn this big so they
+// always cover at least the pixel they're centered in
+#define IMAGE_OBS_MIN_RADIUS 0.75f
+
+const uint8_t IMAGE_SHIELD_VALUE = 64;
+const uint8_t IMAGE_OWN_VALUE = 128;
+const uint8_t IMAGE_OTHER_VALUE = 255;
+
+static inline uint8_t imageWallValue(const enum entityType type) {
+    return (type + 1) * (255 / (DEATH_WALL_ENTITY + 1));
+}
+
+// transforms world positions to pixel coordinates of an agent's image
+typedef struct imageView {
+    b2Vec2 center;
+    float pixelsPerUnit;
+} imageView;
+
+static inline b2Vec2 imagePixelPos(const imageView *view, const b2Vec2 pos) {
+    return (b2Vec2){
+        .x = ((pos.x - view->center.x) * view->pixelsPerUnit) + (IMAGE_OBS_SIZE / 2.0f),
+        .y = ((pos.y - view->center.y) * view->pixelsPerUnit) + (IMAGE_OBS_SIZE / 2.0f),
+    };
+}
+
+// returns the first pixel whose center is at or past the coordinate
+static inline int16_t imagePixelStart(const float coord) {
+    return (int16_t)ceilf(coord - 0.5f);
+}
+
+// fills pixels [x0, x1) of a row, keeping existing pixels if higher
+static inline void fillImageSpan(uint8_t *row, int16_t x0, int16_t x1, const uint8_t value) {
+    x0 = max(x0, 0);
+    x1 = min(x1, _IMAGE_OBS_SIZE);
+    if (x0 >= x1) {
+        return;
+    }
+#ifdef USE_AVX2
+    // lanes in the span are selected by comparing lane indexes against
+    // its ends, so any span is filled with the same 2 vector ops
+    const __m256i lowIdxs = _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+    const __m256i highIdxs = _mm256_add_epi8(lowIdxs, _mm256_set1_epi8(32));
+    const __m256i start = _mm256_set1_epi8(x0 - 1);
+    const __m256i end = _mm256_set1_epi8(x1);
+    const __m256i values = _mm256_set1_epi8(value);
+
+    const __m256i lowMask = _mm256_and_si256(_mm256_cmpgt_epi8(lowIdxs, start), _mm256_cmpgt_epi8(end, lowIdxs));
+    const __m256i highMask = _mm256_and_si256(_mm256_cmpgt_epi8(highIdxs, start), _mm256_cmpgt_epi8(end, highIdxs));
+    __m256i *lowRow = (__m256i *)row;
+    __m256i *highRow = (__m256i *)(row + 32);
+    _mm256_storeu_si256(lowRow, _mm256_max_epu8(_mm256_loadu_si256(lowRow), _mm256_and_si256(lowMask, values)));
+    _mm256_storeu_si256(highRow, _mm256_max_epu8(_mm256_loadu_si256(highRow), _mm256_and_si256(highMask, values)));
+#else
+    for (int16_t x = x0; x < x1; x++) {
+        row[x] = max(row[x], value);
+    }
+#endif
+}
+
+// fills the pixels whose centers are inside an axis aligned rectangle
+static void fillImageRect(uint8_t *plane, const b2Vec2 min, const b2Vec2 max, const uint8_t value) {
+    const int16_t x0 = imagePixelStart(min.x);
+    const int16_t x1 = imagePixelStart(max.x);
+    const int16_t y0 = max(imagePixelStart(min.y), 0);
+    const int16_t y1 = min(imagePixelStart(max.y), _IMAGE_OBS_SIZE);
+    for (int16_t y = y0; y < y1; y++) {
+        fillImageSpan(plane + (y * IMAGE_OBS_SIZE), x0, x1, value);
+    }
+}
+
+// fills the pixels whose centers are inside a circle one row span at a
+// time
+static void fillImageCircle(uint8_t *plane, const b2Vec2 center, float radius, const uint8_t value) {
+    radius = fmaxf(radius, IMAGE_OBS_MIN_RADIUS);
+    const int16_t y0 = max(imagePixelStart(center.y - radius), 0);
+    const int16_t y1 = min(imagePixelStart(center.y + radius), _IMAGE_OBS_SIZE);
+    const float radiusSquared = radius * radius;
+    for (int16_t y = y0; y < y1; y++) {
+        const float dy = (y + 0.5f) - center.y;
+        const float halfWidth = sqrtf(fmaxf(radiusSquared - (dy * dy), 0.0f));
+        fillImageSpan(plane + (y * IMAGE_OBS_SIZE), imagePixelStart(center.x - halfWidth), imagePixelStart(center.x + halfWidth), value);
+    }
+}
+
+// fills the pixels whose centers are inside a convex quad, each row's
+// span is between the left and rightmost edge crossings of its center
+static void fillImageQuad(uint8_t *plane, const b2Vec2 corners[4], const uint8_t value) {
+    float minY = corners[0].y;
+    float maxY = corners[0].y;
+    for (uint8_t i = 1; i < 4; i++) {
+        minY = fminf(minY, corners[i].y);
+        maxY = fmaxf(maxY, corners[i].y);
+    }
+    const int16_t y0 = max(imagePixelStart(minY), 0);
+    const int16_t y1 = min(imagePixelStart(maxY), _IMAGE_OBS_SIZE);
+    for (int16_t y = y0; y < y1; y++) {
+        const float rowY = y + 0.5f;
+        float minX = FLT_MAX;
+        float maxX = -FLT_MAX;
+        for (uint8_t i = 0; i < 4; i++) {
+            const b2Vec2 a = corners[i];
+            const b2Vec2 b = corners[(i + 1) % 4];
+            if ((rowY < a.y) == (rowY < b.y)) {
+                continue;
+            }
+            const float x = a.x + ((rowY - a.y) * (b.x - a.x) / (b.y - a.y));
+            minX = fminf(minX, x);
+            maxX = fmaxf(maxX, x);
+        }
+        if (minX > maxX) {
+            continue;
+        }
+        fillImageSpan(plane + (y * IMAGE_OBS_SIZE), imagePixelStart(minX), imagePixelStart(maxX), value);
+    }
+}
+
+// draws the static walls in view from the map cells, runs of walls of
+// the same type in a row of cells are filled as one rectangle
+static void drawImageWalls(const env *e, const imageView *view, uint8_t *plane) {
+    const float halfView = (IMAGE_OBS_SIZE / 2.0f) / view->pixelsPerUnit;
+    const int16_t columns = e->map->columns;
+    const int16_t rows = e->map->rows;
+    const int16_t startCol = max((int16_t)floorf(((view->center.x - halfView) / WALL_THICKNESS) + (columns / 2.0f)), 0);
+    const int16_t endCol = min((int16_t)floorf(((view->center.x + halfView) / WALL_THICKNESS) + (columns / 2.0f)), columns - 1);
+    const int16_t startRow = max((int16_t)floorf(((view->center.y - halfView) / WALL_THICKNESS) + (rows / 2.0f)), 0);
+    const int16_t endRow = min((int16_t)floorf(((view->center.y + halfView) / WALL_THICKNESS) + (rows / 2.0f)), rows - 1);
+    const b2Vec2 halfCell = {.x = WALL_THICKNESS / 2.0f, .y = WALL_THICKNESS / 2.0f};
+
+    for (int16_t row = startRow; row <= endRow; row++) {
+        int16_t runStart = -1;
+        uint8_t runValue = 0;
+        for (int16_t col = startCol; col <= endCol + 1; col++) {
+            uint8_t value = 0;
+            if (col <= endCol) {
+                const mapCell *cell = safe_array_get_at(e->cells, cellIndex(e, col, row));
+                if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
+                    value = imageWallValue(cell->ent->type);
+                }
+            }
+            if (value == runValue) {
+                continue;
+            }
+            if (runValue != 0) {
+                const mapCell *first = safe_array_get_at(e->cells, cellIndex(e, runStart, row));
+                const mapCell *last = safe_array_get_at(e->cells, cellIndex(e, col - 1, row));
+                fillImageRect(plane, imagePixelPos(view, b2Sub(first->pos, halfCell)), imagePixelPos(view, b2Add(last->pos, halfCell)), runValue);
+            }
+            runStart = col;
+            runValue = value;
+        }
+    }
+}
+
+static void drawImageFloatingWalls(const env *e, const imageView *view, uint8_t *plane) {
+    for (size_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
+        const wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+        const b2Vec2 extents[4] = {
+            {.x = -wall->extent.x, .y = -wall->extent.y},
+            {.x = wall->extent.x, .y = -wall->extent.y},
+            {.x = wall->extent.x, .y = wall->extent.y},
+            {.x = -wall->extent.x, .y = wall->extent.y},
+        };
+        b2Vec2 corners[4];
+        for (uint8_t j = 0; j < 4; j++) {
+            corners[j] = imagePixelPos(view, b2Add(wall->pos, b2RotateVector(wall->rot, extents[j])));
+        }
+        fillImageQuad(plane, corners, imageWallValue(wall->type));
+    }
+}
+
+static void drawImagePickups(const env *e, const imageView *view, uint8_t *plane) {
+    const b2Vec2 halfPickup = {.x = PICKUP_THICKNESS / 2.0f, .y = PICKUP_THICKNESS / 2.0f};
+    for (size_t i = 0; i < cc_array_size(e->pickups); i++) {
+        const weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+        if (pickup->bodyDestroyed) {
+            continue;
+        }
+        const uint8_t value = (pickup->weapon + 1) * (255 / NUM_WEAPONS);
+        fillImageRect(plane, imagePixelPos(view, b2Sub(pickup->pos, halfPickup)), imagePixelPos(view, b2Add(pickup->pos, halfPickup)), value);
+    }
+}
+
+static void drawImageDrone(const droneEntity *drone, const imageView *view, uint8_t *plane, const uint8_t value) {
+    const b2Vec2 pos = imagePixelPos(view, drone->pos);
+    if (drone->shield != NULL) {
+        fillImageCircle(plane, pos, DRONE_SHIELD_RADIUS * view->pixelsPerUnit, IMAGE_SHIELD_VALUE);
+    }
+    fillImageCircle(plane, pos, DRONE_RADIUS * view->pixelsPerUnit, value);
+}
+
+static void drawImageProjectiles(const env *e, const droneEntity *agentDrone, const imageView *view, uint8_t *plane) {
+    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        const projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+        const uint8_t value = projectile->droneIdx == agentDrone->idx ? IMAGE_OWN_VALUE : IMAGE_OTHER_VALUE;
+        fillImageCircle(plane, imagePixelPos(view, projectile->pos), projectile->weaponInfo->radius * view->pixelsPerUnit, value);
+    }
+}
+
+// rasterizes the image obs of every agent into the obs buffer
+void computeImageObs(env *e) {
+    const uint16_t planeSize = IMAGE_OBS_SIZE * IMAGE_OBS_SIZE;
+    const float pixelsPerUnit = IMAGE_OBS_SIZE / (IMAGE_OBS_VIEW_CELLS * WALL_THICKNESS);
+
+    for (uint8_t agentIdx = 0; agentIdx < e->numAgents; agentIdx++) {
+        droneEntity *agentDrone = safe_array_get_at(e->drones, agentIdx);
+        // if the drone is dead, only compute observations if it died
+        // this step and it isn't out of bounds
+        if (agentDrone->livesLeft == 0 && (!agentDrone->diedThisStep || agentDrone->mapCellIdx == -1)) {
+            continue;
+        }
+
+        uint8_t *obs = e->obs + (agentIdx * e->obsStride);
+        memset(obs, 0x0, imageObsBytes());
+        const imageView view = {.center = agentDrone->pos, .pixelsPerUnit = pixelsPerUnit};
+
+        drawImageWalls(e, &view, obs + (IMAGE_WALL_CHANNEL * planeSize));
+        drawImageFloatingWalls(e, &view, obs + (IMAGE_FLOATING_WALL_CHANNEL * planeSize));
+        drawImagePickups(e, &view, obs + (IMAGE_PICKUP_CHANNEL * planeSize));
+
+        for (uint8_t i = 0; i < e->numDrones; i++) {
+            const droneEntity *drone = safe_array_get_at(e->drones, i);
+            if (drone->dead) {
+                continue;
+            }
+            if (i == agentIdx) {
+                drawImageDrone(drone, &view, obs + (IMAGE_AGENT_CHANNEL * planeSize), IMAGE_OTHER_VALUE);
+                continue;
+            }
+            const uint8_t value = drone->team == agentDrone->team ? IMAGE_OWN_VALUE : IMAGE_OTHER_VALUE;
+            drawImageDrone(drone, &view, obs + (IMAGE_DRONE_CHANNEL * planeSize), value);
+        }
+
+        drawImageProjectiles(e, agentDrone, &view, obs + (IMAGE_PROJECTILE_CHANNEL * planeSize));
+    }
+}
+
+#endif
+
+#endif
@@ -32,6 +32,9 @@ extern "C" {
 #include <stddef.h> /* for size_t */
 
 #define USE_DL_PREFIX
+/* reset pools and render threads allocate while envs are stepped, the
+   lock is only taken while they run, see dlmalloc_enable_locking */
+#define USE_MALLOC_LOCK
 
 /*
   malloc(size_t n)
@@ -381,6 +384,20 @@ void malloc_stats(void);
 void dlmalloc_stats(void);
 #endif
 
+/*
+  dlmalloc_enable_locking();
+  dlmalloc_disable_locking();
+  When USE_MALLOC_LOCK is defined, calls are only serialized while
+  locking is enabled so a single threaded program doesn't pay for the
+  lock. Enabling is counted, each call to dlmalloc_enable_locking must be
+  paired with a call to dlmalloc_disable_locking. Locking must be
+  enabled before another thread that allocates is started and disabled
+  only after it's joined.
+*/
+
+void dlmalloc_enable_locking(void);
+void dlmalloc_disable_locking(void);
+
 /*
   mallinfo()
   Returns (by copy) a struct containing various summary statistics:
@@ -2170,9 +2187,21 @@ static int mALLOC_MUTEx;
 #include <pthread.h>
 
 static pthread_mutex_t mALLOC_MUTEx = PTHREAD_MUTEX_INITIALIZER;
+/* how many enabled locking; only changes from or to 0 while a single
+   thread allocates so the lock is taken and released consistently */
+static int mALLOC_LOCKERs = 0;
 
-#define MALLOC_PREACTION pthread_mutex_lock(&mALLOC_MUTEx)
-#define MALLOC_POSTACTION pthread_mutex_unlock(&mALLOC_MUTEx)
+#define MALLOC_LOCKING (__atomic_load_n(&mALLOC_LOCKERs, __ATOMIC_ACQUIRE) != 0)
+#define MALLOC_PREACTION (MALLOC_LOCKING ? pthread_mutex_lock(&mALLOC_MUTEx) : 0)
+#define MALLOC_POSTACTION (MALLOC_LOCKING ? pthread_mutex_unlock(&mALLOC_MUTEx) : 0)
+
+void dlmalloc_enable_locking(void) {
+    __atomic_add_fetch(&mALLOC_LOCKERs, 1, __ATOMIC_RELEASE);
+}
+
+void dlmalloc_disable_locking(void) {
+    __atomic_sub_fetch(&mALLOC_LOCKERs, 1, __ATOMIC_RELEASE);
+}
 
 #endif /* USE_MALLOC_LOCK */
 
@@ -2185,6 +2214,15 @@ static pthread_mutex_t mALLOC_MUTEx = PTHREAD_MUTEX_INITIALIZER;
 
 #endif
 
+#if !defined(USE_MALLOC_LOCK) || defined(WIN32)
+/* not locking at all or always locking */
+void dlmalloc_enable_locking(void) {
+}
+
+void dlmalloc_disable_locking(void) {
+}
+#endif
+
 Void_t *public_mALLOc(size_t bytes) {
     Void_t *m;
     if (MALLOC_PREACTION != 0) {
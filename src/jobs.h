@@ -0,0 +1,208 @@
+#ifndef IMPULSE_WARS_JOBS_H
+#define IMPULSE_WARS_JOBS_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "box2d/box2d.h"
+
+#include "helpers.h"
+#include "types.h"
+
+// a pool of worker threads shared by every box2d world in the process;
+// it's sized once for the whole process so worlds don't each spawn their
+// own threads and oversubscribe cores when many envs are stepped in
+// parallel by multiple processes
+
+#define MAX_JOB_THREADS 31
+// box2d never has more than this many tasks in flight during a step
+#define MAX_WORLD_TASKS 64
+#define MAX_QUEUED_JOBS 1024
+
+#ifndef AUTOPXD
+typedef struct jobTask {
+    b2TaskCallback *task;
+    void *taskContext;
+    int itemCount;
+    // the task's items are split into parts that can run in parallel,
+    // each part is run with its index as box2d's worker index
+    int numParts;
+    atomic_int nextPart;
+    // workers that took a ticket for this task and haven't finished
+    // running the part they claimed
+    atomic_int inFlight;
+} jobTask;
+
+typedef struct jobSystem {
+    pthread_mutex_t lock;
+    pthread_cond_t workAvailable;
+    uint32_t refCount;
+    bool shutdown;
+    uint8_t numThreads;
+    pthread_t threads[MAX_JOB_THREADS];
+
+    // ring buffer of tickets, a task has a ticket for each of its parts
+    jobTask *queue[MAX_QUEUED_JOBS];
+    uint16_t queueStart;
+    uint16_t queueSize;
+} jobSystem;
+
+jobSystem jobs = {.lock = PTHREAD_MUTEX_INITIALIZER, .workAvailable = PTHREAD_COND_INITIALIZER};
+
+// tasks of a single world, box2d passes this to the task callbacks
+struct worldJobs {
+    jobTask tasks[MAX_WORLD_TASKS];
+    uint8_t nextTask;
+};
+
+static inline void runTaskPart(jobTask *t, const int part) {
+    const int start = (t->itemCount * part) / t->numParts;
+    const int end = (t->itemCount * (part + 1)) / t->numParts;
+    t->task(start, end, part, t->taskContext);
+}
+
+void *jobWorker(void *arg) {
+    MAYBE_UNUSED(arg);
+    while (true) {
+        pthread_mutex_lock(&jobs.lock);
+        while (jobs.queueSize == 0 && !jobs.shutdown) {
+            pthread_cond_wait(&jobs.workAvailable, &jobs.lock);
+        }
+        if (jobs.shutdown) {
+            pthread_mutex_unlock(&jobs.lock);
+            return NULL;
+        }
+        jobTask *t = jobs.queue[jobs.queueStart];
+        jobs.queueStart = (jobs.queueStart + 1) % MAX_QUEUED_JOBS;
+        jobs.queueSize--;
+        atomic_fetch_add(&t->inFlight, 1);
+        pthread_mutex_unlock(&jobs.lock);
+
+        const int part = atomic_fetch_add(&t->nextPart, 1);
+        if (part < t->numParts) {
+            runTaskPart(t, part);
+        }
+        atomic_fetch_sub(&t->inFlight, 1);
+    }
+}
+
+void *enqueueJobTask(b2TaskCallback *task, int itemCount, int minRange, void *taskContext, void *userContext) {
+    worldJobs *wj = userContext;
+    jobTask *t = &wj->tasks[wj->nextTask];
+    wj->nextTask = (wj->nextTask + 1) % MAX_WORLD_TASKS;
+
+    t->task = task;
+    t->taskContext = taskContext;
+    t->itemCount = itemCount;
+    t->numParts = min(max((itemCount + minRange - 1) / minRange, 1), jobs.numThreads + 1);
+    atomic_store(&t->nextPart, 0);
+    atomic_store(&t->inFlight, 0);
+
+    pthread_mutex_lock(&jobs.lock);
+    if (jobs.queueSize + t->numParts > MAX_QUEUED_JOBS) {
+        // box2d treats a NULL task as one that has already been run
+        pthread_mutex_unlock(&jobs.lock);
+        task(0, itemCount, 0, taskContext);
+        return NULL;
+    }
+    for (int i = 0; i < t->numParts; i++) {
+        jobs.queue[(jobs.queueStart + jobs.queueSize) % MAX_QUEUED_JOBS] = t;
+        jobs.queueSize++;
+    }
+    pthread_cond_broadcast(&jobs.workAvailable);
+    pthread_mutex_unlock(&jobs.lock);
+
+    return t;
+}
+
+void finishJobTask(void *userTask, void *userContext) {
+    MAYBE_UNUSED(userContext);
+    jobTask *t = userTask;
+
+    // remove tickets workers haven't taken so none of them can pick up
+    // this task after it's finished and its slot is reused
+    pthread_mutex_lock(&jobs.lock);
+    uint16_t kept = 0;
+    for (uint16_t i = 0; i < jobs.queueSize; i++) {
+        jobTask *queued = jobs.queue[(jobs.queueStart + i) % MAX_QUEUED_JOBS];
+        if (queued != t) {
+            jobs.queue[(jobs.queueStart + kept) % MAX_QUEUED_JOBS] = queued;
+            kept++;
+        }
+    }
+    jobs.queueSize = kept;
+    pthread_mutex_unlock(&jobs.lock);
+
+    // run parts no worker has started on this thread, then wait for
+    // the rest to finish
+    int part;
+    while ((part = atomic_fetch_add(&t->nextPart, 1)) < t->numParts) {
+        runTaskPart(t, part);
+    }
+    while (atomic_load(&t->inFlight) != 0) {
+        sched_yield();
+    }
+}
+
+// sets up a world def so the world's tasks run on the shared job system
+// if it has any threads; returns the task state that must be freed after
+// the world is destroyed, or NULL if the world will be single threaded
+worldJobs *useJobSystem(b2WorldDef *worldDef) {
+    if (jobs.numThreads == 0) {
+        return NULL;
+    }
+
+    worldJobs *wj = fastCalloc(1, sizeof(worldJobs));
+    worldDef->workerCount = jobs.numThreads + 1;
+    worldDef->enqueueTask = enqueueJobTask;
+    worldDef->finishTask = finishJobTask;
+    worldDef->userTaskContext = wj;
+    return wj;
+}
+#endif
+
+// starts the shared job system with numThreads worker threads if no
+// other caller in the process already has, the thread calling box2d also
+// runs tasks so a world can use numThreads + 1 cores. Must be called
+// before envs are initialized and paired with a call to destroyJobSystem
+void initJobSystem(uint8_t numThreads) {
+    pthread_mutex_lock(&jobs.lock);
+    if (jobs.refCount++ != 0 || numThreads == 0) {
+        pthread_mutex_unlock(&jobs.lock);
+        return;
+    }
+
+    jobs.shutdown = false;
+    jobs.numThreads = min(numThreads, MAX_JOB_THREADS);
+    for (uint8_t i = 0; i < jobs.numThreads; i++) {
+        if (pthread_create(&jobs.threads[i], NULL, jobWorker, NULL) != 0) {
+            ERRORF("failed to create job thread: %s", strerror(errno));
+        }
+    }
+    pthread_mutex_unlock(&jobs.lock);
+}
+
+// must be called after every world using the job system is destroyed
+void destroyJobSystem() {
+    pthread_mutex_lock(&jobs.lock);
+    ASSERT(jobs.refCount != 0);
+    if (--jobs.refCount != 0 || jobs.numThreads == 0) {
+        pthread_mutex_unlock(&jobs.lock);
+        return;
+    }
+    jobs.shutdown = true;
+    pthread_cond_broadcast(&jobs.workAvailable);
+    pthread_mutex_unlock(&jobs.lock);
+
+    for (uint8_t i = 0; i < jobs.numThreads; i++) {
+        pthread_join(jobs.threads[i], NULL);
+    }
+    jobs.numThreads = 0;
+    jobs.queueStart = 0;
+    jobs.queueSize = 0;
+}
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef IMPULSE_WARS_LIDAR_H
+#define IMPULSE_WARS_LIDAR_H
+
+#include "game.h"
+#include "helpers.h"
+#include "settings.h"
+#include "types.h"
+
+// lidar observations are the distances along rays cast from an agent's
+// drone in evenly spaced world aligned directions, and what each ray
+// hit. Casting every ray through the broadphase separately would walk
+// the same tree nodes for each ray, so instead the shapes in range of
+// any ray are gathered with one AABB query and every ray is intersected
+// with them analytically, 8 rays at a time when AVX2 is available.
+
+#ifndef AUTOPXD
+
+// shapes past this many in range of an agent are ignored, the lidar
+// range is small enough that this is never reached on real maps
+#define LIDAR_MAX_BOXES 128
+#define LIDAR_MAX_CIRCLES _MAX_DRONES
+
+enum lidarHitType {
+    LIDAR_STANDARD_WALL_HIT,
+    LIDAR_BOUNCY_WALL_HIT,
+    LIDAR_DEATH_WALL_HIT,
+    LIDAR_DRONE_HIT,
+};
+
+// shapes in range of an agent's rays, boxes are stored as parallel
+// arrays so their values can be broadcast to all rays at once
+typedef struct lidarShapes {
+    const env *e;
+    const droneEntity *drone;
+
+    uint8_t numBoxes;
+    float boxX[LIDAR_MAX_BOXES];
+    float boxY[LIDAR_MAX_BOXES];
+    float boxCos[LIDAR_MAX_BOXES];
+    float boxSin[LIDAR_MAX_BOXES];
+    float boxExtentX[LIDAR_MAX_BOXES];
+    float boxExtentY[LIDAR_MAX_BOXES];
+    // hit type in the low bits, set bit 2 if floating
+    uint8_t boxHit[LIDAR_MAX_BOXES];
+
+    uint8_t numCircles;
+    float circleX[LIDAR_MAX_CIRCLES];
+    float circleY[LIDAR_MAX_CIRCLES];
+} lidarShapes;
+
+#define LIDAR_FLOATING_HIT 0x4
+#define LIDAR_HIT_TYPE_MASK 0x3
+
+bool lidarShapesCallback(b2ShapeId shapeID, void *context) {
+    if (!b2Shape_IsValid(shapeID)) {
+        return true;
+    }
+
+    lidarShapes *shapes = context;
+    const entity *ent = b2Shape_GetUserData(shapeID);
+    // arenas sharing a world can be in range of each other's queries
+    if (ent == NULL || ent->env != shapes->e) {
+        return true;
+    }
+
+    if (entityTypeIsWall(ent->type)) {
+        if (shapes->numBoxes == LIDAR_MAX_BOXES) {
+            return true;
+        }
+        const wallEntity *wall = ent->entity;
+        const uint8_t i = shapes->numBoxes++;
+        shapes->boxX[i] = wall->pos.x;
+        shapes->boxY[i] = wall->pos.y;
+        shapes->boxCos[i] = wall->rot.c;
+        shapes->boxSin[i] = wall->rot.s;
+        shapes->boxExtentX[i] = wall->extent.x;
+        shapes->boxExtentY[i] = wall->extent.y;
+        shapes->boxHit[i] = (ent->type - STANDARD_WALL_ENTITY) | (wall->isFloating ? LIDAR_FLOATING_HIT : 0);
+    } else if (ent->type == DRONE_ENTITY) {
+        const droneEntity *drone = ent->entity;
+        if (drone == shapes->drone || shapes->numCircles == LIDAR_MAX_CIRCLES) {
+            return true;
+        }
+        const uint8_t i = shapes->numCircles++;
+        shapes->circleX[i] = drone->pos.x;
+        shapes->circleY[i] = drone->pos.y;
+    }
+    return true;
+}
+
+// distance to the nearest hit of each ray, LIDAR_RANGE if nothing was hit
+typedef struct lidarHits {
+    float distance[_MAX_LIDAR_RAYS];
+    float dirX[_MAX_LIDAR_RAYS];
+    float dirY[_MAX_LIDAR_RAYS];
+    // -1 if nothing was hit
+    int32_t hit[_MAX_LIDAR_RAYS];
+} lidarHits;
+
+// intersects rays [start, start + 8) with every shape
+static void castLidarRays(const lidarShapes *shapes, const b2Vec2 origin, lidarHits *hits, const uint8_t start) {
+#ifdef USE_AVX2
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 dirX = _mm256_loadu_ps(hits->dirX + start);
+    const __m256 dirY = _mm256_loadu_ps(hits->dirY + start);
+    __m256 best = _mm256_loadu_ps(hits->distance + start);
+    __m256i bestHit = _mm256_loadu_si256((const __m256i *)(hits->hit + start));
+
+    for (uint8_t i = 0; i < shapes->numBoxes; i++) {
+        // slab test in the box's local frame
+        const float c = shapes->boxCos[i];
+        const float s = shapes->boxSin[i];
+        const float relX = origin.x - shapes->boxX[i];
+        const float relY = origin.y - shapes->boxY[i];
+        const __m256 localOriginX = _mm256_set1_ps((c * relX) + (s * relY));
+        const __m256 localOriginY = _mm256_set1_ps((c * relY) - (s * relX));
+        const __m256 extentX = _mm256_set1_ps(shapes->boxExtentX[i]);
+        const __m256 extentY = _mm256_set1_ps(shapes->boxExtentY[i]);
+
+        const __m256 cv = _mm256_set1_ps(c);
+        const __m256 sv = _mm256_set1_ps(s);
+        const __m256 invDirX = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_fmadd_ps(cv, dirX, _mm256_mul_ps(sv, dirY)));
+        const __m256 invDirY = _mm256_div_ps(_mm256_set1_ps(1.0f), _mm256_fmsub_ps(cv, dirY, _mm256_mul_ps(sv, dirX)));
+
+        const __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, extentX), localOriginX), invDirX);
+        const __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(extentX, localOriginX), invDirX);
+        const __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_sub_ps(zero, extentY), localOriginY), invDirY);
+        const __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(extentY, localOriginY), invDirY);
+        const __m256 tNear = _mm256_max_ps(_mm256_max_ps(_mm256_min_ps(tx1, tx2), _mm256_min_ps(ty1, ty2)), zero);
+        const __m256 tFar = _mm256_min_ps(_mm256_max_ps(tx1, tx2), _mm256_max_ps(ty1, ty2));
+
+        const __m256 closer = _mm256_and_ps(_mm256_cmp_ps(tNear, tFar, _CMP_LE_OQ), _mm256_cmp_ps(tNear, best, _CMP_LT_OQ));
+        best = _mm256_blendv_ps(best, tNear, closer);
+        bestHit = _mm256_blendv_epi8(bestHit, _mm256_set1_epi32(shapes->boxHit[i]), _mm256_castps_si256(closer));
+    }
+
+    const __m256 radiusSquared = _mm256_set1_ps(DRONE_RADIUS * DRONE_RADIUS);
+    const __m256i droneHit = _mm256_set1_epi32(LIDAR_DRONE_HIT);
+    for (uint8_t i = 0; i < shapes->numCircles; i++) {
+        const float relX = origin.x - shapes->circleX[i];
+        const float relY = origin.y - shapes->circleY[i];
+        const __m256 b = _mm256_fmadd_ps(_mm256_set1_ps(relX), dirX, _mm256_mul_ps(_mm256_set1_ps(relY), dirY));
+        const __m256 c = _mm256_sub_ps(_mm256_set1_ps((relX * relX) + (relY * relY)), radiusSquared);
+        const __m256 disc = _mm256_fmsub_ps(b, b, c);
+        const __m256 t = _mm256_sub_ps(_mm256_sub_ps(zero, b), _mm256_sqrt_ps(_mm256_max_ps(disc, zero)));
+
+        __m256 closer = _mm256_cmp_ps(disc, zero, _CMP_GE_OQ);
+        closer = _mm256_and_ps(closer, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+        closer = _mm256_and_ps(closer, _mm256_cmp_ps(t, best, _CMP_LT_OQ));
+        best = _mm256_blendv_ps(best, t, closer);
+        bestHit = _mm256_blendv_epi8(bestHit, droneHit, _mm256_castps_si256(closer));
+    }
+
+    _mm256_storeu_ps(hits->distance + start, best);
+    _mm256_storeu_si256((__m256i *)(hits->hit + start), bestHit);
+#else
+    for (uint8_t r = start; r < start + 8; r++) {
+        const float dirX = hits->dirX[r];
+        const float dirY = hits->dirY[r];
+        float best = hits->distance[r];
+        int32_t bestHit = hits->hit[r];
+
+        for (uint8_t i = 0; i < shapes->numBoxes; i++) {
+            const float c = shapes->boxCos[i];
+            const float s = shapes->boxSin[i];
+            const float relX = origin.x - shapes->boxX[i];
+            const float relY = origin.y - shapes->boxY[i];
+            const float localOriginX = (c * relX) + (s * relY);
+            const float localOriginY = (c * relY) - (s * relX);
+            const float invDirX = 1.0f / ((c * dirX) + (s * dirY));
+            const float invDirY = 1.0f / ((c * dirY) - (s * dirX));
+
+            const float tx1 = (-shapes->boxExtentX[i] - localOriginX) * invDirX;
+            const float tx2 = (shapes->boxExtentX[i] - localOriginX) * invDirX;
+            const float ty1 = (-shapes->boxExtentY[i] - localOriginY) * invDirY;
+            const float ty2 = (shapes->boxExtentY[i] - localOriginY) * invDirY;
+            const float tNear = fmaxf(fmaxf(fminf(tx1, tx2), fminf(ty1, ty2)), 0.0f);
+            const float tFar = fminf(fmaxf(tx1, tx2), fmaxf(ty1, ty2));
+            if (tNear <= tFar && tNear < best) {
+                best = tNear;
+                bestHit = shapes->boxHit[i];
+            }
+        }
+
+        for (uint8_t i = 0; i < shapes->numCircles; i++) {
+            const float relX = origin.x - shapes->circleX[i];
+            const float relY = origin.y - shapes->circleY[i];
+            const float b = (relX * dirX) + (relY * dirY);
+            const float disc = (b * b) - ((relX * relX) + (relY * relY) - (DRONE_RADIUS * DRONE_RADIUS));
+            if (disc < 0.0f) {
+                continue;
+            }
+            const float t = -b - sqrtf(disc);
+            if (t >= 0.0f && t < best) {
+                best = t;
+                bestHit = LIDAR_DRONE_HIT;
+            }
+        }
+
+        hits->distance[r] = best;
+        hits->hit[r] = bestHit;
+    }
+#endif
+}
+
+// casts the profile's lidar rays from a drone and writes the distance
+// and hit type of each to obs
+void computeLidarObs(const env *e, const droneEntity *drone, const uint8_t numRays, float *obs) {
+    ASSERT(numRays <= MAX_LIDAR_RAYS);
+
+    lidarShapes shapes;
+    shapes.e = e;
+    shapes.drone = drone;
+    shapes.numBoxes = 0;
+    shapes.numCircles = 0;
+
+    const b2Vec2 worldPos = arenaToWorldPos(e, drone->pos);
+    const b2AABB bounds = {
+        .lowerBound = {.x = worldPos.x - LIDAR_RANGE, .y = worldPos.y - LIDAR_RANGE},
+        .upperBound = {.x = worldPos.x + LIDAR_RANGE, .y = worldPos.y + LIDAR_RANGE},
+    };
+    const b2QueryFilter filter = {
+        .categoryBits = PROJECTILE_SHAPE,
+        .maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | DRONE_SHAPE,
+    };
+    b2World_OverlapAABB(e->worldID, bounds, filter, lidarShapesCallback, &shapes);
+
+    // rays are cast in batches of 8, rays past numRays are cast but
+    // not observed
+    lidarHits hits;
+    const uint8_t numCast = alignedSize(numRays, 8);
+    const float rayAngle = (2.0f * PI) / numRays;
+    for (uint8_t i = 0; i < numCast; i++) {
+        hits.distance[i] = LIDAR_RANGE;
+        hits.dirX[i] = cosf(i * rayAngle);
+        hits.dirY[i] = sinf(i * rayAngle);
+        hits.hit[i] = -1;
+    }
+    for (uint8_t i = 0; i < numCast; i += 8) {
+        castLidarRays(&shapes, drone->pos, &hits, i);
+    }
+
+    for (uint8_t i = 0; i < numRays; i++) {
+        float *rayObs = obs + (i * LIDAR_RAY_OBS_SIZE);
+        rayObs[0] = hits.distance[i] / LIDAR_RANGE;
+        if (hits.hit[i] == -1) {
+            continue;
+        }
+        rayObs[1 + (hits.hit[i] & LIDAR_HIT_TYPE_MASK)] = 1.0f;
+        rayObs[LIDAR_RAY_OBS_SIZE - 1] = (hits.hit[i] & LIDAR_FLOATING_HIT) != 0 ? 1.0f : 0.0f;
+    }
+}
+
+#endif
+
+#endif
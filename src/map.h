@@ -2,6 +2,7 @@
 #define IMPULSE_WARS_MAP_H
 
 #include <errno.h>
+#include <pthread.h>
 #include <string.h>
 
 #include "env.h"
@@ -33,7 +34,7 @@ const char boringLayout[] = {
     'D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D',
 };
 
-mapEntry boringMap = {
+const mapEntry boringMap = {
     .layout = boringLayout,
     .columns = 21,
     .rows = 21,
@@ -68,7 +69,7 @@ const char prototypeArenaLayout[] = {
     'D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D',
 };
 
-mapEntry prototypeArenaMap = {
+const mapEntry prototypeArenaMap = {
     .layout = prototypeArenaLayout,
     .columns = 20,
     .rows = 20,
@@ -104,7 +105,7 @@ const char snipersLayout[] = {
     'B','B','B','B','B','B','B','B','B','B','B','B','B','B','B','B','B','B','B','B','B',
 };
 
-mapEntry snipersMap = {
+const mapEntry snipersMap = {
     .layout = snipersLayout,
     .columns = 21,
     .rows = 21,
@@ -140,7 +141,7 @@ const char roomsLayout[] = {
     'D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D',
 };
 
-mapEntry roomsMap = {
+const mapEntry roomsMap = {
     .layout = roomsLayout,
     .columns = 21,
     .rows = 21,
@@ -178,7 +179,7 @@ const char xArenaLayout[] = {
     'D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D',
 };
 
-mapEntry xArena = {
+const mapEntry xArena = {
     .layout = xArenaLayout,
     .columns = 23,
     .rows = 23,
@@ -217,7 +218,7 @@ const char crossBounceLayout[] = {
     'D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D',
 };
 
-mapEntry crossBounce = {
+const mapEntry crossBounce = {
     .layout = crossBounceLayout,
     .columns = 24,
     .rows = 24,
@@ -255,7 +256,7 @@ const char asteriskArenaLayout[]= {
     'D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D','D',
 };
 
-mapEntry asteriskArena = {
+const mapEntry asteriskArena = {
     .layout = asteriskArenaLayout,
     .columns = 23,
     .rows = 23,
@@ -290,7 +291,7 @@ const char foamPitLayout[] = {
     'B','B','B','W','W','W','D','D','D','B','B','D','D','D','W','W','W','B','B','B',
 };
 
-mapEntry foamPitMap = {
+const mapEntry foamPitMap = {
     .layout = foamPitLayout,
     .columns = 20,
     .rows = 20,
@@ -329,7 +330,7 @@ const char siegeLayout[] = {
     'B','B','B','W','W','W','W','W','D','D','D','D','D','D','D','D','D','W','W','W','W','W','B','B','B',
 };
 
-mapEntry siegeMap = {
+const mapEntry siegeMap = {
     .layout = siegeLayout,
     .columns = 25,
     .rows = 24,
@@ -343,8 +344,52 @@ mapEntry siegeMap = {
 
 // clang-format on
 
+// large arenas are procedurally generated once per process by
+// generateMapLayouts, their layouts are generated from a fixed seed so
+// they are the same in every process
+char largeArenaLayout[64 * 64];
+
+const mapEntry largeArenaMap = {
+    .layout = largeArenaLayout,
+    .columns = 64,
+    .rows = 64,
+    .randFloatingStandardWalls = 4,
+    .randFloatingBouncyWalls = 3,
+    .randFloatingDeathWalls = 3,
+    .hasSetFloatingWalls = false,
+    .weaponPickups = 10,
+    .defaultWeapon = STANDARD_WEAPON,
+};
+
+char hugeArenaLayout[_MAX_MAP_COLUMNS * _MAX_MAP_ROWS];
+
+const mapEntry hugeArenaMap = {
+    .layout = hugeArenaLayout,
+    .columns = _MAX_MAP_COLUMNS,
+    .rows = _MAX_MAP_ROWS,
+    .randFloatingStandardWalls = 8,
+    .randFloatingBouncyWalls = 5,
+    .randFloatingDeathWalls = 5,
+    .hasSetFloatingWalls = false,
+    .weaponPickups = MAX_WEAPON_PICKUPS,
+    .defaultWeapon = STANDARD_WEAPON,
+};
+
+typedef struct generatedMap {
+    char *layout;
+    const mapEntry *map;
+    const uint64_t seed;
+    // how many blocks of walls to scatter inside the arena
+    const uint16_t numBlocks;
+} generatedMap;
+
+const generatedMap generatedMaps[] = {
+    {.layout = largeArenaLayout, .map = &largeArenaMap, .seed = 0x5eed0040, .numBlocks = 110},
+    {.layout = hugeArenaLayout, .map = &hugeArenaMap, .seed = 0x5eed0080, .numBlocks = 440},
+};
+
 #ifndef AUTOPXD
-mapEntry *maps[] = {
+const mapEntry *maps[] = {
     &boringMap,
     &prototypeArenaMap,
     &snipersMap,
@@ -354,26 +399,54 @@ mapEntry *maps[] = {
     &asteriskArena,
     &foamPitMap,
     &siegeMap,
+    &largeArenaMap,
+    &hugeArenaMap,
 };
+
+// derived map data is shared between all envs in the process; the first
+// call to initMaps builds it and the last matching call to destroyMaps
+// frees it, so multiple vectorized envs can be created and destroyed
+// independently
+typedef struct mapRegistry {
+    pthread_mutex_t lock;
+    uint32_t refCount;
+    mapDataEntry data[_NUM_MAPS];
+} mapRegistry;
+
+mapRegistry mapDataRegistry = {.lock = PTHREAD_MUTEX_INITIALIZER, .refCount = 0};
+
+pthread_once_t generatedMapsOnce = PTHREAD_ONCE_INIT;
 #endif
 
-void resetMap(env *e) {
-    // if sudden death walls were placed, remove them
-    if (e->suddenDeathWallsPlaced) {
-        e->suddenDeathWallsPlaced = false;
-        DEBUG_LOG("removing sudden death walls");
-        // remove walls from the end of the array, sudden death walls
-        // are added last
-        for (int16_t i = cc_array_size(e->walls) - 1; i >= 0; i--) {
-            wallEntity *wall = safe_array_get_at(e->walls, i);
-            if (!wall->isSuddenDeath) {
-                // if we reached the first non sudden death wall, we're done
-                break;
-            }
-            cc_array_remove_last(e->walls, NULL);
-            destroyWall(e, wall, true);
+void removeSuddenDeathWalls(env *e) {
+    if (!e->suddenDeathWallsPlaced) {
+        return;
+    }
+    e->suddenDeathWallsPlaced = false;
+    DEBUG_LOG("removing sudden death walls");
+    // remove walls from the end of the array, sudden death walls
+    // are added last
+    for (int16_t i = cc_array_size(e->walls) - 1; i >= 0; i--) {
+        wallEntity *wall = safe_array_get_at(e->walls, i);
+        if (!wall->isSuddenDeath) {
+            // if we reached the first non sudden death wall, we're done
+            break;
+        }
+        cc_array_remove_last(e->walls, NULL);
+        destroyWall(e, wall, true);
+    }
+    for (int16_t i = cc_array_size(e->wallBoxes) - 1; i >= 0; i--) {
+        wallEntity *box = safe_array_get_at(e->wallBoxes, i);
+        if (!box->isSuddenDeath) {
+            break;
         }
+        cc_array_remove_last(e->wallBoxes, NULL);
+        destroyWall(e, box, false);
     }
+}
+
+void resetMap(env *e) {
+    removeSuddenDeathWalls(e);
 
     // place floating walls with a set position if there are any
     const mapEntry *map = maps[e->mapIdx];
@@ -414,6 +487,63 @@ void resetMap(env *e) {
     }
 }
 
+static inline bool isStaticWallCell(const env *e, const uint16_t cellIdx, const enum entityType type) {
+    const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+    return cell->ent != NULL && cell->ent->type == type;
+}
+
+// greedily merges rectangles of static walls of the same type into
+// boxes so the broadphase only has to track a handful of large shapes
+// instead of one per wall cell
+void mergeStaticWalls(env *e) {
+    const uint8_t columns = e->map->columns;
+    const uint8_t rows = e->map->rows;
+    bool merged[columns * rows];
+    memset(merged, 0x0, sizeof(merged));
+
+    for (uint8_t row = 0; row < rows; row++) {
+        for (uint8_t col = 0; col < columns; col++) {
+            const uint16_t cellIdx = col + (row * columns);
+            if (merged[cellIdx]) {
+                continue;
+            }
+            const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+            if (cell->ent == NULL || !entityTypeIsWall(cell->ent->type)) {
+                continue;
+            }
+            const enum entityType type = cell->ent->type;
+
+            // grow the box right as far as possible, then grow it down
+            // as long as each row of the box is made of unmerged walls
+            // of the same type
+            uint8_t width = 1;
+            while (col + width < columns && !merged[cellIdx + width] && isStaticWallCell(e, cellIdx + width, type)) {
+                width++;
+            }
+            uint8_t height = 1;
+            while (row + height < rows) {
+                const uint16_t rowStartIdx = cellIdx + (height * columns);
+                bool canGrow = true;
+                for (uint8_t i = 0; i < width; i++) {
+                    if (merged[rowStartIdx + i] || !isStaticWallCell(e, rowStartIdx + i, type)) {
+                        canGrow = false;
+                        break;
+                    }
+                }
+                if (!canGrow) {
+                    break;
+                }
+                height++;
+            }
+
+            for (uint8_t i = 0; i < height; i++) {
+                memset(merged + cellIdx + (i * columns), true, width * sizeof(bool));
+            }
+            createWallBox(e, cellIdx, width, height, type);
+        }
+    }
+}
+
 void setupMap(env *e, const uint8_t mapIdx) {
     // reset the map if we're switching to the same map
     if (e->mapIdx == mapIdx) {
@@ -427,12 +557,18 @@ void setupMap(env *e, const uint8_t mapIdx) {
         destroyWall(e, wall, false);
     }
 
+    for (size_t i = 0; i < cc_array_size(e->wallBoxes); i++) {
+        wallEntity *box = safe_array_get_at(e->wallBoxes, i);
+        destroyWall(e, box, false);
+    }
+
     for (size_t i = 0; i < cc_array_size(e->cells); i++) {
         mapCell *cell = safe_array_get_at(e->cells, i);
         fastFree(cell);
     }
 
     cc_array_remove_all(e->walls);
+    cc_array_remove_all(e->wallBoxes);
     cc_array_remove_all(e->cells);
     e->suddenDeathWallsPlaced = false;
 
@@ -442,6 +578,7 @@ void setupMap(env *e, const uint8_t mapIdx) {
 
     e->mapIdx = mapIdx;
     e->map = maps[mapIdx];
+    e->mapData = &mapDataRegistry.data[mapIdx];
     e->defaultWeapon = weaponInfos[maps[mapIdx]->defaultWeapon];
     if (e->isTraining && randFloat(&e->randState, 0.0f, 1.0f) < 0.25f) {
         e->defaultWeapon = weaponInfos[randInt(&e->randState, 0, NUM_WEAPONS - 1)];
@@ -496,9 +633,11 @@ void setupMap(env *e, const uint8_t mapIdx) {
             cellIdx++;
         }
     }
+
+    mergeStaticWalls(e);
 }
 
-void computeMapBoundsAndQuadrants(env *e, mapEntry *map) {
+void computeMapBoundsAndQuadrants(env *e, mapDataEntry *map) {
     mapBounds bounds = {.min = {.x = FLT_MAX, .y = FLT_MAX}, .max = {.x = FLT_MIN, .y = FLT_MIN}};
     for (size_t i = 0; i < cc_array_size(e->walls); i++) {
         const wallEntity *wall = safe_array_get_at(e->walls, i);
@@ -571,17 +710,194 @@ bool posValidDroneSpawnPoint(const env *e, const b2Vec2 pos) {
 }
 #endif
 
+// fills layout with an arena surrounded by standard walls with
+// randomly sized blocks of walls scattered inside it; open areas that
+// can't be reached from the rest of the arena are filled in so every
+// open cell can be pathed to
+void generateMapLayout(char *layout, const uint8_t columns, const uint8_t rows, uint64_t seed, const uint16_t numBlocks) {
+    const uint16_t numCells = columns * rows;
+    memset(layout, 'O', numCells);
+    for (uint8_t col = 0; col < columns; col++) {
+        layout[col] = 'W';
+        layout[col + ((rows - 1) * columns)] = 'W';
+    }
+    for (uint8_t row = 0; row < rows; row++) {
+        layout[row * columns] = 'W';
+        layout[(columns - 1) + (row * columns)] = 'W';
+    }
+
+    for (uint16_t i = 0; i < numBlocks; i++) {
+        const uint8_t width = randInt(&seed, 1, 4);
+        const uint8_t height = randInt(&seed, 1, 4);
+        // leave a gap between blocks and the border walls
+        const uint8_t startCol = randInt(&seed, 2, columns - 3 - width);
+        const uint8_t startRow = randInt(&seed, 2, rows - 3 - height);
+
+        char wallType = 'W';
+        const int roll = randInt(&seed, 0, 9);
+        if (roll >= 8) {
+            wallType = 'D';
+        } else if (roll >= 6) {
+            wallType = 'B';
+        }
+
+        for (uint8_t row = startRow; row < startRow + height; row++) {
+            memset(&layout[startCol + (row * columns)], wallType, width);
+        }
+    }
+
+    // flood fill open cells starting from the open cell nearest the center
+    uint16_t startIdx = 0;
+    uint32_t startDistance = UINT32_MAX;
+    for (uint16_t i = 0; i < numCells; i++) {
+        if (layout[i] != 'O') {
+            continue;
+        }
+        const int16_t colDiff = (i % columns) - (columns / 2);
+        const int16_t rowDiff = (i / columns) - (rows / 2);
+        const uint32_t distance = (colDiff * colDiff) + (rowDiff * rowDiff);
+        if (distance < startDistance) {
+            startIdx = i;
+            startDistance = distance;
+        }
+    }
+    ASSERT(startDistance != UINT32_MAX);
+
+    bool reachable[numCells];
+    memset(reachable, 0x0, sizeof(reachable));
+    uint16_t stack[numCells];
+    uint16_t stackSize = 0;
+    stack[stackSize++] = startIdx;
+    reachable[startIdx] = true;
+    while (stackSize != 0) {
+        const uint16_t cellIdx = stack[--stackSize];
+        // border cells are always walls so neighbors are always in bounds
+        const uint16_t neighbors[4] = {cellIdx - 1, cellIdx + 1, cellIdx - columns, cellIdx + columns};
+        for (uint8_t i = 0; i < 4; i++) {
+            const uint16_t neighbor = neighbors[i];
+            if (reachable[neighbor] || layout[neighbor] != 'O') {
+                continue;
+            }
+            reachable[neighbor] = true;
+            stack[stackSize++] = neighbor;
+        }
+    }
+
+    for (uint16_t i = 0; i < numCells; i++) {
+        if (layout[i] == 'O' && !reachable[i]) {
+            layout[i] = 'W';
+        }
+    }
+}
+
+static void generateMapLayoutsOnce() {
+    for (uint8_t i = 0; i < sizeof(generatedMaps) / sizeof(generatedMap); i++) {
+        const generatedMap *gen = &generatedMaps[i];
+        generateMapLayout(gen->layout, gen->map->columns, gen->map->rows, gen->seed, gen->numBlocks);
+    }
+}
+
+// generated layouts are the same every time so they're only generated
+// once per process, this is safe to call from any thread and never
+// rewrites a layout another thread may be reading
+void generateMapLayouts() {
+    pthread_once(&generatedMapsOnce, generateMapLayoutsOnce);
+}
+
+static inline bool nearWallLess(const nearEntity *a, const nearEntity *b) {
+    return a->distanceSquared < b->distanceSquared || (a->distanceSquared == b->distanceSquared && a->idx < b->idx);
+}
+
+// finds the MAX_NEAREST_WALLS walls nearest to a cell by searching
+// outwards in square rings of cells, stopping once no cell in the next
+// ring could be nearer than the furthest wall found; wallIdxs maps cell
+// indexes to wall indexes, or -1 if the cell isn't a wall
+void findNearestCellWalls(const env *e, const int16_t *wallIdxs, const uint16_t cellIdx, nearEntity *nearestWalls) {
+    const int16_t columns = e->map->columns;
+    const int16_t rows = e->map->rows;
+    const int16_t cellCol = cellIdx % columns;
+    const int16_t cellRow = cellIdx / columns;
+    const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
+
+    uint8_t numWalls = 0;
+    const int16_t maxRing = max(columns, rows);
+    for (int16_t ring = 1; ring <= maxRing; ring++) {
+        for (int16_t row = cellRow - ring; row <= cellRow + ring; row++) {
+            if (row < 0 || row >= rows) {
+                continue;
+            }
+            // only the left and right cells are in the ring unless this
+            // is the top or bottom row of the ring
+            const bool edgeRow = row == cellRow - ring || row == cellRow + ring;
+            const int16_t colStep = edgeRow ? 1 : 2 * ring;
+            for (int16_t col = cellCol - ring; col <= cellCol + ring; col += colStep) {
+                if (col < 0 || col >= columns) {
+                    continue;
+                }
+                const int16_t wallCellIdx = cellIndex(e, col, row);
+                if (wallIdxs[wallCellIdx] == -1) {
+                    continue;
+                }
+
+                const mapCell *wallCell = safe_array_get_at(e->cells, wallCellIdx);
+                const nearEntity wall = {
+                    .idx = wallIdxs[wallCellIdx],
+                    .distanceSquared = b2DistanceSquared(cell->pos, wallCell->pos),
+                };
+                if (numWalls == MAX_NEAREST_WALLS && !nearWallLess(&wall, &nearestWalls[numWalls - 1])) {
+                    continue;
+                }
+
+                // insert the wall keeping walls sorted by distance, then index
+                int8_t i = min(numWalls, MAX_NEAREST_WALLS - 1);
+                while (i > 0 && nearWallLess(&wall, &nearestWalls[i - 1])) {
+                    nearestWalls[i] = nearestWalls[i - 1];
+                    i--;
+                }
+                nearestWalls[i] = wall;
+                if (numWalls < MAX_NEAREST_WALLS) {
+                    numWalls++;
+                }
+            }
+        }
+
+        const float nextRingDistance = (ring + 1) * WALL_THICKNESS;
+        if (numWalls == MAX_NEAREST_WALLS && nearestWalls[numWalls - 1].distanceSquared < SQUARED(nextRingDistance)) {
+            break;
+        }
+    }
+}
+
+// builds derived map data if no other env in the process has already,
+// must be paired with a call to destroyMaps
 void initMaps(env *e) {
+    pthread_mutex_lock(&mapDataRegistry.lock);
+    if (mapDataRegistry.refCount++ != 0) {
+        pthread_mutex_unlock(&mapDataRegistry.lock);
+        return;
+    }
+
+    generateMapLayouts();
+
     for (uint8_t i = 0; i < NUM_MAPS; i++) {
         setupMap(e, i);
-        mapEntry *map = maps[i];
+        const mapEntry *map = maps[i];
+        mapDataEntry *mapData = &mapDataRegistry.data[i];
 
-        computeMapBoundsAndQuadrants(e, map);
+        computeMapBoundsAndQuadrants(e, mapData);
 
         bool *droneSpawns = fastCalloc(map->columns * map->rows, sizeof(bool));
         uint8_t *packedLayout = fastCalloc(map->columns * map->rows, sizeof(uint8_t));
         nearEntity *nearestWalls = fastCalloc(MAX_NEAREST_WALLS * map->columns * map->rows, sizeof(nearEntity));
 
+        // walls are indexed in cell order
+        int16_t wallIdxs[map->columns * map->rows];
+        int16_t numWalls = 0;
+        for (uint16_t i = 0; i < cc_array_size(e->cells); i++) {
+            const mapCell *cell = safe_array_get_at(e->cells, i);
+            wallIdxs[i] = cell->ent != NULL ? numWalls++ : -1;
+        }
+
         for (uint16_t i = 0; i < cc_array_size(e->cells); i++) {
             const mapCell *cell = safe_array_get_at(e->cells, i);
 
@@ -595,27 +911,11 @@ void initMaps(env *e) {
             }
 
             // find nearest walls for each empty cell
-            uint16_t wallIdx = 0;
-            nearEntity walls[map->columns * map->rows];
-            memset(walls, 0x0, map->columns * map->rows * sizeof(nearEntity));
-            for (uint16_t j = 0; j < cc_array_size(e->cells); j++) {
-                const mapCell *c = safe_array_get_at(e->cells, j);
-                if (c->ent == NULL) {
-                    continue;
-                }
-
-                walls[wallIdx].idx = wallIdx;
-                walls[wallIdx].distanceSquared = b2DistanceSquared(cell->pos, c->pos);
-                wallIdx++;
-            }
-            insertionSort(walls, wallIdx);
-
-            const uint32_t startIdx = i * MAX_NEAREST_WALLS;
-            memcpy(nearestWalls + startIdx, walls, MAX_NEAREST_WALLS * sizeof(nearEntity));
+            findNearestCellWalls(e, wallIdxs, i, nearestWalls + (i * MAX_NEAREST_WALLS));
         }
-        map->droneSpawns = droneSpawns;
-        map->packedLayout = packedLayout;
-        map->nearestWalls = nearestWalls;
+        mapData->droneSpawns = droneSpawns;
+        mapData->packedLayout = packedLayout;
+        mapData->nearestWalls = nearestWalls;
 
         // clear floating walls from the map
         for (uint8_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
@@ -626,15 +926,25 @@ void initMaps(env *e) {
     }
 
     e->mapIdx = -1;
+    pthread_mutex_unlock(&mapDataRegistry.lock);
 }
 
 void destroyMaps() {
+    pthread_mutex_lock(&mapDataRegistry.lock);
+    ASSERT(mapDataRegistry.refCount != 0);
+    if (--mapDataRegistry.refCount != 0) {
+        pthread_mutex_unlock(&mapDataRegistry.lock);
+        return;
+    }
+
     for (uint8_t i = 0; i < NUM_MAPS; i++) {
-        mapEntry *map = maps[i];
-        fastFree(map->droneSpawns);
-        fastFree(map->packedLayout);
-        fastFree(map->nearestWalls);
+        mapDataEntry *mapData = &mapDataRegistry.data[i];
+        fastFree(mapData->droneSpawns);
+        fastFree(mapData->packedLayout);
+        fastFree(mapData->nearestWalls);
     }
+    memset(mapDataRegistry.data, 0x0, sizeof(mapDataRegistry.data));
+    pthread_mutex_unlock(&mapDataRegistry.lock);
 }
 
 void placeRandFloatingWall(env *e, const enum entityType wallType) {
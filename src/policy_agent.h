@@ -0,0 +1,430 @@
+#ifndef IMPULSE_WARS_POLICY_AGENT_H
+#define IMPULSE_WARS_POLICY_AGENT_H
+
+#include <math.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "settings.h"
+#include "types.h"
+
+// runs a policy trained in Python and exported with exportFrozenPolicy
+// in policy.py so opponent drones can be driven by past checkpoints
+// without a round trip through Python; the layers mirror Policy and the
+// LSTM that wraps it, but the exporter rearranges the weights so every
+// layer can be run as a sum of contiguous weight rows
+
+#define POLICY_FILE_MAGIC 0x4c505749 // "IWPL"
+#define POLICY_FILE_VERSION 3
+
+#define POLICY_CNN_CHANNELS 64
+#define POLICY_CONV1_KERNEL 5
+#define POLICY_CONV1_STRIDE 3
+#define POLICY_ENCODER_SIZE 256
+#define POLICY_HIDDEN_SIZE 256
+#define POLICY_LSTM_INPUTS (POLICY_ENCODER_SIZE + POLICY_HIDDEN_SIZE)
+#define POLICY_LSTM_GATES (4 * POLICY_HIDDEN_SIZE)
+// the hidden and cell state of the LSTM
+#define POLICY_STATE_SIZE (2 * POLICY_HIDDEN_SIZE)
+#define POLICY_DISCRETE_OUTPUTS 32
+// continuous actions are padded so every layer's output is a multiple
+// of 8 floats
+#define POLICY_CONTINUOUS_OUTPUTS 8
+// max amount of drones inferred at once, bounds the scratch buffers
+#define POLICY_MAX_BATCH 16
+
+// sizes of the move, aim, shoot, brake and burst action heads
+const uint8_t POLICY_DISCRETE_ACTION_HEADS[] = {9, 17, 2, 2, 2};
+
+#ifndef AUTOPXD
+typedef struct policyFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t numDrones;
+    uint32_t discreteActions;
+    uint32_t mapInputChannels;
+    uint32_t multihotSize;
+    uint32_t continuousSize;
+    uint32_t numWeaponSlots;
+    uint32_t weaponTypes;
+    uint32_t numActionOutputs;
+    // the obs profile the policy was trained with
+    uint32_t mapObsRows;
+    uint32_t mapObsColumns;
+    uint32_t numNearWallObs;
+    uint32_t numFloatingWallObs;
+    uint32_t numProjectileObs;
+    uint32_t numWeaponPickupObs;
+    uint32_t numLidarRays;
+} policyFileHeader;
+
+// all weight matrices are stored input major: the weights of each
+// input are contiguous so a layer is a sum of input scaled rows
+struct frozenPolicy {
+    uint8_t numDrones;
+    bool discreteActions;
+    obsProfile obsProfile;
+    uint16_t obsBytes;
+    uint16_t discreteObsBytes;
+    // height and width of the first conv layer's output, the second
+    // conv layer's kernel covers all of it
+    uint8_t conv1OutRows;
+    uint8_t conv1OutColumns;
+    uint16_t conv2Inputs;
+    uint8_t mapInputChannels;
+    uint16_t multihotSize;
+    uint16_t continuousSize;
+    uint8_t numWeaponSlots;
+    uint8_t weaponTypes;
+    uint8_t numActionOutputs;
+    // multihot offsets of each discrete obs that isn't a weapon type
+    uint16_t multihotOffsets[_MAX_NEAR_WALL_OBS + _MAX_FLOATING_WALL_OBS + _MAX_PROJECTILE_OBS];
+
+    float *weights;
+    // [mapInputChannels][kernel][kernel][channels]
+    const float *conv1Weights;
+    const float *conv1Bias;
+    // [kernel][kernel][channels][channels], inputs are in the order
+    // conv1 outputs are stored in
+    const float *conv2Weights;
+    const float *conv2Bias;
+    // [channels + continuousSize][encoderSize], the CNN output followed
+    // by the continuous obs
+    const float *encoderWeights;
+    // [multihotSize][encoderSize]
+    const float *multihotWeights;
+    // [numWeaponSlots][weaponTypes][encoderSize], weapon type embeddings
+    // already multiplied by the encoder weights
+    const float *weaponWeights;
+    const float *encoderBias;
+    // [encoderSize + hiddenSize][gates], gates are ordered input, forget,
+    // cell, output like torch
+    const float *lstmWeights;
+    // input and hidden biases summed
+    const float *lstmBias;
+    // [hiddenSize][numActionOutputs]
+    const float *actorWeights;
+    const float *actorBias;
+
+    // scratch buffers, policies are shared by every env in a process
+    // which are stepped on a single thread
+    uint8_t *obs;
+    float *conv1Out;
+    float *encoderIn;
+    float *lstmIn;
+    float *gates;
+    float *actorOut;
+};
+#endif
+
+frozenPolicy *loadFrozenPolicy(const char *path, const obsProfile *profile);
+void destroyFrozenPolicy(frozenPolicy *p);
+
+#ifndef AUTOPXD
+// out[0:n] += w[0:n], n must be a multiple of 8
+static inline void addRow(float *restrict out, const float *restrict w, const uint16_t n) {
+#ifdef USE_AVX2
+    for (uint16_t i = 0; i < n; i += 8) {
+        _mm256_storeu_ps(out + i, _mm256_add_ps(_mm256_loadu_ps(w + i), _mm256_loadu_ps(out + i)));
+    }
+#else
+    for (uint16_t i = 0; i < n; i++) {
+        out[i] += w[i];
+    }
+#endif
+}
+
+static inline void relu(float *v, const uint16_t n) {
+    for (uint16_t i = 0; i < n; i++) {
+        v[i] = fmaxf(v[i], 0.0f);
+    }
+}
+
+static inline float sigmoid(const float x) {
+    return 1.0f / (1.0f + expf(-x));
+}
+
+// out = in * weights + bias for a batch of inputs; 4 inputs are
+// processed at a time so each weight row is loaded once for all of
+// them. outSize must be a multiple of 8
+static void denseLayer(const float *in, const uint16_t inStride, const uint8_t batchSize, const float *weights, const float *bias, const uint16_t inSize, const uint16_t outSize, float *out, const uint16_t outStride) {
+    for (uint8_t b = 0; b < batchSize; b += 4) {
+        // repeat the last input if there are less than 4 left
+        const float *rows[4];
+        for (uint8_t k = 0; k < 4; k++) {
+            rows[k] = in + (min(b + k, batchSize - 1) * inStride);
+        }
+        const uint8_t numRows = min(4, batchSize - b);
+
+        for (uint16_t j = 0; j < outSize; j += 8) {
+#ifdef USE_AVX2
+            __m256 acc0 = _mm256_loadu_ps(bias + j);
+            __m256 acc1 = acc0;
+            __m256 acc2 = acc0;
+            __m256 acc3 = acc0;
+            for (uint16_t i = 0; i < inSize; i++) {
+                const __m256 w = _mm256_loadu_ps(weights + (i * outSize) + j);
+                acc0 = _mm256_fmadd_ps(_mm256_set1_ps(rows[0][i]), w, acc0);
+                acc1 = _mm256_fmadd_ps(_mm256_set1_ps(rows[1][i]), w, acc1);
+                acc2 = _mm256_fmadd_ps(_mm256_set1_ps(rows[2][i]), w, acc2);
+                acc3 = _mm256_fmadd_ps(_mm256_set1_ps(rows[3][i]), w, acc3);
+            }
+            const __m256 acc[4] = {acc0, acc1, acc2, acc3};
+            for (uint8_t k = 0; k < numRows; k++) {
+                _mm256_storeu_ps(out + ((b + k) * outStride) + j, acc[k]);
+            }
+#else
+            for (uint8_t k = 0; k < numRows; k++) {
+                float acc[8];
+                memcpy(acc, bias + j, sizeof(acc));
+                for (uint16_t i = 0; i < inSize; i++) {
+                    const float *w = weights + (i * outSize) + j;
+                    for (uint8_t l = 0; l < 8; l++) {
+                        acc[l] += rows[k][i] * w[l];
+                    }
+                }
+                memcpy(out + ((b + k) * outStride) + j, acc, sizeof(acc));
+            }
+#endif
+        }
+    }
+}
+
+static bool readPolicyWeights(FILE *f, float **dst, const float **weights, const size_t count) {
+    *weights = *dst;
+    const bool ok = fread(*dst, sizeof(float), count, f) == count;
+    *dst += count;
+    return ok;
+}
+
+#define CHECK_POLICY_HEADER(field, expected)                                                                                   \
+    if (header.field != (uint32_t)(expected)) {                                                                                \
+        ERRORF("policy file %s has %s %u, expected %u; was it exported for this env?", path, #field, header.field, (uint32_t)(expected)); \
+    }
+#endif
+
+frozenPolicy *loadFrozenPolicy(const char *path, const obsProfile *profile) {
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        ERRORF("failed to open policy file %s", path);
+    }
+
+    policyFileHeader header;
+    if (fread(&header, sizeof(header), 1, f) != 1) {
+        ERRORF("failed to read header of policy file %s", path);
+    }
+    if (header.magic != POLICY_FILE_MAGIC) {
+        ERRORF("%s is not a policy file", path);
+    }
+
+    const uint8_t wallTypes = NUM_WALL_TYPES;
+    const uint8_t numDrones = profile->numDrones;
+    CHECK_POLICY_HEADER(version, POLICY_FILE_VERSION);
+    CHECK_POLICY_HEADER(numDrones, numDrones);
+    CHECK_POLICY_HEADER(mapObsRows, profile->mapObsRows);
+    CHECK_POLICY_HEADER(mapObsColumns, profile->mapObsColumns);
+    CHECK_POLICY_HEADER(numNearWallObs, profile->numNearWallObs);
+    CHECK_POLICY_HEADER(numFloatingWallObs, profile->numFloatingWallObs);
+    CHECK_POLICY_HEADER(numProjectileObs, profile->numProjectileObs);
+    CHECK_POLICY_HEADER(numWeaponPickupObs, profile->numWeaponPickupObs);
+    CHECK_POLICY_HEADER(numLidarRays, profile->numLidarRays);
+    CHECK_POLICY_HEADER(mapInputChannels, mapObsChannels(profile));
+    CHECK_POLICY_HEADER(multihotSize, multihotObsSize(profile));
+    CHECK_POLICY_HEADER(continuousSize, profile->continuousObsSize);
+    CHECK_POLICY_HEADER(numWeaponSlots, weaponTypeObsSize(profile));
+    CHECK_POLICY_HEADER(weaponTypes, NUM_WEAPONS + 1);
+    CHECK_POLICY_HEADER(numActionOutputs, header.discreteActions ? POLICY_DISCRETE_OUTPUTS : POLICY_CONTINUOUS_OUTPUTS);
+
+    frozenPolicy *p = fastCalloc(1, sizeof(frozenPolicy));
+    p->numDrones = numDrones;
+    p->discreteActions = header.discreteActions;
+    p->obsProfile = *profile;
+    p->obsBytes = obsBytes(profile);
+    p->discreteObsBytes = profile->discreteObsBytes;
+    p->conv1OutRows = ((profile->mapObsRows - POLICY_CONV1_KERNEL) / POLICY_CONV1_STRIDE) + 1;
+    p->conv1OutColumns = ((profile->mapObsColumns - POLICY_CONV1_KERNEL) / POLICY_CONV1_STRIDE) + 1;
+    p->conv2Inputs = p->conv1OutRows * p->conv1OutColumns * POLICY_CNN_CHANNELS;
+    p->mapInputChannels = header.mapInputChannels;
+    p->multihotSize = header.multihotSize;
+    p->continuousSize = header.continuousSize;
+    p->numWeaponSlots = header.numWeaponSlots;
+    p->weaponTypes = header.weaponTypes;
+    p->numActionOutputs = header.numActionOutputs;
+
+    uint16_t multihotOffset = 0;
+    uint8_t slot = 0;
+    for (uint8_t i = 0; i < profile->numNearWallObs; i++) {
+        p->multihotOffsets[slot++] = multihotOffset;
+        multihotOffset += wallTypes;
+    }
+    for (uint8_t i = 0; i < profile->numFloatingWallObs; i++) {
+        p->multihotOffsets[slot++] = multihotOffset;
+        multihotOffset += wallTypes + 1;
+    }
+    for (uint8_t i = 0; i < profile->numProjectileObs; i++) {
+        p->multihotOffsets[slot++] = multihotOffset;
+        multihotOffset += numDrones + 1;
+    }
+    ASSERTF(multihotOffset == p->multihotSize, "multihot size %u", multihotOffset);
+
+    const size_t conv1Size = p->mapInputChannels * POLICY_CONV1_KERNEL * POLICY_CONV1_KERNEL * POLICY_CNN_CHANNELS;
+    const size_t conv2Size = p->conv2Inputs * POLICY_CNN_CHANNELS;
+    const size_t encoderSize = (POLICY_CNN_CHANNELS + p->continuousSize) * POLICY_ENCODER_SIZE;
+    const size_t multihotSize = p->multihotSize * POLICY_ENCODER_SIZE;
+    const size_t weaponSize = p->numWeaponSlots * p->weaponTypes * POLICY_ENCODER_SIZE;
+    const size_t lstmSize = POLICY_LSTM_INPUTS * POLICY_LSTM_GATES;
+    const size_t actorSize = POLICY_HIDDEN_SIZE * p->numActionOutputs;
+    const size_t numWeights = conv1Size + POLICY_CNN_CHANNELS + conv2Size + POLICY_CNN_CHANNELS + encoderSize + multihotSize + weaponSize + POLICY_ENCODER_SIZE + lstmSize + POLICY_LSTM_GATES + actorSize + p->numActionOutputs;
+    p->weights = fastMalloc(numWeights * sizeof(float));
+
+    float *dst = p->weights;
+    bool ok = readPolicyWeights(f, &dst, &p->conv1Weights, conv1Size);
+    ok = ok && readPolicyWeights(f, &dst, &p->conv1Bias, POLICY_CNN_CHANNELS);
+    ok = ok && readPolicyWeights(f, &dst, &p->conv2Weights, conv2Size);
+    ok = ok && readPolicyWeights(f, &dst, &p->conv2Bias, POLICY_CNN_CHANNELS);
+    ok = ok && readPolicyWeights(f, &dst, &p->encoderWeights, encoderSize);
+    ok = ok && readPolicyWeights(f, &dst, &p->multihotWeights, multihotSize);
+    ok = ok && readPolicyWeights(f, &dst, &p->weaponWeights, weaponSize);
+    ok = ok && readPolicyWeights(f, &dst, &p->encoderBias, POLICY_ENCODER_SIZE);
+    ok = ok && readPolicyWeights(f, &dst, &p->lstmWeights, lstmSize);
+    ok = ok && readPolicyWeights(f, &dst, &p->lstmBias, POLICY_LSTM_GATES);
+    ok = ok && readPolicyWeights(f, &dst, &p->actorWeights, actorSize);
+    ok = ok && readPolicyWeights(f, &dst, &p->actorBias, p->numActionOutputs);
+    if (!ok || fgetc(f) != EOF) {
+        ERRORF("policy file %s is truncated or has trailing data", path);
+    }
+    fclose(f);
+
+    p->obs = fastMalloc(POLICY_MAX_BATCH * p->obsBytes);
+    p->conv1Out = fastMalloc(POLICY_MAX_BATCH * p->conv2Inputs * sizeof(float));
+    p->encoderIn = fastMalloc(POLICY_MAX_BATCH * (POLICY_CNN_CHANNELS + p->continuousSize) * sizeof(float));
+    p->lstmIn = fastMalloc(POLICY_MAX_BATCH * POLICY_LSTM_INPUTS * sizeof(float));
+    p->gates = fastMalloc(POLICY_MAX_BATCH * POLICY_LSTM_GATES * sizeof(float));
+    p->actorOut = fastMalloc(POLICY_MAX_BATCH * p->numActionOutputs * sizeof(float));
+
+    return p;
+}
+
+void destroyFrozenPolicy(frozenPolicy *p) {
+    fastFree(p->weights);
+    fastFree(p->obs);
+    fastFree(p->conv1Out);
+    fastFree(p->encoderIn);
+    fastFree(p->lstmIn);
+    fastFree(p->gates);
+    fastFree(p->actorOut);
+    fastFree(p);
+}
+
+#ifndef AUTOPXD
+// the first conv layer's input is a few one hot channels per map cell,
+// so only the weights of the channels that are set are summed
+static void policyConv1(const frozenPolicy *p, const uint8_t *mapObs, float *out) {
+    const uint8_t wallTypes = NUM_WALL_TYPES;
+    const uint8_t mapObsColumns = p->obsProfile.mapObsColumns;
+    for (uint8_t oy = 0; oy < p->conv1OutRows; oy++) {
+        for (uint8_t ox = 0; ox < p->conv1OutColumns; ox++) {
+            float *pixel = out + (((oy * p->conv1OutColumns) + ox) * POLICY_CNN_CHANNELS);
+            memcpy(pixel, p->conv1Bias, POLICY_CNN_CHANNELS * sizeof(float));
+
+            for (uint8_t ky = 0; ky < POLICY_CONV1_KERNEL; ky++) {
+                for (uint8_t kx = 0; kx < POLICY_CONV1_KERNEL; kx++) {
+                    const uint8_t row = (oy * POLICY_CONV1_STRIDE) + ky;
+                    const uint8_t col = (ox * POLICY_CONV1_STRIDE) + kx;
+                    const uint8_t cell = mapObs[(row * mapObsColumns) + col];
+
+                    // each cell has 2 bits for wall type, 1 bit for is
+                    // floating wall, 1 bit for is weapon pickup and 3
+                    // bits for drone index
+                    uint8_t channels[4];
+                    uint8_t numChannels = 0;
+                    channels[numChannels++] = (cell >> 5) & 0x3;
+                    if ((cell & (1 << 4)) != 0) {
+                        channels[numChannels++] = wallTypes + 1;
+                    }
+                    if ((cell & (1 << 3)) != 0) {
+                        channels[numChannels++] = wallTypes + 2;
+                    }
+                    channels[numChannels++] = wallTypes + 3 + (cell & 0x7);
+
+                    const uint16_t kernelIdx = (ky * POLICY_CONV1_KERNEL) + kx;
+                    for (uint8_t i = 0; i < numChannels; i++) {
+                        const uint16_t weightIdx = (channels[i] * POLICY_CONV1_KERNEL * POLICY_CONV1_KERNEL) + kernelIdx;
+                        addRow(pixel, p->conv1Weights + (weightIdx * POLICY_CNN_CHANNELS), POLICY_CNN_CHANNELS);
+                    }
+                }
+            }
+        }
+    }
+    relu(out, p->conv2Inputs);
+}
+
+// runs the policy on a batch of obs in p->obs, updating the recurrent
+// state of each drone and leaving the action outputs in p->actorOut
+void policyForward(frozenPolicy *p, const uint8_t batchSize, float **states) {
+    ASSERT(batchSize <= POLICY_MAX_BATCH);
+    const uint16_t encoderInSize = POLICY_CNN_CHANNELS + p->continuousSize;
+
+    for (uint8_t b = 0; b < batchSize; b++) {
+        const uint8_t *obs = p->obs + (b * p->obsBytes);
+        policyConv1(p, obs, p->conv1Out + (b * p->conv2Inputs));
+
+        // the CNN output is followed by the continuous obs so both can
+        // be fed through the encoder at once
+        float *encoderIn = p->encoderIn + (b * encoderInSize);
+        memcpy(encoderIn + POLICY_CNN_CHANNELS, obs + p->discreteObsBytes, p->continuousSize * sizeof(float));
+
+        // the hidden state is fed through the LSTM with the encoder output
+        memcpy(p->lstmIn + (b * POLICY_LSTM_INPUTS) + POLICY_ENCODER_SIZE, states[b], POLICY_HIDDEN_SIZE * sizeof(float));
+    }
+
+    // the second conv layer's kernel covers the entire output of the
+    // first one, so it's a dense layer
+    denseLayer(p->conv1Out, p->conv2Inputs, batchSize, p->conv2Weights, p->conv2Bias, p->conv2Inputs, POLICY_CNN_CHANNELS, p->encoderIn, encoderInSize);
+    for (uint8_t b = 0; b < batchSize; b++) {
+        relu(p->encoderIn + (b * encoderInSize), POLICY_CNN_CHANNELS);
+    }
+
+    denseLayer(p->encoderIn, encoderInSize, batchSize, p->encoderWeights, p->encoderBias, encoderInSize, POLICY_ENCODER_SIZE, p->lstmIn, POLICY_LSTM_INPUTS);
+    for (uint8_t b = 0; b < batchSize; b++) {
+        const uint8_t *obs = p->obs + (b * p->obsBytes);
+        float *encoded = p->lstmIn + (b * POLICY_LSTM_INPUTS);
+
+        // discrete obs are one hot encoded, so add the weights of the
+        // set inputs
+        const uint8_t numMultihotObs = p->obsProfile.projectileWeaponsObsOffset - p->obsProfile.nearWallTypesObsOffset;
+        for (uint8_t i = 0; i < numMultihotObs; i++) {
+            const uint16_t input = p->multihotOffsets[i] + obs[p->obsProfile.nearWallTypesObsOffset + i];
+            addRow(encoded, p->multihotWeights + (input * POLICY_ENCODER_SIZE), POLICY_ENCODER_SIZE);
+        }
+        for (uint8_t i = 0; i < p->numWeaponSlots; i++) {
+            const uint16_t input = (i * p->weaponTypes) + obs[p->obsProfile.projectileWeaponsObsOffset + i];
+            addRow(encoded, p->weaponWeights + (input * POLICY_ENCODER_SIZE), POLICY_ENCODER_SIZE);
+        }
+        relu(encoded, POLICY_ENCODER_SIZE);
+    }
+
+    denseLayer(p->lstmIn, POLICY_LSTM_INPUTS, batchSize, p->lstmWeights, p->lstmBias, POLICY_LSTM_INPUTS, POLICY_LSTM_GATES, p->gates, POLICY_LSTM_GATES);
+    for (uint8_t b = 0; b < batchSize; b++) {
+        const float *gates = p->gates + (b * POLICY_LSTM_GATES);
+        float *hidden = states[b];
+        float *cell = states[b] + POLICY_HIDDEN_SIZE;
+        for (uint16_t i = 0; i < POLICY_HIDDEN_SIZE; i++) {
+            const float inputGate = sigmoid(gates[i]);
+            const float forgetGate = sigmoid(gates[POLICY_HIDDEN_SIZE + i]);
+            const float cellGate = tanhf(gates[(2 * POLICY_HIDDEN_SIZE) + i]);
+            const float outputGate = sigmoid(gates[(3 * POLICY_HIDDEN_SIZE) + i]);
+            cell[i] = (forgetGate * cell[i]) + (inputGate * cellGate);
+            hidden[i] = outputGate * tanhf(cell[i]);
+        }
+    }
+
+    // the hidden states are scattered, so gather them for the actor
+    for (uint8_t b = 0; b < batchSize; b++) {
+        memcpy(p->lstmIn + (b * POLICY_LSTM_INPUTS), states[b], POLICY_HIDDEN_SIZE * sizeof(float));
+    }
+    denseLayer(p->lstmIn, POLICY_LSTM_INPUTS, batchSize, p->actorWeights, p->actorBias, POLICY_HIDDEN_SIZE, p->numActionOutputs, p->actorOut, p->numActionOutputs);
+}
+#endif
+
+#endif
@@ -279,8 +279,8 @@ void updateCamera(env *e) {
     // smoothly move towards the center of players
     const Vector2 centerPoint = {.x = droneBounds.x, .y = droneBounds.y};
     camera->targetPos = Vector2Lerp(camera->targetPos, centerPoint, PAN_SPEED);
-    camera->targetPos.x = Clamp(camera->targetPos.x, e->map->bounds.min.x + MAP_MAX_X_OFFSET, e->map->bounds.max.x - MAP_MAX_X_OFFSET);
-    camera->targetPos.y = Clamp(camera->targetPos.y, e->map->bounds.min.y + MAP_MAX_Y_OFFSET, e->map->bounds.max.y - MAP_MAX_Y_OFFSET);
+    camera->targetPos.x = Clamp(camera->targetPos.x, e->mapData->bounds.min.x + MAP_MAX_X_OFFSET, e->mapData->bounds.max.x - MAP_MAX_X_OFFSET);
+    camera->targetPos.y = Clamp(camera->targetPos.y, e->mapData->bounds.min.y + MAP_MAX_Y_OFFSET, e->mapData->bounds.max.y - MAP_MAX_Y_OFFSET);
 
     camera->camera3D.target.x = camera->targetPos.x;
     camera->camera3D.target.z = camera->targetPos.y;
@@ -308,7 +308,8 @@ Color getDroneColor(const uint8_t droneIdx) {
     case 3:
         return PUFF_YELLOW;
     default:
-        ERRORF("unsupported number of drones %d", droneIdx + 1);
+        // spread the hues of any additional drones around the color wheel
+        return ColorFromHSV(fmodf(droneIdx * 137.5f, 360.0f), 0.8f, 0.9f);
     }
 }
 
@@ -1112,18 +1113,22 @@ b2RayResult droneAimingAt(const env *e, const droneEntity *drone) {
     const b2Vec2 rayEnd = b2MulAdd(drone->pos, 150.0f, drone->lastAim);
     const b2Vec2 translation = b2Sub(rayEnd, drone->pos);
     const b2QueryFilter filter = {.categoryBits = PROJECTILE_SHAPE, .maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | DRONE_SHAPE};
-    return b2World_CastRayClosest(e->worldID, drone->pos, translation, filter);
+    return b2World_CastRayClosest(e->worldID, arenaToWorldPos(e, drone->pos), translation, filter);
 }
 
 void renderDroneAimGuide(const env *e, const droneEntity *drone) {
-    // find length of laser aiming guide by where it touches the nearest shape
-    const b2RayResult rayRes = droneAimingAt(e, drone);
-    ASSERT(b2Shape_IsValid(rayRes.shapeId));
-    const entity *ent = b2Shape_GetUserData(rayRes.shapeId);
-
-    const b2DistanceOutput output = closestPoint(drone->ent, ent);
     float aimGuideWidth = getWeaponAimGuideWidth(drone->weaponInfo->type);
-    aimGuideWidth = min(aimGuideWidth, output.distance + 0.1f) + (DRONE_RADIUS * 2.0f);
+    // find length of laser aiming guide by where it touches the nearest
+    // shape, replayed envs don't have a world so the guide isn't cut short
+    if (b2World_IsValid(e->worldID)) {
+        const b2RayResult rayRes = droneAimingAt(e, drone);
+        ASSERT(b2Shape_IsValid(rayRes.shapeId));
+        const entity *ent = b2Shape_GetUserData(rayRes.shapeId);
+
+        const b2DistanceOutput output = closestPoint(drone->ent, ent);
+        aimGuideWidth = min(aimGuideWidth, output.distance + 0.1f);
+    }
+    aimGuideWidth += DRONE_RADIUS * 2.0f;
 
     // render laser aim guide
     const b2Vec2 pos = b2MulAdd(drone->pos, aimGuideWidth / 2.0f, drone->lastAim);
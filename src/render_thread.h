@@ -0,0 +1,190 @@
+#ifndef IMPULSE_WARS_RENDER_THREAD_H
+#define IMPULSE_WARS_RENDER_THREAD_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "frame_view.h"
+#include "render.h"
+#include "trace.h"
+#include "types.h"
+
+// renders an env on its own thread so stepping the env never waits on
+// raylib. After every frame the env encodes its state the same way
+// traces do into one of three buffers and publishes it; the render
+// thread takes whichever buffer was published last, so neither side
+// ever blocks on the other and frames published faster than they're
+// rendered are skipped.
+
+// set in the published buffer index if the render thread hasn't taken
+// the buffer yet
+#define RENDER_FRAME_READY 0x4
+#define RENDER_FRAME_IDX_MASK 0x3
+
+typedef struct renderFrameBuffer {
+    uint8_t *data;
+    uint32_t capacity;
+} renderFrameBuffer;
+
+typedef struct renderThread {
+    pthread_t thread;
+    frameView *view;
+
+    // each buffer is owned by exactly one of the env, the render thread
+    // or the published slot at a time; ownership of the published one
+    // is swapped by exchanging latest
+    renderFrameBuffer buffers[3];
+    atomic_uint latest;
+    // only accessed by the env's thread
+    uint8_t back;
+    uint32_t episode;
+    bool realtime;
+    struct timespec nextFrameTime;
+    // only accessed by the render thread
+    uint8_t front;
+
+    atomic_bool stop;
+    atomic_bool windowClosed;
+} renderThread;
+
+// returns the frame published last if it hasn't been taken yet, or NULL;
+// the frame stays valid until the next frame is taken
+static const traceFrame *takeRenderFrame(renderThread *rt) {
+    if (!(atomic_load_explicit(&rt->latest, memory_order_acquire) & RENDER_FRAME_READY)) {
+        return NULL;
+    }
+    const uint32_t published = atomic_exchange_explicit(&rt->latest, rt->front, memory_order_acq_rel);
+    rt->front = published & RENDER_FRAME_IDX_MASK;
+    return (const traceFrame *)rt->buffers[rt->front].data;
+}
+
+static void *renderThreadLoop(void *arg) {
+    renderThread *rt = arg;
+    // the window and its GL context belong to the thread that creates
+    // them, so everything raylib does happens here
+    rayClient *client = createRayClient();
+    rt->view->e->client = client;
+
+    bool hasFrame = false;
+    while (!atomic_load(&rt->stop)) {
+        if (WindowShouldClose()) {
+            atomic_store(&rt->windowClosed, true);
+            break;
+        }
+
+        const traceFrame *frame = takeRenderFrame(rt);
+        if (frame != NULL) {
+            advanceFrameView(rt->view, frame);
+            hasFrame = true;
+        }
+        if (!hasFrame) {
+            // keep the window responsive until the env steps
+            BeginDrawing();
+            ClearBackground(PUFF_BACKGROUND);
+            EndDrawing();
+            continue;
+        }
+        renderFrameView(rt->view);
+    }
+
+    rt->view->e->client = NULL;
+    destroyRayClient(client);
+    return NULL;
+}
+
+// starts consuming the env's frames on a new thread with consume, which
+// is passed the render thread, takes frames with takeRenderFrame and
+// must return once stop is set; must be paired with a call to
+// stopRenderThread. Only used directly to consume frames without
+// rendering them.
+renderThread *startFrameConsumer(env *e, const bool realtime, void *(*consume)(void *)) {
+    renderThread *rt = fastCalloc(1, sizeof(renderThread));
+    rt->view = createFrameView(e->numDrones, e->numAgents, e->frameRate, e->teamsEnabled, NULL);
+    atomic_init(&rt->latest, 1);
+    rt->back = 0;
+    rt->front = 2;
+    rt->realtime = realtime;
+    atomic_init(&rt->stop, false);
+    atomic_init(&rt->windowClosed, false);
+
+    enableFrameEvents(e);
+    e->renderThread = rt;
+
+    // the render thread allocates its window and textures
+    enableAllocLocking();
+    if (pthread_create(&rt->thread, NULL, consume, rt) != 0) {
+        ERROR("failed to create render thread");
+    }
+    return rt;
+}
+
+// starts rendering the env on a new thread, must be paired with a call
+// to stopRenderThread. If realtime is set stepping the env is slowed to
+// its frame rate so it can be watched.
+renderThread *startRenderThread(env *e, const bool realtime) {
+    return startFrameConsumer(e, realtime, renderThreadLoop);
+}
+
+void stopRenderThread(renderThread *rt, env *e) {
+    e->renderThread = NULL;
+    atomic_store(&rt->stop, true);
+    pthread_join(rt->thread, NULL);
+    disableAllocLocking();
+
+    destroyFrameView(rt->view);
+    for (uint8_t i = 0; i < 3; i++) {
+        fastFree(rt->buffers[i].data);
+    }
+    fastFree(rt);
+}
+
+// returns true if the render thread stopped because its window was closed
+bool renderThreadWindowClosed(renderThread *rt) {
+    return atomic_load(&rt->windowClosed);
+}
+
+// sleeps until the next frame is due so the env steps in real time,
+// if stepping fell more than a frame behind it doesn't try to catch up
+static void waitForNextRenderFrame(renderThread *rt, const uint8_t frameRate) {
+    const long frameNanos = 1000000000L / frameRate;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    struct timespec *next = &rt->nextFrameTime;
+    next->tv_nsec += frameNanos;
+    if (next->tv_nsec >= 1000000000L) {
+        next->tv_nsec -= 1000000000L;
+        next->tv_sec++;
+    }
+    const int64_t behind = ((int64_t)(now.tv_sec - next->tv_sec) * 1000000000L) + (now.tv_nsec - next->tv_nsec);
+    if (behind > frameNanos) {
+        *next = now;
+        return;
+    }
+    clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, next, NULL);
+}
+
+// publishes the state of the env after a frame was stepped
+void publishRenderFrame(renderThread *rt, const env *e) {
+    const uint64_t size = traceFrameSize(e);
+    renderFrameBuffer *buf = &rt->buffers[rt->back];
+    if (size > buf->capacity) {
+        fastFree(buf->data);
+        buf->capacity = size;
+        buf->data = fastCalloc(buf->capacity, sizeof(uint8_t));
+    }
+    encodeTraceFrame(e, rt->episode, buf->data, size);
+    if (e->needsReset) {
+        rt->episode++;
+    }
+
+    const uint32_t prev = atomic_exchange_explicit(&rt->latest, rt->back | RENDER_FRAME_READY, memory_order_acq_rel);
+    rt->back = prev & RENDER_FRAME_IDX_MASK;
+
+    if (rt->realtime) {
+        waitForNextRenderFrame(rt, e->frameRate);
+    }
+}
+
+#endif
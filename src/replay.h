@@ -0,0 +1,159 @@
+#ifndef IMPULSE_WARS_REPLAY_H
+#define IMPULSE_WARS_REPLAY_H
+
+#include "env.h"
+#include "frame_view.h"
+#include "render.h"
+#include "trace.h"
+
+// plays back a trace file with the same rendering as a live env without
+// creating a box2d world or stepping physics.
+//
+// Controls:
+//   space         pause or unpause
+//   up/down       double or halve the playback speed
+//   right/left    seek forward or back a second, or a frame when paused
+//   page up/down  jump to the start of the previous or next episode
+//   home/end      jump to the first or last frame
+
+#define REPLAY_MAX_SPEED 512
+
+typedef struct traceReplay {
+    traceReader *reader;
+    // every frame in the trace in order so seeking is constant time
+    const traceFrame **frames;
+    uint32_t numFrames;
+    uint32_t frameIdx;
+
+    uint16_t speed;
+    bool paused;
+    // fractional frames to advance carried between rendered frames
+    float framesToAdvance;
+
+    frameView *view;
+} traceReplay;
+
+// moves to a frame without playing the frames in between
+static void seekTraceReplay(traceReplay *r, const uint32_t frameIdx) {
+    r->frameIdx = frameIdx;
+    r->framesToAdvance = 0.0f;
+    setFrameView(r->view, r->frames[frameIdx]);
+}
+
+// returns the index of the first frame of the episode the frame is in
+static uint32_t episodeStartFrame(const traceReplay *r, uint32_t frameIdx) {
+    const uint32_t episode = r->frames[frameIdx]->episode;
+    while (frameIdx != 0 && r->frames[frameIdx - 1]->episode == episode) {
+        frameIdx--;
+    }
+    return frameIdx;
+}
+
+static void handleReplayInput(traceReplay *r) {
+    const uint32_t lastFrame = r->numFrames - 1;
+    if (IsKeyPressed(KEY_SPACE)) {
+        r->paused = !r->paused;
+    }
+    if (IsKeyPressed(KEY_UP)) {
+        r->speed = min(r->speed * 2, REPLAY_MAX_SPEED);
+    }
+    if (IsKeyPressed(KEY_DOWN)) {
+        r->speed = max(r->speed / 2, 1);
+    }
+
+    const uint32_t seekFrames = r->paused ? 1 : r->view->e->frameRate;
+    if (IsKeyPressed(KEY_RIGHT) || IsKeyPressedRepeat(KEY_RIGHT)) {
+        seekTraceReplay(r, min(r->frameIdx + seekFrames, lastFrame));
+    }
+    if (IsKeyPressed(KEY_LEFT) || IsKeyPressedRepeat(KEY_LEFT)) {
+        seekTraceReplay(r, r->frameIdx > seekFrames ? r->frameIdx - seekFrames : 0);
+    }
+    if (IsKeyPressed(KEY_PAGE_DOWN)) {
+        uint32_t frameIdx = r->frameIdx;
+        const uint32_t episode = r->frames[frameIdx]->episode;
+        while (frameIdx != lastFrame && r->frames[frameIdx]->episode == episode) {
+            frameIdx++;
+        }
+        seekTraceReplay(r, frameIdx);
+    }
+    if (IsKeyPressed(KEY_PAGE_UP)) {
+        uint32_t frameIdx = episodeStartFrame(r, r->frameIdx);
+        if (frameIdx == r->frameIdx && frameIdx != 0) {
+            frameIdx = episodeStartFrame(r, frameIdx - 1);
+        }
+        seekTraceReplay(r, frameIdx);
+    }
+    if (IsKeyPressed(KEY_HOME)) {
+        seekTraceReplay(r, 0);
+    }
+    if (IsKeyPressed(KEY_END)) {
+        seekTraceReplay(r, lastFrame);
+    }
+}
+
+// opens a trace and sets up an env to render it with the client, must
+// be paired with a call to destroyTraceReplay
+traceReplay *createTraceReplay(const char *path, rayClient *client) {
+    traceReplay *r = fastCalloc(1, sizeof(traceReplay));
+    r->reader = openTraceReader(path);
+    while (nextTraceFrame(r->reader) != NULL) {
+        r->numFrames++;
+    }
+    if (r->numFrames == 0) {
+        ERRORF("trace file %s has no frames", path);
+    }
+    r->frames = fastCalloc(r->numFrames, sizeof(traceFrame *));
+    rewindTraceReader(r->reader);
+    for (uint32_t i = 0; i < r->numFrames; i++) {
+        r->frames[i] = nextTraceFrame(r->reader);
+    }
+    r->speed = 1;
+
+    const traceFileHeader *header = r->reader->header;
+    if (header->frameRate == 0) {
+        ERRORF("trace file %s was never given to an env", path);
+    }
+    r->view = createFrameView(header->numDrones, header->numAgents, header->frameRate, header->teamsEnabled, client);
+
+    seekTraceReplay(r, 0);
+    return r;
+}
+
+void destroyTraceReplay(traceReplay *r) {
+    destroyFrameView(r->view);
+    fastFree(r->frames);
+    closeTraceReader(r->reader);
+    fastFree(r);
+}
+
+// advances the replay by however many frames the playback speed covers
+// in the time since the last call and renders the latest one
+void stepTraceReplay(traceReplay *r) {
+    handleReplayInput(r);
+
+    if (!r->paused) {
+        r->framesToAdvance += GetFrameTime() * r->view->e->frameRate * r->speed;
+        while (r->framesToAdvance >= 1.0f && r->frameIdx != r->numFrames - 1) {
+            r->framesToAdvance -= 1.0f;
+            r->frameIdx++;
+            advanceFrameView(r->view, r->frames[r->frameIdx]);
+        }
+        if (r->frameIdx == r->numFrames - 1) {
+            r->framesToAdvance = 0.0f;
+        }
+    }
+
+    const traceFrame *frame = r->frames[r->frameIdx];
+    SetWindowTitle(TextFormat(
+        "Impulse Wars replay | episode %u frame %u | %u/%u | %ux%s",
+        frame->episode,
+        frame->frame,
+        r->frameIdx + 1,
+        r->numFrames,
+        r->speed,
+        r->paused ? " paused" : ""
+    ));
+    renderFrameView(r->view);
+}
+
+#endif
@@ -0,0 +1,268 @@
+#ifndef IMPULSE_WARS_RESET_POOL_H
+#define IMPULSE_WARS_RESET_POOL_H
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <string.h>
+
+#include "helpers.h"
+#include "snapshot.h"
+#include "types.h"
+
+// a background thread that sets up the initial states of envs' next
+// episodes ahead of time so the step that crosses an episode boundary
+// only has to restore a ready made state instead of picking a map and
+// placing drones, floating walls and pickups. States are generated in
+// a scratch env with the same config as the pooled envs; if an env
+// runs out of states it falls back to resetting itself.
+//
+// Each env's states are generated from their own random stream seeded
+// by the env, and the scratch env's map is rebuilt for every state so
+// a state doesn't depend on which env's state was generated before it.
+// States are always generated on the map the env was set up with so
+// restoring one never has to rebuild the env's map; envs that don't
+// have a pinned map keep the first map they picked while pooled.
+
+#define MAX_POOLED_STATES 8
+
+// defined in env.h and map.h which include this header
+env *initEnv(env *e, uint8_t numDrones, uint8_t numAgents, const obsProfile *profile, uint8_t *obs, bool discretizeActions, float *contActions, int32_t *discActions, float *rewards, uint8_t *masks, uint8_t *terminals, uint8_t *truncations, logBuffer *logs, int8_t mapIdx, uint64_t seed, bool enableTeams, bool sittingDuck, bool isTraining);
+void setTimingProfile(env *e, const timingProfile *timing);
+timingProfile envTimingProfile(const env *e);
+void resetEnv(env *e);
+void destroyEnv(env *e);
+void initMaps(env *e);
+void destroyMaps();
+
+#ifndef AUTOPXD
+typedef struct pooledState {
+    uint8_t *buf;
+    uint32_t size;
+    uint32_t capacity;
+} pooledState;
+
+// a ring of states that's only written to by the pool's thread and only
+// read from by the thread stepping the env
+typedef struct envStateQueue {
+    pooledState states[MAX_POOLED_STATES];
+    // incremented when a state is taken or added respectively
+    atomic_uint head;
+    atomic_uint tail;
+    uint64_t randState;
+    int8_t pinnedMapIdx;
+    // the env is pinned to its map while pooled so resets that miss the
+    // pool don't pick another one, its own pinned map is put back when
+    // the pool is destroyed
+    int8_t envPinnedMapIdx;
+} envStateQueue;
+
+typedef struct resetPool {
+    env *scratch;
+    uint8_t *scratchObs;
+    float *scratchActions;
+    float *scratchRewards;
+    uint8_t *scratchMasks;
+    uint8_t *scratchTerminals;
+    uint8_t *scratchTruncations;
+
+    uint16_t numEnvs;
+    uint8_t statesPerEnv;
+    envStateQueue *queues;
+    // resets that happened before a state was ready
+    atomic_uint misses;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t stateTaken;
+    bool stateWasTaken;
+    bool shutdown;
+} resetPool;
+
+static void generatePooledState(resetPool *pool, envStateQueue *q, pooledState *state) {
+    env *e = pool->scratch;
+    e->randState = wyhash64(&q->randState);
+    e->pinnedMapIdx = q->pinnedMapIdx;
+    e->mapIdx = -1;
+    resetEnv(e);
+
+    const uint32_t size = envSnapshotSize(e);
+    if (size > state->capacity) {
+        fastFree(state->buf);
+        state->buf = fastCalloc(size, sizeof(uint8_t));
+        state->capacity = size;
+    }
+    state->size = snapshotEnv(e, state->buf, state->capacity);
+}
+
+void *resetPoolWorker(void *arg) {
+    resetPool *pool = arg;
+    while (true) {
+        // add a state to every queue with room before adding another to
+        // any queue so envs are refilled evenly
+        bool addedState = false;
+        for (uint16_t i = 0; i < pool->numEnvs; i++) {
+            envStateQueue *q = &pool->queues[i];
+            const uint32_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+            const uint32_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+            if (tail - head == pool->statesPerEnv) {
+                continue;
+            }
+
+            generatePooledState(pool, q, &q->states[tail % pool->statesPerEnv]);
+            atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+            addedState = true;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (!addedState) {
+            while (!pool->stateWasTaken && !pool->shutdown) {
+                pthread_cond_wait(&pool->stateTaken, &pool->lock);
+            }
+            pool->stateWasTaken = false;
+        }
+        if (pool->shutdown) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+// restores the next pregenerated state of the env, returns false if
+// there isn't one ready
+bool restorePooledState(env *e) {
+    resetPool *pool = e->resetPool;
+    envStateQueue *q = &pool->queues[e->resetPoolIdx];
+    const uint32_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+    if (atomic_load_explicit(&q->tail, memory_order_acquire) == head) {
+        atomic_fetch_add_explicit(&pool->misses, 1, memory_order_relaxed);
+        return false;
+    }
+
+    const pooledState *state = &q->states[head % pool->statesPerEnv];
+    restoreEnv(e, state->buf, state->size);
+    atomic_store_explicit(&q->head, head + 1, memory_order_release);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stateWasTaken = true;
+    pthread_cond_signal(&pool->stateTaken);
+    pthread_mutex_unlock(&pool->lock);
+    return true;
+}
+#endif
+
+// starts a thread that keeps statesPerEnv initial states ready for each
+// env. The envs must have been initialized with the same config other
+// than their pinned map, set up and can't share arena worlds; must be
+// paired with a call to destroyResetPool before the envs are destroyed
+resetPool *createResetPool(env *envs, uint16_t numEnvs, uint8_t statesPerEnv) {
+    ASSERT(numEnvs != 0);
+    if (statesPerEnv == 0 || statesPerEnv > MAX_POOLED_STATES) {
+        ERRORF("pooled states per env must be between 1 and %d, got %u", MAX_POOLED_STATES, statesPerEnv);
+    }
+    const env *first = &envs[0];
+    for (uint16_t i = 0; i < numEnvs; i++) {
+        if (envs[i].arenaWorld != NULL) {
+            ERROR("envs that share arena worlds can't use a reset pool");
+        }
+        if (envs[i].mapIdx == -1) {
+            ERROR("envs must be set up before a reset pool is created");
+        }
+    }
+
+    resetPool *pool = fastCalloc(1, sizeof(resetPool));
+    pool->numEnvs = numEnvs;
+    pool->statesPerEnv = statesPerEnv;
+    pool->queues = fastCalloc(numEnvs, sizeof(envStateQueue));
+    for (uint16_t i = 0; i < numEnvs; i++) {
+        pool->queues[i].randState = envs[i].randState;
+        pool->queues[i].pinnedMapIdx = envs[i].mapIdx;
+        pool->queues[i].envPinnedMapIdx = envs[i].pinnedMapIdx;
+        envs[i].pinnedMapIdx = envs[i].mapIdx;
+        envs[i].resetPool = pool;
+        envs[i].resetPoolIdx = i;
+    }
+
+    // the scratch env is never stepped, it only needs buffers to be
+    // able to compute observations when it's set up
+    const uint8_t numDrones = first->numDrones;
+    pool->scratch = fastCalloc(1, sizeof(env));
+    pool->scratchObs = fastCalloc(first->numAgents, obsBytes(&first->obsProfile));
+    pool->scratchActions = fastCalloc(numDrones * CONTINUOUS_ACTION_SIZE, sizeof(float));
+    pool->scratchRewards = fastCalloc(numDrones, sizeof(float));
+    pool->scratchMasks = fastCalloc(numDrones, sizeof(uint8_t));
+    pool->scratchTerminals = fastCalloc(numDrones, sizeof(uint8_t));
+    pool->scratchTruncations = fastCalloc(numDrones, sizeof(uint8_t));
+    initEnv(
+        pool->scratch,
+        numDrones,
+        first->numAgents,
+        &first->obsProfile,
+        pool->scratchObs,
+        false,
+        pool->scratchActions,
+        NULL,
+        pool->scratchRewards,
+        pool->scratchMasks,
+        pool->scratchTerminals,
+        pool->scratchTruncations,
+        NULL,
+        first->pinnedMapIdx,
+        0,
+        first->teamsEnabled,
+        first->sittingDuck,
+        first->isTraining
+    );
+    const timingProfile timing = envTimingProfile(first);
+    setTimingProfile(pool->scratch, &timing);
+    initMaps(pool->scratch);
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->stateTaken, NULL);
+    enableAllocLocking();
+    if (pthread_create(&pool->thread, NULL, resetPoolWorker, pool) != 0) {
+        ERRORF("failed to create reset pool thread: %s", strerror(errno));
+    }
+
+    return pool;
+}
+
+// returns how many resets had to be done synchronously because no
+// state was ready
+uint32_t resetPoolMisses(resetPool *pool) {
+    return atomic_load(&pool->misses);
+}
+
+void destroyResetPool(resetPool *pool, env *envs) {
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = true;
+    pthread_cond_signal(&pool->stateTaken);
+    pthread_mutex_unlock(&pool->lock);
+    pthread_join(pool->thread, NULL);
+    disableAllocLocking();
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->stateTaken);
+
+    for (uint16_t i = 0; i < pool->numEnvs; i++) {
+        envs[i].resetPool = NULL;
+        envs[i].pinnedMapIdx = pool->queues[i].envPinnedMapIdx;
+        for (uint8_t j = 0; j < pool->statesPerEnv; j++) {
+            fastFree(pool->queues[i].states[j].buf);
+        }
+    }
+    fastFree(pool->queues);
+
+    destroyEnv(pool->scratch);
+    destroyMaps();
+    fastFree(pool->scratch);
+    fastFree(pool->scratchObs);
+    fastFree(pool->scratchActions);
+    fastFree(pool->scratchRewards);
+    fastFree(pool->scratchMasks);
+    fastFree(pool->scratchTerminals);
+    fastFree(pool->scratchTruncations);
+    fastFree(pool);
+}
+
+#endif
@@ -37,48 +37,98 @@ float castCircleCallback(b2ShapeId shapeId, b2Vec2 point, b2Vec2 normal, float f
     return fraction;
 }
 
-static inline uint32_t pathOffset(const env *e, uint16_t srcCellIdx, uint16_t destCellIdx) {
-    const uint8_t srcCol = srcCellIdx % e->map->columns;
-    const uint8_t srcRow = srcCellIdx / e->map->columns;
-    const uint8_t destCol = destCellIdx % e->map->columns;
-    const uint8_t destRow = destCellIdx / e->map->columns;
-    return (destRow * e->map->rows * e->map->columns * e->map->rows) + (destCol * e->map->rows * e->map->columns) + (srcRow * e->map->columns) + srcCol;
+// maps with more cells than this use hierarchical path tables instead
+// of storing the path between every pair of cells, which would need
+// 268MB for a 128x128 map
+#define MAX_DENSE_PATH_CELLS 1024
+// width and height in cells of the clusters large maps are split into
+#define PATH_CLUSTER_SIZE 8
+// local paths cover the destination's cluster and the clusters around it
+#define LOCAL_PATH_SIZE (3 * PATH_CLUSTER_SIZE)
+
+const uint8_t PATH_UNKNOWN = UINT8_MAX;
+// the cell is a wall, is the destination or can't reach the destination
+const uint8_t PATH_NONE = 8;
+
+// the part of the map a path table covers
+typedef struct pathWindow {
+    int16_t minCol;
+    int16_t minRow;
+    int16_t columns;
+    int16_t rows;
+} pathWindow;
+
+static inline bool usesClusterPaths(const mapEntry *map) {
+    return map->columns * map->rows > MAX_DENSE_PATH_CELLS;
 }
 
-void pathfindBFS(const env *e, uint8_t *flatPaths, uint16_t destCellIdx) {
-    uint8_t (*paths)[e->map->columns] = (uint8_t (*)[e->map->columns])flatPaths;
-    int8_t (*buffer)[3] = (int8_t (*)[3])e->mapPathing[e->mapIdx].pathBuffer;
+static inline uint16_t pathClusterColumns(const mapEntry *map) {
+    return (map->columns + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+}
 
-    uint16_t start = 0;
-    uint16_t end = 1;
+static inline uint16_t pathClusterIdx(const env *e, const uint16_t cellIdx) {
+    const uint16_t col = cellIdx % e->map->columns;
+    const uint16_t row = cellIdx / e->map->columns;
+    return (row / PATH_CLUSTER_SIZE) * pathClusterColumns(e->map) + (col / PATH_CLUSTER_SIZE);
+}
 
-    const mapCell *cell = safe_array_get_at(e->cells, destCellIdx);
-    if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
-        return;
+// path tables are allocated the first time a scripted agent needs to
+// path on a map so maps that are never pathed on don't use any memory
+void initPathing(env *e) {
+    pathingInfo *info = &e->mapPathing[e->mapIdx];
+    const uint32_t numCells = e->map->columns * e->map->rows;
+
+    uint32_t pathsSize = numCells * numCells;
+    if (usesClusterPaths(e->map)) {
+        const uint16_t clusterRows = (e->map->rows + PATH_CLUSTER_SIZE - 1) / PATH_CLUSTER_SIZE;
+        pathsSize = numCells * pathClusterColumns(e->map) * clusterRows;
+
+        const uint32_t localPathsSize = numCells * LOCAL_PATH_SIZE * LOCAL_PATH_SIZE;
+        info->localPaths = fastMalloc(localPathsSize * sizeof(uint8_t));
+        memset(info->localPaths, PATH_UNKNOWN, localPathsSize * sizeof(uint8_t));
+    }
+    info->paths = fastMalloc(pathsSize * sizeof(uint8_t));
+    memset(info->paths, PATH_UNKNOWN, pathsSize * sizeof(uint8_t));
+    // every visited cell queues 8 neighbors, plus the starting cells
+    info->pathBuffer = fastCalloc(3 * (8 * numCells + SQUARED(PATH_CLUSTER_SIZE)), sizeof(int16_t));
+}
+
+// breadth first search outwards from the source cells, storing the
+// direction each cell in the window should move to get closer to the
+// nearest source
+void pathfindBFS(const env *e, uint8_t *flatPaths, const pathWindow window, const uint16_t *sources, const uint16_t numSources) {
+    uint8_t (*paths)[window.columns] = (uint8_t (*)[window.columns])flatPaths;
+    int16_t (*buffer)[3] = (int16_t (*)[3])e->mapPathing[e->mapIdx].pathBuffer;
+
+    uint32_t start = 0;
+    uint32_t end = 0;
+
+    for (uint16_t i = 0; i < numSources; i++) {
+        buffer[end][0] = 8;
+        buffer[end][1] = sources[i] % e->map->columns;
+        buffer[end][2] = sources[i] / e->map->columns;
+        end++;
     }
-    const int8_t destCol = destCellIdx % e->map->columns;
-    const int8_t destRow = destCellIdx / e->map->columns;
 
-    buffer[start][0] = 8;
-    buffer[start][1] = destCol;
-    buffer[start][2] = destRow;
     while (start < end) {
-        const int8_t direction = buffer[start][0];
-        const int8_t startCol = buffer[start][1];
-        const int8_t startRow = buffer[start][2];
+        const int16_t direction = buffer[start][0];
+        const int16_t startCol = buffer[start][1];
+        const int16_t startRow = buffer[start][2];
         start++;
 
-        if (startCol < 0 || startCol >= e->map->columns || startRow < 0 || startRow >= e->map->rows || paths[startRow][startCol] != UINT8_MAX) {
+        const int16_t col = startCol - window.minCol;
+        const int16_t row = startRow - window.minRow;
+        if (col < 0 || col >= window.columns || row < 0 || row >= window.rows || paths[row][col] != PATH_UNKNOWN) {
             continue;
         }
         int16_t cellIdx = cellIndex(e, startCol, startRow);
         const mapCell *cell = safe_array_get_at(e->cells, cellIdx);
         if (cell->ent != NULL && entityTypeIsWall(cell->ent->type)) {
-            paths[startRow][startCol] = 8;
+            paths[row][col] = PATH_NONE;
             continue;
         }
 
-        paths[startRow][startCol] = direction;
+        paths[row][col] = direction;
 
         buffer[end][0] = 6; // up
         buffer[end][1] = startCol;
@@ -120,6 +170,84 @@ void pathfindBFS(const env *e, uint8_t *flatPaths, uint16_t destCellIdx) {
         buffer[end][2] = startRow + 1;
         end++;
     }
+
+    // cells that can't reach a source don't need to be searched again
+    for (int16_t row = 0; row < window.rows; row++) {
+        for (int16_t col = 0; col < window.columns; col++) {
+            if (paths[row][col] == PATH_UNKNOWN) {
+                paths[row][col] = PATH_NONE;
+            }
+        }
+    }
+}
+
+// returns the window of cells around the destination's cluster that
+// local paths to the destination cover
+static inline pathWindow localPathWindow(const env *e, const uint16_t dstCellIdx) {
+    const int16_t clusterCol = (dstCellIdx % e->map->columns) / PATH_CLUSTER_SIZE;
+    const int16_t clusterRow = (dstCellIdx / e->map->columns) / PATH_CLUSTER_SIZE;
+    const int16_t minCol = max((clusterCol - 1) * PATH_CLUSTER_SIZE, 0);
+    const int16_t minRow = max((clusterRow - 1) * PATH_CLUSTER_SIZE, 0);
+    const int16_t maxCol = min((clusterCol + 2) * PATH_CLUSTER_SIZE, (int16_t)e->map->columns);
+    const int16_t maxRow = min((clusterRow + 2) * PATH_CLUSTER_SIZE, (int16_t)e->map->rows);
+    return (pathWindow){
+        .minCol = minCol,
+        .minRow = minRow,
+        .columns = maxCol - minCol,
+        .rows = maxRow - minRow,
+    };
+}
+
+// returns the direction to move from the source cell to get closer to
+// the destination cell, or PATH_NONE if there is no path
+uint8_t pathDirection(env *e, const uint16_t srcCellIdx, const uint16_t dstCellIdx) {
+    pathingInfo *info = &e->mapPathing[e->mapIdx];
+    if (info->paths == NULL) {
+        initPathing(e);
+    }
+    const uint16_t numCells = e->map->columns * e->map->rows;
+    const pathWindow mapWindow = {.minCol = 0, .minRow = 0, .columns = e->map->columns, .rows = e->map->rows};
+
+    if (!usesClusterPaths(e->map)) {
+        uint8_t *paths = &info->paths[dstCellIdx * numCells];
+        if (paths[srcCellIdx] == PATH_UNKNOWN) {
+            pathfindBFS(e, paths, mapWindow, &dstCellIdx, 1);
+        }
+        return paths[srcCellIdx];
+    }
+
+    // use the exact path to the destination when close to it
+    const pathWindow local = localPathWindow(e, dstCellIdx);
+    const int16_t srcCol = (srcCellIdx % e->map->columns) - local.minCol;
+    const int16_t srcRow = (srcCellIdx / e->map->columns) - local.minRow;
+    if (srcCol >= 0 && srcCol < local.columns && srcRow >= 0 && srcRow < local.rows) {
+        uint8_t *paths = &info->localPaths[dstCellIdx * SQUARED(LOCAL_PATH_SIZE)];
+        const uint16_t localIdx = (srcRow * local.columns) + srcCol;
+        if (paths[localIdx] == PATH_UNKNOWN) {
+            pathfindBFS(e, paths, local, &dstCellIdx, 1);
+        }
+        if (paths[localIdx] != PATH_NONE || srcCellIdx == dstCellIdx) {
+            return paths[localIdx];
+        }
+        // the path leaves the local window, fall back to cluster paths
+    }
+
+    // otherwise move towards the nearest open cell of the destination's cluster
+    const uint16_t clusterIdx = pathClusterIdx(e, dstCellIdx);
+    uint8_t *paths = &info->paths[clusterIdx * numCells];
+    if (paths[srcCellIdx] == PATH_UNKNOWN) {
+        uint16_t sources[SQUARED(PATH_CLUSTER_SIZE)];
+        uint16_t numSources = 0;
+        const uint16_t clusterCol = (clusterIdx % pathClusterColumns(e->map)) * PATH_CLUSTER_SIZE;
+        const uint16_t clusterRow = (clusterIdx / pathClusterColumns(e->map)) * PATH_CLUSTER_SIZE;
+        for (uint16_t row = clusterRow; row < min(clusterRow + PATH_CLUSTER_SIZE, (uint16_t)e->map->rows); row++) {
+            for (uint16_t col = clusterCol; col < min(clusterCol + PATH_CLUSTER_SIZE, (uint16_t)e->map->columns); col++) {
+                sources[numSources++] = cellIndex(e, col, row);
+            }
+        }
+        pathfindBFS(e, paths, mapWindow, sources, numSources);
+    }
+    return paths[srcCellIdx];
 }
 
 float distanceWithDamping(const env *e, const droneEntity *drone, const b2Vec2 direction, const float linearDamping, const float steps) {
@@ -147,7 +275,8 @@ bool safeToFire(env *e, const droneEntity *drone, const b2Vec2 direction) {
     const b2Vec2 pos = drone->pos;
     const b2Vec2 rayEnd = b2MulAdd(pos, recoilDistance, invDirection);
     const b2Vec2 translation = b2Sub(rayEnd, pos);
-    const b2ShapeProxy cirProxy = b2MakeProxy(&pos, 1, DRONE_RADIUS);
+    const b2Vec2 worldPos = arenaToWorldPos(e, pos);
+    const b2ShapeProxy cirProxy = b2MakeProxy(&worldPos, 1, DRONE_RADIUS);
     const b2QueryFilter filter = {.categoryBits = DRONE_SHAPE, .maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | DRONE_SHAPE};
 
     castCircleCtx ctx = {0};
@@ -188,15 +317,8 @@ void moveTo(env *e, const droneEntity *drone, agentActions *actions, const b2Vec
         return;
     }
 
-    uint32_t pathIdx = pathOffset(e, drone->mapCellIdx, dstIdx);
-    uint8_t *paths = e->mapPathing[e->mapIdx].paths;
-    uint8_t direction = paths[pathIdx];
-    if (direction == UINT8_MAX) {
-        uint32_t bfsIdx = pathOffset(e, 0, dstIdx);
-        pathfindBFS(e, &paths[bfsIdx], dstIdx);
-        direction = paths[pathIdx];
-    }
-    if (direction >= 8) {
+    const uint8_t direction = pathDirection(e, drone->mapCellIdx, dstIdx);
+    if (direction >= PATH_NONE) {
         return;
     }
     actions->move.x += discMoveToContMoveMap[0][direction];
@@ -244,7 +366,8 @@ bool shouldShootAtEnemy(env *e, const droneEntity *drone, const droneEntity *ene
     const float enemyDroneDistance = b2Distance(enemyDrone->pos, drone->pos);
     const b2Vec2 castEnd = b2MulAdd(drone->pos, enemyDroneDistance, enemyDroneDirection);
     const b2Vec2 translation = b2Sub(castEnd, drone->pos);
-    const b2ShapeProxy cirProxy = b2MakeProxy(&drone->pos, 1, drone->weaponInfo->radius);
+    const b2Vec2 worldPos = arenaToWorldPos(e, drone->pos);
+    const b2ShapeProxy cirProxy = b2MakeProxy(&worldPos, 1, drone->weaponInfo->radius);
     const b2QueryFilter filter = {.categoryBits = PROJECTILE_SHAPE, .maskBits = WALL_SHAPE | FLOATING_WALL_SHAPE | DRONE_SHAPE};
 
     castCircleCtx ctx = {0};
@@ -15,15 +15,51 @@ const uint8_t TRAINING_BOX2D_SUBSTEPS = 2;
 const uint8_t EVAL_FRAME_RATE = 120;
 const uint8_t EVAL_BOX2D_SUBSTEPS = 4;
 
-const uint8_t NUM_MAPS = 9;
-#define _MAX_MAP_COLUMNS 25
-#define _MAX_MAP_ROWS 25
+// ROUND_STEPS * frameRate steps must fit in a uint16_t
+const uint8_t MAX_FRAME_RATE = 240;
+const uint8_t MAX_BOX2D_SUBSTEPS = 16;
+
+void initTimingProfile(timingProfile *p, const uint8_t frameRate, const uint8_t box2dSubSteps, const uint8_t frameSkip) {
+    if (frameRate == 0 || frameRate > MAX_FRAME_RATE) {
+        ERRORF("frame rate must be between 1 and %u, got %u", MAX_FRAME_RATE, frameRate);
+    }
+    if (box2dSubSteps == 0 || box2dSubSteps > MAX_BOX2D_SUBSTEPS) {
+        ERRORF("box2d substeps must be between 1 and %u, got %u", MAX_BOX2D_SUBSTEPS, box2dSubSteps);
+    }
+    if (frameSkip == 0 || frameSkip > frameRate) {
+        ERRORF("frame skip must be between 1 and the frame rate %u, got %u", frameRate, frameSkip);
+    }
+    p->frameRate = frameRate;
+    p->box2dSubSteps = box2dSubSteps;
+    p->frameSkip = frameSkip;
+}
+
+void trainingTimingProfile(timingProfile *p) {
+    initTimingProfile(p, TRAINING_FRAME_RATE, TRAINING_BOX2D_SUBSTEPS, TRAINING_FRAME_RATE / TRAINING_ACTIONS_PER_SECOND);
+}
+
+// agents act as often as in training so policies transfer
+void evalTimingProfile(timingProfile *p) {
+    initTimingProfile(p, EVAL_FRAME_RATE, EVAL_BOX2D_SUBSTEPS, EVAL_FRAME_RATE / TRAINING_ACTIONS_PER_SECOND);
+}
+
+#define _NUM_MAPS 11
+const uint8_t NUM_MAPS = _NUM_MAPS;
+// the large generated arenas come last and are only used when pinned
+const uint8_t NUM_TRAINING_MAPS = 9;
+#define _MAX_MAP_COLUMNS 128
+#define _MAX_MAP_ROWS 128
 #define MAX_CELLS _MAX_MAP_COLUMNS *_MAX_MAP_ROWS + 1
 #define MAX_FLOATING_WALLS 18
 #define MAX_WEAPON_PICKUPS 12
 
 #define MAX_NEAREST_WALLS 8
 
+// distance between arenas of envs that share a box2d world, twice the
+// width of the largest map so entities that leave an arena are
+// destroyed long before they could reach another one
+const float ARENA_SPACING = 1024.0f;
+
 const uint8_t DRONE_LIVES = 1;
 const float DRONE_RESPAWN_WAIT = 2.0f;
 const uint8_t ROUND_STEPS = 90;
@@ -31,8 +67,6 @@ const uint8_t SUDDEN_DEATH_STEPS = 5;
 
 const uint8_t MAX_DRONES = _MAX_DRONES;
 
-const uint16_t LOG_BUFFER_SIZE = 1024;
-
 // reward settings
 const float WIN_REWARD = 1.5f;
 const float ENEMY_DEATH_REWARD = 1.5f;
@@ -48,67 +82,175 @@ const uint8_t DISTANCE_CUTOFF = 15.0f;
 
 // observation constants
 
-// map layout observations
-const uint8_t MAP_OBS_ROWS = 11;
-const uint8_t MAP_OBS_COLUMNS = 11;
-const uint16_t MAP_OBS_SIZE = MAP_OBS_ROWS * MAP_OBS_COLUMNS;
-
-// discrete observations
-#define _NUM_NEAR_WALL_OBS 4
-const uint8_t NUM_NEAR_WALL_OBS = _NUM_NEAR_WALL_OBS;
-const uint16_t NEAR_WALL_TYPES_OBS_OFFSET = MAP_OBS_SIZE;
-
-#define _NUM_FLOATING_WALL_OBS 4
-const uint8_t NUM_FLOATING_WALL_OBS = _NUM_FLOATING_WALL_OBS;
-const uint16_t FLOATING_WALL_TYPES_OBS_OFFSET = NEAR_WALL_TYPES_OBS_OFFSET + NUM_NEAR_WALL_OBS;
+// the most an obs profile can observe, profiles that observe less
+// shrink observations and the cost of computing them
 
-const uint8_t NUM_PROJECTILE_OBS = 30;
-const uint16_t PROJECTILE_DRONE_OBS_OFFSET = FLOATING_WALL_TYPES_OBS_OFFSET + NUM_FLOATING_WALL_OBS;
-const uint16_t PROJECTILE_WEAPONS_OBS_OFFSET = PROJECTILE_DRONE_OBS_OFFSET + NUM_PROJECTILE_OBS;
+// map layout observations, the window is centered on the drone
+#define _MAX_MAP_OBS_ROWS 11
+const uint8_t MAX_MAP_OBS_ROWS = _MAX_MAP_OBS_ROWS;
+#define _MAX_MAP_OBS_COLUMNS 11
+const uint8_t MAX_MAP_OBS_COLUMNS = _MAX_MAP_OBS_COLUMNS;
+// the policy's first conv layer needs at least this many rows and columns
+const uint8_t MIN_MAP_OBS_ROWS = 5;
+const uint8_t MIN_MAP_OBS_COLUMNS = 5;
 
-#define _NUM_WEAPON_PICKUP_OBS 3
-const uint8_t NUM_WEAPON_PICKUP_OBS = _NUM_WEAPON_PICKUP_OBS;
-const uint16_t WEAPON_PICKUP_WEAPONS_OBS_OFFSET = PROJECTILE_WEAPONS_OBS_OFFSET + NUM_PROJECTILE_OBS;
-
-const uint16_t ENEMY_DRONE_WEAPONS_OBS_OFFSET = WEAPON_PICKUP_WEAPONS_OBS_OFFSET + NUM_WEAPON_PICKUP_OBS;
+// discrete observations
+#define _MAX_NEAR_WALL_OBS 4
+const uint8_t MAX_NEAR_WALL_OBS = _MAX_NEAR_WALL_OBS;
+#define _MAX_FLOATING_WALL_OBS 4
+const uint8_t MAX_FLOATING_WALL_OBS = _MAX_FLOATING_WALL_OBS;
+#define _MAX_PROJECTILE_OBS 30
+const uint8_t MAX_PROJECTILE_OBS = _MAX_PROJECTILE_OBS;
+#define _MAX_WEAPON_PICKUP_OBS 3
+const uint8_t MAX_WEAPON_PICKUP_OBS = _MAX_WEAPON_PICKUP_OBS;
+// lidar rays are cast in batches of 8 so this must be a multiple of 8
+#define _MAX_LIDAR_RAYS 32
+const uint8_t MAX_LIDAR_RAYS = _MAX_LIDAR_RAYS;
 
 // continuous observations
 const uint8_t NEAR_WALL_POS_OBS_SIZE = 2;
-const uint8_t NEAR_WALL_OBS_SIZE = NUM_NEAR_WALL_OBS * NEAR_WALL_POS_OBS_SIZE;
-const uint16_t NEAR_WALL_POS_OBS_OFFSET = 0;
-
 const uint8_t FLOATING_WALL_INFO_OBS_SIZE = 5;
-const uint8_t FLOATING_WALL_OBS_SIZE = NUM_FLOATING_WALL_OBS * FLOATING_WALL_INFO_OBS_SIZE;
-const uint16_t FLOATING_WALL_INFO_OBS_OFFSET = NEAR_WALL_POS_OBS_OFFSET + NEAR_WALL_OBS_SIZE;
-
 const uint8_t WEAPON_PICKUP_POS_OBS_SIZE = 2;
-const uint8_t WEAPON_PICKUP_OBS_SIZE = NUM_WEAPON_PICKUP_OBS * WEAPON_PICKUP_POS_OBS_SIZE;
-const uint16_t WEAPON_PICKUP_POS_OBS_OFFSET = FLOATING_WALL_INFO_OBS_OFFSET + FLOATING_WALL_OBS_SIZE;
-
 const uint8_t PROJECTILE_INFO_OBS_SIZE = 4;
-const uint8_t PROJECTILE_OBS_SIZE = NUM_PROJECTILE_OBS * PROJECTILE_INFO_OBS_SIZE;
-const uint16_t PROJECTILE_INFO_OBS_OFFSET = WEAPON_PICKUP_POS_OBS_OFFSET + WEAPON_PICKUP_OBS_SIZE;
-
-const uint16_t ENEMY_DRONE_OBS_OFFSET = PROJECTILE_INFO_OBS_OFFSET + PROJECTILE_OBS_SIZE;
+// distance, one-hot hit type of standard, bouncy or death wall or drone
+// and if the hit wall is floating
+const uint8_t LIDAR_RAY_OBS_SIZE = 6;
+const float LIDAR_RANGE = 40.0f;
 const uint8_t ENEMY_DRONE_OBS_SIZE = 24;
+// only the nearest drones are observed when there are more, drone
+// indexes in the map observation are 3 bits so this can't exceed 7
+#define _MAX_ENEMY_DRONE_OBS 7
+const uint8_t MAX_ENEMY_DRONE_OBS = _MAX_ENEMY_DRONE_OBS;
 
 const uint8_t DRONE_OBS_SIZE = 22;
 
 const uint8_t MISC_OBS_SIZE = 1;
 
-const uint16_t _DISCRETE_OBS_SIZE = MAP_OBS_SIZE + NUM_NEAR_WALL_OBS + NUM_FLOATING_WALL_OBS + (NUM_PROJECTILE_OBS * 2) + NUM_WEAPON_PICKUP_OBS + 1;
-const uint16_t _CONTINUOUS_OBS_SIZE = NEAR_WALL_OBS_SIZE + FLOATING_WALL_OBS_SIZE + WEAPON_PICKUP_OBS_SIZE + PROJECTILE_OBS_SIZE + DRONE_OBS_SIZE + MISC_OBS_SIZE;
+uint8_t numEnemyDroneObs(uint8_t numDrones) {
+    return min(numDrones - 1, MAX_ENEMY_DRONE_OBS);
+}
+
+// fills in the layout of a valid profile; forced inline so specialized
+// obs builders that lay out a constant profile get constant offsets,
+// padding is left alone as zeroing it keeps them from folding
+static FORCE_INLINE void layoutObsProfile(obsProfile *p, const uint8_t numDrones, const uint8_t mapObsRows, const uint8_t mapObsColumns, const uint8_t numNearWallObs, const uint8_t numFloatingWallObs, const uint8_t numProjectileObs, const uint8_t numWeaponPickupObs, const uint8_t numLidarRays) {
+    p->numDrones = numDrones;
+    p->numEnemyDroneObs = numEnemyDroneObs(numDrones);
+    p->mapObsRows = mapObsRows;
+    p->mapObsColumns = mapObsColumns;
+    p->mapObsSize = mapObsRows * mapObsColumns;
+    p->numNearWallObs = numNearWallObs;
+    p->numFloatingWallObs = numFloatingWallObs;
+    p->numProjectileObs = numProjectileObs;
+    p->numWeaponPickupObs = numWeaponPickupObs;
+    p->numLidarRays = numLidarRays;
+
+    p->nearWallTypesObsOffset = p->mapObsSize;
+    p->floatingWallTypesObsOffset = p->nearWallTypesObsOffset + numNearWallObs;
+    p->projectileDroneObsOffset = p->floatingWallTypesObsOffset + numFloatingWallObs;
+    p->projectileWeaponsObsOffset = p->projectileDroneObsOffset + numProjectileObs;
+    p->weaponPickupWeaponsObsOffset = p->projectileWeaponsObsOffset + numProjectileObs;
+    p->enemyDroneWeaponsObsOffset = p->weaponPickupWeaponsObsOffset + numWeaponPickupObs;
+    // weapon types of observed enemy drones and the agent drone
+    p->discreteObsSize = p->enemyDroneWeaponsObsOffset + p->numEnemyDroneObs + 1;
+    p->discreteObsBytes = alignedSize(p->discreteObsSize * sizeof(uint8_t), sizeof(float));
+
+    p->nearWallPosObsOffset = 0;
+    p->floatingWallInfoObsOffset = p->nearWallPosObsOffset + (numNearWallObs * NEAR_WALL_POS_OBS_SIZE);
+    p->weaponPickupPosObsOffset = p->floatingWallInfoObsOffset + (numFloatingWallObs * FLOATING_WALL_INFO_OBS_SIZE);
+    p->projectileInfoObsOffset = p->weaponPickupPosObsOffset + (numWeaponPickupObs * WEAPON_PICKUP_POS_OBS_SIZE);
+    p->lidarObsOffset = p->projectileInfoObsOffset + (numProjectileObs * PROJECTILE_INFO_OBS_SIZE);
+    p->enemyDroneObsOffset = p->lidarObsOffset + (numLidarRays * LIDAR_RAY_OBS_SIZE);
+    p->droneObsOffset = p->enemyDroneObsOffset + (p->numEnemyDroneObs * ENEMY_DRONE_OBS_SIZE);
+    p->miscObsOffset = p->droneObsOffset + DRONE_OBS_SIZE;
+    p->continuousObsSize = p->miscObsOffset + MISC_OBS_SIZE;
+}
+
+// computes the observation layout of a profile once so obs offsets don't
+// have to be derived every step
+void initObsProfile(obsProfile *p, const uint8_t numDrones, const uint8_t mapObsRows, const uint8_t mapObsColumns, const uint8_t numNearWallObs, const uint8_t numFloatingWallObs, const uint8_t numProjectileObs, const uint8_t numWeaponPickupObs, const uint8_t numLidarRays) {
+    if (mapObsRows < MIN_MAP_OBS_ROWS || mapObsRows > MAX_MAP_OBS_ROWS || mapObsRows % 2 == 0) {
+        ERRORF("map obs rows must be odd and between %u and %u, got %u", MIN_MAP_OBS_ROWS, MAX_MAP_OBS_ROWS, mapObsRows);
+    }
+    if (mapObsColumns < MIN_MAP_OBS_COLUMNS || mapObsColumns > MAX_MAP_OBS_COLUMNS || mapObsColumns % 2 == 0) {
+        ERRORF("map obs columns must be odd and between %u and %u, got %u", MIN_MAP_OBS_COLUMNS, MAX_MAP_OBS_COLUMNS, mapObsColumns);
+    }
+    if (numNearWallObs > MAX_NEAR_WALL_OBS || numFloatingWallObs > MAX_FLOATING_WALL_OBS || numProjectileObs > MAX_PROJECTILE_OBS || numWeaponPickupObs > MAX_WEAPON_PICKUP_OBS) {
+        ERRORF("obs profile observes too many entities: %u near walls, %u floating walls, %u projectiles, %u weapon pickups", numNearWallObs, numFloatingWallObs, numProjectileObs, numWeaponPickupObs);
+    }
+    if (numLidarRays > MAX_LIDAR_RAYS) {
+        ERRORF("obs profile casts too many lidar rays: %u, max is %u", numLidarRays, MAX_LIDAR_RAYS);
+    }
+
+    // zero padding too so profiles can be compared with memcmp
+    memset(p, 0x0, sizeof(obsProfile));
+    layoutObsProfile(p, numDrones, mapObsRows, mapObsColumns, numNearWallObs, numFloatingWallObs, numProjectileObs, numWeaponPickupObs, numLidarRays);
+}
+
+// observes as much as possible, lidar is opt in as the map obs already
+// covers the same walls
+void defaultObsProfile(obsProfile *p, const uint8_t numDrones) {
+    initObsProfile(p, numDrones, MAX_MAP_OBS_ROWS, MAX_MAP_OBS_COLUMNS, MAX_NEAR_WALL_OBS, MAX_FLOATING_WALL_OBS, MAX_PROJECTILE_OBS, MAX_WEAPON_PICKUP_OBS, 0);
+}
+
+// the discrete observations and their alignment are the same in every
+// obs format so the continuous obs always start at the same offset
+uint16_t continuousObsBytes(const obsProfile *p, enum obsFormat format) {
+    if (format == FLOAT32_OBS) {
+        return p->continuousObsSize * sizeof(float);
+    }
+    return p->continuousObsSize * sizeof(uint16_t);
+}
+
+uint16_t obsBytesInFormat(const obsProfile *p, enum obsFormat format) {
+    return alignedSize(p->discreteObsBytes + continuousObsBytes(p, format), sizeof(float));
+}
+
+uint16_t obsBytes(const obsProfile *p) {
+    return obsBytesInFormat(p, FLOAT32_OBS);
+}
+
+// observations of each agent can be stacked in a ring of up to this many
+// obs, each agent's ring starts with a header, see enableObsHistory
+const uint8_t MAX_OBS_HISTORY = 16;
+const uint8_t OBS_HISTORY_HEADER_BYTES = 4;
+
+uint32_t stackedObsBytes(const obsProfile *p, enum obsFormat format, const uint8_t historyLen) {
+    return OBS_HISTORY_HEADER_BYTES + (historyLen * obsBytesInFormat(p, format));
+}
+
+// decoded observations are floats laid out how the policy's encoder
+// consumes them: the map obs one hot encoded into a plane per channel,
+// the discrete obs other than weapon types one hot encoded, the weapon
+// types as is for the embedding, then the continuous obs
+
+// wall type, floating wall, weapon pickup and drone index channels
+uint8_t mapObsChannels(const obsProfile *p) {
+    return (NUM_WALL_TYPES + 1) + 1 + 1 + (p->numEnemyDroneObs + 1);
+}
+
+uint16_t multihotObsSize(const obsProfile *p) {
+    return (p->numNearWallObs * NUM_WALL_TYPES) + (p->numFloatingWallObs * (NUM_WALL_TYPES + 1)) + (p->numProjectileObs * (p->numDrones + 1));
+}
+
+uint16_t weaponTypeObsSize(const obsProfile *p) {
+    return p->discreteObsSize - p->projectileWeaponsObsOffset;
+}
+
+uint16_t decodedMultihotObsOffset(const obsProfile *p) {
+    return mapObsChannels(p) * p->mapObsSize;
+}
 
-uint16_t discreteObsSize(uint8_t numDrones) {
-    return _DISCRETE_OBS_SIZE + ((numDrones - 1));
+uint16_t decodedWeaponTypesObsOffset(const obsProfile *p) {
+    return decodedMultihotObsOffset(p) + multihotObsSize(p);
 }
 
-uint16_t continuousObsSize(uint8_t numDrones) {
-    return _CONTINUOUS_OBS_SIZE + ((numDrones - 1) * ENEMY_DRONE_OBS_SIZE);
+uint16_t decodedContinuousObsOffset(const obsProfile *p) {
+    return decodedWeaponTypesObsOffset(p) + weaponTypeObsSize(p);
 }
 
-uint16_t obsBytes(uint8_t numDrones) {
-    return alignedSize((discreteObsSize(numDrones) * sizeof(uint8_t)) + (continuousObsSize(numDrones) * sizeof(float)), sizeof(float));
+uint16_t decodedObsSize(const obsProfile *p) {
+    return decodedContinuousObsOffset(p) + p->continuousObsSize;
 }
 
 const float MAX_X_POS = 150.0f;
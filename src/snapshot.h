@@ -0,0 +1,795 @@
+#ifndef IMPULSE_WARS_SNAPSHOT_H
+#define IMPULSE_WARS_SNAPSHOT_H
+
+#include <string.h>
+
+#include "box2d/box2d.h"
+
+#include "game.h"
+#include "helpers.h"
+#include "map.h"
+#include "types.h"
+
+// snapshots hold everything about an env mid-episode that can't be
+// derived from its config: drones, projectiles, pickups, floating walls
+// and drone pieces along with their body transforms and velocities,
+// sudden death progress, the RNG state and episode stats. box2d worlds
+// can't be copied so restoring a snapshot rebuilds the env's bodies;
+// static walls aren't stored as they're rebuilt from the map and
+// sudden death wall counter.
+//
+// box2d's contact cache isn't part of a snapshot, so a restored env
+// can diverge from the original in the low bits of body positions
+// after collisions. Envs that share an arena world can't be restored.
+
+#define ENV_SNAPSHOT_VERSION 2
+// restored bodies are stepped by this much to discard contacts that
+// already began before the snapshot was taken
+#define SNAPSHOT_PRIME_DELTA_TIME 1e-6f
+
+// defined in env.h and render.h which include this header
+void clearEnv(env *e);
+void resetObsHistory(env *e);
+void computeObs(env *e);
+void setupEnvCamera(env *e);
+
+// entities other entities refer to are stored by their kind and index,
+// entity IDs change when a snapshot is restored
+enum snapshotRefType {
+    NO_REF,
+    DRONE_REF,
+    PROJECTILE_REF,
+    FLOATING_WALL_REF,
+    WALL_BOX_REF,
+};
+
+typedef struct snapshotRef {
+    uint32_t idx;
+    uint8_t type;
+} snapshotRef;
+
+typedef struct envSnapshotHeader {
+    uint32_t version;
+    // size of the whole snapshot in bytes
+    uint32_t size;
+    uint64_t randState;
+    uint32_t numProjectiles;
+    uint16_t numFloatingWalls;
+    uint16_t numPickups;
+    uint16_t numDronePieces;
+    uint16_t episodeLength;
+    uint16_t stepsLeft;
+    uint16_t suddenDeathSteps;
+    uint8_t numDrones;
+    uint8_t numAgents;
+    uint8_t frameRate;
+    uint8_t box2dSubSteps;
+    uint8_t frameSkip;
+    int8_t mapIdx;
+    uint8_t defaultWeapon;
+    int8_t lastSpawnQuad;
+    uint8_t suddenDeathWallCounter;
+    uint8_t spawnedWeaponPickups[_NUM_WEAPONS];
+    bool needsReset;
+    bool hasOpponentStates;
+} envSnapshotHeader;
+
+typedef struct droneSnapshot {
+    b2Vec2 pos;
+    b2Vec2 lastPos;
+    b2Vec2 initalPos;
+    b2Vec2 velocity;
+    b2Vec2 lastVelocity;
+    b2Vec2 lastMove;
+    b2Vec2 lastAim;
+    b2Vec2 bodyVelocity;
+    b2Vec2 shieldPos;
+    float linearDamping;
+    float weaponCooldown;
+    float weaponCharge;
+    float energyLeft;
+    float burstCharge;
+    float burstCooldown;
+    float energyRefillWait;
+    float respawnWait;
+    float shieldHealth;
+    float shieldDuration;
+    droneStepInfo stepInfo;
+    int16_t mapCellIdx;
+    uint16_t heat;
+    uint16_t respawnGuideLifetime;
+    int8_t ammo;
+    uint8_t weapon;
+    uint8_t livesLeft;
+    bool chargingWeapon;
+    bool braking;
+    bool chargingBurst;
+    bool energyFullyDepleted;
+    bool energyFullyDepletedThisStep;
+    bool shotThisStep;
+    bool diedThisStep;
+    bool dead;
+    bool hasShield;
+    bool awake;
+} droneSnapshot;
+
+typedef struct floatingWallSnapshot {
+    b2Vec2 pos;
+    b2Rot rot;
+    b2Vec2 velocity;
+    b2Vec2 bodyVelocity;
+    b2Vec2 extent;
+    float angularVelocity;
+    int16_t mapCellIdx;
+    uint8_t type;
+    bool isSuddenDeath;
+    bool awake;
+} floatingWallSnapshot;
+
+typedef struct weaponPickupSnapshot {
+    b2Vec2 pos;
+    float respawnWait;
+    int16_t mapCellIdx;
+    uint8_t weapon;
+    uint8_t floatingWallsTouching;
+    bool bodyDestroyed;
+} weaponPickupSnapshot;
+
+// followed by numEntsInBlackHole refs in the snapshot
+typedef struct projectileSnapshot {
+    b2Vec2 pos;
+    b2Vec2 lastPos;
+    b2Vec2 velocity;
+    b2Vec2 lastVelocity;
+    b2Vec2 bodyVelocity;
+    b2Rot rot;
+    float speed;
+    float lastSpeed;
+    float distance;
+    float angularVelocity;
+    snapshotRef mineWall;
+    int16_t mapCellIdx;
+    uint8_t droneIdx;
+    uint8_t weapon;
+    uint8_t bounces;
+    uint8_t contacts;
+    uint8_t numDronesBehindWalls;
+    uint8_t dronesBehindWalls[_MAX_DRONES];
+    uint8_t numEntsInBlackHole;
+    bool setMine;
+    bool needsToBeDestroyed;
+    bool awake;
+} projectileSnapshot;
+
+typedef struct dronePieceSnapshot {
+    b2Vec2 pos;
+    b2Rot rot;
+    b2Vec2 bodyVelocity;
+    float angularVelocity;
+    uint16_t lifetime;
+    uint8_t droneIdx;
+    bool isShieldPiece;
+    bool awake;
+} dronePieceSnapshot;
+
+#ifndef AUTOPXD
+static inline void writeSnapshotData(uint8_t *buf, uint32_t *offset, const void *data, const uint32_t size) {
+    memcpy(buf + *offset, data, size);
+    *offset += size;
+}
+
+static inline void readSnapshotData(const uint8_t *buf, const uint32_t bufSize, uint32_t *offset, void *data, const uint32_t size) {
+    if (*offset + size > bufSize) {
+        ERROR("env snapshot is truncated");
+    }
+    memcpy(data, buf + *offset, size);
+    *offset += size;
+}
+
+static snapshotRef entitySnapshotRef(const env *e, const entityID id) {
+    snapshotRef ref;
+    memset(&ref, 0x0, sizeof(ref));
+    ref.type = NO_REF;
+
+    const entity *ent = getEntityByID(e, id);
+    if (ent == NULL) {
+        return ref;
+    }
+
+    switch (ent->type) {
+    case DRONE_ENTITY: {
+        const droneEntity *drone = ent->entity;
+        ref.type = DRONE_REF;
+        ref.idx = drone->idx;
+        break;
+    }
+    case PROJECTILE_ENTITY: {
+        const projectileEntity *projectile = ent->entity;
+        ref.type = PROJECTILE_REF;
+        ref.idx = projectile->idx;
+        break;
+    }
+    case STANDARD_WALL_ENTITY:
+    case BOUNCY_WALL_ENTITY:
+    case DEATH_WALL_ENTITY: {
+        const wallEntity *wall = ent->entity;
+        const CC_Array *walls = e->wallBoxes;
+        enum snapshotRefType type = WALL_BOX_REF;
+        if (wall->isFloating) {
+            walls = e->floatingWalls;
+            type = FLOATING_WALL_REF;
+        }
+        for (size_t i = 0; i < cc_array_size(walls); i++) {
+            if (safe_array_get_at(walls, i) == wall) {
+                ref.type = type;
+                ref.idx = i;
+                break;
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+
+    return ref;
+}
+
+static entity *snapshotRefEntity(const env *e, const snapshotRef ref) {
+    switch (ref.type) {
+    case DRONE_REF: {
+        const droneEntity *drone = safe_array_get_at(e->drones, ref.idx);
+        return drone->ent;
+    }
+    case PROJECTILE_REF: {
+        const projectileEntity *projectile = safe_array_get_at(e->projectiles, ref.idx);
+        return projectile->ent;
+    }
+    case FLOATING_WALL_REF: {
+        const wallEntity *wall = safe_array_get_at(e->floatingWalls, ref.idx);
+        return wall->ent;
+    }
+    case WALL_BOX_REF: {
+        const wallEntity *box = safe_array_get_at(e->wallBoxes, ref.idx);
+        return box->ent;
+    }
+    default:
+        return NULL;
+    }
+}
+
+static void snapshotDrone(const droneEntity *drone, droneSnapshot *s) {
+    memset(s, 0x0, sizeof(droneSnapshot));
+    s->pos = drone->pos;
+    s->lastPos = drone->lastPos;
+    s->initalPos = drone->initalPos;
+    s->velocity = drone->velocity;
+    s->lastVelocity = drone->lastVelocity;
+    s->lastMove = drone->lastMove;
+    s->lastAim = drone->lastAim;
+    s->bodyVelocity = b2Body_GetLinearVelocity(drone->bodyID);
+    s->linearDamping = b2Body_GetLinearDamping(drone->bodyID);
+    s->weaponCooldown = drone->weaponCooldown;
+    s->weaponCharge = drone->weaponCharge;
+    s->energyLeft = drone->energyLeft;
+    s->burstCharge = drone->burstCharge;
+    s->burstCooldown = drone->burstCooldown;
+    s->energyRefillWait = drone->energyRefillWait;
+    s->respawnWait = drone->respawnWait;
+    s->stepInfo = drone->stepInfo;
+    s->mapCellIdx = drone->mapCellIdx;
+    s->heat = drone->heat;
+    s->respawnGuideLifetime = drone->respawnGuideLifetime;
+    s->ammo = drone->ammo;
+    s->weapon = drone->weaponInfo->type;
+    s->livesLeft = drone->livesLeft;
+    s->chargingWeapon = drone->chargingWeapon;
+    s->braking = drone->braking;
+    s->chargingBurst = drone->chargingBurst;
+    s->energyFullyDepleted = drone->energyFullyDepleted;
+    s->energyFullyDepletedThisStep = drone->energyFullyDepletedThisStep;
+    s->shotThisStep = drone->shotThisStep;
+    s->diedThisStep = drone->diedThisStep;
+    s->dead = drone->dead;
+    s->awake = b2Body_IsAwake(drone->bodyID);
+    if (drone->shield != NULL) {
+        s->hasShield = true;
+        s->shieldPos = drone->shield->pos;
+        s->shieldHealth = drone->shield->health;
+        s->shieldDuration = drone->shield->duration;
+    }
+}
+
+static void restoreDrone(env *e, const uint8_t idx, const droneSnapshot *s) {
+    droneEntity *drone = createDroneAtPos(e, idx, s->pos);
+    drone->lastPos = s->lastPos;
+    drone->initalPos = s->initalPos;
+    drone->velocity = s->velocity;
+    drone->lastVelocity = s->lastVelocity;
+    drone->lastMove = s->lastMove;
+    drone->lastAim = s->lastAim;
+    drone->weaponCooldown = s->weaponCooldown;
+    drone->weaponCharge = s->weaponCharge;
+    drone->energyLeft = s->energyLeft;
+    drone->burstCharge = s->burstCharge;
+    drone->burstCooldown = s->burstCooldown;
+    drone->energyRefillWait = s->energyRefillWait;
+    drone->respawnWait = s->respawnWait;
+    drone->stepInfo = s->stepInfo;
+    drone->mapCellIdx = s->mapCellIdx;
+    drone->heat = s->heat;
+    drone->respawnGuideLifetime = s->respawnGuideLifetime;
+    drone->ammo = s->ammo;
+    drone->weaponInfo = weaponInfos[s->weapon];
+    drone->livesLeft = s->livesLeft;
+    drone->chargingWeapon = s->chargingWeapon;
+    drone->braking = s->braking;
+    drone->chargingBurst = s->chargingBurst;
+    drone->energyFullyDepleted = s->energyFullyDepleted;
+    drone->energyFullyDepletedThisStep = s->energyFullyDepletedThisStep;
+    drone->shotThisStep = s->shotThisStep;
+    drone->diedThisStep = s->diedThisStep;
+    drone->dead = s->dead;
+    b2Body_SetLinearDamping(drone->bodyID, s->linearDamping);
+
+    if (s->hasShield) {
+        createDroneShield(e, drone, -(idx + 1));
+        drone->shield->pos = s->shieldPos;
+        drone->shield->health = s->shieldHealth;
+        drone->shield->duration = s->shieldDuration;
+        b2Body_SetTransform(drone->shield->bodyID, arenaToWorldPos(e, s->shieldPos), b2Rot_identity);
+    }
+    if (drone->dead) {
+        b2Body_Disable(drone->bodyID);
+    }
+}
+
+static void snapshotFloatingWall(const wallEntity *wall, floatingWallSnapshot *s) {
+    memset(s, 0x0, sizeof(floatingWallSnapshot));
+    s->pos = wall->pos;
+    s->rot = wall->rot;
+    s->velocity = wall->velocity;
+    s->bodyVelocity = b2Body_GetLinearVelocity(wall->bodyID);
+    s->extent = wall->extent;
+    s->angularVelocity = b2Body_GetAngularVelocity(wall->bodyID);
+    s->mapCellIdx = wall->mapCellIdx;
+    s->type = wall->type;
+    s->isSuddenDeath = wall->isSuddenDeath;
+    s->awake = b2Body_IsAwake(wall->bodyID);
+}
+
+static void restoreFloatingWall(env *e, const floatingWallSnapshot *s) {
+    const entity *ent = createWall(e, s->pos, s->extent.x * 2.0f, s->extent.y * 2.0f, s->mapCellIdx, s->type, true);
+    wallEntity *wall = ent->entity;
+    wall->rot = s->rot;
+    wall->velocity = s->velocity;
+    wall->isSuddenDeath = s->isSuddenDeath;
+    b2Body_SetTransform(wall->bodyID, arenaToWorldPos(e, s->pos), s->rot);
+}
+
+static void snapshotWeaponPickup(const weaponPickupEntity *pickup, weaponPickupSnapshot *s) {
+    memset(s, 0x0, sizeof(weaponPickupSnapshot));
+    s->pos = pickup->pos;
+    s->respawnWait = pickup->respawnWait;
+    s->mapCellIdx = pickup->mapCellIdx;
+    s->weapon = pickup->weapon;
+    s->floatingWallsTouching = pickup->floatingWallsTouching;
+    s->bodyDestroyed = pickup->bodyDestroyed;
+}
+
+static void restoreWeaponPickup(env *e, const weaponPickupSnapshot *s) {
+    weaponPickupEntity *pickup = fastCalloc(1, sizeof(weaponPickupEntity));
+    pickup->weapon = s->weapon;
+    pickup->respawnWait = s->respawnWait;
+    pickup->floatingWallsTouching = s->floatingWallsTouching;
+    pickup->pos = s->pos;
+    pickup->mapCellIdx = s->mapCellIdx;
+    pickup->bodyDestroyed = true;
+    pickup->ent = createEntity(e, WEAPON_PICKUP_ENTITY, pickup);
+
+    if (!s->bodyDestroyed) {
+        mapCell *cell = safe_array_get_at(e->cells, pickup->mapCellIdx);
+        cell->ent = pickup->ent;
+        createWeaponPickupBodyShape(e, pickup);
+    }
+
+    cc_array_add(e->pickups, pickup);
+}
+
+static void snapshotProjectile(const env *e, const projectileEntity *projectile, projectileSnapshot *s) {
+    memset(s, 0x0, sizeof(projectileSnapshot));
+    s->pos = projectile->pos;
+    s->lastPos = projectile->lastPos;
+    s->velocity = projectile->velocity;
+    s->lastVelocity = projectile->lastVelocity;
+    s->bodyVelocity = b2Body_GetLinearVelocity(projectile->bodyID);
+    s->rot = b2Body_GetRotation(projectile->bodyID);
+    s->speed = projectile->speed;
+    s->lastSpeed = projectile->lastSpeed;
+    s->distance = projectile->distance;
+    s->angularVelocity = b2Body_GetAngularVelocity(projectile->bodyID);
+    s->mineWall.type = NO_REF;
+    if (projectile->setMine) {
+        s->mineWall = entitySnapshotRef(e, projectile->mineWallID);
+    }
+    s->mapCellIdx = projectile->mapCellIdx;
+    s->droneIdx = projectile->droneIdx;
+    s->weapon = projectile->weaponInfo->type;
+    s->bounces = projectile->bounces;
+    s->contacts = projectile->contacts;
+    s->numDronesBehindWalls = projectile->numDronesBehindWalls;
+    memcpy(s->dronesBehindWalls, projectile->dronesBehindWalls, sizeof(s->dronesBehindWalls));
+    s->numEntsInBlackHole = projectile->numEntsInBlackHole;
+    s->setMine = projectile->setMine;
+    s->needsToBeDestroyed = projectile->needsToBeDestroyed;
+    s->awake = b2Body_IsAwake(projectile->bodyID);
+}
+
+// welds a restored mine to the wall it was set on, anchored where the
+// mine currently is
+static void weldRestoredMine(env *e, projectileEntity *projectile, const snapshotRef wallRef) {
+    const entity *ent = snapshotRefEntity(e, wallRef);
+    if (ent == NULL) {
+        return;
+    }
+    const wallEntity *wall = ent->entity;
+
+    b2WeldJointDef jointDef = b2DefaultWeldJointDef();
+    jointDef.bodyIdA = projectile->bodyID;
+    jointDef.bodyIdB = wall->bodyID;
+    jointDef.localAnchorB = b2Body_GetLocalPoint(wall->bodyID, b2Body_GetPosition(projectile->bodyID));
+    jointDef.referenceAngle = b2RelativeAngle(b2Body_GetRotation(wall->bodyID), b2Body_GetRotation(projectile->bodyID));
+    b2CreateWeldJoint(e->worldID, &jointDef);
+    projectile->mineWallID = ent->id;
+}
+
+static void restoreProjectile(env *e, const projectileSnapshot *s) {
+    projectileEntity *projectile = fastCalloc(1, sizeof(projectileEntity));
+    projectile->droneIdx = s->droneIdx;
+    projectile->weaponInfo = weaponInfos[s->weapon];
+    projectile->ent = createEntity(e, PROJECTILE_ENTITY, projectile);
+    createProjectileBodyShapes(e, projectile, s->pos);
+    if (s->rot.c != 1.0f || s->rot.s != 0.0f) {
+        b2Body_SetTransform(projectile->bodyID, arenaToWorldPos(e, s->pos), s->rot);
+    }
+
+    projectile->pos = s->pos;
+    projectile->lastPos = s->lastPos;
+    projectile->velocity = s->velocity;
+    projectile->lastVelocity = s->lastVelocity;
+    projectile->speed = s->speed;
+    projectile->lastSpeed = s->lastSpeed;
+    projectile->distance = s->distance;
+    projectile->mapCellIdx = s->mapCellIdx;
+    projectile->bounces = s->bounces;
+    projectile->contacts = s->contacts;
+    projectile->numDronesBehindWalls = s->numDronesBehindWalls;
+    memcpy(projectile->dronesBehindWalls, s->dronesBehindWalls, sizeof(projectile->dronesBehindWalls));
+    projectile->setMine = s->setMine;
+    projectile->needsToBeDestroyed = s->needsToBeDestroyed;
+    if (projectile->setMine) {
+        weldRestoredMine(e, projectile, s->mineWall);
+    }
+
+    projectile->idx = cc_array_size(e->projectiles);
+    cc_array_add(e->projectiles, projectile);
+}
+
+static void snapshotDronePiece(const dronePieceEntity *piece, dronePieceSnapshot *s) {
+    memset(s, 0x0, sizeof(dronePieceSnapshot));
+    s->pos = piece->pos;
+    s->rot = piece->rot;
+    s->bodyVelocity = b2Body_GetLinearVelocity(piece->bodyID);
+    s->angularVelocity = b2Body_GetAngularVelocity(piece->bodyID);
+    s->lifetime = piece->lifetime;
+    s->droneIdx = piece->droneIdx;
+    s->isShieldPiece = piece->isShieldPiece;
+    s->awake = b2Body_IsAwake(piece->bodyID);
+}
+
+// restored bodies are created at rest, once the world has been primed
+// give them back their velocities or put them back to sleep
+static void restoreBodyMotion(const b2BodyId bodyID, const bool awake, const b2Vec2 velocity, const float angularVelocity) {
+    b2Body_SetAwake(bodyID, awake);
+    if (!awake) {
+        return;
+    }
+    b2Body_SetLinearVelocity(bodyID, velocity);
+    b2Body_SetAngularVelocity(bodyID, angularVelocity);
+}
+#endif
+
+uint32_t envSnapshotSize(const env *e) {
+    uint32_t size = sizeof(envSnapshotHeader);
+    size += e->numDrones * (sizeof(droneStats) + sizeof(droneSnapshot));
+    size += cc_array_size(e->floatingWalls) * sizeof(floatingWallSnapshot);
+    size += cc_array_size(e->pickups) * sizeof(weaponPickupSnapshot);
+    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        const projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+        size += sizeof(projectileSnapshot) + (projectile->numEntsInBlackHole * sizeof(snapshotRef));
+    }
+    size += cc_array_size(e->dronePieces) * sizeof(dronePieceSnapshot);
+    size += e->numAgents * (sizeof(float) + (3 * sizeof(uint8_t)));
+    if (e->opponentStates != NULL) {
+        size += e->numDrones * POLICY_STATE_SIZE * sizeof(float);
+    }
+    return size;
+}
+
+// writes a snapshot of the env to buf, which must be at least
+// envSnapshotSize bytes; returns the size of the snapshot
+uint32_t snapshotEnv(const env *e, uint8_t *buf, const uint32_t bufSize) {
+    const uint32_t size = envSnapshotSize(e);
+    if (bufSize < size) {
+        ERRORF("env snapshot needs %u bytes, buffer is %u bytes", size, bufSize);
+    }
+
+    envSnapshotHeader header;
+    memset(&header, 0x0, sizeof(header));
+    header.version = ENV_SNAPSHOT_VERSION;
+    header.size = size;
+    header.randState = e->randState;
+    header.numProjectiles = cc_array_size(e->projectiles);
+    header.numFloatingWalls = cc_array_size(e->floatingWalls);
+    header.numPickups = cc_array_size(e->pickups);
+    header.numDronePieces = cc_array_size(e->dronePieces);
+    header.episodeLength = e->episodeLength;
+    header.stepsLeft = e->stepsLeft;
+    header.suddenDeathSteps = e->suddenDeathSteps;
+    header.numDrones = e->numDrones;
+    header.numAgents = e->numAgents;
+    header.frameRate = e->frameRate;
+    header.box2dSubSteps = e->box2dSubSteps;
+    header.frameSkip = e->frameSkip;
+    header.mapIdx = e->mapIdx;
+    header.defaultWeapon = e->defaultWeapon->type;
+    header.lastSpawnQuad = e->lastSpawnQuad;
+    header.suddenDeathWallCounter = e->suddenDeathWallCounter;
+    memcpy(header.spawnedWeaponPickups, e->spawnedWeaponPickups, sizeof(header.spawnedWeaponPickups));
+    header.needsReset = e->needsReset;
+    header.hasOpponentStates = e->opponentStates != NULL;
+
+    uint32_t offset = 0;
+    writeSnapshotData(buf, &offset, &header, sizeof(header));
+    writeSnapshotData(buf, &offset, e->stats, e->numDrones * sizeof(droneStats));
+
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneSnapshot s;
+        snapshotDrone(safe_array_get_at(e->drones, i), &s);
+        writeSnapshotData(buf, &offset, &s, sizeof(s));
+    }
+    for (size_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
+        floatingWallSnapshot s;
+        snapshotFloatingWall(safe_array_get_at(e->floatingWalls, i), &s);
+        writeSnapshotData(buf, &offset, &s, sizeof(s));
+    }
+    for (size_t i = 0; i < cc_array_size(e->pickups); i++) {
+        weaponPickupSnapshot s;
+        snapshotWeaponPickup(safe_array_get_at(e->pickups, i), &s);
+        writeSnapshotData(buf, &offset, &s, sizeof(s));
+    }
+    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        const projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+        projectileSnapshot s;
+        snapshotProjectile(e, projectile, &s);
+        writeSnapshotData(buf, &offset, &s, sizeof(s));
+        // entities that left the world are still written so the size
+        // matches envSnapshotSize, they're dropped on restore
+        for (uint8_t j = 0; j < projectile->numEntsInBlackHole; j++) {
+            const snapshotRef ref = entitySnapshotRef(e, projectile->entsInBlackHole[j]);
+            writeSnapshotData(buf, &offset, &ref, sizeof(ref));
+        }
+    }
+    for (size_t i = 0; i < cc_array_size(e->dronePieces); i++) {
+        dronePieceSnapshot s;
+        snapshotDronePiece(safe_array_get_at(e->dronePieces, i), &s);
+        writeSnapshotData(buf, &offset, &s, sizeof(s));
+    }
+
+    writeSnapshotData(buf, &offset, e->rewards, e->numAgents * sizeof(float));
+    writeSnapshotData(buf, &offset, e->masks, e->numAgents * sizeof(uint8_t));
+    writeSnapshotData(buf, &offset, e->terminals, e->numAgents * sizeof(uint8_t));
+    writeSnapshotData(buf, &offset, e->truncations, e->numAgents * sizeof(uint8_t));
+    if (e->opponentStates != NULL) {
+        writeSnapshotData(buf, &offset, e->opponentStates, e->numDrones * POLICY_STATE_SIZE * sizeof(float));
+    }
+
+    ASSERTF(offset == size, "wrote %u byte env snapshot, expected %u bytes", offset, size);
+    return size;
+}
+
+// restores an env to a snapshot taken by snapshotEnv from an env with
+// the same config; observations are recomputed and the observation
+// history starts over from the restored step
+void restoreEnv(env *e, const uint8_t *buf, const uint32_t bufSize) {
+    envSnapshotHeader header;
+    uint32_t offset = 0;
+    readSnapshotData(buf, bufSize, &offset, &header, sizeof(header));
+    if (header.version != ENV_SNAPSHOT_VERSION) {
+        ERRORF("env snapshot version %u isn't supported, expected version %u", header.version, ENV_SNAPSHOT_VERSION);
+    }
+    if (header.size != bufSize) {
+        ERRORF("env snapshot is %u bytes, got %u bytes", header.size, bufSize);
+    }
+    if (header.numDrones != e->numDrones || header.numAgents != e->numAgents || header.frameRate != e->frameRate) {
+        ERRORF(
+            "env snapshot has %u drones, %u agents and a frame rate of %u; env has %u drones, %u agents and a frame rate of %u",
+            header.numDrones,
+            header.numAgents,
+            header.frameRate,
+            e->numDrones,
+            e->numAgents,
+            e->frameRate
+        );
+    }
+    if (header.box2dSubSteps != e->box2dSubSteps || header.frameSkip != e->frameSkip) {
+        ERRORF(
+            "env snapshot has %u box2d substeps and a frame skip of %u; env has %u box2d substeps and a frame skip of %u",
+            header.box2dSubSteps,
+            header.frameSkip,
+            e->box2dSubSteps,
+            e->frameSkip
+        );
+    }
+    if (header.mapIdx < 0 || header.mapIdx >= NUM_MAPS) {
+        ERRORF("env snapshot has invalid map index %d", header.mapIdx);
+    }
+    // priming the restored bodies steps the whole world
+    if (e->arenaWorld != NULL) {
+        ERROR("envs that share an arena world can't be restored");
+    }
+
+    clearEnv(e);
+
+    if (e->mapIdx == header.mapIdx) {
+        removeSuddenDeathWalls(e);
+    } else {
+        setupMap(e, header.mapIdx);
+        // floating walls are restored below
+        for (size_t i = 0; i < cc_array_size(e->floatingWalls); i++) {
+            wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+            destroyWall(e, wall, false);
+        }
+        cc_array_remove_all(e->floatingWalls);
+    }
+    e->defaultWeapon = weaponInfos[header.defaultWeapon];
+
+    // sudden death walls are placed in rings, place each ring again
+    for (uint8_t i = 1; i <= header.suddenDeathWallCounter; i++) {
+        e->suddenDeathWallCounter = i;
+        e->suddenDeathWallsPlaced = true;
+        placeSuddenDeathWalls(e);
+    }
+    e->suddenDeathWallCounter = header.suddenDeathWallCounter;
+
+    e->randState = header.randState;
+    e->needsReset = header.needsReset;
+    e->episodeLength = header.episodeLength;
+    e->stepsLeft = header.stepsLeft;
+    e->suddenDeathSteps = header.suddenDeathSteps;
+    e->lastSpawnQuad = header.lastSpawnQuad;
+    memcpy(e->spawnedWeaponPickups, header.spawnedWeaponPickups, sizeof(e->spawnedWeaponPickups));
+    readSnapshotData(buf, bufSize, &offset, e->stats, e->numDrones * sizeof(droneStats));
+
+    // entities are created in the order they were snapshotted so their
+    // indices match any refs to them
+    const uint32_t dronesOffset = offset;
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        restoreDrone(e, i, &s);
+    }
+    const uint32_t wallsOffset = offset;
+    for (uint16_t i = 0; i < header.numFloatingWalls; i++) {
+        floatingWallSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        restoreFloatingWall(e, &s);
+    }
+    for (uint16_t i = 0; i < header.numPickups; i++) {
+        weaponPickupSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        restoreWeaponPickup(e, &s);
+    }
+    const uint32_t projectilesOffset = offset;
+    for (uint32_t i = 0; i < header.numProjectiles; i++) {
+        projectileSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        restoreProjectile(e, &s);
+        offset += s.numEntsInBlackHole * sizeof(snapshotRef);
+    }
+    const uint32_t piecesOffset = offset;
+    for (uint16_t i = 0; i < header.numDronePieces; i++) {
+        dronePieceSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        dronePieceEntity *piece = createDronePieceAtPos(e, s.droneIdx, s.pos, s.rot, b2Vec2_zero, 0.0f, s.isShieldPiece);
+        piece->lifetime = s.lifetime;
+    }
+
+    readSnapshotData(buf, bufSize, &offset, e->rewards, e->numAgents * sizeof(float));
+    readSnapshotData(buf, bufSize, &offset, e->masks, e->numAgents * sizeof(uint8_t));
+    readSnapshotData(buf, bufSize, &offset, e->terminals, e->numAgents * sizeof(uint8_t));
+    readSnapshotData(buf, bufSize, &offset, e->truncations, e->numAgents * sizeof(uint8_t));
+    if (header.hasOpponentStates) {
+        const uint32_t statesSize = e->numDrones * POLICY_STATE_SIZE * sizeof(float);
+        if (e->opponentStates != NULL) {
+            readSnapshotData(buf, bufSize, &offset, e->opponentStates, statesSize);
+        } else {
+            offset += statesSize;
+        }
+    } else if (e->opponentStates != NULL) {
+        memset(e->opponentStates, 0x0, e->numDrones * POLICY_STATE_SIZE * sizeof(float));
+    }
+    e->opponentActionsReady = false;
+    if (offset != bufSize) {
+        ERRORF("env snapshot is %u bytes, only %u bytes were read", bufSize, offset);
+    }
+
+    // contacts and sensor overlaps between restored bodies would be
+    // reported as beginning on the next step, but they were already
+    // handled before the snapshot was taken. Step the world a negligible
+    // amount with every body at rest so they're reported now and can
+    // be discarded. A snapshot of an episode that hasn't been stepped,
+    // like a pooled initial state, has nothing to discard; it's left as
+    // setupEnv would leave it
+    if (header.episodeLength != 0) {
+        b2World_Step(e->worldID, SNAPSHOT_PRIME_DELTA_TIME, 1);
+    }
+
+    offset = dronesOffset;
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        droneSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        if (!s.dead) {
+            const droneEntity *drone = safe_array_get_at(e->drones, i);
+            restoreBodyMotion(drone->bodyID, s.awake, s.bodyVelocity, 0.0f);
+        }
+    }
+    offset = wallsOffset;
+    for (uint16_t i = 0; i < header.numFloatingWalls; i++) {
+        floatingWallSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        const wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+        restoreBodyMotion(wall->bodyID, s.awake, s.bodyVelocity, s.angularVelocity);
+    }
+    offset = projectilesOffset;
+    for (uint32_t i = 0; i < header.numProjectiles; i++) {
+        projectileSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+        restoreBodyMotion(projectile->bodyID, s.awake, s.bodyVelocity, s.angularVelocity);
+
+        for (uint8_t j = 0; j < s.numEntsInBlackHole; j++) {
+            snapshotRef ref;
+            readSnapshotData(buf, bufSize, &offset, &ref, sizeof(ref));
+            const entity *ent = snapshotRefEntity(e, ref);
+            if (ent != NULL) {
+                projectile->entsInBlackHole[projectile->numEntsInBlackHole++] = ent->id;
+            }
+        }
+    }
+    offset = piecesOffset;
+    for (uint16_t i = 0; i < header.numDronePieces; i++) {
+        dronePieceSnapshot s;
+        readSnapshotData(buf, bufSize, &offset, &s, sizeof(s));
+        const dronePieceEntity *piece = safe_array_get_at(e->dronePieces, i);
+        restoreBodyMotion(piece->bodyID, s.awake, s.bodyVelocity, s.angularVelocity);
+    }
+
+    // black holes apply their pull after each step, so it has to be
+    // applied again for the next step
+    for (size_t i = 0; i < cc_array_size(e->projectiles); i++) {
+        projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+        if (projectile->weaponInfo->type == BLACK_HOLE_WEAPON && !projectile->needsToBeDestroyed) {
+            handleBlackHolePull(e, projectile);
+        }
+    }
+
+    if (e->client != NULL) {
+        setupEnvCamera(e);
+    }
+
+    resetObsHistory(e);
+    computeObs(e);
+}
+
+#endif
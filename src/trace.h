@@ -0,0 +1,524 @@
+#ifndef IMPULSE_WARS_TRACE_H
+#define IMPULSE_WARS_TRACE_H
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "helpers.h"
+#include "types.h"
+
+// a trace is a file of compact per-frame records of an env's game state
+// so episodes can be analyzed or replayed offline without rerunning
+// them. The file is mapped into memory and frames are written into a
+// ring after the file header, once the ring is full the oldest frames
+// are overwritten so a trace never grows past the size it was opened
+// with. Each frame is a traceFrame followed by arrays of the entities
+// in it in the order of the traceFrame's counts.
+//
+// All structs are laid out so they have no implicit padding, and the
+// file is written in the host's byte order
+
+#define TRACE_MAGIC 0x52545749 // "IWTR"
+#define TRACE_VERSION 1
+#define TRACE_MIN_CAPACITY 4096
+#define TRACE_MAX_EXPLOSIONS 64
+
+// frames are padded to a multiple of 8 bytes so every frame and entity
+// array in the ring is aligned
+#define TRACE_ALIGN(size) (((size) + 7) & ~(uint64_t)7)
+
+typedef struct traceFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // bytes of the ring following the header
+    uint64_t capacity;
+    // offsets in the ring of the oldest frame and of where the next
+    // frame will be written
+    uint64_t head;
+    uint64_t tail;
+    // bytes of the ring in use including the unused space skipped at
+    // the end of the ring when a frame didn't fit
+    uint64_t used;
+    uint64_t framesWritten;
+    uint64_t framesOverwritten;
+    // frames that were bigger than half the ring and weren't written
+    uint64_t framesDropped;
+    // config of the env the trace was written by, set when the trace is
+    // given to an env
+    uint8_t numDrones;
+    uint8_t numAgents;
+    uint8_t frameRate;
+    bool teamsEnabled;
+    uint8_t pad[4];
+} traceFileHeader;
+
+typedef struct traceFrame {
+    // size of the frame including the entities following it, a size of
+    // 0 marks the rest of the ring as unused
+    uint32_t size;
+    uint32_t episode;
+    uint16_t frame;
+    uint16_t stepsLeft;
+    uint16_t numProjectiles;
+    uint8_t numDrones;
+    uint8_t numFloatingWalls;
+    uint8_t numPickups;
+    uint8_t numExplosions;
+    uint8_t suddenDeathWallCounter;
+    int8_t mapIdx;
+    // set on the last frame of an episode
+    bool episodeEnded;
+    uint8_t pad[3];
+} traceFrame;
+
+#define TRACE_DRONE_DEAD (1 << 0)
+#define TRACE_DRONE_SHIELDED (1 << 1)
+#define TRACE_DRONE_BRAKING (1 << 2)
+#define TRACE_DRONE_CHARGING_WEAPON (1 << 3)
+#define TRACE_DRONE_CHARGING_BURST (1 << 4)
+#define TRACE_DRONE_SHOT (1 << 5)
+
+typedef struct traceDrone {
+    b2Vec2 pos;
+    b2Vec2 velocity;
+    b2Vec2 aim;
+    float energyLeft;
+    // 0 if the drone doesn't have a shield
+    float shieldHealth;
+    uint8_t weapon;
+    int8_t ammo;
+    uint8_t livesLeft;
+    uint8_t flags;
+} traceDrone;
+
+typedef struct traceFloatingWall {
+    b2Vec2 pos;
+    b2Rot rot;
+    uint8_t type;
+    uint8_t pad[3];
+} traceFloatingWall;
+
+typedef struct traceProjectile {
+    b2Vec2 pos;
+    uint8_t weapon;
+    uint8_t droneIdx;
+    uint8_t pad[2];
+} traceProjectile;
+
+typedef struct tracePickup {
+    b2Vec2 pos;
+    uint8_t weapon;
+    // false while the pickup is waiting to respawn
+    bool enabled;
+    uint8_t pad[2];
+} tracePickup;
+
+typedef struct traceExplosion {
+    b2Vec2 pos;
+    float radius;
+    uint8_t droneIdx;
+    bool isBurst;
+    uint8_t pad[2];
+} traceExplosion;
+
+#ifndef AUTOPXD
+typedef struct traceWriter {
+    int fd;
+    uint8_t *mapped;
+    size_t mappedSize;
+    traceFileHeader *header;
+    uint8_t *ring;
+
+    uint32_t episode;
+} traceWriter;
+
+// events of the frame being stepped that can't be read from the env's
+// state after it, the env only keeps track of explosions when rendering
+typedef struct traceFrameEvents {
+    uint8_t numExplosions;
+    traceExplosion explosions[TRACE_MAX_EXPLOSIONS];
+} traceFrameEvents;
+
+typedef struct traceReader {
+    int fd;
+    const uint8_t *mapped;
+    size_t mappedSize;
+    const traceFileHeader *header;
+    const uint8_t *ring;
+
+    uint64_t offset;
+    uint64_t remaining;
+} traceReader;
+#endif
+
+// creates or truncates the trace file at path with a ring of capacity
+// bytes; must be paired with a call to closeTraceWriter
+traceWriter *openTraceWriter(const char *path, uint64_t capacity, uint8_t numDrones) {
+    capacity &= ~(uint64_t)7;
+    if (capacity < TRACE_MIN_CAPACITY) {
+        ERRORF("trace capacity must be at least %d bytes", TRACE_MIN_CAPACITY);
+    }
+
+    const int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd == -1) {
+        ERRORF("failed to open trace file %s: %s", path, strerror(errno));
+    }
+    const size_t mappedSize = sizeof(traceFileHeader) + capacity;
+    if (ftruncate(fd, mappedSize) == -1) {
+        ERRORF("failed to resize trace file %s: %s", path, strerror(errno));
+    }
+    uint8_t *mapped = mmap(NULL, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        ERRORF("failed to map trace file %s: %s", path, strerror(errno));
+    }
+
+    traceWriter *w = fastCalloc(1, sizeof(traceWriter));
+    w->fd = fd;
+    w->mapped = mapped;
+    w->mappedSize = mappedSize;
+    w->header = (traceFileHeader *)mapped;
+    w->ring = mapped + sizeof(traceFileHeader);
+
+    w->header->magic = TRACE_MAGIC;
+    w->header->version = TRACE_VERSION;
+    w->header->capacity = capacity;
+    w->header->numDrones = numDrones;
+
+    return w;
+}
+
+void closeTraceWriter(traceWriter *w) {
+    msync(w->mapped, w->mappedSize, MS_SYNC);
+    munmap(w->mapped, w->mappedSize);
+    close(w->fd);
+    fastFree(w);
+}
+
+#ifndef AUTOPXD
+// makes the env record the events of each frame so they can be
+// encoded with the frame
+void enableFrameEvents(env *e) {
+    if (e->frameEvents == NULL) {
+        e->frameEvents = fastCalloc(1, sizeof(traceFrameEvents));
+    }
+}
+#endif
+
+// the env doesn't own the trace writer, it must be closed by the caller
+// after the env is destroyed or its trace is unset
+void setEnvTrace(env *e, traceWriter *w) {
+    if (w != NULL && w->header->numDrones != e->numDrones) {
+        ERRORF("trace was opened for %u drones, env has %u drones", w->header->numDrones, e->numDrones);
+    }
+    e->trace = w;
+    if (w != NULL) {
+        enableFrameEvents(e);
+        w->header->numAgents = e->numAgents;
+        w->header->frameRate = e->frameRate;
+        w->header->teamsEnabled = e->teamsEnabled;
+    }
+}
+
+uint64_t traceFramesWritten(const traceWriter *w) {
+    return w->header->framesWritten;
+}
+
+#ifndef AUTOPXD
+// records an explosion to be encoded with the current frame
+void recordFrameExplosion(env *e, const b2ExplosionDef *def, const uint8_t droneIdx, const bool isBurst) {
+    traceFrameEvents *events = e->frameEvents;
+    if (events->numExplosions == TRACE_MAX_EXPLOSIONS) {
+        return;
+    }
+    events->explosions[events->numExplosions++] = (traceExplosion){
+        .pos = def->position,
+        .radius = def->radius,
+        .droneIdx = droneIdx,
+        .isBurst = isBurst,
+    };
+}
+
+static void evictOldestTraceFrame(traceWriter *w) {
+    traceFileHeader *h = w->header;
+    uint32_t size;
+    memcpy(&size, w->ring + h->head, sizeof(size));
+    if (size == 0) {
+        h->used -= h->capacity - h->head;
+        h->head = 0;
+        return;
+    }
+
+    h->used -= size;
+    h->head += size;
+    if (h->head == h->capacity) {
+        h->head = 0;
+    }
+    h->framesOverwritten++;
+}
+
+// returns where a frame of size bytes can be written, overwriting the
+// oldest frames if needed. Frames are never split across the end of
+// the ring, if a frame doesn't fit at the end it's written at the
+// start and the rest of the ring is marked unused
+static uint8_t *reserveTraceFrame(traceWriter *w, const uint32_t size) {
+    traceFileHeader *h = w->header;
+    const bool wrap = h->tail + size > h->capacity;
+    uint64_t needed = size;
+    if (wrap) {
+        needed += h->capacity - h->tail;
+    }
+    while (h->capacity - h->used < needed) {
+        evictOldestTraceFrame(w);
+    }
+
+    if (wrap) {
+        const uint32_t marker = 0;
+        memcpy(w->ring + h->tail, &marker, sizeof(marker));
+        h->used += h->capacity - h->tail;
+        h->tail = 0;
+    }
+    uint8_t *dst = w->ring + h->tail;
+    h->used += size;
+    h->tail += size;
+    if (h->tail == h->capacity) {
+        h->tail = 0;
+    }
+    return dst;
+}
+
+static uint8_t traceDroneFlags(const droneEntity *drone) {
+    uint8_t flags = 0;
+    if (drone->dead) {
+        flags |= TRACE_DRONE_DEAD;
+    }
+    if (drone->shield != NULL) {
+        flags |= TRACE_DRONE_SHIELDED;
+    }
+    if (drone->braking) {
+        flags |= TRACE_DRONE_BRAKING;
+    }
+    if (drone->chargingWeapon) {
+        flags |= TRACE_DRONE_CHARGING_WEAPON;
+    }
+    if (drone->chargingBurst) {
+        flags |= TRACE_DRONE_CHARGING_BURST;
+    }
+    if (drone->shotThisStep) {
+        flags |= TRACE_DRONE_SHOT;
+    }
+    return flags;
+}
+
+// returns the size of a frame of the env's current state
+uint64_t traceFrameSize(const env *e) {
+    const uint16_t numProjectiles = min(cc_array_size(e->projectiles), (size_t)UINT16_MAX);
+    return TRACE_ALIGN(
+        sizeof(traceFrame) + (e->numDrones * sizeof(traceDrone)) + (cc_array_size(e->floatingWalls) * sizeof(traceFloatingWall)) + (numProjectiles * sizeof(traceProjectile)) + (cc_array_size(e->pickups) * sizeof(tracePickup)) + (e->frameEvents->numExplosions * sizeof(traceExplosion))
+    );
+}
+
+// writes a frame of the env's current state to dst, size must be the
+// frame's size returned by traceFrameSize
+void encodeTraceFrame(const env *e, const uint32_t episode, uint8_t *dst, const uint32_t size) {
+    const uint16_t numProjectiles = min(cc_array_size(e->projectiles), (size_t)UINT16_MAX);
+    const uint8_t numFloatingWalls = cc_array_size(e->floatingWalls);
+    const uint8_t numPickups = cc_array_size(e->pickups);
+    const traceFrameEvents *events = e->frameEvents;
+
+    traceFrame *frame = (traceFrame *)dst;
+    *frame = (traceFrame){
+        .size = size,
+        .episode = episode,
+        .frame = e->episodeLength,
+        .stepsLeft = e->stepsLeft,
+        .numProjectiles = numProjectiles,
+        .numDrones = e->numDrones,
+        .numFloatingWalls = numFloatingWalls,
+        .numPickups = numPickups,
+        .numExplosions = events->numExplosions,
+        .suddenDeathWallCounter = e->suddenDeathWallCounter,
+        .mapIdx = e->mapIdx,
+        .episodeEnded = e->needsReset,
+    };
+    dst += sizeof(traceFrame);
+
+    traceDrone *drones = (traceDrone *)dst;
+    for (uint8_t i = 0; i < e->numDrones; i++) {
+        const droneEntity *drone = safe_array_get_at(e->drones, i);
+        drones[i] = (traceDrone){
+            .pos = drone->pos,
+            .velocity = drone->velocity,
+            .aim = drone->lastAim,
+            .energyLeft = drone->energyLeft,
+            .shieldHealth = drone->shield != NULL ? drone->shield->health : 0.0f,
+            .weapon = drone->weaponInfo->type,
+            .ammo = drone->ammo,
+            .livesLeft = drone->livesLeft,
+            .flags = traceDroneFlags(drone),
+        };
+    }
+    dst += e->numDrones * sizeof(traceDrone);
+
+    traceFloatingWall *walls = (traceFloatingWall *)dst;
+    for (uint8_t i = 0; i < numFloatingWalls; i++) {
+        const wallEntity *wall = safe_array_get_at(e->floatingWalls, i);
+        walls[i] = (traceFloatingWall){
+            .pos = wall->pos,
+            .rot = wall->rot,
+            .type = wall->type,
+        };
+    }
+    dst += numFloatingWalls * sizeof(traceFloatingWall);
+
+    traceProjectile *projectiles = (traceProjectile *)dst;
+    for (uint16_t i = 0; i < numProjectiles; i++) {
+        const projectileEntity *projectile = safe_array_get_at(e->projectiles, i);
+        projectiles[i] = (traceProjectile){
+            .pos = projectile->pos,
+            .weapon = projectile->weaponInfo->type,
+            .droneIdx = projectile->droneIdx,
+        };
+    }
+    dst += numProjectiles * sizeof(traceProjectile);
+
+    tracePickup *pickups = (tracePickup *)dst;
+    for (uint8_t i = 0; i < numPickups; i++) {
+        const weaponPickupEntity *pickup = safe_array_get_at(e->pickups, i);
+        pickups[i] = (tracePickup){
+            .pos = pickup->pos,
+            .weapon = pickup->weapon,
+            .enabled = !pickup->bodyDestroyed,
+        };
+    }
+    dst += numPickups * sizeof(tracePickup);
+
+    memcpy(dst, events->explosions, events->numExplosions * sizeof(traceExplosion));
+    dst += events->numExplosions * sizeof(traceExplosion);
+
+    // zero the alignment padding so frames of the same state are the
+    // same bytes no matter what the buffer held before
+    memset(dst, 0x0, ((uint8_t *)frame + size) - dst);
+}
+
+// writes the state of the env after a frame was stepped
+void writeTraceFrame(traceWriter *w, const env *e) {
+    const uint64_t size = traceFrameSize(e);
+    if (size > w->header->capacity / 2 || size > UINT32_MAX) {
+        w->header->framesDropped++;
+        return;
+    }
+
+    encodeTraceFrame(e, w->episode, reserveTraceFrame(w, size), size);
+    w->header->framesWritten++;
+    if (e->needsReset) {
+        w->episode++;
+    }
+}
+
+// opens a trace file for reading, frames are read from oldest to newest
+// with nextTraceFrame; must be paired with a call to closeTraceReader
+traceReader *openTraceReader(const char *path) {
+    const int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        ERRORF("failed to open trace file %s: %s", path, strerror(errno));
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        ERRORF("failed to stat trace file %s: %s", path, strerror(errno));
+    }
+    if ((size_t)st.st_size < sizeof(traceFileHeader)) {
+        ERRORF("trace file %s is too small to be a trace", path);
+    }
+    const uint8_t *mapped = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (mapped == MAP_FAILED) {
+        ERRORF("failed to map trace file %s: %s", path, strerror(errno));
+    }
+
+    const traceFileHeader *h = (const traceFileHeader *)mapped;
+    if (h->magic != TRACE_MAGIC) {
+        ERRORF("%s is not a trace file", path);
+    }
+    if (h->version != TRACE_VERSION) {
+        ERRORF("trace file %s is version %u, expected version %d", path, h->version, TRACE_VERSION);
+    }
+    if (sizeof(traceFileHeader) + h->capacity != (size_t)st.st_size || h->head >= h->capacity || h->used > h->capacity) {
+        ERRORF("trace file %s is corrupted", path);
+    }
+
+    traceReader *r = fastCalloc(1, sizeof(traceReader));
+    r->fd = fd;
+    r->mapped = mapped;
+    r->mappedSize = st.st_size;
+    r->header = h;
+    r->ring = mapped + sizeof(traceFileHeader);
+    r->offset = h->head;
+    r->remaining = h->used;
+
+    return r;
+}
+
+void closeTraceReader(traceReader *r) {
+    munmap((void *)r->mapped, r->mappedSize);
+    close(r->fd);
+    fastFree(r);
+}
+
+// starts reading frames from the oldest frame again
+void rewindTraceReader(traceReader *r) {
+    r->offset = r->header->head;
+    r->remaining = r->header->used;
+}
+
+// returns the next frame or NULL if every frame has been read
+const traceFrame *nextTraceFrame(traceReader *r) {
+    while (r->remaining != 0) {
+        uint32_t size;
+        memcpy(&size, r->ring + r->offset, sizeof(size));
+        if (size == 0) {
+            r->remaining -= r->header->capacity - r->offset;
+            r->offset = 0;
+            continue;
+        }
+        if (size < sizeof(traceFrame) || size > r->remaining || r->offset + size > r->header->capacity) {
+            ERRORF("trace frame at offset %" PRIu64 " has invalid size %u", r->offset, size);
+        }
+
+        const traceFrame *frame = (const traceFrame *)(r->ring + r->offset);
+        r->remaining -= size;
+        r->offset += size;
+        if (r->offset == r->header->capacity) {
+            r->offset = 0;
+        }
+        return frame;
+    }
+
+    return NULL;
+}
+
+static inline const traceDrone *traceFrameDrones(const traceFrame *frame) {
+    return (const traceDrone *)((const uint8_t *)frame + sizeof(traceFrame));
+}
+
+static inline const traceFloatingWall *traceFrameFloatingWalls(const traceFrame *frame) {
+    return (const traceFloatingWall *)(traceFrameDrones(frame) + frame->numDrones);
+}
+
+static inline const traceProjectile *traceFrameProjectiles(const traceFrame *frame) {
+    return (const traceProjectile *)(traceFrameFloatingWalls(frame) + frame->numFloatingWalls);
+}
+
+static inline const tracePickup *traceFramePickups(const traceFrame *frame) {
+    return (const tracePickup *)(traceFrameProjectiles(frame) + frame->numProjectiles);
+}
+
+static inline const traceExplosion *traceFrameExplosions(const traceFrame *frame) {
+    return (const traceExplosion *)(traceFramePickups(frame) + frame->numPickups);
+}
+#endif
+
+#endif
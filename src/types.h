@@ -23,9 +23,70 @@ typedef struct dummyStruct b2IdPool, Camera3D, Camera2D, Shader, Texture2D, Rend
 
 #include "include/cc_array.h"
 
+// continuous observations can be stored as half precision floats or
+// fixed point with 15 fractional bits instead of floats to halve their
+// size; defined before settings.h is included as its obs layout
+// functions depend on it along with obsProfile
+enum obsFormat {
+    FLOAT32_OBS,
+    FLOAT16_OBS,
+    INT16_OBS,
+};
+
+// what an env observes and the resulting obs layout; the offsets of
+// discrete obs are in bytes from the start of the obs, the offsets of
+// continuous obs are in values from the start of the continuous obs
+typedef struct obsProfile {
+    uint8_t numDrones;
+    uint8_t numEnemyDroneObs;
+    uint8_t mapObsRows;
+    uint8_t mapObsColumns;
+    uint16_t mapObsSize;
+    uint8_t numNearWallObs;
+    uint8_t numFloatingWallObs;
+    uint8_t numProjectileObs;
+    uint8_t numWeaponPickupObs;
+    uint8_t numLidarRays;
+
+    uint16_t nearWallTypesObsOffset;
+    uint16_t floatingWallTypesObsOffset;
+    uint16_t projectileDroneObsOffset;
+    uint16_t projectileWeaponsObsOffset;
+    uint16_t weaponPickupWeaponsObsOffset;
+    uint16_t enemyDroneWeaponsObsOffset;
+    uint16_t discreteObsSize;
+    uint16_t discreteObsBytes;
+
+    uint16_t nearWallPosObsOffset;
+    uint16_t floatingWallInfoObsOffset;
+    uint16_t weaponPickupPosObsOffset;
+    uint16_t projectileInfoObsOffset;
+    uint16_t lidarObsOffset;
+    uint16_t enemyDroneObsOffset;
+    uint16_t droneObsOffset;
+    uint16_t miscObsOffset;
+    uint16_t continuousObsSize;
+} obsProfile;
+
+// how often physics is stepped and agents act, training uses a cheaper
+// profile than eval by default
+typedef struct timingProfile {
+    uint8_t frameRate;
+    uint8_t box2dSubSteps;
+    // frames stepped with the same actions
+    uint8_t frameSkip;
+} timingProfile;
+
 #include "settings.h"
 
-#define _MAX_DRONES 4
+// can be overridden at build time, but drones are tracked in droneMask
+// bitsets so it can't be larger than 32
+#ifndef _MAX_DRONES
+#define _MAX_DRONES 16
+#endif
+
+// bitset of drone indexes
+typedef uint32_t droneMask;
 
 const uint8_t NUM_WALL_TYPES = 3;
 
@@ -33,6 +94,9 @@ const uint8_t NUM_WALL_TYPES = 3;
 #define MAX_DRONE_TRAIL_POINTS 20
 #define MAX_PROJECTLE_TRAIL_POINTS 10
 
+// max number of entities a black hole can pull at once
+#define MAX_ENTS_IN_BLACK_HOLE 32
+
 enum entityType {
     STANDARD_WALL_ENTITY,
     BOUNCY_WALL_ENTITY,
@@ -56,15 +120,24 @@ enum shapeCategory {
     DRONE_PIECE_SHAPE = 64,
 };
 
-typedef struct entityID {
-    int32_t id;
-    uint16_t generation;
-} entityID;
+// entity handle; the low ENTITY_INDEX_BITS bits hold the entity's index
+// in env.entities plus one, the remaining high bits hold the generation
+// of the entity slot so handles to destroyed entities can be detected.
+// A handle of 0 is never valid
+typedef uint32_t entityID;
+
+#define ENTITY_INDEX_BITS 20
+#define ENTITY_INDEX_MASK ((1u << ENTITY_INDEX_BITS) - 1)
+#define ENTITY_GENERATION_MASK ((1u << (32 - ENTITY_INDEX_BITS)) - 1)
 
 // general purpose entity object
 typedef struct entity {
-    entityID *id;
-    uint32_t generation;
+    // handle of the entity, 0 if the entity has been destroyed
+    entityID id;
+    uint16_t generation;
+    // env the entity belongs to, used to route box2d events when
+    // multiple envs share a world
+    struct env *env;
     enum entityType type;
     void *entity;
 } entity;
@@ -108,13 +181,17 @@ typedef struct mapEntry {
     const bool hasSetFloatingWalls;
     const uint16_t weaponPickups;
     const enum weaponType defaultWeapon;
+} mapEntry;
 
+// data derived from a map layout that is expensive to compute, built
+// once per process by initMaps and shared read-only by every env
+typedef struct mapDataEntry {
     mapBounds bounds;
     mapBounds spawnQuads[4];
     bool *droneSpawns;
     uint8_t *packedLayout;
     nearEntity *nearestWalls;
-} mapEntry;
+} mapDataEntry;
 
 // a cell in the map; ent will be NULL if the cell is empty
 typedef struct mapCell {
@@ -133,6 +210,11 @@ typedef struct wallEntity {
     bool isFloating;
     enum entityType type;
     bool isSuddenDeath;
+    // static walls are merged into boxes that span multiple cells, for
+    // box walls these are the number of cells covered starting at
+    // mapCellIdx, for regular walls they are 0
+    uint8_t boxColumns;
+    uint8_t boxRows;
 
     entity *ent;
 } wallEntity;
@@ -191,6 +273,9 @@ typedef struct trailPoints {
 
 typedef struct projectileEntity {
     uint8_t droneIdx;
+    // index of the projectile in e->projectiles, kept up to date so the
+    // projectile can be removed in constant time
+    uint32_t idx;
 
     b2BodyId bodyID;
     b2ShapeId shapeID;
@@ -208,9 +293,12 @@ typedef struct projectileEntity {
     uint8_t bounces;
     uint8_t contacts;
     bool setMine;
+    // wall a set mine is welded to
+    entityID mineWallID;
     uint8_t numDronesBehindWalls;
     uint8_t dronesBehindWalls[_MAX_DRONES];
-    CC_Array *entsInBlackHole;
+    uint8_t numEntsInBlackHole;
+    entityID entsInBlackHole[MAX_ENTS_IN_BLACK_HOLE];
     bool needsToBeDestroyed;
 
     entity *ent;
@@ -224,6 +312,9 @@ typedef struct droneStepInfo {
     bool firedShot;
     bool pickedUpWeapon;
     enum weaponType prevWeapon;
+    // drones that were hit by or hit this drone this step, so only
+    // drones that were interacted with need to be checked below
+    droneMask hitDrones;
     uint8_t shotHit[_MAX_DRONES];
     bool explosionHit[_MAX_DRONES];
     uint8_t shotTaken[_MAX_DRONES];
@@ -326,10 +417,20 @@ typedef struct logEntry {
     droneStats stats[_MAX_DRONES];
 } logEntry;
 
+// running statistics of every field of the episodes an env logged since
+// it was last aggregated, fields are indexed as if a logEntry was an
+// array of floats
 typedef struct logBuffer {
-    logEntry *logs;
-    uint16_t size;
-    uint16_t capacity;
+    uint32_t count;
+    // fields past the stats of the env's drones are always 0 so aren't
+    // tracked
+    uint16_t numFields;
+    double *mean;
+    // sum of squared differences from the mean, and the min and max of
+    // each field; only allocated if the spread of fields is tracked
+    double *m2;
+    float *min;
+    float *max;
 } logBuffer;
 
 typedef struct gameCamera {
@@ -390,10 +491,43 @@ typedef struct agentActions {
 } agentActions;
 
 typedef struct pathingInfo {
+    // directions to move towards a destination cell on small maps, or
+    // towards a destination cluster of cells on large maps
     uint8_t *paths;
-    int8_t *pathBuffer;
+    // directions to move towards a nearby destination cell, only used
+    // on large maps
+    uint8_t *localPaths;
+    int16_t *pathBuffer;
 } pathingInfo;
 
+// box2d task state of a world using the shared job system
+typedef struct worldJobs worldJobs;
+
+// a trained policy exported from Python
+typedef struct frozenPolicy frozenPolicy;
+
+// initial states of envs' next episodes generated ahead of time
+typedef struct resetPool resetPool;
+
+// writes the game state of every frame to a trace file
+typedef struct traceWriter traceWriter;
+
+// events of the current frame that are encoded with it
+typedef struct traceFrameEvents traceFrameEvents;
+
+// renders an env on another thread from the frames it publishes
+typedef struct renderThread renderThread;
+
+// a box2d world shared by multiple envs, each env's arena is placed at
+// a different offset in the world far enough away from the others that
+// they can't interact
+typedef struct arenaWorld {
+    b2WorldId worldID;
+    worldJobs *worldJobs;
+    uint8_t numArenas;
+    struct env **arenas;
+} arenaWorld;
+
 typedef struct env {
     uint8_t numDrones;
     uint8_t numAgents;
@@ -402,10 +536,30 @@ typedef struct env {
     bool sittingDuck;
     bool isTraining;
 
+    obsProfile obsProfile;
+    enum obsFormat obsFormat;
     uint16_t obsBytes;
     uint16_t discreteObsBytes;
+    // if not 0 the last obsHistoryLen obs of each agent are kept in obs,
+    // obsHistorySlot is the slot the newest obs were written to
+    uint8_t obsHistoryLen;
+    uint8_t obsHistorySlot;
+    // bytes between the obs of consecutive agents
+    uint32_t obsStride;
+    // observation function specialized for numDrones, selected in initEnv
+    void (*computeObs)(struct env *e);
 
     uint8_t *obs;
+    // if set observations are decoded into this buffer after they're
+    // computed, and obs is a scratch buffer owned by the env
+    float *decodedObs;
+    uint16_t decodedObsSize;
+    // if set obs are images rasterized by computeImageObs
+    bool imageObs;
+    // if set the env is reset in the step its episode ends and the obs
+    // of that step are copied here first, laid out like the obs the
+    // learner reads
+    void *terminalObs;
     float *rewards;
     bool discretizeActions;
     float *contActions;
@@ -426,9 +580,15 @@ typedef struct env {
     droneStats stats[_MAX_DRONES];
 
     b2WorldId worldID;
+    worldJobs *worldJobs;
+    // set if this env's arena is in a world shared with other envs
+    arenaWorld *arenaWorld;
+    // position of this env's arena in the world
+    b2Vec2 arenaOffset;
     int8_t pinnedMapIdx;
     int8_t mapIdx;
-    mapEntry *map;
+    const mapEntry *map;
+    const mapDataEntry *mapData;
     int8_t lastSpawnQuad;
     uint8_t spawnedWeaponPickups[_NUM_WEAPONS];
     weaponInformation *defaultWeapon;
@@ -436,6 +596,9 @@ typedef struct env {
     CC_Array *entities;
     CC_Array *cells;
     CC_Array *walls;
+    // static body all static wall shapes are attached to
+    b2BodyId wallsBodyID;
+    CC_Array *wallBoxes;
     CC_Array *floatingWalls;
     CC_Array *drones;
     CC_Array *pickups;
@@ -455,10 +618,33 @@ typedef struct env {
     uint8_t suddenDeathWallCounter;
     bool suddenDeathWallsPlaced;
 
+    // drives non-agent drones instead of the scripted agent if set
+    frozenPolicy *opponentPolicy;
+    // LSTM state of each drone, only allocated if opponentPolicy is set
+    float *opponentStates;
+    agentActions opponentActions[_MAX_DRONES];
+    // set if opponent actions were inferred in a batch with other envs
+    bool opponentActionsReady;
+
+    // if set resets restore a state generated ahead of time by the pool
+    resetPool *resetPool;
+    uint16_t resetPoolIdx;
+
+    // if set the state of every frame is written to the trace
+    traceWriter *trace;
+    // if set the state of every frame is published to the render thread
+    renderThread *renderThread;
+    // allocated if frames are traced or rendered on another thread
+    traceFrameEvents *frameEvents;
+
     bool humanInput;
     uint8_t humanDroneInput;
     uint8_t connectedControllers;
 
+    // specialized step function used when not rendering, selected in
+    // initEnv based off of the action type and if teams are enabled
+    void (*stepHeadless)(struct env *e);
+
     rayClient *client;
     float renderScale;
     CC_Array *brakeTrailPoints;